@@ -0,0 +1,82 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "utils.h"
+#include "serialization.h"
+#include "socket.h"
+
+struct Arguments {
+    BenchReport report;
+    std::vector<size_t> snapshot_sizes;
+};
+
+void print_help(void);
+
+Arguments parse_arguments(int argc, char const *argv[]);
+
+std::vector<size_t> parse_sizes(char const *content);
+
+int main(int argc, char const *argv[])
+{
+    Arguments arguments = parse_arguments(argc, argv);
+
+    bool success = BenchSuite()
+        .append(serialization_bench_suite(arguments.snapshot_sizes))
+        .append(socket_bench_suite())
+        .run(arguments.report);
+
+    if (success) {
+        return 0;
+    }
+    return 1;
+}
+
+void print_help(void)
+{
+    std::cerr
+        << "Usage: ./app_bench [--json] [--snapshot-sizes <n>[,<n>...]]"
+        << std::endl;
+}
+
+Arguments parse_arguments(int argc, char const *argv[])
+{
+    Arguments arguments;
+    arguments.report = BENCH_REPORT_TEXT;
+    arguments.snapshot_sizes = std::vector<size_t> { 10, 100, 1000 };
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--json") == 0) {
+            arguments.report = BENCH_REPORT_JSON;
+        } else if (
+            std::strcmp(argv[i], "--snapshot-sizes") == 0
+            && i + 1 < argc
+        ) {
+            i++;
+            arguments.snapshot_sizes = parse_sizes(argv[i]);
+        } else {
+            print_help();
+            exit(1);
+        }
+    }
+
+    return arguments;
+}
+
+std::vector<size_t> parse_sizes(char const *content)
+{
+    std::vector<size_t> sizes;
+    char const *cursor = content;
+    for (;;) {
+        char *end;
+        unsigned long long size = std::strtoull(cursor, &end, 10);
+        if (end == cursor || (*end != ',' && *end != '\0')) {
+            std::cerr << "invalid snapshot size list: " << content << std::endl;
+            exit(1);
+        }
+        sizes.push_back(size);
+        if (*end == '\0') {
+            return sizes;
+        }
+        cursor = end + 1;
+    }
+}
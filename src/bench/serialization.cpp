@@ -0,0 +1,768 @@
+#include <memory>
+#include <sstream>
+#include "serialization.h"
+#include "../shared/message.h"
+#include "../server/data.h"
+
+class SampleBody {
+    public:
+        std::string name;
+        std::shared_ptr<MessageBody> body;
+};
+
+class SampleText {
+    public:
+        std::string name;
+        std::string text;
+};
+
+class SampleCodec {
+    public:
+        std::string name;
+        WireFormat wire_format;
+};
+
+static std::vector<SampleBody> sample_bodies();
+
+static std::vector<SampleText> sample_notif_texts();
+
+/**
+ * Fills the table with the given number of profiles, each followed by up to
+ * three others, with no session left open.
+ */
+static void sample_profile_table(ServerProfileTable& table, size_t size);
+
+static std::vector<SampleCodec> sample_codecs();
+
+static Message sample_message(std::shared_ptr<MessageBody> const& body);
+
+static std::vector<Message> sample_trace(std::vector<SampleBody> const& bodies);
+
+static void encode(
+    WireFormat wire_format,
+    Message const& message,
+    std::string& buf
+);
+
+static void decode(
+    WireFormat wire_format,
+    std::string const& buf,
+    Message& message
+);
+
+/**
+ * Same as encode, but through the virtual Serializer interface.
+ */
+static void encode_virtual(
+    WireFormat wire_format,
+    Message const& message,
+    std::string& buf
+);
+
+/**
+ * Same as decode, but through the virtual Deserializer interface.
+ */
+static void decode_virtual(
+    WireFormat wire_format,
+    std::string const& buf,
+    Message& message
+);
+
+/**
+ * Runs the routine with the buffer serializer of the given format, writing to
+ * the cleared buffer.
+ */
+template <typename F>
+static void with_serializer(
+    WireFormat wire_format,
+    std::string& buf,
+    F&& routine
+);
+
+/**
+ * Runs the routine with the span deserializer of the given format, reading
+ * from the buffer.
+ */
+template <typename F>
+static void with_deserializer(
+    WireFormat wire_format,
+    std::string const& buf,
+    F&& routine
+);
+
+/**
+ * Counts the characters that need escaping using the given scanner.
+ */
+template <typename F>
+static size_t count_escapes(std::string const& text, F&& find_escape);
+
+/**
+ * Byte-at-a-time scanner, to compare against plaintext_find_escape.
+ */
+static char const *scalar_find_escape(char const *begin, char const *end);
+
+template <typename F>
+static void bench_encode_trace(
+    Bencher& bencher,
+    WireFormat wire_format,
+    std::vector<Message> const& trace,
+    F&& encoder
+);
+
+template <typename F>
+static void bench_decode_trace(
+    Bencher& bencher,
+    WireFormat wire_format,
+    std::vector<Message> const& trace,
+    F&& decoder
+);
+
+BenchSuite serialization_bench_suite(
+    std::vector<size_t> const& snapshot_sizes
+)
+{
+    BenchSuite suite;
+
+    std::vector<SampleBody> bodies = sample_bodies();
+    std::vector<Message> trace = sample_trace(bodies);
+    MessageHeader header = sample_message(bodies[0].body).header;
+
+    suite.bench(
+        "encode MessageHeader plaintext stream",
+        [header] (Bencher& bencher) {
+            std::ostringstream stream;
+            bencher.iter([&] {
+                stream.str(std::string());
+                PlaintextSerializer serializer(stream);
+                serializer << header;
+                bench_black_box(stream);
+            });
+            bencher.set_bytes_per_op(stream.str().size());
+        }
+    );
+
+    suite.bench(
+        "decode MessageHeader plaintext stream",
+        [header] (Bencher& bencher) {
+            std::ostringstream ostream;
+            PlaintextSerializer serializer(ostream);
+            serializer << header;
+            std::string buf = ostream.str();
+            bencher.iter([&] {
+                std::istringstream istream(buf);
+                PlaintextDeserializer deserializer(istream);
+                MessageHeader decoded;
+                deserializer >> decoded;
+                bench_black_box(decoded);
+            });
+            bencher.set_bytes_per_op(buf.size());
+        }
+    );
+
+    for (SampleCodec const& codec : sample_codecs()) {
+        for (SampleBody const& sample : bodies) {
+            Message message = sample_message(sample.body);
+
+            suite.bench(
+                "encode " + sample.name + " " + codec.name,
+                [message, wire_format = codec.wire_format] (Bencher& bencher) {
+                    std::string buf;
+                    bencher.iter([&] {
+                        encode(wire_format, message, buf);
+                        bench_black_box(buf);
+                    });
+                    bencher.set_bytes_per_op(buf.size());
+                }
+            );
+
+            suite.bench(
+                "decode " + sample.name + " " + codec.name,
+                [message, wire_format = codec.wire_format] (Bencher& bencher) {
+                    std::string buf;
+                    encode(wire_format, message, buf);
+                    bencher.iter([&] {
+                        Message decoded;
+                        decode(wire_format, buf, decoded);
+                        bench_black_box(decoded);
+                    });
+                    bencher.set_bytes_per_op(buf.size());
+                }
+            );
+
+            suite.bench(
+                "decode header of " + sample.name + " " + codec.name,
+                [message, wire_format = codec.wire_format] (Bencher& bencher) {
+                    std::string buf;
+                    encode(wire_format, message, buf);
+                    bencher.iter([&] {
+                        Message decoded;
+                        with_deserializer(
+                            wire_format,
+                            buf,
+                            [&] (auto& deserializer) {
+                                MessageTag tag =
+                                    decoded.decode_header(deserializer);
+                                bench_black_box(tag);
+                            }
+                        );
+                        bench_black_box(decoded);
+                    });
+                    bencher.set_bytes_per_op(buf.size());
+                }
+            );
+        }
+
+        suite.bench(
+            "encode MessageHeader " + codec.name,
+            [header, wire_format = codec.wire_format] (Bencher& bencher) {
+                std::string buf;
+                bencher.iter([&] {
+                    with_serializer(wire_format, buf, [&] (auto& serializer) {
+                        serializer << header;
+                    });
+                    bench_black_box(buf);
+                });
+                bencher.set_bytes_per_op(buf.size());
+            }
+        );
+
+        suite.bench(
+            "decode MessageHeader " + codec.name,
+            [header, wire_format = codec.wire_format] (Bencher& bencher) {
+                std::string buf;
+                with_serializer(wire_format, buf, [&] (auto& serializer) {
+                    serializer << header;
+                });
+                bencher.iter([&] {
+                    MessageHeader decoded;
+                    with_deserializer(
+                        wire_format,
+                        buf,
+                        [&] (auto& deserializer) {
+                            deserializer >> decoded;
+                        }
+                    );
+                    bench_black_box(decoded);
+                });
+                bencher.set_bytes_per_op(buf.size());
+            }
+        );
+
+        suite.bench(
+            "encode mixed trace " + codec.name,
+            [trace, wire_format = codec.wire_format] (Bencher& bencher) {
+                bench_encode_trace(bencher, wire_format, trace, encode);
+            }
+        );
+
+        suite.bench(
+            "encode mixed trace " + codec.name + " virtual",
+            [trace, wire_format = codec.wire_format] (Bencher& bencher) {
+                bench_encode_trace(bencher, wire_format, trace, encode_virtual);
+            }
+        );
+
+        suite.bench(
+            "decode mixed trace " + codec.name,
+            [trace, wire_format = codec.wire_format] (Bencher& bencher) {
+                bench_decode_trace(bencher, wire_format, trace, decode);
+            }
+        );
+
+        suite.bench(
+            "decode mixed trace " + codec.name + " virtual",
+            [trace, wire_format = codec.wire_format] (Bencher& bencher) {
+                bench_decode_trace(bencher, wire_format, trace, decode_virtual);
+            }
+        );
+    }
+
+    for (size_t size : snapshot_sizes) {
+        for (SampleCodec const& codec : sample_codecs()) {
+            std::string name =
+                "ServerProfileTable " + std::to_string(size) + " " + codec.name;
+
+            suite.bench(
+                "encode " + name,
+                [size, wire_format = codec.wire_format] (Bencher& bencher) {
+                    ServerProfileTable table("/dev/null");
+                    sample_profile_table(table, size);
+                    std::string buf;
+                    bencher.iter([&] {
+                        with_serializer(
+                            wire_format,
+                            buf,
+                            [&] (auto& serializer) {
+                                serializer << table;
+                            }
+                        );
+                        bench_black_box(buf);
+                    });
+                    bencher.set_bytes_per_op(buf.size());
+                }
+            );
+
+            suite.bench(
+                "decode " + name,
+                [size, wire_format = codec.wire_format] (Bencher& bencher) {
+                    ServerProfileTable table("/dev/null");
+                    sample_profile_table(table, size);
+                    std::string buf;
+                    with_serializer(wire_format, buf, [&] (auto& serializer) {
+                        serializer << table;
+                    });
+                    ServerProfileTable decoded("/dev/null");
+                    bencher.iter([&] {
+                        with_deserializer(
+                            wire_format,
+                            buf,
+                            [&] (auto& deserializer) {
+                                deserializer >> decoded;
+                            }
+                        );
+                        bench_black_box(decoded);
+                    });
+                    bencher.set_bytes_per_op(buf.size());
+                }
+            );
+        }
+    }
+
+    for (SampleText const& sample : sample_notif_texts()) {
+        std::string const& text = sample.text;
+
+        suite.bench(
+            "scan notification " + sample.name,
+            [text] (Bencher& bencher) {
+                bencher.iter([&] {
+                    size_t count = count_escapes(text, plaintext_find_escape);
+                    bench_black_box(count);
+                });
+                bencher.set_bytes_per_op(text.size());
+            }
+        );
+
+        suite.bench(
+            "scan notification " + sample.name + " scalar",
+            [text] (Bencher& bencher) {
+                bencher.iter([&] {
+                    size_t count = count_escapes(text, scalar_find_escape);
+                    bench_black_box(count);
+                });
+                bencher.set_bytes_per_op(text.size());
+            }
+        );
+
+        suite.bench(
+            "encode notification " + sample.name + " plaintext",
+            [text] (Bencher& bencher) {
+                std::string buf;
+                bencher.iter([&] {
+                    buf.clear();
+                    PlaintextBufferSerializer serializer(buf);
+                    serializer << text;
+                    bench_black_box(buf);
+                });
+                bencher.set_bytes_per_op(buf.size());
+            }
+        );
+
+        suite.bench(
+            "decode notification " + sample.name + " plaintext",
+            [text] (Bencher& bencher) {
+                std::string buf;
+                PlaintextBufferSerializer serializer(buf);
+                serializer << text;
+                std::string decoded;
+                bencher.iter([&] {
+                    PlaintextSpanDeserializer deserializer(
+                        buf.data(),
+                        buf.size()
+                    );
+                    deserializer >> decoded;
+                    bench_black_box(decoded);
+                });
+                bencher.set_bytes_per_op(buf.size());
+            }
+        );
+    }
+
+    return suite;
+}
+
+static std::vector<SampleBody> sample_bodies()
+{
+    std::set<Address> addresses {
+        Address(make_ipv4({ 192, 168, 0, 10 }), 8080),
+        Address(make_ipv4({ 192, 168, 0, 11 }), 8080),
+        Address(make_ipv4({ 192, 168, 0, 12 }), 8080)
+    };
+    std::optional<Address> primary(
+        Address(make_ipv4({ 192, 168, 0, 10 }), 8080)
+    );
+
+    std::shared_ptr<MessageServerConnResp> server_conn_resp(
+        new MessageServerConnResp
+    );
+    server_conn_resp->members = addresses;
+    server_conn_resp->coordinator = primary;
+
+    NotifMessage notif_message(
+        "Just landed in Porto Alegre; the weather is great and the "
+        "coffee is even better. See you all at the meetup tonight!"
+    );
+
+    return std::vector<SampleBody> {
+        { "MessageNopAck", std::shared_ptr<MessageBody>(new MessageNopAck) },
+        {
+            "MessageErrorResp",
+            std::shared_ptr<MessageBody>(
+                new MessageErrorResp(MSG_NO_CONNECTION)
+            )
+        },
+        {
+            "MessageClientConnReq",
+            std::shared_ptr<MessageBody>(
+                new MessageClientConnReq(Username("@bruno"))
+            )
+        },
+        {
+            "MessageClientConnResp",
+            std::shared_ptr<MessageBody>(new MessageClientConnResp)
+        },
+        {
+            "MessageServerConnReq",
+            std::shared_ptr<MessageBody>(new MessageServerConnReq)
+        },
+        { "MessageServerConnResp", server_conn_resp },
+        {
+            "MessageDisconnectReq",
+            std::shared_ptr<MessageBody>(new MessageDisconnectReq)
+        },
+        {
+            "MessageDisconnectResp",
+            std::shared_ptr<MessageBody>(new MessageDisconnectResp)
+        },
+        { "MessagePingReq", std::shared_ptr<MessageBody>(new MessagePingReq) },
+        {
+            "MessagePingResp",
+            std::shared_ptr<MessageBody>(new MessagePingResp)
+        },
+        {
+            "MessageFollowReq",
+            std::shared_ptr<MessageBody>(
+                new MessageFollowReq(Username("@someone_else"))
+            )
+        },
+        {
+            "MessageFollowResp",
+            std::shared_ptr<MessageBody>(new MessageFollowResp)
+        },
+        {
+            "MessageNotifyReq",
+            std::shared_ptr<MessageBody>(new MessageNotifyReq(notif_message))
+        },
+        {
+            "MessageNotifyResp",
+            std::shared_ptr<MessageBody>(new MessageNotifyResp)
+        },
+        {
+            "MessageDeliverReq",
+            std::shared_ptr<MessageBody>(new MessageDeliverReq(
+                Username("@bruno"),
+                notif_message,
+                1667000000
+            ))
+        },
+        {
+            "MessageDeliverResp",
+            std::shared_ptr<MessageBody>(new MessageDeliverResp)
+        },
+        {
+            "MessageRmLookupReq",
+            std::shared_ptr<MessageBody>(new MessageRmLookupReq)
+        },
+        {
+            "MessageRmLookupResp",
+            std::shared_ptr<MessageBody>(
+                new MessageRmLookupResp(addresses, primary)
+            )
+        }
+    };
+}
+
+/**
+ * Notification texts close to NotifMessage::MAX_LEN, with no, few and many
+ * characters that need escaping.
+ */
+static std::vector<SampleText> sample_notif_texts()
+{
+    return std::vector<SampleText> {
+        {
+            "clean",
+            "Just landed in Porto Alegre, the weather is great and the "
+            "coffee is even better. See you all at the meetup, bring "
+            "friends!"
+        },
+        {
+            "escaped",
+            "Just landed in Porto Alegre; the weather is great and the "
+            "coffee is even better; see you all at the meetup. Bring "
+            "friends!"
+        },
+        {
+            "dense",
+            "a;b;c\\d;e;f;g\\h;i;j;k\\l;m;n;o\\p;q;r;s\\t;u;v;w\\x;y;z;"
+            "a;b;c\\d;e;f;g\\h;i;j;k\\l;m;n;o\\p;q;r;s\\t;u;v;w\\x;y;z;"
+            "a;b;c\\d;e;f;g\\h;i;j;k\\l;m;n"
+        }
+    };
+}
+
+static void sample_profile_table(ServerProfileTable& table, size_t size)
+{
+    std::vector<Username> usernames;
+    std::vector<Address> clients;
+    for (size_t i = 0; i < size; i++) {
+        usernames.push_back(Username("@user_" + std::to_string(i)));
+        clients.push_back(Address(
+            make_ipv4({
+                10,
+                (uint8_t) (i >> 16),
+                (uint8_t) (i >> 8),
+                (uint8_t) i
+            }),
+            8080
+        ));
+        table.connect(clients[i], usernames[i], 1667000000 + i);
+    }
+    for (size_t i = 0; i < size; i++) {
+        for (size_t offset = 1; offset <= 3 && offset < size; offset++) {
+            table.follow(
+                clients[i],
+                usernames[(i + offset) % size],
+                1667000000
+            );
+        }
+    }
+    for (size_t i = 0; i < size; i++) {
+        table.disconnect(clients[i], 1667000000);
+    }
+}
+
+static std::vector<SampleCodec> sample_codecs()
+{
+    return std::vector<SampleCodec> {
+        { "plaintext", WIRE_PLAINTEXT },
+        { "binary", WIRE_BINARY },
+        { "compact", WIRE_COMPACT }
+    };
+}
+
+static Message sample_message(std::shared_ptr<MessageBody> const& body)
+{
+    Message message;
+    message.header.fill_req();
+    message.header.election_counter = 3;
+    message.body = body;
+    return message;
+}
+
+/**
+ * Interleaves the sample bodies, weighted by how often each one shows up in
+ * the traffic of a busy server: mostly pings, acks and deliveries.
+ */
+static std::vector<Message> sample_trace(std::vector<SampleBody> const& bodies)
+{
+    std::map<std::string, size_t> weights {
+        { "MessageNopAck", 16 },
+        { "MessagePingReq", 8 },
+        { "MessagePingResp", 8 },
+        { "MessageDeliverReq", 4 },
+        { "MessageDeliverResp", 4 },
+        { "MessageNotifyReq", 2 },
+        { "MessageNotifyResp", 2 }
+    };
+    size_t max_weight = 16;
+
+    std::vector<Message> trace;
+    for (size_t round = 0; round < max_weight; round++) {
+        for (SampleBody const& sample : bodies) {
+            auto weight = weights.find(sample.name);
+            size_t count = weight == weights.end() ? 1 : weight->second;
+            if (round < count) {
+                trace.push_back(sample_message(sample.body));
+            }
+        }
+    }
+    return trace;
+}
+
+template <typename F>
+static void bench_encode_trace(
+    Bencher& bencher,
+    WireFormat wire_format,
+    std::vector<Message> const& trace,
+    F&& encoder
+)
+{
+    std::string buf;
+    uint64_t total_bytes = 0;
+    for (Message const& message : trace) {
+        encoder(wire_format, message, buf);
+        total_bytes += buf.size();
+    }
+    size_t i = 0;
+    bencher.iter([&] {
+        encoder(wire_format, trace[i], buf);
+        bench_black_box(buf);
+        i = (i + 1) % trace.size();
+    });
+    bencher.set_bytes_per_op(total_bytes / trace.size());
+}
+
+template <typename F>
+static void bench_decode_trace(
+    Bencher& bencher,
+    WireFormat wire_format,
+    std::vector<Message> const& trace,
+    F&& decoder
+)
+{
+    std::vector<std::string> bufs(trace.size());
+    uint64_t total_bytes = 0;
+    for (size_t i = 0; i < trace.size(); i++) {
+        encode(wire_format, trace[i], bufs[i]);
+        total_bytes += bufs[i].size();
+    }
+    size_t i = 0;
+    bencher.iter([&] {
+        Message decoded;
+        decoder(wire_format, bufs[i], decoded);
+        bench_black_box(decoded);
+        i = (i + 1) % bufs.size();
+    });
+    bencher.set_bytes_per_op(total_bytes / bufs.size());
+}
+
+template <typename F>
+static void with_serializer(
+    WireFormat wire_format,
+    std::string& buf,
+    F&& routine
+)
+{
+    buf.clear();
+    switch (wire_format) {
+        case WIRE_PLAINTEXT: {
+            PlaintextBufferSerializer serializer(buf);
+            routine(serializer);
+            break;
+        }
+        case WIRE_BINARY: {
+            BinaryBufferSerializer serializer(buf);
+            routine(serializer);
+            break;
+        }
+        case WIRE_COMPACT: {
+            CompactBufferSerializer serializer(buf);
+            routine(serializer);
+            break;
+        }
+    }
+}
+
+template <typename F>
+static void with_deserializer(
+    WireFormat wire_format,
+    std::string const& buf,
+    F&& routine
+)
+{
+    switch (wire_format) {
+        case WIRE_PLAINTEXT: {
+            PlaintextSpanDeserializer deserializer(buf.data(), buf.size());
+            routine(deserializer);
+            break;
+        }
+        case WIRE_BINARY: {
+            BinarySpanDeserializer deserializer(buf.data(), buf.size());
+            routine(deserializer);
+            break;
+        }
+        case WIRE_COMPACT: {
+            CompactSpanDeserializer deserializer(buf.data(), buf.size());
+            routine(deserializer);
+            break;
+        }
+    }
+}
+
+static void encode(
+    WireFormat wire_format,
+    Message const& message,
+    std::string& buf
+)
+{
+    with_serializer(wire_format, buf, [&] (auto& serializer) {
+        serializer << message;
+    });
+}
+
+static void encode_virtual(
+    WireFormat wire_format,
+    Message const& message,
+    std::string& buf
+)
+{
+    with_serializer(wire_format, buf, [&] (Serializer& serializer) {
+        serializer << message;
+    });
+}
+
+static void decode(
+    WireFormat wire_format,
+    std::string const& buf,
+    Message& message
+)
+{
+    with_deserializer(wire_format, buf, [&] (auto& deserializer) {
+        deserializer >> message;
+    });
+}
+
+static void decode_virtual(
+    WireFormat wire_format,
+    std::string const& buf,
+    Message& message
+)
+{
+    with_deserializer(wire_format, buf, [&] (Deserializer& deserializer) {
+        deserializer >> message;
+    });
+}
+
+template <typename F>
+static size_t count_escapes(std::string const& text, F&& find_escape)
+{
+    char const *cursor = text.data();
+    char const *end = cursor + text.size();
+    size_t count = 0;
+    for (;;) {
+        cursor = find_escape(cursor, end);
+        if (cursor == end) {
+            return count;
+        }
+        count++;
+        cursor++;
+    }
+}
+
+static char const *scalar_find_escape(char const *begin, char const *end)
+{
+    char const *cursor = begin;
+    while (cursor != end && *cursor != ';' && *cursor != '\\') {
+        cursor++;
+    }
+    return cursor;
+}
@@ -0,0 +1,16 @@
+#ifndef BENCH_SERIALIZATION_H_
+#define BENCH_SERIALIZATION_H_ 1
+
+#include <vector>
+#include "utils.h"
+
+/**
+ * Encodes and decodes every message body, a mixed trace of messages and
+ * ServerProfileTable snapshots with each given number of profiles, through
+ * each codec.
+ */
+BenchSuite serialization_bench_suite(
+    std::vector<size_t> const& snapshot_sizes
+);
+
+#endif
@@ -0,0 +1,723 @@
+#include "socket.h"
+#include "../shared/socket.h"
+#include "../shared/loopback.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+/**
+ * Port of the loopback socket the benches send to. Nothing reads from it, so
+ * the kernel drops datagrams once its receive queue is full.
+ */
+constexpr uint16_t BENCH_SINK_PORT = 8091;
+
+/**
+ * Number of receivers a notification is encoded for in the fan-out benches.
+ */
+constexpr size_t BENCH_FAN_OUT = 1000;
+
+/**
+ * Number of datagrams sent and then received in each iteration of the receive
+ * benches, small enough to fit in the default socket receive buffer.
+ */
+constexpr size_t BENCH_RECV_BURST = 32;
+
+/**
+ * Port the receiver of the ping benches binds to. Each iteration sends a
+ * single ping and receives it back, so the time per operation is the inverse
+ * of the pings per second a socket can take.
+ */
+constexpr uint16_t BENCH_PING_PORT = 8093;
+
+/**
+ * Port the server of the request round-trip benches binds to.
+ */
+constexpr uint16_t BENCH_ROUND_TRIP_PORT = 8094;
+
+/**
+ * Seed of the impairments of the loopback transport benches, fixed so that
+ * every run loses, duplicates and reorders the same datagrams.
+ */
+constexpr uint64_t BENCH_LOOPBACK_SEED = 1;
+
+/**
+ * Port the sharded receivers bind to with SO_REUSEPORT.
+ */
+constexpr uint16_t BENCH_SHARD_PORT = 8092;
+
+/**
+ * Number of client sockets sending to the sharded receivers. The kernel
+ * spreads datagrams across shards by source address, so one client would
+ * always hit the same shard.
+ */
+constexpr size_t BENCH_SHARD_CLIENTS = 8;
+
+/**
+ * How long a sharded ingress iteration waits for datagrams the kernel may have
+ * dropped before giving up on them.
+ */
+constexpr std::chrono::milliseconds BENCH_SHARD_DEADLINE(1000);
+
+class SampleCodec {
+    public:
+        std::string name;
+        WireFormat wire_format;
+};
+
+class SampleBackend {
+    public:
+        std::string name;
+        SocketBackend backend;
+};
+
+static std::vector<SampleCodec> sample_codecs();
+
+static std::vector<SampleBackend> sample_backends();
+
+template <typename F>
+static void bench_loopback_ping(Bencher& bencher, F&& receive);
+
+static void bench_receive_req(Bencher& bencher);
+
+static void bench_request_round_trip(
+    Bencher& bencher,
+    ReliableSocket::Config const& config
+);
+
+static void bench_loopback_round_trip(
+    Bencher& bencher,
+    LoopbackConditions const& conditions
+);
+
+static Enveloped sample_retransmit();
+
+/**
+ * Encodes the message once per receiver, each with its own header, as the
+ * reliable socket does when a notification is sent to every follower.
+ */
+static void fan_out(
+    Socket const& socket,
+    Message& message,
+    std::string& datagram
+);
+
+/**
+ * Sends a burst of copies of the datagram to the receiver, then receives all
+ * of them with the given routine, which returns how many it took. Both
+ * sockets use the given backend.
+ */
+template <typename F>
+static void bench_receive_burst(
+    Bencher& bencher,
+    Enveloped const& enveloped,
+    SocketBackend backend,
+    F&& receive
+);
+
+/**
+ * Sends a burst of copies of the datagram to the receiver in a single batch,
+ * then receives all of them in batches. With offload, the burst goes out as
+ * UDP GSO segments and is received coalesced with UDP GRO.
+ */
+static void bench_offload_burst(
+    Bencher& bencher,
+    Enveloped const& enveloped,
+    bool offload
+);
+
+/**
+ * Spreads bursts from several clients across the given number of receivers
+ * bound to the same port, each drained by its own thread, as the server does
+ * when sharded. A burst whose datagrams are not all received within
+ * BENCH_SHARD_DEADLINE is given up on, and the datagrams missing by the end
+ * are reported as lost.
+ */
+static void bench_sharded_ingress(
+    Bencher& bencher,
+    Enveloped const& enveloped,
+    size_t shard_count
+);
+
+BenchSuite socket_bench_suite()
+{
+    BenchSuite suite;
+
+    Enveloped enveloped = sample_retransmit();
+
+    for (SampleCodec const& codec : sample_codecs()) {
+        suite.bench(
+            "retransmit MessageDeliverReq " + codec.name + " re-encoded",
+            [enveloped, wire_format = codec.wire_format] (Bencher& bencher) {
+                Socket sink(enveloped.remote, 1024, wire_format);
+                Socket socket(1024, wire_format);
+                bencher.iter([&] {
+                    socket.send(enveloped);
+                });
+                bencher.set_bytes_per_op(
+                    socket.serialized_size(enveloped.message)
+                );
+            }
+        );
+
+        suite.bench(
+            "retransmit MessageDeliverReq " + codec.name + " cached",
+            [enveloped, wire_format = codec.wire_format] (Bencher& bencher) {
+                Socket sink(enveloped.remote, 1024, wire_format);
+                Socket socket(1024, wire_format);
+                std::string datagram;
+                socket.encode(enveloped.message, datagram);
+                bencher.iter([&] {
+                    socket.send_encoded(enveloped.remote, datagram);
+                });
+                bencher.set_bytes_per_op(datagram.size());
+            }
+        );
+
+        suite.bench(
+            "fan out MessageDeliverReq " + codec.name + " re-encoded",
+            [enveloped, wire_format = codec.wire_format] (Bencher& bencher) {
+                Socket socket(1024, wire_format);
+                Message message = enveloped.message;
+                std::string datagram;
+                bencher.iter([&] {
+                    fan_out(socket, message, datagram);
+                });
+                bencher.set_bytes_per_op(datagram.size() * BENCH_FAN_OUT);
+            }
+        );
+
+        suite.bench(
+            "fan out MessageDeliverReq " + codec.name + " pre-encoded",
+            [enveloped, wire_format = codec.wire_format] (Bencher& bencher) {
+                Socket socket(1024, wire_format);
+                Message message = enveloped.message;
+                message.body = MessageRawBody::from_body(
+                    wire_format,
+                    *enveloped.message.body
+                );
+                std::string datagram;
+                bencher.iter([&] {
+                    fan_out(socket, message, datagram);
+                });
+                bencher.set_bytes_per_op(datagram.size() * BENCH_FAN_OUT);
+            }
+        );
+    }
+
+    suite.bench(
+        "send fan out of " + std::to_string(BENCH_FAN_OUT)
+            + " MessageDeliverReq one at a time",
+        [enveloped] (Bencher& bencher) {
+            Socket sink(enveloped.remote, 1024, WIRE_COMPACT);
+            Socket socket(1024, WIRE_COMPACT);
+            std::string datagram;
+            socket.encode(enveloped.message, datagram);
+            bencher.iter([&] {
+                for (size_t i = 0; i < BENCH_FAN_OUT; i++) {
+                    socket.send_encoded(enveloped.remote, datagram);
+                }
+            });
+            bencher.set_bytes_per_op(datagram.size() * BENCH_FAN_OUT);
+        }
+    );
+
+    suite.bench(
+        "send fan out of " + std::to_string(BENCH_FAN_OUT)
+            + " MessageDeliverReq batched",
+        [enveloped] (Bencher& bencher) {
+            Socket sink(enveloped.remote, 1024, WIRE_COMPACT);
+            Socket socket(1024, WIRE_COMPACT);
+            std::string datagram;
+            socket.encode(enveloped.message, datagram);
+            std::vector<OutgoingDatagram> batch(
+                BENCH_FAN_OUT,
+                OutgoingDatagram(enveloped.remote, datagram)
+            );
+            bencher.iter([&] {
+                socket.send_batch(batch);
+            });
+            bencher.set_bytes_per_op(datagram.size() * BENCH_FAN_OUT);
+        }
+    );
+
+    suite.bench(
+        "send fan out of " + std::to_string(BENCH_FAN_OUT)
+            + " MessageDeliverReq batched without GSO",
+        [enveloped] (Bencher& bencher) {
+            Socket sink(enveloped.remote, 1024, WIRE_COMPACT);
+            Socket socket(1024, WIRE_COMPACT);
+            socket.set_gso(false);
+            std::string datagram;
+            socket.encode(enveloped.message, datagram);
+            std::vector<OutgoingDatagram> batch(
+                BENCH_FAN_OUT,
+                OutgoingDatagram(enveloped.remote, datagram)
+            );
+            bencher.iter([&] {
+                socket.send_batch(batch);
+            });
+            bencher.set_bytes_per_op(datagram.size() * BENCH_FAN_OUT);
+        }
+    );
+
+    suite.bench(
+        "receive burst of " + std::to_string(BENCH_RECV_BURST)
+            + " MessageDeliverReq one at a time",
+        [enveloped] (Bencher& bencher) {
+            bench_receive_burst(
+                bencher,
+                enveloped,
+                SOCKET_POLL,
+                [] (Socket& socket) {
+                    std::optional<Enveloped> received =
+                        socket.receive_lazy(-1);
+                    bench_black_box(received);
+                    return 1;
+                }
+            );
+        }
+    );
+
+    suite.bench(
+        "receive burst of " + std::to_string(BENCH_RECV_BURST)
+            + " MessageDeliverReq batched",
+        [enveloped] (Bencher& bencher) {
+            bench_receive_burst(
+                bencher,
+                enveloped,
+                SOCKET_POLL,
+                [] (Socket& socket) {
+                    std::vector<Enveloped> received =
+                        socket.receive_batch(BENCH_RECV_BURST, -1);
+                    bench_black_box(received);
+                    return received.size();
+                }
+            );
+        }
+    );
+
+    suite.bench(
+        "loopback MessagePingReq decoded",
+        [] (Bencher& bencher) {
+            bench_loopback_ping(bencher, [] (Socket& socket) {
+                Enveloped received = socket.receive();
+                bench_black_box(received);
+            });
+        }
+    );
+
+    suite.bench(
+        "loopback MessagePingReq lazily decoded",
+        [] (Bencher& bencher) {
+            bench_loopback_ping(bencher, [] (Socket& socket) {
+                Enveloped received = socket.receive_lazy();
+                bench_black_box(received);
+            });
+        }
+    );
+
+    for (SampleBackend const& backend : sample_backends()) {
+        suite.bench(
+            "loopback burst of " + std::to_string(BENCH_RECV_BURST)
+                + " MessageDeliverReq through " + backend.name,
+            [enveloped, backend] (Bencher& bencher) {
+                bench_receive_burst(
+                    bencher,
+                    enveloped,
+                    backend.backend,
+                    [] (Socket& socket) {
+                        std::vector<Enveloped> received =
+                            socket.receive_batch(BENCH_RECV_BURST, -1);
+                        bench_black_box(received);
+                        return received.size();
+                    }
+                );
+            }
+        );
+    }
+
+    for (bool offload : { false, true }) {
+        suite.bench(
+            "loopback batch of " + std::to_string(BENCH_RECV_BURST)
+                + " MessageDeliverReq "
+                + (offload ? "with" : "without") + " GSO and GRO",
+            [enveloped, offload] (Bencher& bencher) {
+                bench_offload_burst(bencher, enveloped, offload);
+            }
+        );
+    }
+
+    suite.bench(
+        "reliable receive_req of MessageFollowReq",
+        [] (Bencher& bencher) {
+            bench_receive_req(bencher);
+        }
+    );
+
+    suite.bench(
+        "request round trip of MessagePingReq parking right away",
+        [] (Bencher& bencher) {
+            bench_request_round_trip(bencher, ReliableSocket::Config());
+        }
+    );
+
+    for (uint64_t busy_poll_usecs : { 50, 1000 }) {
+        suite.bench(
+            "request round trip of MessagePingReq busy polling for "
+                + std::to_string(busy_poll_usecs) + "us",
+            [busy_poll_usecs] (Bencher& bencher) {
+                bench_request_round_trip(
+                    bencher,
+                    ReliableSocket::Config()
+                        .with_busy_poll_nanos(busy_poll_usecs * 1000)
+                        .with_socket_busy_poll_usecs(busy_poll_usecs)
+                );
+            }
+        );
+    }
+
+    for (uint64_t loss_percent : { 0, 1, 10 }) {
+        suite.bench(
+            "request round trip of MessagePingReq over loopback transport with "
+                + std::to_string(loss_percent) + "% loss",
+            [loss_percent] (Bencher& bencher) {
+                bench_loopback_round_trip(
+                    bencher,
+                    LoopbackConditions()
+                        .with_loss(loss_percent / 100.0)
+                        .with_seed(BENCH_LOOPBACK_SEED)
+                );
+            }
+        );
+    }
+
+    suite.bench(
+        "request round trip of MessagePingReq over loopback transport with "
+            "10% duplication and 10% reordering",
+        [] (Bencher& bencher) {
+            bench_loopback_round_trip(
+                bencher,
+                LoopbackConditions()
+                    .with_duplication(0.1)
+                    .with_reordering(0.1)
+                    .with_reorder_delay_nanos(100 * 1000)
+                    .with_seed(BENCH_LOOPBACK_SEED)
+            );
+        }
+    );
+
+    for (size_t shard_count : { 1, 2, 4, 8 }) {
+        suite.bench(
+            "sharded ingress of " + std::to_string(BENCH_RECV_BURST)
+                + " MessageDeliverReq over "
+                + std::to_string(shard_count) + " shards",
+            [enveloped, shard_count] (Bencher& bencher) {
+                bench_sharded_ingress(bencher, enveloped, shard_count);
+            }
+        );
+    }
+
+    return suite;
+}
+
+static std::vector<SampleCodec> sample_codecs()
+{
+    return std::vector<SampleCodec> {
+        { "plaintext", WIRE_PLAINTEXT },
+        { "binary", WIRE_BINARY },
+        { "compact", WIRE_COMPACT }
+    };
+}
+
+static std::vector<SampleBackend> sample_backends()
+{
+    return std::vector<SampleBackend> {
+        { "poll", SOCKET_POLL },
+        { "io_uring", SOCKET_IO_URING }
+    };
+}
+
+static void fan_out(
+    Socket const& socket,
+    Message& message,
+    std::string& datagram
+)
+{
+    for (size_t i = 0; i < BENCH_FAN_OUT; i++) {
+        message.header.fill_req();
+        socket.encode(message, datagram);
+        bench_black_box(datagram);
+    }
+}
+
+template <typename F>
+static void bench_loopback_ping(Bencher& bencher, F&& receive)
+{
+    Address address(make_ipv4({ 127, 0, 0, 1 }), BENCH_PING_PORT);
+    Socket receiver(address, 1024, WIRE_COMPACT);
+    Socket sender(1024, WIRE_COMPACT);
+    Message message;
+    message.header.fill_req();
+    message.body = make_pooled<MessagePingReq>();
+    std::string datagram;
+    sender.encode(message, datagram);
+    bencher.iter([&] {
+        sender.send_encoded(address, datagram);
+        receive(receiver);
+    });
+    bencher.set_bytes_per_op(datagram.size());
+}
+
+static void bench_receive_req(Bencher& bencher)
+{
+    Address address(make_ipv4({ 127, 0, 0, 1 }), BENCH_ROUND_TRIP_PORT);
+    ReliableSocket server(Socket(address, 1024, WIRE_COMPACT));
+    Socket sender(1024, WIRE_COMPACT);
+
+    Enveloped request;
+    request.remote = address;
+    request.message.header.fill_req();
+    request.message.body = make_pooled<MessageClientConnReq>(
+        Username("@bench")
+    );
+    sender.send(request);
+    std::move(server.receive_req()).send_resp(
+        make_pooled<MessageClientConnResp>()
+    );
+
+    request.message.body = make_pooled<MessageFollowReq>(Username("@bench"));
+    std::string datagram;
+    bencher.iter([&] {
+        request.message.header.fill_req();
+        sender.encode(request.message, datagram);
+        sender.send_encoded(address, datagram);
+        ReliableSocket::ReceivedReq received = server.receive_req();
+        bench_black_box(received.req_enveloped());
+        std::move(received).send_resp(make_pooled<MessageFollowResp>());
+    });
+    bencher.set_bytes_per_op(datagram.size());
+}
+
+static void bench_request_round_trip(
+    Bencher& bencher,
+    ReliableSocket::Config const& config
+)
+{
+    Address address(make_ipv4({ 127, 0, 0, 1 }), BENCH_ROUND_TRIP_PORT);
+    ReliableSocket server(Socket(address, 1024, WIRE_COMPACT), config);
+    ReliableSocket client(Socket(1024, WIRE_COMPACT), config);
+
+    Enveloped conn_req;
+    conn_req.remote = address;
+    conn_req.message.body = make_pooled<MessageClientConnReq>(
+        Username("@bench")
+    );
+    ReliableSocket::SentReq sent_conn_req = client.send_req(conn_req);
+    std::move(server.receive_req()).send_resp(
+        make_pooled<MessageClientConnResp>()
+    );
+    std::move(sent_conn_req).receive_resp();
+
+    Enveloped request;
+    request.remote = address;
+    request.message.body = make_pooled<MessagePingReq>();
+    bencher.iter([&] {
+        auto then = std::chrono::steady_clock::now();
+        Enveloped response = client.send_req(request).receive_resp();
+        auto now = std::chrono::steady_clock::now();
+        bench_black_box(response);
+        bencher.record_latency(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                now - then
+            ).count()
+        );
+    });
+}
+
+static void bench_loopback_round_trip(
+    Bencher& bencher,
+    LoopbackConditions const& conditions
+)
+{
+    std::shared_ptr<LoopbackNetwork> network(new LoopbackNetwork(conditions));
+    Address address(make_ipv4({ 127, 0, 0, 1 }), BENCH_ROUND_TRIP_PORT);
+    ReliableSocket server(std::unique_ptr<Transport>(
+        new LoopbackTransport(network, address, 1024, WIRE_COMPACT)
+    ));
+    ReliableSocket client(std::unique_ptr<Transport>(
+        new LoopbackTransport(network, 1024, WIRE_COMPACT)
+    ));
+
+    Enveloped conn_req;
+    conn_req.remote = address;
+    conn_req.message.body = make_pooled<MessageClientConnReq>(
+        Username("@bench")
+    );
+    ReliableSocket::SentReq sent_conn_req = client.send_req(conn_req);
+    std::move(server.receive_req()).send_resp(
+        make_pooled<MessageClientConnResp>()
+    );
+    std::move(sent_conn_req).receive_resp();
+
+    Enveloped request;
+    request.remote = address;
+    request.message.body = make_pooled<MessagePingReq>();
+    uint64_t sent_before = network->stats().sent;
+    uint64_t round_trips = 0;
+    bencher.iter([&] {
+        auto then = std::chrono::steady_clock::now();
+        Enveloped response = client.send_req(request).receive_resp();
+        auto now = std::chrono::steady_clock::now();
+        bench_black_box(response);
+        bencher.record_latency(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                now - then
+            ).count()
+        );
+        round_trips++;
+    });
+    bencher.set_metric(
+        "datagrams/op",
+        (double) (network->stats().sent - sent_before) / round_trips
+    );
+}
+
+template <typename F>
+static void bench_receive_burst(
+    Bencher& bencher,
+    Enveloped const& enveloped,
+    SocketBackend backend,
+    F&& receive
+)
+{
+    Socket receiver(enveloped.remote, 1024, WIRE_COMPACT, false, backend);
+    Socket sender(1024, WIRE_COMPACT, backend);
+    if (receiver.backend() != backend || sender.backend() != backend) {
+        throw std::runtime_error("socket backend is not supported");
+    }
+    std::string datagram;
+    sender.encode(enveloped.message, datagram);
+    bencher.iter([&] {
+        for (size_t i = 0; i < BENCH_RECV_BURST; i++) {
+            sender.send_encoded(enveloped.remote, datagram);
+        }
+        size_t received = 0;
+        while (received < BENCH_RECV_BURST) {
+            received += receive(receiver);
+        }
+    });
+    bencher.set_bytes_per_op(datagram.size() * BENCH_RECV_BURST);
+}
+
+static void bench_offload_burst(
+    Bencher& bencher,
+    Enveloped const& enveloped,
+    bool offload
+)
+{
+    Socket receiver(enveloped.remote, 1024, WIRE_COMPACT);
+    Socket sender(1024, WIRE_COMPACT);
+    if (
+        sender.set_gso(offload) != offload
+        || receiver.set_gro(offload) != offload
+    ) {
+        throw std::runtime_error("UDP GSO or GRO is not supported");
+    }
+    std::string datagram;
+    sender.encode(enveloped.message, datagram);
+    std::vector<OutgoingDatagram> batch(
+        BENCH_RECV_BURST,
+        OutgoingDatagram(enveloped.remote, datagram)
+    );
+    bencher.iter([&] {
+        sender.send_batch(batch);
+        size_t received = 0;
+        while (received < BENCH_RECV_BURST) {
+            std::vector<Enveloped> burst =
+                receiver.receive_batch(BENCH_RECV_BURST, -1);
+            bench_black_box(burst);
+            received += burst.size();
+        }
+    });
+    bencher.set_bytes_per_op(datagram.size() * BENCH_RECV_BURST);
+}
+
+static void bench_sharded_ingress(
+    Bencher& bencher,
+    Enveloped const& enveloped,
+    size_t shard_count
+)
+{
+    Address shard_address(make_ipv4({ 127, 0, 0, 1 }), BENCH_SHARD_PORT);
+    std::vector<Socket> shards;
+    for (size_t i = 0; i < shard_count; i++) {
+        shards.push_back(Socket(shard_address, 1024, WIRE_COMPACT, true));
+    }
+    std::vector<Socket> clients;
+    for (size_t i = 0; i < BENCH_SHARD_CLIENTS; i++) {
+        clients.push_back(Socket(1024, WIRE_COMPACT));
+    }
+
+    std::string datagram;
+    clients[0].encode(enveloped.message, datagram);
+
+    std::atomic<size_t> received(0);
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> receivers;
+    for (Socket& shard : shards) {
+        receivers.push_back(std::thread([&shard, &received, &stop] {
+            while (!stop.load()) {
+                received += shard.receive_batch(BENCH_RECV_BURST, 10).size();
+            }
+        }));
+    }
+
+    size_t sent = 0;
+    uint64_t bursts = 0;
+    bencher.iter([&] {
+        for (size_t i = 0; i < BENCH_RECV_BURST; i++) {
+            clients[i % BENCH_SHARD_CLIENTS].send_encoded(
+                shard_address,
+                datagram
+            );
+        }
+        sent += BENCH_RECV_BURST;
+        bursts++;
+        auto deadline = std::chrono::steady_clock::now()
+            + BENCH_SHARD_DEADLINE;
+        while (
+            received.load() < sent
+            && std::chrono::steady_clock::now() < deadline
+        ) {
+            std::this_thread::yield();
+        }
+    });
+    bencher.set_bytes_per_op(datagram.size() * BENCH_RECV_BURST);
+
+    stop.store(true);
+    for (std::thread& receiver : receivers) {
+        receiver.join();
+    }
+    bencher.set_metric(
+        "lost/op",
+        (double) (sent - std::min(sent, received.load())) / bursts
+    );
+}
+
+static Enveloped sample_retransmit()
+{
+    Enveloped enveloped;
+    enveloped.remote = Address(make_ipv4({ 127, 0, 0, 1 }), BENCH_SINK_PORT);
+    enveloped.message.header.fill_req();
+    enveloped.message.body = make_pooled<MessageDeliverReq>(
+        Username("@bruno"),
+        NotifMessage(
+            "Just landed in Porto Alegre; the weather is great and the "
+            "coffee is even better. See you all at the meetup tonight!"
+        ),
+        1667000000
+    );
+    return enveloped;
+}
@@ -0,0 +1,12 @@
+#ifndef BENCH_SOCKET_H_
+#define BENCH_SOCKET_H_ 1
+
+#include "utils.h"
+
+/**
+ * Sends datagrams through loopback UDP sockets, as the reliable socket does
+ * when it retransmits requests and repeats cached responses.
+ */
+BenchSuite socket_bench_suite();
+
+#endif
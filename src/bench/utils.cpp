@@ -0,0 +1,300 @@
+#include <iostream>
+#include <sstream>
+#include <atomic>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <new>
+#include "utils.h"
+
+/**
+ * Percentiles of the recorded latencies reported for benches that record
+ * them.
+ */
+static constexpr double BENCH_LATENCY_PERCENTILES[] = { 50, 99, 99.9 };
+
+static std::atomic<uint64_t> allocation_counter(0);
+
+void *operator new(size_t size)
+{
+    allocation_counter.fetch_add(1, std::memory_order_relaxed);
+    void *ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    ::operator delete(ptr);
+}
+
+uint64_t bench_allocations()
+{
+    return allocation_counter.load(std::memory_order_relaxed);
+}
+
+uint64_t bench_cpu_nanos()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return (uint64_t) time.tv_sec * 1000 * 1000 * 1000 + time.tv_nsec;
+}
+
+Bencher::Bencher() :
+    iterations_(0),
+    elapsed_nanos_(0),
+    cpu_nanos_(0),
+    allocations_(0),
+    bytes_per_op_(0),
+    records_latencies(false)
+{
+}
+
+uint64_t Bencher::iterations() const
+{
+    return this->iterations_;
+}
+
+uint64_t Bencher::elapsed_nanos() const
+{
+    return this->elapsed_nanos_;
+}
+
+uint64_t Bencher::bytes_per_op() const
+{
+    return this->bytes_per_op_;
+}
+
+double Bencher::nanos_per_op() const
+{
+    if (this->iterations_ == 0) {
+        return 0.0;
+    }
+    return (double) this->elapsed_nanos_ / (double) this->iterations_;
+}
+
+double Bencher::cpu_nanos_per_op() const
+{
+    if (this->iterations_ == 0) {
+        return 0.0;
+    }
+    return (double) this->cpu_nanos_ / (double) this->iterations_;
+}
+
+double Bencher::allocs_per_op() const
+{
+    if (this->iterations_ == 0) {
+        return 0.0;
+    }
+    return (double) this->allocations_ / (double) this->iterations_;
+}
+
+void Bencher::set_bytes_per_op(uint64_t bytes)
+{
+    this->bytes_per_op_ = bytes;
+}
+
+void Bencher::record_latency(uint64_t nanos)
+{
+    this->records_latencies = true;
+    this->latencies.push_back(nanos);
+}
+
+std::optional<uint64_t> Bencher::latency_percentile(double percent) const
+{
+    if (this->latencies.empty()) {
+        return std::optional<uint64_t>();
+    }
+    std::vector<uint64_t> sorted = this->latencies;
+    std::sort(sorted.begin(), sorted.end());
+    size_t rank = std::ceil(percent / 100.0 * sorted.size());
+    if (rank > 0) {
+        rank--;
+    }
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+void Bencher::set_metric(std::string const& name, double value)
+{
+    this->metrics_.push_back(std::make_pair(name, value));
+}
+
+std::vector<std::pair<std::string, double>> const& Bencher::metrics() const
+{
+    return this->metrics_;
+}
+
+std::string const& BenchCase::name() const
+{
+    return this->name_;
+}
+
+void BenchCase::run(Bencher& bencher)
+{
+    this->bench(bencher);
+}
+
+BenchSuite& BenchSuite::append(BenchSuite const& subsuite)
+{
+    this->bench_cases.insert(
+        this->bench_cases.end(),
+        subsuite.bench_cases.begin(),
+        subsuite.bench_cases.end()
+    );
+    return *this;
+}
+
+static std::string latency_name(double percent)
+{
+    std::ostringstream name;
+    name << percent;
+    return name.str();
+}
+
+static std::string json_string(std::string const& content)
+{
+    std::string output = "\"";
+    for (char ch : content) {
+        switch (ch) {
+            case '"':
+            case '\\':
+                output.push_back('\\');
+                output.push_back(ch);
+                break;
+            case '\n':
+                output += "\\n";
+                break;
+            default:
+                output.push_back(ch);
+                break;
+        }
+    }
+    output.push_back('"');
+    return output;
+}
+
+bool BenchSuite::run(BenchReport report)
+{
+    std::vector<std::string> failures;
+
+    if (report == BENCH_REPORT_TEXT) {
+        std::cerr << std::endl;
+    } else {
+        std::cout << "[";
+    }
+
+    bool first = true;
+    for (auto bench_case : this->bench_cases) {
+        if (report == BENCH_REPORT_TEXT) {
+            std::cerr << bench_case.name() << "..." << std::flush;
+        } else {
+            std::cout
+                << (first ? "" : ",")
+                << std::endl
+                << "  {\"name\": "
+                << json_string(bench_case.name());
+        }
+        first = false;
+        try {
+            Bencher bencher;
+            bench_case.run(bencher);
+            if (report == BENCH_REPORT_TEXT) {
+                std::cerr.precision(1);
+                std::cerr
+                    << std::fixed
+                    << " "
+                    << bencher.nanos_per_op()
+                    << " ns/op, "
+                    << bencher.cpu_nanos_per_op()
+                    << " cpu ns/op, "
+                    << bencher.allocs_per_op()
+                    << " allocs/op, "
+                    << bencher.bytes_per_op()
+                    << " bytes/op";
+                for (double percent : BENCH_LATENCY_PERCENTILES) {
+                    if (auto latency = bencher.latency_percentile(percent)) {
+                        std::cerr
+                            << ", p" << latency_name(percent)
+                            << " " << *latency << " ns";
+                    }
+                }
+                for (auto const& metric : bencher.metrics()) {
+                    std::cerr
+                        << ", " << std::get<1>(metric)
+                        << " " << std::get<0>(metric);
+                }
+                std::cerr << std::endl;
+            } else {
+                std::cout.precision(3);
+                std::cout
+                    << std::fixed
+                    << ", \"iterations\": "
+                    << bencher.iterations()
+                    << ", \"ns_per_op\": "
+                    << bencher.nanos_per_op()
+                    << ", \"cpu_ns_per_op\": "
+                    << bencher.cpu_nanos_per_op()
+                    << ", \"allocs_per_op\": "
+                    << bencher.allocs_per_op()
+                    << ", \"bytes_per_op\": "
+                    << bencher.bytes_per_op();
+                for (double percent : BENCH_LATENCY_PERCENTILES) {
+                    if (auto latency = bencher.latency_percentile(percent)) {
+                        std::cout
+                            << ", \"p" << latency_name(percent) << "_ns\": "
+                            << *latency;
+                    }
+                }
+                for (auto const& metric : bencher.metrics()) {
+                    std::cout
+                        << ", " << json_string(std::get<0>(metric))
+                        << ": " << std::get<1>(metric);
+                }
+                std::cout << "}";
+            }
+        } catch (std::exception const& failure) {
+            if (report == BENCH_REPORT_TEXT) {
+                std::cerr
+                    << " Failed"
+                    << std::endl
+                    << std::endl
+                    << failure.what()
+                    << std::endl
+                    << std::endl;
+            } else {
+                std::cout
+                    << ", \"error\": "
+                    << json_string(failure.what())
+                    << "}";
+            }
+            failures.push_back(bench_case.name());
+        }
+    }
+
+    if (report == BENCH_REPORT_JSON) {
+        std::cout << std::endl << "]" << std::endl;
+    } else {
+        std::cerr << std::endl;
+    }
+
+    if (failures.empty()) {
+        return true;
+    }
+
+    std::cerr << "failures:" << std::endl;
+
+    for (auto bench_name : failures) {
+        std::cerr << "- " << bench_name << std::endl;
+    }
+
+    std::cerr << std::endl;
+
+    return false;
+}
@@ -0,0 +1,182 @@
+#ifndef BENCH_UTILS_H_
+#define BENCH_UTILS_H_ 1
+
+#include <cstdint>
+#include <string>
+#include <optional>
+#include <utility>
+#include <vector>
+#include <chrono>
+#include <ctime>
+#include <functional>
+
+/**
+ * Number of allocations made through the global operator new so far, by any
+ * thread.
+ */
+uint64_t bench_allocations();
+
+/**
+ * CPU time consumed so far by the whole process, in user and kernel mode,
+ * including threads the kernel runs on its behalf, such as io_uring workers.
+ */
+uint64_t bench_cpu_nanos();
+
+class Bencher {
+    private:
+        uint64_t iterations_;
+        uint64_t elapsed_nanos_;
+        uint64_t cpu_nanos_;
+        uint64_t allocations_;
+        uint64_t bytes_per_op_;
+        /**
+         * Latencies recorded during the last run of the routine, one per
+         * operation, if the bench records them.
+         */
+        std::vector<uint64_t> latencies;
+        /**
+         * Whether the routine recorded any latency, e.g. during the warm-up
+         * run, so that later runs reserve room for one per operation.
+         */
+        bool records_latencies;
+        /**
+         * Further named results of the bench, reported as they are.
+         */
+        std::vector<std::pair<std::string, double>> metrics_;
+
+    public:
+        static constexpr uint64_t TARGET_NANOS = 100 * 1000 * 1000;
+
+        Bencher();
+
+        uint64_t iterations() const;
+        uint64_t elapsed_nanos() const;
+        uint64_t bytes_per_op() const;
+
+        double nanos_per_op() const;
+        double cpu_nanos_per_op() const;
+        double allocs_per_op() const;
+
+        void set_bytes_per_op(uint64_t bytes);
+
+        /**
+         * Records the latency of a single operation, to be called from the
+         * routine. Only the runs that count for the result are kept.
+         */
+        void record_latency(uint64_t nanos);
+
+        /**
+         * The latency below which the given percentage of the recorded
+         * latencies fall, if any was recorded.
+         */
+        std::optional<uint64_t> latency_percentile(double percent) const;
+
+        void set_metric(std::string const& name, double value);
+
+        std::vector<std::pair<std::string, double>> const& metrics() const;
+
+        template <typename F>
+        void iter(F&& routine);
+};
+
+class BenchCase {
+    private:
+        std::string name_;
+        std::function<void (Bencher&)> bench;
+
+    public:
+        template <typename F>
+        BenchCase(std::string const& name, F bench);
+
+        std::string const& name() const;
+
+        void run(Bencher& bencher);
+};
+
+enum BenchReport {
+    /**
+     * Human-readable progress and results on stderr.
+     */
+    BENCH_REPORT_TEXT,
+    /**
+     * A JSON array with one object per bench case on stdout, meant to be
+     * stored and compared across releases.
+     */
+    BENCH_REPORT_JSON
+};
+
+class BenchSuite {
+    private:
+        std::vector<BenchCase> bench_cases;
+
+    public:
+        template <typename F>
+        BenchSuite& bench(std::string const& name, F bench);
+
+        BenchSuite& append(BenchSuite const& subsuite);
+
+        bool run(BenchReport report = BENCH_REPORT_TEXT);
+};
+
+/**
+ * Prevents the compiler from optimizing away the computation of the given
+ * value.
+ */
+template <typename T>
+void bench_black_box(T const& value)
+{
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+template <typename F>
+void Bencher::iter(F&& routine)
+{
+    uint64_t iterations = 1;
+    routine();
+    for (;;) {
+        this->latencies.clear();
+        if (this->records_latencies) {
+            this->latencies.reserve(iterations);
+        }
+        uint64_t allocations_before = bench_allocations();
+        uint64_t cpu_before = bench_cpu_nanos();
+        auto then = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            routine();
+        }
+        auto now = std::chrono::steady_clock::now();
+        uint64_t cpu = bench_cpu_nanos() - cpu_before;
+        uint64_t allocations = bench_allocations() - allocations_before;
+        uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            now - then
+        ).count();
+        if (elapsed >= Bencher::TARGET_NANOS || iterations >= UINT64_MAX / 2) {
+            this->iterations_ = iterations;
+            this->elapsed_nanos_ = elapsed;
+            this->cpu_nanos_ = cpu;
+            this->allocations_ = allocations;
+            break;
+        }
+        if (elapsed < Bencher::TARGET_NANOS / 100) {
+            iterations *= 10;
+        } else {
+            iterations *= 2;
+        }
+    }
+}
+
+template <typename F>
+BenchCase::BenchCase(std::string const& name, F bench) :
+    name_(name),
+    bench(bench)
+{
+}
+
+template <typename F>
+BenchSuite& BenchSuite::bench(std::string const& name, F bench)
+{
+    this->bench_cases.push_back(BenchCase(name, bench));
+    return *this;
+}
+
+#endif
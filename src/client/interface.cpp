@@ -1,5 +1,4 @@
 #include <iostream>
-#include <poll.h>
 #include "interface.h"
 #include "../shared/string_ext.h"
 #include "../shared/log.h"
@@ -19,62 +18,53 @@ void start_client_interface(
         std::string follow_cmd = "FOLLOW ";
         std::string send_cmd = "SEND ";
         std::string line;
-        while (!std::cin.eof() && to_session_man.is_connected()) {
-            bool has_chars = false;
-            while (
-                !std::cin.eof()
-                && to_session_man.is_connected()
-                && !has_chars
-            ) {
-                struct pollfd fds[1];
-                fds[0].fd = fileno(stdin);
-                fds[0].events = POLLIN;
-                fds[0].revents = 0;
-                poll(fds, sizeof(fds) / sizeof(fds[0]), 10);
-                has_chars = (fds[0].revents & POLLIN) != 0;
-            }
-
-            if (has_chars) {
-                std::getline(std::cin, line);
-                if (!std::cin.bad() && !std::cin.fail() && !std::cin.eof()) {
-                    line = trim_spaces(line);
-                    if (string_starts_with_ignore_case(line, follow_cmd)) {
-                        try {
-                            Username username = trim_spaces(line.substr(
-                                follow_cmd.size(),
-                                line.size() - follow_cmd.size()
+        Reactor& reactor = shutdown_reactor();
+        reactor.watch(fileno(stdin));
+        while (
+            !std::cin.eof()
+            && to_session_man.is_connected()
+            && reactor.wait(-1) == REACTOR_READABLE
+        ) {
+            std::getline(std::cin, line);
+            if (!std::cin.bad() && !std::cin.fail() && !std::cin.eof()) {
+                line = trim_spaces(line);
+                if (string_starts_with_ignore_case(line, follow_cmd)) {
+                    try {
+                        Username username = trim_spaces(line.substr(
+                            follow_cmd.size(),
+                            line.size() - follow_cmd.size()
+                        ));
+                        to_session_man
+                            .send(std::shared_ptr<ClientInputCommand>(
+                                new ClientFollowCommand(username)
                             ));
-                            to_session_man
-                                .send(std::shared_ptr<ClientInputCommand>(
-                                    new ClientFollowCommand(username)
-                                ));
-                        } catch (InvalidUsername const& exc) {
-                            Logger::with([&exc] (auto& output) {
-                                output << exc.what() << std::endl;
-                            });
-                        }
-                    } else if (string_starts_with_ignore_case(line, send_cmd)) {
-                        try {
-                            NotifMessage message = trim_spaces(line.substr(
-                                send_cmd.size(),
-                                line.size() - send_cmd.size()
+                    } catch (InvalidUsername const& exc) {
+                        Logger::with([&exc] (auto& output) {
+                            output << exc.what() << std::endl;
+                        });
+                    }
+                } else if (string_starts_with_ignore_case(line, send_cmd)) {
+                    try {
+                        NotifMessage message = trim_spaces(line.substr(
+                            send_cmd.size(),
+                            line.size() - send_cmd.size()
+                        ));
+                        to_session_man
+                            .send(std::shared_ptr<ClientInputCommand>(
+                                new ClientSendCommand(message)
                             ));
-                            to_session_man
-                                .send(std::shared_ptr<ClientInputCommand>(
-                                    new ClientSendCommand(message)
-                                ));
-                        } catch (InvalidNotifMessage const& exc) {
-                            Logger::with([&exc] (auto& output) {
-                                output << exc.what() << std::endl;
-                            });
-                        }
-                    } else if (line != "") {
-                        std::unique_lock lock(stdout_mutex);
-                        std::cout << "Unrecognized command." << std::endl;
+                    } catch (InvalidNotifMessage const& exc) {
+                        Logger::with([&exc] (auto& output) {
+                            output << exc.what() << std::endl;
+                        });
                     }
+                } else if (line != "") {
+                    std::unique_lock lock(stdout_mutex);
+                    std::cout << "Unrecognized command." << std::endl;
                 }
             }
         }
+        reactor.unwatch(fileno(stdin));
         signal_graceful_shutdown();
     });
 
@@ -16,9 +16,7 @@ ClientSessionManDisconnectGuard::~ClientSessionManDisconnectGuard()
     ReliableSocket::DisconnectGuard guard_(this->socket);
     Enveloped disconnect_req;
     disconnect_req.remote = this->server_addr;
-    disconnect_req.message.body = std::shared_ptr<MessageBody>(
-        new MessageDisconnectReq
-    );
+    disconnect_req.message.body = make_pooled<MessageDisconnectReq>();
     ReliableSocket::SentReq sent_req = this->socket->send_req(disconnect_req);
     try {
         std::move(sent_req).receive_resp();
@@ -69,9 +67,8 @@ void start_client_session_manager(
         try {
             Enveloped connect_req;
             connect_req.remote = server_addr;
-            connect_req.message.body = std::shared_ptr<MessageBody>(
-                new MessageClientConnReq(username)
-            );
+            connect_req.message.body =
+                make_pooled<MessageClientConnReq>(username);
             ReliableSocket::SentReq sent_connect_req =
                 socket->send_req(connect_req);
             Enveloped connect_resp = std::move(sent_connect_req).receive_resp();
@@ -96,9 +93,10 @@ void start_client_session_manager(
                                 );
                             Enveloped cmd_req;
                             cmd_req.remote = server_addr;
-                            cmd_req.message.body = std::shared_ptr<MessageBody>(
-                                new MessageFollowReq(follow_cmd.username)
-                            );
+                            cmd_req.message.body =
+                                make_pooled<MessageFollowReq>(
+                                    follow_cmd.username
+                                );
                             ReliableSocket::SentReq sent_req =
                                 socket->send_req(cmd_req);
                             Enveloped resp = std::move(sent_req).receive_resp();
@@ -112,9 +110,8 @@ void start_client_session_manager(
                                 );
                             Enveloped cmd_req;
                             cmd_req.remote = server_addr;
-                            cmd_req.message.body = std::shared_ptr<MessageBody>(
-                                new MessageNotifyReq(send_cmd.message)
-                            );
+                            cmd_req.message.body =
+                                make_pooled<MessageNotifyReq>(send_cmd.message);
                             ReliableSocket::SentReq sent_req =
                                 socket->send_req(cmd_req);
                             Enveloped resp = std::move(sent_req).receive_resp();
@@ -179,9 +176,7 @@ void start_client_session_manager(
                         case MSG_NOTIFY:
                         {
                             std::shared_ptr<MessageBody> response =
-                                std::shared_ptr<MessageBody>(
-                                    new MessageErrorResp(MSG_BAD)
-                                );
+                                make_pooled<MessageErrorResp>(MSG_BAD);
                             std::move(received).send_resp(response);
                             break;
                         }
@@ -202,18 +197,14 @@ void start_client_session_manager(
                                 );
                             to_interface.send(notice);
                             std::shared_ptr<MessageBody> response =
-                                std::shared_ptr<MessageBody>(
-                                    new MessageDeliverResp
-                                );
+                                make_pooled<MessageDeliverResp>();
                             std::move(received).send_resp(response);
                             break;
                         }
 
                         case MSG_DISCONNECT: {
                             std::shared_ptr<MessageBody> response =
-                                std::shared_ptr<MessageBody>(
-                                    new MessageDisconnectResp
-                                );
+                                make_pooled<MessageDisconnectResp>();
                             std::move(received).send_resp(response);
                             connected = false;
                             Logger::with([] (auto& output) {
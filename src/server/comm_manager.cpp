@@ -1,82 +1,198 @@
 #include <iostream>
+#include <deque>
+#include <list>
+#include <set>
 #include "../shared/log.h"
 #include "comm_manager.h"
 #include "../shared/shutdown.h"
 
+/**
+ * Index of the socket holding the connection with the remote, or of the first
+ * socket if none does.
+ */
+static size_t find_shard(
+    std::vector<std::shared_ptr<ReliableSocket>> const& sockets,
+    Address const& remote
+);
+
+/**
+ * Takes the notifications of the next round, those deferred by the previous
+ * round first, then queued ones, up to COMM_MAX_NOTIF_BATCH in total. Only the
+ * oldest notification of each receiver is taken, and the others are deferred,
+ * so that a receiver has a single deliver request in flight and gets its
+ * notifications in order. Blocks while there is nothing to send.
+ */
+static std::vector<Enveloped> next_notif_round(
+    Channel<Enveloped>::Receiver& from_notif_man,
+    std::deque<Enveloped>& deferred
+);
+
 void start_server_communication_manager(
     ThreadTracker& thread_tracker,
-    std::shared_ptr<ReliableSocket> const& socket,
+    std::vector<std::shared_ptr<ReliableSocket>> const& sockets,
     Channel<ReliableSocket::ReceivedReq>::Sender&& to_profile_man,
     Channel<Enveloped>::Receiver&& from_notif_man
 )
 {
     thread_tracker.spawn([
-        socket,
+        sockets,
         from_notif_man = std::move(from_notif_man)
     ] () mutable {
-        ReliableSocket::DisconnectGuard guard_(socket);
-
-        try {
-            for (;;) {
-                Enveloped notif_enveloped = from_notif_man.receive();
-                try {
-                    ReliableSocket::SentReq sent_req =
-                        socket->send_req(notif_enveloped);
-                    Enveloped response = std::move(sent_req).receive_resp();
-
-                    response.message.body->cast<MessageDeliverResp>();
-                } catch (std::exception const& exc) {
-                    Logger::with([&exc, &notif_enveloped] (auto& output) {
-                        output
-                            << "error notifying connection "
-                            << notif_enveloped.remote.to_string()
-                            << " : "
-                            << exc.what()
-                            << std::endl;
-                    });
-                }
-            }
-        } catch (ChannelDisconnected const& exc) {
+        std::list<ReliableSocket::DisconnectGuard> guards_;
+        for (auto const& socket : sockets) {
+            guards_.emplace_back(socket);
         }
-        signal_graceful_shutdown();
-    });
 
-    thread_tracker.spawn([
-        socket,
-        to_profile_man = std::move(to_profile_man)
-    ] () mutable {
-        ReliableSocket::DisconnectGuard guard_(socket);
+        std::deque<Enveloped> deferred;
 
         try {
             for (;;) {
-                ReliableSocket::ReceivedReq req = socket->receive_req();
-                switch (req.req_enveloped().message.body->tag().type) {
-                    case MSG_ERROR:
-                        Logger::with([] (auto& output) {
+                std::vector<Enveloped> notif_batch =
+                    next_notif_round(from_notif_man, deferred);
+
+                std::vector<std::vector<Enveloped>> shard_batches(
+                    sockets.size()
+                );
+                for (Enveloped& notif_enveloped : notif_batch) {
+                    size_t shard = find_shard(sockets, notif_enveloped.remote);
+                    shard_batches[shard].push_back(std::move(notif_enveloped));
+                }
+
+                std::vector<ReliableSocket::SentReq> sent_reqs;
+                for (size_t shard = 0; shard < sockets.size(); shard++) {
+                    std::vector<Enveloped> const& shard_batch =
+                        shard_batches[shard];
+                    if (shard_batch.empty()) {
+                        continue;
+                    }
+                    try {
+                        for (
+                            ReliableSocket::SentReq& sent_req
+                            : sockets[shard]->send_req_batch(shard_batch)
+                        ) {
+                            sent_reqs.push_back(std::move(sent_req));
+                        }
+                    } catch (std::exception const& exc) {
+                        Logger::with([&exc, &shard_batch] (auto& output) {
                             output
-                                << "warning: received bad error request"
+                                << "error notifying "
+                                << shard_batch.size()
+                                << " connections: "
+                                << exc.what()
                                 << std::endl;
                         });
-                        break;
+                    }
+                }
 
-                    case MSG_DELIVER:
-                        Logger::with([] (auto& output) {
+                for (ReliableSocket::SentReq& sent_req : sent_reqs) {
+                    Address remote = sent_req.req_enveloped().remote;
+                    try {
+                        Enveloped response =
+                            std::move(sent_req).receive_resp();
+
+                        response.message.body->cast<MessageDeliverResp>();
+                    } catch (std::exception const& exc) {
+                        Logger::with([&exc, &remote] (auto& output) {
                             output
-                                << "warning: received bad deliver request"
+                                << "error notifying connection "
+                                << remote.to_string()
+                                << " : "
+                                << exc.what()
                                 << std::endl;
                         });
-                        break;
-
-                    case MSG_CLIENT_CONN:
-                    case MSG_DISCONNECT:
-                    case MSG_FOLLOW:
-                    case MSG_NOTIFY:
-                        to_profile_man.send(req);
-                        break;
+                    }
                 }
             }
         } catch (ChannelDisconnected const& exc) {
         }
         signal_graceful_shutdown();
     });
+
+    Channel<ReliableSocket::ReceivedReq>::Sender shared_to_profile_man =
+        std::move(to_profile_man);
+
+    for (auto const& socket : sockets) {
+        thread_tracker.spawn([
+            socket,
+            to_profile_man = shared_to_profile_man
+        ] () mutable {
+            ReliableSocket::DisconnectGuard guard_(socket);
+
+            try {
+                for (;;) {
+                    ReliableSocket::ReceivedReq req = socket->receive_req();
+                    switch (req.req_enveloped().message.body->tag().type) {
+                        case MSG_ERROR:
+                            Logger::with([] (auto& output) {
+                                output
+                                    << "warning: received bad error request"
+                                    << std::endl;
+                            });
+                            break;
+
+                        case MSG_DELIVER:
+                            Logger::with([] (auto& output) {
+                                output
+                                    << "warning: received bad deliver request"
+                                    << std::endl;
+                            });
+                            break;
+
+                        case MSG_CLIENT_CONN:
+                        case MSG_DISCONNECT:
+                        case MSG_FOLLOW:
+                        case MSG_NOTIFY:
+                            to_profile_man.send(req);
+                            break;
+                    }
+                }
+            } catch (ChannelDisconnected const& exc) {
+            }
+            signal_graceful_shutdown();
+        });
+    }
+}
+
+static size_t find_shard(
+    std::vector<std::shared_ptr<ReliableSocket>> const& sockets,
+    Address const& remote
+)
+{
+    for (size_t shard = 0; shard < sockets.size(); shard++) {
+        if (sockets[shard]->has_connection(remote)) {
+            return shard;
+        }
+    }
+    return 0;
+}
+
+static std::vector<Enveloped> next_notif_round(
+    Channel<Enveloped>::Receiver& from_notif_man,
+    std::deque<Enveloped>& deferred
+)
+{
+    std::deque<Enveloped> candidates = std::move(deferred);
+    deferred.clear();
+    if (candidates.empty()) {
+        candidates.push_back(from_notif_man.receive());
+    }
+    while (candidates.size() < COMM_MAX_NOTIF_BATCH) {
+        std::optional<Enveloped> notif_enveloped =
+            from_notif_man.try_receive();
+        if (!notif_enveloped) {
+            break;
+        }
+        candidates.push_back(std::move(*notif_enveloped));
+    }
+
+    std::vector<Enveloped> round;
+    std::set<Address> receivers;
+    for (Enveloped& notif_enveloped : candidates) {
+        if (receivers.insert(notif_enveloped.remote).second) {
+            round.push_back(std::move(notif_enveloped));
+        } else {
+            deferred.push_back(std::move(notif_enveloped));
+        }
+    }
+    return round;
 }
@@ -1,12 +1,25 @@
 #ifndef SERVER_COMM_MANAGER_H_
 #define SERVER_COMM_MANAGER_H_ 1
 
+#include <vector>
 #include "../shared/socket.h"
 #include "../shared/tracker.h"
 
+/**
+ * Maximum number of queued notifications the communication manager considers
+ * for a single batch. At most one of them per receiver goes in the batch.
+ */
+constexpr size_t COMM_MAX_NOTIF_BATCH = 1024;
+
+/**
+ * Receives requests from every socket, each in its own thread, and sends
+ * notifications through the socket holding the connection with their
+ * receivers. Sockets are shards bound to the same address, so connection
+ * state stays local to the shard the kernel routes a client to.
+ */
 void start_server_communication_manager(
     ThreadTracker& thread_tracker,
-    std::shared_ptr<ReliableSocket> const& socket,
+    std::vector<std::shared_ptr<ReliableSocket>> const& sockets,
     Channel<ReliableSocket::ReceivedReq>::Sender&& to_profile_man,
     Channel<Enveloped>::Receiver&& from_notif_man
 );
@@ -99,8 +99,7 @@ bool ServerCoordination::try_connect(ReliableSocket& socket, Address server_addr
 {
     Enveloped req_enveloped;
     req_enveloped.remote = server_addr;
-    req_enveloped.message.body =
-        std::shared_ptr<MessageBody>(new MessageServerConnReq);
+    req_enveloped.message.body = make_pooled<MessageServerConnReq>();
     ReliableSocket::SentReq request = socket.send_req(req_enveloped);
     Enveloped resp_enveloped = std::move(request).receive_resp();
     try {
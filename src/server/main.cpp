@@ -1,6 +1,8 @@
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <string>
+#include <vector>
 #include <iostream>
 #include "data.h"
 #include "comm_manager.h"
@@ -12,6 +14,9 @@
 
 struct Arguments {
     Address bind_address;
+    size_t shards;
+    SocketBackend backend;
+    uint64_t busy_poll_usecs;
 };
 
 void print_help(void);
@@ -34,11 +39,44 @@ int main(int argc, char const *argv[])
         output << "Binding to " << bind_address.to_string() << std::endl;
     });
 
-    Socket udp(arguments.bind_address, 1024);
-    std::shared_ptr<ReliableSocket> socket(new ReliableSocket(std::move(udp)));
+    std::vector<std::shared_ptr<ReliableSocket>> sockets;
+    WireFormat wire_format = WIRE_PLAINTEXT;
+    SocketBackend backend = arguments.backend;
+    bool gso = false;
+    bool gro = false;
+    for (size_t i = 0; i < arguments.shards; i++) {
+        Socket udp(
+            arguments.bind_address,
+            1024,
+            wire_format,
+            arguments.shards > 1,
+            arguments.backend
+        );
+        backend = udp.backend();
+        gso = udp.gso_enabled();
+        gro = udp.set_gro(true);
+        ReliableSocket::Config config = ReliableSocket::Config()
+            .with_busy_poll_nanos(arguments.busy_poll_usecs * 1000)
+            .with_socket_busy_poll_usecs(arguments.busy_poll_usecs);
+        sockets.push_back(std::shared_ptr<ReliableSocket>(
+            new ReliableSocket(std::move(udp), config)
+        ));
+    }
 
-    Logger::with([&socket] (auto& output) {
-        socket->config().report(output);
+    Logger::with([&sockets, backend, gso, gro] (auto& output) {
+        output << "Using " << sockets.size() << " socket shards" << std::endl;
+        output
+            << "Using "
+            << (backend == SOCKET_IO_URING ? "io_uring" : "poll")
+            << " socket backend"
+            << std::endl;
+        output
+            << "UDP GSO is "
+            << (gso ? "on" : "off")
+            << ", UDP GRO is "
+            << (gro ? "on" : "off")
+            << std::endl;
+        sockets[0]->config().report(output);
     });
 
     std::shared_ptr<ServerProfileTable> profile_table(new ServerProfileTable);
@@ -62,7 +100,7 @@ int main(int argc, char const *argv[])
 
     start_server_communication_manager(
         thread_tracker,
-        socket,
+        sockets,
         std::move(comm_to_prof_man.sender),
         std::move(notif_to_comm_man.receiver)
     );
@@ -85,6 +123,7 @@ int main(int argc, char const *argv[])
     start_server_notification_manager(
         thread_tracker,
         profile_table,
+        wire_format,
         std::move(notif_to_comm_man.sender),
         std::move(prof_to_notif_man.receiver)
     );
@@ -103,24 +142,67 @@ int main(int argc, char const *argv[])
     comm_receiver.disconnect();
     notif_receiver.disconnect();
 
-    socket->disconnect_timeout(50 * 1000 * 1000, 10);
+    for (auto const& socket : sockets) {
+        socket->disconnect_timeout(50 * 1000 * 1000, 10);
+    }
 
     thread_tracker.join_all();
 
+    Logger::with([&sockets] (auto& output) {
+        for (size_t i = 0; i < sockets.size(); i++) {
+            SocketStats stats = sockets[i]->socket_stats();
+            output
+                << "Shard " << i
+                << " sent " << stats.sent_datagrams
+                << " datagrams in " << stats.send_syscalls
+                << " syscalls and " << stats.sent_messages
+                << " messages, received " << stats.received_datagrams
+                << " in " << stats.recv_syscalls
+                << " syscalls and " << stats.received_messages
+                << " messages, and the kernel dropped " << stats.kernel_drops
+                << std::endl;
+        }
+    });
+
     return 0;
 }
 
 void print_help(void)
 {
     std::cerr
-        << "Usage: ./app_server <bind-address> <bind-port>"
+        << "Usage: ./app_server <bind-address> <bind-port> [--shards <n>]"
+        << " [--io-uring]"
+        << std::endl
+        << "                    [--busy-poll <us>]"
+        << std::endl
+        << std::endl
+        << "  --shards <n>      bind n sockets to the address with"
+        << " SO_REUSEPORT,"
+        << std::endl
+        << "                    each with its own receiving threads (default 1)"
+        << std::endl
+        << "  --io-uring        exchange datagrams through io_uring, falling"
+        << " back"
+        << std::endl
+        << "                    to poll if the kernel does not support it"
+        << std::endl
+        << "  --busy-poll <us>  keep receiving without blocking for up to us"
+        << std::endl
+        << "                    microseconds before parking, also set as"
+        << std::endl
+        << "                    SO_BUSY_POLL, trading a core per shard for"
+        << std::endl
+        << "                    latency (default 0)"
         << std::endl;
 }
 
 Arguments parse_arguments(int argc, char const *argv[])
 {
     Arguments arguments;
-    if (argc != 3) {
+    arguments.shards = 1;
+    arguments.backend = SOCKET_POLL;
+    arguments.busy_poll_usecs = 0;
+    if (argc < 3) {
         print_help();
         exit(1);
     }
@@ -139,5 +221,38 @@ Arguments parse_arguments(int argc, char const *argv[])
         exit(1);
     }
 
+    for (int i = 3; i < argc; i++) {
+        if (std::strcmp(argv[i], "--io-uring") == 0) {
+            arguments.backend = SOCKET_IO_URING;
+        } else if (std::strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            i++;
+            char *end;
+            unsigned long shards = std::strtoul(argv[i], &end, 10);
+            if (*argv[i] == '\0' || *end != '\0' || shards == 0) {
+                std::cerr
+                    << "invalid number of shards: "
+                    << argv[i]
+                    << std::endl;
+                exit(1);
+            }
+            arguments.shards = shards;
+        } else if (std::strcmp(argv[i], "--busy-poll") == 0 && i + 1 < argc) {
+            i++;
+            char *end;
+            unsigned long long usecs = std::strtoull(argv[i], &end, 10);
+            if (*argv[i] == '\0' || *end != '\0') {
+                std::cerr
+                    << "invalid busy poll duration: "
+                    << argv[i]
+                    << std::endl;
+                exit(1);
+            }
+            arguments.busy_poll_usecs = usecs;
+        } else {
+            print_help();
+            exit(1);
+        }
+    }
+
     return arguments;
 }
@@ -4,12 +4,14 @@
 void start_server_notification_manager(
     ThreadTracker& thread_tracker,
     std::shared_ptr<ServerProfileTable> const& profile_table,
+    WireFormat wire_format,
     Channel<Enveloped>::Sender&& to_comm_man,
     Channel<Username>::Receiver&& from_prof_man
 )
 {
     thread_tracker.spawn([
         profile_table,
+        wire_format,
         to_comm_man = std::move(to_comm_man),
         from_prof_man = std::move(from_prof_man)
     ] () mutable {
@@ -20,19 +22,23 @@ void start_server_notification_manager(
                     profile_table->consume_one_notif(to_be_notif_username);
 
                 if (auto pending_notif = maybe_pending_notif) {
-                    Enveloped enveloped;
-                    enveloped.message.body = std::shared_ptr<MessageBody>(
-                        new MessageDeliverReq(
-                            Username(pending_notif->sender),
-                            NotifMessage(pending_notif->message),
-                            pending_notif->sent_at
-                        )
+                    MessageDeliverReq body(
+                        Username(pending_notif->sender),
+                        NotifMessage(pending_notif->message),
+                        pending_notif->sent_at
                     );
 
+                    Enveloped enveloped;
+                    enveloped.message.body =
+                        MessageRawBody::from_body(wire_format, body);
+
+                    std::vector<Enveloped> fan_out;
+                    fan_out.reserve(pending_notif->receivers.size());
                     for (Address receiver : pending_notif->receivers) {
                         enveloped.remote = receiver;
-                        to_comm_man.send(enveloped);
+                        fan_out.push_back(enveloped);
                     }
+                    to_comm_man.send_all(std::move(fan_out));
                 }
             }
         } catch (ChannelDisconnected const& exc) {
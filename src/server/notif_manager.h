@@ -6,9 +6,16 @@
 #include "../shared/username.h"
 #include "data.h"
 
+/**
+ * Delivers pending notifications to every session following their senders.
+ * Each notification body is encoded once, in the given wire format, and
+ * shared by all of its receivers, which are queued together so that the
+ * communication manager sends them in one batch.
+ */
 void start_server_notification_manager(
     ThreadTracker& thread_tracker,
     std::shared_ptr<ServerProfileTable> const& profile_table,
+    WireFormat wire_format,
     Channel<Enveloped>::Sender&& to_comm_man,
     Channel<Username>::Receiver&& from_prof_man
 );
@@ -51,9 +51,7 @@ void start_server_profile_manager(
                                 req_enveloped.message.header.timestamp
                             );
                             std::move(req).send_resp(
-                                std::shared_ptr<MessageBody>(
-                                    new MessageClientConnResp
-                                )
+                                make_pooled<MessageClientConnResp>()
                             );
                             Logger::with([
                                 &message,
@@ -76,9 +74,7 @@ void start_server_profile_manager(
                                 req_enveloped.message.header.timestamp
                             );
                             std::move(req).send_resp(
-                                std::shared_ptr<MessageBody>(
-                                    new MessageDisconnectResp
-                                )
+                                make_pooled<MessageDisconnectResp>()
                             );
                             if (disconnected) {
                                 Logger::with([
@@ -107,9 +103,7 @@ void start_server_profile_manager(
                                 req_enveloped.message.header.timestamp
                             );
                             std::move(req).send_resp(
-                                std::shared_ptr<MessageBody>(
-                                    new MessageFollowResp
-                                )
+                                make_pooled<MessageFollowResp>()
                             );
                             Logger::with([
                                 &message,
@@ -138,9 +132,7 @@ void start_server_profile_manager(
                                 req_enveloped.message.header.timestamp
                             );
                             std::move(req).send_resp(
-                                std::shared_ptr<MessageBody>(
-                                    new MessageNotifyResp
-                                )
+                                make_pooled<MessageNotifyResp>()
                             );
                             Logger::with([
                                 &message,
@@ -161,9 +153,9 @@ void start_server_profile_manager(
                             throw InvalidServerProfManMsg();
                     }
                 } catch (ThrowableMessageError exc) {
-                    std::move(req).send_resp(std::shared_ptr<MessageBody>(
-                        new MessageErrorResp(exc.error())
-                    ));
+                    std::move(req).send_resp(
+                        make_pooled<MessageErrorResp>(exc.error())
+                    );
                 }
             }
         } catch (ChannelDisconnected const& exc) {
@@ -185,12 +185,12 @@ bool Address::operator>=(Address const& other) const
 
 void Address::serialize(Serializer& stream) const
 {
-    stream << this->ipv4 << this->port;
+    this->encode(stream);
 }
 
 void Address::deserialize(Deserializer& stream)
 {
-    stream >> this->ipv4 >> this->port;
+    this->decode(stream);
 }
 
 std::string Address::to_string() const
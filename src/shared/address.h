@@ -59,6 +59,11 @@ class Address : public Serializable, public Deserializable {
         bool operator>(Address const& other) const;
         bool operator>=(Address const& other) const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& stream) const;
         virtual void deserialize(Deserializer& stream);
 
@@ -68,4 +73,16 @@ class Address : public Serializable, public Deserializable {
         static Address parse(std::string const& content);
 };
 
+template <typename S>
+void Address::encode(S& serializer) const
+{
+    serializer << this->ipv4 << this->port;
+}
+
+template <typename D>
+void Address::decode(D& deserializer)
+{
+    deserializer >> this->ipv4 >> this->port;
+}
+
 #endif
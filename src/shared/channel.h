@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <queue>
+#include <vector>
 #include <optional>
 #include <exception>
 #include <mutex>
@@ -52,6 +53,8 @@ class Channel {
 
                 void send(T message);
 
+                void send_all(std::vector<T>&& messages);
+
                 std::optional<T> unsafe_try_receive();
 
                 std::optional<T> try_receive();
@@ -82,6 +85,11 @@ class Channel {
 
                 void send(T message);
 
+                /**
+                 * Sends every message in order, taking the lock only once.
+                 */
+                void send_all(std::vector<T>&& messages);
+
                 void disconnect();
 
             private:
@@ -195,6 +203,19 @@ void Channel<T>::Inner::send(T message)
     this->cond_var.notify_one();
 }
 
+template <typename T>
+void Channel<T>::Inner::send_all(std::vector<T>&& messages)
+{
+    std::unique_lock lock(this->mutex);
+    if (this->receivers == 0) {
+        throw ReceiversDisconnected();
+    }
+    for (T& message : messages) {
+        this->messages.push(std::move(message));
+    }
+    this->cond_var.notify_all();
+}
+
 template <typename T>
 std::optional<T> Channel<T>::Inner::unsafe_try_receive()
 {
@@ -298,6 +319,15 @@ void Channel<T>::Sender::send(T message)
     this->inner->send(std::move(message));
 }
 
+template <typename T>
+void Channel<T>::Sender::send_all(std::vector<T>&& messages)
+{
+    if (!this->inner) {
+        throw UsageOfMovedChannel();
+    }
+    this->inner->send_all(std::move(messages));
+}
+
 template <typename T>
 void Channel<T>::Sender::connected()
 {
@@ -0,0 +1,142 @@
+#include "datagram_buffer.h"
+#include <algorithm>
+
+DatagramBufferPool::Inner::Inner(size_t buffer_size, size_t capacity) :
+    buffer_size(buffer_size),
+    capacity(capacity),
+    allocations(0)
+{
+    this->idle.reserve(capacity);
+}
+
+void DatagramBufferPool::Inner::give_back(std::string&& bytes)
+{
+    if (bytes.size() != this->buffer_size) {
+        return;
+    }
+    std::unique_lock lock(this->mutex);
+    if (this->idle.size() < this->capacity) {
+        this->idle.push_back(std::move(bytes));
+    }
+}
+
+DatagramBufferPool::DatagramBufferPool(size_t buffer_size, size_t capacity) :
+    inner(std::make_shared<Inner>(buffer_size, capacity))
+{
+}
+
+size_t DatagramBufferPool::buffer_size() const
+{
+    return this->inner->buffer_size;
+}
+
+DatagramBuffer DatagramBufferPool::take()
+{
+    {
+        std::unique_lock lock(this->inner->mutex);
+        if (!this->inner->idle.empty()) {
+            std::string bytes = std::move(this->inner->idle.back());
+            this->inner->idle.pop_back();
+            return DatagramBuffer(std::move(bytes), this->inner);
+        }
+    }
+
+    this->inner->allocations++;
+    return DatagramBuffer(
+        std::string(this->inner->buffer_size, '\0'),
+        this->inner
+    );
+}
+
+uint64_t DatagramBufferPool::allocations() const
+{
+    return this->inner->allocations.load();
+}
+
+size_t DatagramBufferPool::idle_count() const
+{
+    std::unique_lock lock(this->inner->mutex);
+    return this->inner->idle.size();
+}
+
+DatagramBuffer::DatagramBuffer(
+    std::string&& bytes,
+    std::shared_ptr<DatagramBufferPool::Inner> const& pool
+) :
+    bytes(std::move(bytes)),
+    size_(0),
+    pool(pool)
+{
+}
+
+DatagramBuffer::DatagramBuffer() : size_(0)
+{
+}
+
+DatagramBuffer::DatagramBuffer(std::string&& bytes) :
+    bytes(std::move(bytes)),
+    size_(this->bytes.size())
+{
+}
+
+DatagramBuffer::DatagramBuffer(DatagramBuffer&& other) :
+    bytes(std::move(other.bytes)),
+    size_(other.size_),
+    pool(std::move(other.pool))
+{
+    other.bytes.clear();
+    other.size_ = 0;
+}
+
+DatagramBuffer& DatagramBuffer::operator=(DatagramBuffer&& other)
+{
+    if (this != &other) {
+        this->release();
+        this->bytes = std::move(other.bytes);
+        this->size_ = other.size_;
+        this->pool = std::move(other.pool);
+        other.bytes.clear();
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+DatagramBuffer::~DatagramBuffer()
+{
+    this->release();
+}
+
+char *DatagramBuffer::data()
+{
+    return this->bytes.data();
+}
+
+char const *DatagramBuffer::data() const
+{
+    return this->bytes.data();
+}
+
+size_t DatagramBuffer::size() const
+{
+    return this->size_;
+}
+
+size_t DatagramBuffer::capacity() const
+{
+    return this->bytes.size();
+}
+
+void DatagramBuffer::resize(size_t size)
+{
+    this->size_ = std::min(size, this->bytes.size());
+}
+
+void DatagramBuffer::release()
+{
+    if (this->pool) {
+        this->pool->give_back(std::move(this->bytes));
+        this->pool.reset();
+    }
+    this->bytes.clear();
+    this->size_ = 0;
+}
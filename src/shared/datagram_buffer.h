@@ -0,0 +1,119 @@
+#ifndef SHARED_DATAGRAM_BUFFER_H_
+#define SHARED_DATAGRAM_BUFFER_H_ 1
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Default number of idle buffers a DatagramBufferPool keeps around. Buffers
+ * given back beyond that are freed.
+ */
+constexpr size_t DATAGRAM_POOL_CAPACITY = 256;
+
+class DatagramBuffer;
+
+/**
+ * Fixed-capacity pool of buffers of the same size, meant for received
+ * datagrams. Buffers are handed out as DatagramBuffer and come back on their
+ * own once the last owner, e.g. a lazily decoded message body, drops them,
+ * from whichever thread that happens.
+ */
+class DatagramBufferPool {
+    private:
+        friend class DatagramBuffer;
+
+        class Inner {
+            public:
+                std::mutex mutex;
+                std::vector<std::string> idle;
+                size_t buffer_size;
+                size_t capacity;
+                std::atomic<uint64_t> allocations;
+
+                Inner(size_t buffer_size, size_t capacity);
+
+                void give_back(std::string&& bytes);
+        };
+
+        std::shared_ptr<Inner> inner;
+
+    public:
+        DatagramBufferPool(
+            size_t buffer_size,
+            size_t capacity = DATAGRAM_POOL_CAPACITY
+        );
+
+        size_t buffer_size() const;
+
+        /**
+         * Takes an idle buffer, or allocates a new one if none is idle.
+         */
+        DatagramBuffer take();
+
+        /**
+         * Number of buffers allocated so far because none was idle.
+         */
+        uint64_t allocations() const;
+
+        size_t idle_count() const;
+};
+
+/**
+ * Bytes of a single datagram. The storage keeps its full capacity however
+ * many bytes are in use, so that reusing it needs neither an allocation nor
+ * zero-filling. Storage taken from a DatagramBufferPool goes back to it when
+ * the buffer is destroyed.
+ */
+class DatagramBuffer {
+    private:
+        friend class DatagramBufferPool;
+
+        std::string bytes;
+        size_t size_;
+        std::shared_ptr<DatagramBufferPool::Inner> pool;
+
+        DatagramBuffer(
+            std::string&& bytes,
+            std::shared_ptr<DatagramBufferPool::Inner> const& pool
+        );
+
+    public:
+        DatagramBuffer();
+
+        /**
+         * Takes the string over, with all of its bytes in use, outside of any
+         * pool.
+         */
+        DatagramBuffer(std::string&& bytes);
+
+        DatagramBuffer(DatagramBuffer&& other);
+        DatagramBuffer& operator=(DatagramBuffer&& other);
+
+        DatagramBuffer(DatagramBuffer const& other) = delete;
+        DatagramBuffer& operator=(DatagramBuffer const& other) = delete;
+
+        ~DatagramBuffer();
+
+        char *data();
+        char const *data() const;
+
+        size_t size() const;
+
+        size_t capacity() const;
+
+        /**
+         * Sets how many bytes are in use, at most the capacity. Bytes past
+         * the old size are left as they were.
+         */
+        void resize(size_t size);
+
+    private:
+        void release();
+};
+
+#endif
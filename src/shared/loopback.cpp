@@ -0,0 +1,632 @@
+#include "loopback.h"
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+/**
+ * The inbox of a bound endpoint. Senders push onto a lock-free stack and
+ * signal an eventfd, while the receiver takes the whole stack at once.
+ * Together with a timerfd for held datagrams, the eventfd is watched by an
+ * epoll instance, which is what polls readable.
+ */
+class LoopbackNetwork::Endpoint {
+    public:
+        class InFlight {
+            public:
+                InFlight *next;
+                std::string bytes;
+                Address remote;
+                int64_t due_nanos;
+                uint64_t order;
+        };
+
+        std::atomic<InFlight *> inbox;
+        int event_fd;
+        int timer_fd;
+        int epoll_fd;
+
+        Endpoint();
+        Endpoint(Endpoint const& other) = delete;
+        Endpoint& operator=(Endpoint const& other) = delete;
+
+        ~Endpoint();
+
+        void push(InFlight *datagram);
+
+        /**
+         * Takes every datagram in the inbox, oldest first.
+         */
+        InFlight *take_all();
+};
+
+/**
+ * Draws each datagram is entitled to, whether the conditions use them or not,
+ * so that decisions about a datagram never shift those about the next ones.
+ */
+constexpr uint64_t LOOPBACK_DRAWS_PER_DATAGRAM = 6;
+
+constexpr uint64_t LOOPBACK_DRAW_LOSS = 0;
+constexpr uint64_t LOOPBACK_DRAW_DUPLICATION = 1;
+/**
+ * Draws for each copy of a datagram start here, in pairs.
+ */
+constexpr uint64_t LOOPBACK_DRAW_COPY = 2;
+constexpr uint64_t LOOPBACK_DRAW_JITTER = 0;
+constexpr uint64_t LOOPBACK_DRAW_REORDERING = 1;
+
+static int64_t monotonic_nanos();
+
+static uint64_t mix_bits(uint64_t bits);
+
+LoopbackAddressInUse::LoopbackAddressInUse(Address address) :
+    message(
+        "loopback address " + address.to_string() + " is already in use"
+    )
+{
+}
+
+const char *LoopbackAddressInUse::what() const noexcept
+{
+    return this->message.c_str();
+}
+
+LoopbackConditions::LoopbackConditions() :
+    loss(0.0),
+    duplication(0.0),
+    reordering(0.0),
+    delay_nanos(0),
+    jitter_nanos(0),
+    reorder_delay_nanos(0),
+    seed(0)
+{
+}
+
+LoopbackConditions& LoopbackConditions::with_loss(double val)
+{
+    this->loss = val;
+    return *this;
+}
+
+LoopbackConditions& LoopbackConditions::with_duplication(double val)
+{
+    this->duplication = val;
+    return *this;
+}
+
+LoopbackConditions& LoopbackConditions::with_reordering(double val)
+{
+    this->reordering = val;
+    return *this;
+}
+
+LoopbackConditions& LoopbackConditions::with_delay_nanos(uint64_t val)
+{
+    this->delay_nanos = val;
+    return *this;
+}
+
+LoopbackConditions& LoopbackConditions::with_jitter_nanos(uint64_t val)
+{
+    this->jitter_nanos = val;
+    return *this;
+}
+
+LoopbackConditions& LoopbackConditions::with_reorder_delay_nanos(
+    uint64_t val
+)
+{
+    this->reorder_delay_nanos = val;
+    return *this;
+}
+
+LoopbackConditions& LoopbackConditions::with_seed(uint64_t val)
+{
+    this->seed = val;
+    return *this;
+}
+
+LoopbackStats::LoopbackStats() :
+    sent(0),
+    lost(0),
+    duplicated(0),
+    reordered(0),
+    unreachable(0)
+{
+}
+
+LoopbackNetwork::Endpoint::Endpoint() :
+    inbox(nullptr),
+    event_fd(-1),
+    timer_fd(-1),
+    epoll_fd(-1)
+{
+    this->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (this->event_fd < 0) {
+        throw SocketIoError("loopback eventfd");
+    }
+    this->timer_fd = timerfd_create(
+        CLOCK_MONOTONIC,
+        TFD_NONBLOCK | TFD_CLOEXEC
+    );
+    if (this->timer_fd < 0) {
+        SocketIoError error("loopback timerfd");
+        ::close(this->event_fd);
+        throw error;
+    }
+    this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (this->epoll_fd < 0) {
+        SocketIoError error("loopback epoll");
+        ::close(this->event_fd);
+        ::close(this->timer_fd);
+        throw error;
+    }
+
+    for (int fd : { this->event_fd, this->timer_fd }) {
+        struct epoll_event event;
+        bzero(&event, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            SocketIoError error("loopback epoll add");
+            ::close(this->event_fd);
+            ::close(this->timer_fd);
+            ::close(this->epoll_fd);
+            throw error;
+        }
+    }
+}
+
+LoopbackNetwork::Endpoint::~Endpoint()
+{
+    InFlight *datagram = this->take_all();
+    while (datagram != nullptr) {
+        InFlight *next = datagram->next;
+        delete datagram;
+        datagram = next;
+    }
+    ::close(this->epoll_fd);
+    ::close(this->timer_fd);
+    ::close(this->event_fd);
+}
+
+void LoopbackNetwork::Endpoint::push(InFlight *datagram)
+{
+    datagram->next = this->inbox.load(std::memory_order_relaxed);
+    while (!this->inbox.compare_exchange_weak(
+        datagram->next,
+        datagram,
+        std::memory_order_release,
+        std::memory_order_relaxed
+    )) {
+    }
+
+    uint64_t one = 1;
+    ssize_t status;
+    do {
+        status = write(this->event_fd, &one, sizeof(one));
+    } while (status < 0 && errno == EINTR);
+}
+
+LoopbackNetwork::Endpoint::InFlight *LoopbackNetwork::Endpoint::take_all()
+{
+    InFlight *newest = this->inbox.exchange(
+        nullptr,
+        std::memory_order_acquire
+    );
+    InFlight *oldest = nullptr;
+    while (newest != nullptr) {
+        InFlight *next = newest->next;
+        newest->next = oldest;
+        oldest = newest;
+        newest = next;
+    }
+    return oldest;
+}
+
+LoopbackNetwork::Counters::Counters() :
+    sent(0),
+    lost(0),
+    duplicated(0),
+    reordered(0),
+    unreachable(0)
+{
+}
+
+LoopbackNetwork::LoopbackNetwork(LoopbackConditions const& conditions) :
+    conditions_(conditions),
+    sequence(0),
+    next_port(LOOPBACK_EPHEMERAL_PORT)
+{
+}
+
+LoopbackConditions const& LoopbackNetwork::conditions() const
+{
+    return this->conditions_;
+}
+
+LoopbackStats LoopbackNetwork::stats() const
+{
+    LoopbackStats stats;
+    stats.sent = this->counters.sent.load();
+    stats.lost = this->counters.lost.load();
+    stats.duplicated = this->counters.duplicated.load();
+    stats.reordered = this->counters.reordered.load();
+    stats.unreachable = this->counters.unreachable.load();
+    return stats;
+}
+
+std::shared_ptr<LoopbackNetwork::Endpoint> LoopbackNetwork::bind(
+    Address address
+)
+{
+    std::unique_lock lock(this->endpoints_mutex);
+    if (this->endpoints.find(address) != this->endpoints.end()) {
+        throw LoopbackAddressInUse(address);
+    }
+    std::shared_ptr<Endpoint> endpoint(new Endpoint);
+    this->endpoints.insert(std::make_pair(address, endpoint));
+    return endpoint;
+}
+
+std::pair<Address, std::shared_ptr<LoopbackNetwork::Endpoint>>
+    LoopbackNetwork::bind_ephemeral(uint32_t ipv4)
+{
+    std::unique_lock lock(this->endpoints_mutex);
+    Address address(ipv4, this->next_port);
+    for (uint32_t tries = 0; tries <= UINT16_MAX; tries++) {
+        address.port = this->next_port;
+        if (this->next_port == UINT16_MAX) {
+            this->next_port = LOOPBACK_EPHEMERAL_PORT;
+        } else {
+            this->next_port++;
+        }
+        if (this->endpoints.find(address) == this->endpoints.end()) {
+            std::shared_ptr<Endpoint> endpoint(new Endpoint);
+            this->endpoints.insert(std::make_pair(address, endpoint));
+            return std::make_pair(address, endpoint);
+        }
+    }
+    throw LoopbackAddressInUse(address);
+}
+
+void LoopbackNetwork::unbind(Address address)
+{
+    std::unique_lock lock(this->endpoints_mutex);
+    this->endpoints.erase(address);
+}
+
+std::shared_ptr<LoopbackNetwork::Endpoint> LoopbackNetwork::find(
+    Address address
+) const
+{
+    std::shared_lock lock(this->endpoints_mutex);
+    auto search = this->endpoints.find(address);
+    if (search == this->endpoints.end()) {
+        return std::shared_ptr<Endpoint>();
+    }
+    return std::get<1>(*search);
+}
+
+void LoopbackNetwork::deliver(
+    Address local,
+    Address remote,
+    uint64_t index,
+    char const *bytes,
+    size_t size
+)
+{
+    this->counters.sent++;
+
+    std::shared_ptr<Endpoint> endpoint = this->find(remote);
+    if (!endpoint) {
+        this->counters.unreachable++;
+        return;
+    }
+
+    if (
+        this->conditions_.loss > 0.0
+        && this->draw(local, remote, index, LOOPBACK_DRAW_LOSS)
+            < this->conditions_.loss
+    ) {
+        this->counters.lost++;
+        return;
+    }
+
+    size_t copies = 1;
+    if (
+        this->conditions_.duplication > 0.0
+        && this->draw(local, remote, index, LOOPBACK_DRAW_DUPLICATION)
+            < this->conditions_.duplication
+    ) {
+        this->counters.duplicated++;
+        copies = 2;
+    }
+
+    int64_t now = monotonic_nanos();
+    for (size_t i = 0; i < copies; i++) {
+        uint64_t copy_draws = LOOPBACK_DRAW_COPY + 2 * i;
+        uint64_t delay = this->conditions_.delay_nanos;
+        if (this->conditions_.jitter_nanos > 0) {
+            double jitter = this->draw(
+                local,
+                remote,
+                index,
+                copy_draws + LOOPBACK_DRAW_JITTER
+            );
+            delay += jitter * this->conditions_.jitter_nanos;
+        }
+        if (
+            this->conditions_.reordering > 0.0
+            && this->draw(
+                local,
+                remote,
+                index,
+                copy_draws + LOOPBACK_DRAW_REORDERING
+            ) < this->conditions_.reordering
+        ) {
+            this->counters.reordered++;
+            delay += this->conditions_.reorder_delay_nanos;
+        }
+
+        Endpoint::InFlight *datagram = new Endpoint::InFlight;
+        datagram->bytes.assign(bytes, size);
+        datagram->remote = local;
+        datagram->due_nanos = now + delay;
+        datagram->order = this->sequence++;
+        endpoint->push(datagram);
+    }
+}
+
+double LoopbackNetwork::draw(
+    Address local,
+    Address remote,
+    uint64_t index,
+    uint64_t decision
+) const
+{
+    uint64_t link = mix_bits(
+        this->conditions_.seed ^ ((uint64_t) local.ipv4 << 16 | local.port)
+    );
+    link = mix_bits(link ^ ((uint64_t) remote.ipv4 << 16 | remote.port));
+    uint64_t bits = mix_bits(
+        link + index * LOOPBACK_DRAWS_PER_DATAGRAM + decision
+    );
+    return (bits >> 11) * 0x1.0p-53;
+}
+
+LoopbackTransport::Counters::Counters() :
+    sent_datagrams(0),
+    received_datagrams(0)
+{
+}
+
+LoopbackTransport::LoopbackTransport(
+    std::shared_ptr<LoopbackNetwork> const& network,
+    Address address,
+    size_t max_message_size,
+    WireFormat wire_format
+) :
+    Transport(max_message_size, wire_format),
+    network(network),
+    address_(address),
+    endpoint(network->bind(address))
+{
+}
+
+LoopbackTransport::LoopbackTransport(
+    std::shared_ptr<LoopbackNetwork> const& network,
+    size_t max_message_size,
+    WireFormat wire_format
+) :
+    Transport(max_message_size, wire_format),
+    network(network)
+{
+    auto bound = network->bind_ephemeral(make_ipv4({ 127, 0, 0, 1 }));
+    this->address_ = std::get<0>(bound);
+    this->endpoint = std::get<1>(bound);
+}
+
+LoopbackTransport::~LoopbackTransport()
+{
+    this->network->unbind(this->address_);
+}
+
+Address LoopbackTransport::address() const
+{
+    return this->address_;
+}
+
+int LoopbackTransport::readable_fd() const
+{
+    return this->endpoint->epoll_fd;
+}
+
+std::vector<Enveloped> LoopbackTransport::receive_batch(
+    size_t max_count,
+    int timeout_ms
+)
+{
+    std::vector<Enveloped> batch;
+    if (max_count == 0) {
+        return batch;
+    }
+
+    for (;;) {
+        this->collect();
+
+        int64_t now = monotonic_nanos();
+        size_t taken = 0;
+        while (
+            taken < max_count
+            && !this->held.empty()
+            && std::get<0>(this->held.begin()->first) <= now
+        ) {
+            HeldDatagram& datagram = this->held.begin()->second;
+            size_t count = std::min(
+                datagram.bytes.size(),
+                this->max_message_size_
+            );
+            this->push_lazy(
+                batch,
+                DatagramBuffer(std::move(datagram.bytes)),
+                count,
+                datagram.remote,
+                std::optional<int64_t>()
+            );
+            this->held.erase(this->held.begin());
+            taken++;
+        }
+        this->counters.received_datagrams += taken;
+        this->arm_timer();
+
+        if (taken > 0 || timeout_ms == 0) {
+            return batch;
+        }
+
+        struct pollfd poll_fd;
+        poll_fd.fd = this->endpoint->epoll_fd;
+        poll_fd.events = POLLIN;
+        poll_fd.revents = 0;
+        int status = poll(&poll_fd, 1, timeout_ms);
+        if (status < 0 && errno != EINTR) {
+            throw SocketIoError("loopback poll");
+        }
+        if (status == 0) {
+            return batch;
+        }
+        timeout_ms = 0;
+    }
+}
+
+void LoopbackTransport::send_encoded(
+    Address const& remote,
+    std::string const& datagram
+)
+{
+    uint64_t index;
+    {
+        std::unique_lock lock(this->link_sends_mutex);
+        index = this->link_sends[remote]++;
+    }
+    this->network->deliver(
+        this->address_,
+        remote,
+        index,
+        datagram.data(),
+        datagram.size()
+    );
+    this->counters.sent_datagrams++;
+}
+
+void LoopbackTransport::send_batch(
+    std::vector<OutgoingDatagram> const& datagrams
+)
+{
+    std::vector<uint64_t> indices;
+    indices.reserve(datagrams.size());
+    {
+        std::unique_lock lock(this->link_sends_mutex);
+        for (OutgoingDatagram const& datagram : datagrams) {
+            indices.push_back(this->link_sends[datagram.remote]++);
+        }
+    }
+    for (size_t i = 0; i < datagrams.size(); i++) {
+        this->network->deliver(
+            this->address_,
+            datagrams[i].remote,
+            indices[i],
+            datagrams[i].bytes->data(),
+            datagrams[i].bytes->size()
+        );
+    }
+    this->counters.sent_datagrams += datagrams.size();
+}
+
+SocketStats LoopbackTransport::stats() const
+{
+    SocketStats stats;
+    stats.sent_datagrams = this->counters.sent_datagrams.load();
+    stats.sent_messages = stats.sent_datagrams;
+    stats.received_datagrams = this->counters.received_datagrams.load();
+    stats.received_messages = stats.received_datagrams;
+    return stats;
+}
+
+void LoopbackTransport::collect()
+{
+    uint64_t signals;
+    while (read(this->endpoint->event_fd, &signals, sizeof(signals)) < 0) {
+        if (errno != EINTR) {
+            break;
+        }
+    }
+
+    LoopbackNetwork::Endpoint::InFlight *datagram =
+        this->endpoint->take_all();
+    while (datagram != nullptr) {
+        HeldDatagram held;
+        held.bytes = std::move(datagram->bytes);
+        held.remote = datagram->remote;
+        this->held.insert(std::make_pair(
+            std::make_pair(datagram->due_nanos, datagram->order),
+            std::move(held)
+        ));
+        LoopbackNetwork::Endpoint::InFlight *next = datagram->next;
+        delete datagram;
+        datagram = next;
+    }
+}
+
+void LoopbackTransport::arm_timer()
+{
+    uint64_t expirations;
+    while (
+        read(this->endpoint->timer_fd, &expirations, sizeof(expirations)) < 0
+    ) {
+        if (errno != EINTR) {
+            break;
+        }
+    }
+
+    struct itimerspec timer;
+    bzero(&timer, sizeof(timer));
+    if (!this->held.empty()) {
+        int64_t due = std::get<0>(this->held.begin()->first);
+        if (due <= 0) {
+            due = 1;
+        }
+        timer.it_value.tv_sec = due / 1000000000;
+        timer.it_value.tv_nsec = due % 1000000000;
+    }
+    int status = timerfd_settime(
+        this->endpoint->timer_fd,
+        TFD_TIMER_ABSTIME,
+        &timer,
+        nullptr
+    );
+    if (status < 0) {
+        throw SocketIoError("loopback timerfd settime");
+    }
+}
+
+static int64_t monotonic_nanos()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+static uint64_t mix_bits(uint64_t bits)
+{
+    bits += 0x9e3779b97f4a7c15;
+    bits = (bits ^ (bits >> 30)) * 0xbf58476d1ce4e5b9;
+    bits = (bits ^ (bits >> 27)) * 0x94d049bb133111eb;
+    return bits ^ (bits >> 31);
+}
@@ -0,0 +1,286 @@
+#ifndef SHARED_LOOPBACK_H_
+#define SHARED_LOOPBACK_H_ 1
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "socket.h"
+
+/**
+ * First port handed out to LoopbackTransport endpoints that are not bound to
+ * a given address.
+ */
+constexpr uint16_t LOOPBACK_EPHEMERAL_PORT = 49152;
+
+/**
+ * Thrown when a LoopbackTransport binds to an address some other endpoint of
+ * the network is bound to.
+ */
+class LoopbackAddressInUse : public SocketError {
+    private:
+        std::string message;
+
+    public:
+        LoopbackAddressInUse(Address address);
+        virtual const char *what() const noexcept;
+};
+
+/**
+ * Impairments a LoopbackNetwork applies to every datagram. Each link, i.e.
+ * pair of sending and receiving addresses, has its own pseudo-random stream
+ * derived from seed, and the n-th datagram sent over a link meets the same
+ * fate on every run, however the sends of other links interleave with it.
+ *
+ * What remains nondeterministic is the order in which threads of the same
+ * sender send over a link, e.g. a retransmission racing a new request, and
+ * the wall-clock time at which delayed datagrams become due, which decides
+ * how they interleave with datagrams of other links.
+ */
+class LoopbackConditions {
+    public:
+        /**
+         * Probability that a datagram is dropped.
+         */
+        double loss;
+        /**
+         * Probability that a datagram is delivered twice.
+         */
+        double duplication;
+        /**
+         * Probability that a datagram is held back for reorder_delay_nanos
+         * more than the others, so that later datagrams overtake it.
+         */
+        double reordering;
+        uint64_t delay_nanos;
+        /**
+         * Upper bound of an extra delay drawn uniformly for each datagram.
+         */
+        uint64_t jitter_nanos;
+        uint64_t reorder_delay_nanos;
+        uint64_t seed;
+
+        LoopbackConditions();
+
+        LoopbackConditions& with_loss(double val);
+        LoopbackConditions& with_duplication(double val);
+        LoopbackConditions& with_reordering(double val);
+        LoopbackConditions& with_delay_nanos(uint64_t val);
+        LoopbackConditions& with_jitter_nanos(uint64_t val);
+        LoopbackConditions& with_reorder_delay_nanos(uint64_t val);
+        LoopbackConditions& with_seed(uint64_t val);
+};
+
+/**
+ * What a LoopbackNetwork did to the datagrams sent through it so far.
+ */
+class LoopbackStats {
+    public:
+        uint64_t sent;
+        uint64_t lost;
+        uint64_t duplicated;
+        uint64_t reordered;
+        /**
+         * Datagrams sent to an address no endpoint is bound to, dropped as
+         * UDP would.
+         */
+        uint64_t unreachable;
+
+        LoopbackStats();
+};
+
+class LoopbackTransport;
+
+/**
+ * An in-process network of LoopbackTransport endpoints, each bound to an
+ * address, that exchange datagrams without involving the kernel but for a
+ * wake-up, under the configured conditions. Many simulated peers can share
+ * one network.
+ */
+class LoopbackNetwork {
+    private:
+        friend class LoopbackTransport;
+
+        class Endpoint;
+
+        class Counters {
+            public:
+                std::atomic<uint64_t> sent;
+                std::atomic<uint64_t> lost;
+                std::atomic<uint64_t> duplicated;
+                std::atomic<uint64_t> reordered;
+                std::atomic<uint64_t> unreachable;
+
+                Counters();
+        };
+
+        LoopbackConditions conditions_;
+        std::atomic<uint64_t> sequence;
+        Counters counters;
+
+        mutable std::shared_mutex endpoints_mutex;
+        std::map<Address, std::shared_ptr<Endpoint>> endpoints;
+        uint16_t next_port;
+
+    public:
+        LoopbackNetwork(
+            LoopbackConditions const& conditions = LoopbackConditions()
+        );
+        LoopbackNetwork(LoopbackNetwork const& other) = delete;
+        LoopbackNetwork& operator=(LoopbackNetwork const& other) = delete;
+
+        LoopbackConditions const& conditions() const;
+
+        LoopbackStats stats() const;
+
+    private:
+        std::shared_ptr<Endpoint> bind(Address address);
+
+        /**
+         * Binds to the next free port of the given IPv4 address, returning
+         * the address bound to.
+         */
+        std::pair<Address, std::shared_ptr<Endpoint>> bind_ephemeral(
+            uint32_t ipv4
+        );
+
+        void unbind(Address address);
+
+        std::shared_ptr<Endpoint> find(Address address) const;
+
+        /**
+         * Applies the conditions to the datagram, the given index-th sent
+         * from local to remote, then queues its copies, if any survive, to
+         * the endpoint bound to the remote.
+         */
+        void deliver(
+            Address local,
+            Address remote,
+            uint64_t index,
+            char const *bytes,
+            size_t size
+        );
+
+        /**
+         * Number of the pseudo-random stream of the link for the given
+         * decision about its index-th datagram, uniform in [0, 1).
+         */
+        double draw(
+            Address local,
+            Address remote,
+            uint64_t index,
+            uint64_t decision
+        ) const;
+};
+
+/**
+ * A Transport whose datagrams go through a LoopbackNetwork. Sending pushes
+ * onto the inbox of the receiving endpoint, a lock-free stack. The only locks
+ * taken are the one to look the endpoint up, shared with other senders, and
+ * the one to count sends over the link, local to this transport. Datagrams
+ * held back by a delay are kept by the receiver until they are due, with a
+ * timer making the transport readable then.
+ *
+ * receive_batch must not be called from more than one thread at once, as
+ * with Socket.
+ */
+class LoopbackTransport : public Transport {
+    private:
+        class Counters {
+            public:
+                std::atomic<uint64_t> sent_datagrams;
+                std::atomic<uint64_t> received_datagrams;
+
+                Counters();
+        };
+
+        class HeldDatagram {
+            public:
+                std::string bytes;
+                Address remote;
+        };
+
+        std::shared_ptr<LoopbackNetwork> network;
+        Address address_;
+        std::shared_ptr<LoopbackNetwork::Endpoint> endpoint;
+        /**
+         * Datagrams taken from the inbox, by time they are due at, then by
+         * order of sending.
+         */
+        std::map<std::pair<int64_t, uint64_t>, HeldDatagram> held;
+        /**
+         * Number of datagrams sent so far to each remote, which indexes the
+         * pseudo-random stream of the link.
+         */
+        std::map<Address, uint64_t> link_sends;
+        std::mutex link_sends_mutex;
+        Counters counters;
+
+    public:
+        /**
+         * Binds to the address, throwing LoopbackAddressInUse if some other
+         * endpoint is bound to it.
+         */
+        LoopbackTransport(
+            std::shared_ptr<LoopbackNetwork> const& network,
+            Address address,
+            size_t max_message_size,
+            WireFormat wire_format = WIRE_PLAINTEXT
+        );
+
+        /**
+         * Binds to a free port of 127.0.0.1.
+         */
+        LoopbackTransport(
+            std::shared_ptr<LoopbackNetwork> const& network,
+            size_t max_message_size,
+            WireFormat wire_format = WIRE_PLAINTEXT
+        );
+
+        LoopbackTransport(LoopbackTransport const& other) = delete;
+        LoopbackTransport& operator=(LoopbackTransport const& other) = delete;
+
+        virtual ~LoopbackTransport();
+
+        Address address() const;
+
+        virtual int readable_fd() const;
+
+        virtual std::vector<Enveloped> receive_batch(
+            size_t max_count,
+            int timeout_ms
+        );
+
+        virtual void send_encoded(
+            Address const& remote,
+            std::string const& datagram
+        );
+
+        virtual void send_batch(std::vector<OutgoingDatagram> const& datagrams);
+
+        /**
+         * Datagrams sent and received, each counted as a message of its own.
+         * No syscall is made to move them.
+         */
+        virtual SocketStats stats() const;
+
+    private:
+        /**
+         * Moves everything in the inbox into the held datagrams.
+         */
+        void collect();
+
+        /**
+         * Arms the timer for the earliest held datagram, or disarms it if
+         * there is none.
+         */
+        void arm_timer();
+};
+
+#endif
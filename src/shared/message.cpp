@@ -30,25 +30,11 @@ MessageStep msg_step_from_code(uint16_t code)
     switch (code) {
         case MSG_REQ: return MSG_REQ;
         case MSG_RESP: return MSG_RESP;
+        case MSG_ACK: return MSG_ACK;
         default: throw InvalidMessageStep(code);
     }
 }
 
-Serializer& operator<<(Serializer& serializer, MessageStep step)
-{
-    uint16_t code = step;
-    serializer << code;
-    return serializer;
-}
-
-Deserializer& operator>>(Deserializer& deserializer, MessageStep &step)
-{
-    uint16_t code;
-    deserializer >> code;
-    step = msg_step_from_code(code);
-    return deserializer;
-}
-
 InvalidMessageType::InvalidMessageType(uint16_t code) :
     DeserializationError("invalid message type code: "),
     code_(code)
@@ -64,32 +50,20 @@ uint16_t InvalidMessageType::code() const
 MessageType msg_type_from_code(uint16_t code)
 {
     switch (code) {
+        case MSG_NOP: return MSG_NOP;
         case MSG_ERROR: return MSG_ERROR;
         case MSG_CLIENT_CONN: return MSG_CLIENT_CONN;
+        case MSG_SERVER_CONN: return MSG_SERVER_CONN;
         case MSG_DISCONNECT: return MSG_DISCONNECT;
         case MSG_PING: return MSG_PING;
         case MSG_FOLLOW: return MSG_FOLLOW;
         case MSG_NOTIFY: return MSG_NOTIFY;
         case MSG_DELIVER: return MSG_DELIVER;
+        case MSG_RM_LOOKUP: return MSG_RM_LOOKUP;
         default: throw InvalidMessageType(code);
     }
 }
 
-Serializer& operator<<(Serializer& serializer, MessageType type)
-{
-    uint16_t code = type;
-    serializer << code;
-    return serializer;
-}
-
-Deserializer& operator>>(Deserializer& deserializer, MessageType &type)
-{
-    uint16_t code;
-    deserializer >> code;
-    type = msg_type_from_code(code);
-    return deserializer;
-}
-
 ThrowableMessageError::ThrowableMessageError(MessageError error) : error_(error)
 {
 }
@@ -120,6 +94,7 @@ MessageError msg_error_from_code(uint16_t code)
 {
     switch (code) {
         case MSG_INTERNAL_ERR: return MSG_INTERNAL_ERR;
+        case MSG_BAD: return MSG_BAD;
         case MSG_MISSED_RESP: return MSG_MISSED_RESP;
         case MSG_NO_CONNECTION: return MSG_NO_CONNECTION;
         case MSG_OUTDATED_SEQN: return MSG_OUTDATED_SEQN;
@@ -144,21 +119,6 @@ char const *msg_error_render(MessageError error)
     }
 }
 
-Serializer& operator<<(Serializer& serializer, MessageError error)
-{
-    uint16_t code = error;
-    serializer << code;
-    return serializer;
-}
-
-Deserializer& operator>>(Deserializer& deserializer, MessageError& error)
-{
-    uint16_t code;
-    deserializer >> code;
-    error = msg_error_from_code(code);
-    return deserializer;
-}
-
 MessageTag::MessageTag() : MessageTag(MSG_REQ, MSG_CLIENT_CONN)
 {
 }
@@ -207,12 +167,12 @@ bool MessageTag::operator>=(MessageTag const& other) const
 
 void MessageTag::serialize(Serializer& serializer) const
 {
-    serializer << this->step << this->type;
+    this->encode(serializer);
 }
 
 void MessageTag::deserialize(Deserializer& deserializer)
 {
-    deserializer >> this->step >> this->type;
+    this->decode(deserializer);
 }
 
 std::string MessageTag::to_string() const
@@ -245,12 +205,12 @@ void MessageHeader::fill_resp(uint64_t seqn)
 
 void MessageHeader::serialize(Serializer& serializer) const
 {
-    serializer << this->seqn << this->timestamp << this->election_counter;
+    this->encode(serializer);
 }
 
 void MessageHeader::deserialize(Deserializer& deserializer)
 {
-    deserializer >> this->seqn >> this->timestamp >> this->election_counter;
+    this->decode(deserializer);
 }
 
 CastOnMessageError::CastOnMessageError(MessageError error) :
@@ -276,15 +236,17 @@ MessageBody::~MessageBody()
 
 MessageTag MessageNopAck::tag() const
 {
-    return MessageTag(MSG_ACK, MSG_NOP);
+    return MessageTag(STEP, TYPE);
 }
 
 void MessageNopAck::serialize(Serializer& serializer) const
 {
+    this->encode(serializer);
 }
 
 void MessageNopAck::deserialize(Deserializer& deserializer)
 {
+    this->decode(deserializer);
 }
 
 MessageErrorResp::MessageErrorResp() : MessageErrorResp(MSG_INTERNAL_ERR)
@@ -297,19 +259,17 @@ MessageErrorResp::MessageErrorResp(MessageError error) : error(error)
 
 MessageTag MessageErrorResp::tag() const
 {
-    return MessageTag(MSG_RESP, MSG_ERROR);
+    return MessageTag(STEP, TYPE);
 }
 
 void MessageErrorResp::serialize(Serializer& serializer) const
 {
-    serializer << (uint64_t) this->error;
+    this->encode(serializer);
 }
 
 void MessageErrorResp::deserialize(Deserializer& deserializer)
 {
-    uint64_t code;
-    deserializer >> code;
-    this->error = msg_error_from_code(code);
+    this->decode(deserializer);
 }
 
 
@@ -324,30 +284,32 @@ MessageClientConnReq::MessageClientConnReq(Username const& username) :
 
 MessageTag MessageClientConnReq::tag() const
 {
-    return MessageTag(MSG_REQ, MSG_CLIENT_CONN);
+    return MessageTag(STEP, TYPE);
 }
 
 void MessageClientConnReq::serialize(Serializer& serializer) const
 {
-    serializer << this->username;
+    this->encode(serializer);
 }
 
 void MessageClientConnReq::deserialize(Deserializer& deserializer)
 {
-    deserializer >> this->username;
+    this->decode(deserializer);
 }
 
 MessageTag MessageClientConnResp::tag() const
 {
-    return MessageTag(MSG_RESP, MSG_CLIENT_CONN);
+    return MessageTag(STEP, TYPE);
 }
 
 void MessageClientConnResp::serialize(Serializer& serializer) const
 {
+    this->encode(serializer);
 }
 
 void MessageClientConnResp::deserialize(Deserializer& deserializer)
 {
+    this->decode(deserializer);
 }
 
 MessageServerConnReq::MessageServerConnReq()
@@ -356,80 +318,92 @@ MessageServerConnReq::MessageServerConnReq()
 
 MessageTag MessageServerConnReq::tag() const
 {
-    return MessageTag(MSG_REQ, MSG_SERVER_CONN);
+    return MessageTag(STEP, TYPE);
 }
 
 void MessageServerConnReq::serialize(Serializer& serializer) const
 {
+    this->encode(serializer);
 }
 
 void MessageServerConnReq::deserialize(Deserializer& deserializer)
 {
+    this->decode(deserializer);
 }
 
 MessageTag MessageServerConnResp::tag() const
 {
-    return MessageTag(MSG_RESP, MSG_SERVER_CONN);
+    return MessageTag(STEP, TYPE);
 }
 
 void MessageServerConnResp::serialize(Serializer& serializer) const
 {
+    this->encode(serializer);
 }
 
 void MessageServerConnResp::deserialize(Deserializer& deserializer)
 {
+    this->decode(deserializer);
 }
 
 MessageTag MessageDisconnectReq::tag() const
 {
-    return MessageTag(MSG_REQ, MSG_DISCONNECT);
+    return MessageTag(STEP, TYPE);
 }
 
 void MessageDisconnectReq::serialize(Serializer& serializer) const
 {
+    this->encode(serializer);
 }
 
 void MessageDisconnectReq::deserialize(Deserializer& deserializer)
 {
+    this->decode(deserializer);
 }
 
 MessageTag MessageDisconnectResp::tag() const
 {
-    return MessageTag(MSG_RESP, MSG_DISCONNECT);
+    return MessageTag(STEP, TYPE);
 }
 
 void MessageDisconnectResp::serialize(Serializer& serializer) const
 {
+    this->encode(serializer);
 }
 
 void MessageDisconnectResp::deserialize(Deserializer& deserializer)
 {
+    this->decode(deserializer);
 }
 
 MessageTag MessagePingReq::tag() const
 {
-    return MessageTag(MSG_REQ, MSG_PING);
+    return MessageTag(STEP, TYPE);
 }
 
 void MessagePingReq::serialize(Serializer& serializer) const
 {
+    this->encode(serializer);
 }
 
 void MessagePingReq::deserialize(Deserializer& deserializer)
 {
+    this->decode(deserializer);
 }
 
 MessageTag MessagePingResp::tag() const
 {
-    return MessageTag(MSG_RESP, MSG_PING);
+    return MessageTag(STEP, TYPE);
 }
 
 void MessagePingResp::serialize(Serializer& serializer) const
 {
+    this->encode(serializer);
 }
 
 void MessagePingResp::deserialize(Deserializer& deserializer)
 {
+    this->decode(deserializer);
 }
 
 MessageFollowReq::MessageFollowReq()
@@ -443,30 +417,32 @@ MessageFollowReq::MessageFollowReq(Username const& username) :
 
 MessageTag MessageFollowReq::tag() const
 {
-    return MessageTag(MSG_REQ, MSG_FOLLOW);
+    return MessageTag(STEP, TYPE);
 }
 
 void MessageFollowReq::serialize(Serializer& serializer) const
 {
-    serializer << this->username;
+    this->encode(serializer);
 }
 
 void MessageFollowReq::deserialize(Deserializer& deserializer)
 {
-    deserializer >> this->username;
+    this->decode(deserializer);
 }
 
 MessageTag MessageFollowResp::tag() const
 {
-    return MessageTag(MSG_RESP, MSG_FOLLOW);
+    return MessageTag(STEP, TYPE);
 }
 
 void MessageFollowResp::serialize(Serializer& serializer) const
 {
+    this->encode(serializer);
 }
 
 void MessageFollowResp::deserialize(Deserializer& deserializer)
 {
+    this->decode(deserializer);
 }
 
 MessageNotifyReq::MessageNotifyReq()
@@ -480,30 +456,32 @@ MessageNotifyReq::MessageNotifyReq(NotifMessage const& notif_msg) :
 
 MessageTag MessageNotifyReq::tag() const
 {
-    return MessageTag(MSG_REQ, MSG_NOTIFY);
+    return MessageTag(STEP, TYPE);
 }
 
 void MessageNotifyReq::serialize(Serializer& serializer) const
 {
-    serializer << this->notif_message;
+    this->encode(serializer);
 }
 
 void MessageNotifyReq::deserialize(Deserializer& deserializer)
 {
-    deserializer >> this->notif_message;
+    this->decode(deserializer);
 }
 
 MessageTag MessageNotifyResp::tag() const
 {
-    return MessageTag(MSG_RESP, MSG_NOTIFY);
+    return MessageTag(STEP, TYPE);
 }
 
 void MessageNotifyResp::serialize(Serializer& serializer) const
 {
+    this->encode(serializer);
 }
 
 void MessageNotifyResp::deserialize(Deserializer& deserializer)
 {
+    this->decode(deserializer);
 }
 
 MessageDeliverReq::MessageDeliverReq() : sent_at(0)
@@ -523,43 +501,47 @@ MessageDeliverReq::MessageDeliverReq(
 
 MessageTag MessageDeliverReq::tag() const
 {
-    return MessageTag(MSG_REQ, MSG_DELIVER);
+    return MessageTag(STEP, TYPE);
 }
 
 void MessageDeliverReq::serialize(Serializer& serializer) const
 {
-    serializer << this->sender << this->notif_message << this->sent_at;
+    this->encode(serializer);
 }
 
 void MessageDeliverReq::deserialize(Deserializer& deserializer)
 {
-    deserializer >> this->sender >> this->notif_message >> this->sent_at;
+    this->decode(deserializer);
 }
 
 MessageTag MessageDeliverResp::tag() const
 {
-    return MessageTag(MSG_RESP, MSG_DELIVER);
+    return MessageTag(STEP, TYPE);
 }
 
 void MessageDeliverResp::serialize(Serializer& serializer) const
 {
+    this->encode(serializer);
 }
 
 void MessageDeliverResp::deserialize(Deserializer& deserializer)
 {
+    this->decode(deserializer);
 }
 
 MessageTag MessageRmLookupReq::tag() const
 {
-    return MessageTag(MSG_REQ, MSG_RM_LOOKUP);
+    return MessageTag(STEP, TYPE);
 }
 
 void MessageRmLookupReq::serialize(Serializer& serializer) const
 {
+    this->encode(serializer);
 }
 
 void MessageRmLookupReq::deserialize(Deserializer& deserializer)
 {
+    this->decode(deserializer);
 }
 
 MessageRmLookupResp::MessageRmLookupResp() :
@@ -578,110 +560,157 @@ MessageRmLookupResp::MessageRmLookupResp(
 
 MessageTag MessageRmLookupResp::tag() const
 {
-    return MessageTag(MSG_RESP, MSG_RM_LOOKUP);
+    return MessageTag(STEP, TYPE);
 }
 
 void MessageRmLookupResp::serialize(Serializer& serializer) const
 {
-    serializer << this->rms << this-> primary;
+    this->encode(serializer);
 }
 
 void MessageRmLookupResp::deserialize(Deserializer& deserializer)
 {
-    deserializer >> this->rms >> this-> primary;
+    this->decode(deserializer);
 }
 
-void Message::serialize(Serializer& serializer) const
+MessageRawBody::MessageRawBody(
+    MessageTag tag,
+    WireFormat wire_format,
+    DatagramBuffer&& datagram,
+    size_t offset
+) :
+    tag_(tag),
+    wire_format_(wire_format),
+    datagram(std::move(datagram)),
+    offset(offset)
 {
-    serializer
-        << MSG_MAGIC_NUMBER
-        << this->header
-        << this->body->tag()
-        << *this->body;
 }
 
-void Message::deserialize(Deserializer& deserializer)
+std::shared_ptr<MessageRawBody> MessageRawBody::from_body(
+    WireFormat wire_format,
+    MessageBody const& body
+)
 {
-    try {
-        uint64_t maybe_magic_number;
-        deserializer >> maybe_magic_number;
-        if (maybe_magic_number != MSG_MAGIC_NUMBER) {
-            throw MessageOutOfProtocol();
+    MessageTag tag = body.tag();
+    std::string buf;
+
+    switch (wire_format) {
+        case WIRE_PLAINTEXT: {
+            PlaintextBufferSerializer serializer(buf);
+            if (!MessageBodies::encode(serializer, tag, body)) {
+                serializer << body;
+            }
+            break;
         }
-    } catch (DeserializationUnexpectedEof const& exc) {
-        throw MessageOutOfProtocol();
-    }
-    MessageTag tag;
-    deserializer >> this->header >> tag;
-    this->body.reset();
-    switch (tag.step) {
-        case MSG_REQ:
-            switch (tag.type) {
-                case MSG_CLIENT_CONN:
-                    this->body =
-                        std::shared_ptr<MessageBody>(new MessageClientConnReq);
-                    break;
-                case MSG_DISCONNECT:
-                    this->body =
-                        std::shared_ptr<MessageBody>(new MessageDisconnectReq);
-                    break;
-                case MSG_PING:
-                    this->body =
-                        std::shared_ptr<MessageBody>(new MessagePingReq);
-                    break;
-                case MSG_FOLLOW:
-                    this->body =
-                        std::shared_ptr<MessageBody>(new MessageFollowReq);
-                    break;
-                case MSG_NOTIFY:
-                    this->body =
-                        std::shared_ptr<MessageBody>(new MessageNotifyReq);
-                    break;
-                case MSG_DELIVER:
-                    this->body =
-                        std::shared_ptr<MessageBody>(new MessageDeliverReq);
-                    break;
+        case WIRE_BINARY: {
+            BinaryBufferSerializer serializer(buf);
+            if (!MessageBodies::encode(serializer, tag, body)) {
+                serializer << body;
             }
             break;
-        case MSG_RESP:
-            switch (tag.type) {
-                case MSG_ERROR:
-                    this->body =
-                        std::shared_ptr<MessageBody>(new MessageErrorResp);
-                    break;
-                case MSG_CLIENT_CONN:
-                    this->body =
-                        std::shared_ptr<MessageBody>(new MessageClientConnResp);
-                    break;
-                case MSG_DISCONNECT:
-                    this->body =
-                        std::shared_ptr<MessageBody>(new MessageDisconnectResp);
-                    break;
-                case MSG_PING:
-                    this->body =
-                        std::shared_ptr<MessageBody>(new MessagePingResp);
-                    break;
-                case MSG_FOLLOW:
-                    this->body =
-                        std::shared_ptr<MessageBody>(new MessageFollowResp);
-                    break;
-                case MSG_NOTIFY:
-                    this->body =
-                        std::shared_ptr<MessageBody>(new MessageNotifyResp);
-                    break;
-                case MSG_DELIVER:
-                    this->body =
-                        std::shared_ptr<MessageBody>(new MessageDeliverResp);
-                    break;
+        }
+        case WIRE_COMPACT: {
+            CompactBufferSerializer serializer(buf);
+            if (!MessageBodies::encode(serializer, tag, body)) {
+                serializer << body;
             }
             break;
+        }
+    }
+
+    return make_pooled<MessageRawBody>(
+        tag,
+        wire_format,
+        DatagramBuffer(std::move(buf)),
+        0
+    );
+}
+
+MessageTag MessageRawBody::tag() const
+{
+    return this->tag_;
+}
+
+WireFormat MessageRawBody::wire_format() const
+{
+    return this->wire_format_;
+}
+
+char const *MessageRawBody::data() const
+{
+    return this->datagram.data() + this->offset;
+}
+
+size_t MessageRawBody::size() const
+{
+    return this->datagram.size() - this->offset;
+}
+
+std::shared_ptr<MessageBody> MessageRawBody::decode() const
+{
+    char const *data = this->data();
+    size_t size = this->size();
+    std::shared_ptr<MessageBody> body;
+
+    switch (this->wire_format_) {
+        case WIRE_PLAINTEXT: {
+            PlaintextSpanDeserializer deserializer(data, size);
+            body = MessageBodies::decode(deserializer, this->tag_);
+            break;
+        }
+        case WIRE_BINARY: {
+            BinarySpanDeserializer deserializer(data, size);
+            body = MessageBodies::decode(deserializer, this->tag_);
+            break;
+        }
+        case WIRE_COMPACT: {
+            CompactSpanDeserializer deserializer(data, size);
+            body = MessageBodies::decode(deserializer, this->tag_);
+            break;
+        }
     }
-    if (!this->body) {
+
+    if (!body) {
         throw InvalidMessagePayload(
-            std::string("invalid message tag:  ") + tag.to_string()
+            std::string("invalid message tag:  ") + this->tag_.to_string()
         );
     }
-    deserializer >> *this->body;
+    return body;
+}
+
+void MessageRawBody::serialize(Serializer& serializer) const
+{
+    serializer << *this->decode();
+}
+
+void MessageRawBody::deserialize(Deserializer& deserializer)
+{
+    throw InvalidMessagePayload("raw message bodies cannot be deserialized");
+}
+
+void Message::decode_body()
+{
+    if (MessageRawBody const *raw_body = this->raw_body()) {
+        this->body = raw_body->decode();
+    }
+}
+
+MessageRawBody const *Message::raw_body() const
+{
+    if (this->body && typeid(*this->body) == typeid(MessageRawBody)) {
+        return static_cast<MessageRawBody const *>(this->body.get());
+    }
+    return nullptr;
+}
+
+void Message::serialize(Serializer& serializer) const
+{
+    this->encode(serializer);
+}
+
+void Message::deserialize(Deserializer& deserializer)
+{
+    this->decode(deserializer);
 }
 
 Enveloped::Enveloped()
@@ -693,3 +722,14 @@ Enveloped::Enveloped(Address remote, Message message) :
     message(message)
 {
 }
+
+std::optional<int64_t> Enveloped::queueing_delay_nanos() const
+{
+    if (!this->received_at_nanos.has_value()) {
+        return std::optional<int64_t>();
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    int64_t now_nanos = (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    return now_nanos - *this->received_at_nanos;
+}
@@ -5,10 +5,15 @@
 #include "username.h"
 #include "notif_message.h"
 #include "address.h"
+#include "pool.h"
+#include "datagram_buffer.h"
 
 #include <cstdint>
 #include <string>
 #include <memory>
+#include <optional>
+#include <array>
+#include <typeinfo>
 
 constexpr uint64_t MSG_MAGIC_NUMBER = 8969265839344830156;
 
@@ -59,8 +64,11 @@ MessageError msg_error_from_code(uint16_t code);
 
 char const *msg_error_render(MessageError error);
 
-Serializer& operator<<(Serializer& serializer, MessageError status);
-Deserializer& operator>>(Deserializer& deserializer, MessageError& status);
+template <typename S>
+SerializerRef<S> operator<<(S& serializer, MessageError error);
+
+template <typename D>
+DeserializerRef<D> operator>>(D& deserializer, MessageError& error);
 
 enum MessageStep {
     MSG_REQ,
@@ -77,10 +85,15 @@ class InvalidMessageStep : public DeserializationError {
         uint16_t code() const;
 };
 
+constexpr size_t MSG_STEP_COUNT = MSG_ACK + 1;
+
 MessageStep msg_step_from_code(uint16_t code);
 
-Serializer& operator<<(Serializer& serializer, MessageStep step);
-Deserializer& operator>>(Deserializer& deserializer, MessageStep &step);
+template <typename S>
+SerializerRef<S> operator<<(S& serializer, MessageStep step);
+
+template <typename D>
+DeserializerRef<D> operator>>(D& deserializer, MessageStep& step);
 
 enum MessageType {
     MSG_NOP,
@@ -104,10 +117,25 @@ class InvalidMessageType : public DeserializationError {
         uint16_t code() const;
 };
 
+constexpr size_t MSG_TYPE_COUNT = MSG_RM_LOOKUP + 1;
+
 MessageType msg_type_from_code(uint16_t code);
 
-Serializer& operator<<(Serializer& serializer, MessageType tag);
-Deserializer& operator>>(Deserializer& deserializer, MessageType &tag);
+template <typename S>
+SerializerRef<S> operator<<(S& serializer, MessageType type);
+
+template <typename D>
+DeserializerRef<D> operator>>(D& deserializer, MessageType& type);
+
+/**
+ * Position of a (step, type) pair in a flat table of every possible tag.
+ */
+constexpr size_t msg_tag_index(MessageStep step, MessageType type)
+{
+    return (size_t) step * MSG_TYPE_COUNT + (size_t) type;
+}
+
+constexpr size_t MSG_TAG_COUNT = MSG_STEP_COUNT * MSG_TYPE_COUNT;
 
 class MessageTag : public Serializable, public Deserializable {
     public:
@@ -127,6 +155,11 @@ class MessageTag : public Serializable, public Deserializable {
 
         std::string to_string() const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
@@ -142,6 +175,11 @@ class MessageHeader : public Serializable, public Deserializable {
         void fill_req();
         void fill_resp(uint64_t seqn);
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
@@ -171,14 +209,25 @@ class MessageBody : public Serializable, public Deserializable {
 
 class MessageNopAck : public MessageBody {
     public:
+        static constexpr MessageStep STEP = MSG_ACK;
+        static constexpr MessageType TYPE = MSG_NOP;
+
         virtual MessageTag tag() const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
 class MessageErrorResp : public MessageBody {
     public:
+        static constexpr MessageStep STEP = MSG_RESP;
+        static constexpr MessageType TYPE = MSG_ERROR;
+
         MessageError error;
 
         MessageErrorResp();
@@ -186,12 +235,20 @@ class MessageErrorResp : public MessageBody {
 
         virtual MessageTag tag() const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
 class MessageClientConnReq : public MessageBody {
     public:
+        static constexpr MessageStep STEP = MSG_REQ;
+        static constexpr MessageType TYPE = MSG_CLIENT_CONN;
+
         Username username;
 
         MessageClientConnReq();
@@ -199,72 +256,136 @@ class MessageClientConnReq : public MessageBody {
 
         virtual MessageTag tag() const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
 class MessageClientConnResp : public MessageBody {
     public:
+        static constexpr MessageStep STEP = MSG_RESP;
+        static constexpr MessageType TYPE = MSG_CLIENT_CONN;
+
         virtual MessageTag tag() const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
 class MessageServerConnReq : public MessageBody {
     public:
+        static constexpr MessageStep STEP = MSG_REQ;
+        static constexpr MessageType TYPE = MSG_SERVER_CONN;
+
         MessageServerConnReq();
 
         virtual MessageTag tag() const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
 class MessageServerConnResp : public MessageBody {
     public:
+        static constexpr MessageStep STEP = MSG_RESP;
+        static constexpr MessageType TYPE = MSG_SERVER_CONN;
+
         virtual MessageTag tag() const;
         std::set<Address> members;
         std::optional<Address> coordinator;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
 class MessageDisconnectReq : public MessageBody {
     public:
+        static constexpr MessageStep STEP = MSG_REQ;
+        static constexpr MessageType TYPE = MSG_DISCONNECT;
+
         virtual MessageTag tag() const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
 class MessageDisconnectResp : public MessageBody {
     public:
+        static constexpr MessageStep STEP = MSG_RESP;
+        static constexpr MessageType TYPE = MSG_DISCONNECT;
+
         virtual MessageTag tag() const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
 class MessagePingReq : public MessageBody {
     public:
+        static constexpr MessageStep STEP = MSG_REQ;
+        static constexpr MessageType TYPE = MSG_PING;
+
         virtual MessageTag tag() const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
 class MessagePingResp : public MessageBody {
     public:
+        static constexpr MessageStep STEP = MSG_RESP;
+        static constexpr MessageType TYPE = MSG_PING;
+
         virtual MessageTag tag() const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
 class MessageFollowReq : public MessageBody {
     public:
+        static constexpr MessageStep STEP = MSG_REQ;
+        static constexpr MessageType TYPE = MSG_FOLLOW;
+
         Username username;
 
         MessageFollowReq();
@@ -272,20 +393,36 @@ class MessageFollowReq : public MessageBody {
 
         virtual MessageTag tag() const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
 class MessageFollowResp : public MessageBody {
     public:
+        static constexpr MessageStep STEP = MSG_RESP;
+        static constexpr MessageType TYPE = MSG_FOLLOW;
+
         virtual MessageTag tag() const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
 class MessageNotifyReq : public MessageBody {
     public:
+        static constexpr MessageStep STEP = MSG_REQ;
+        static constexpr MessageType TYPE = MSG_NOTIFY;
+
         NotifMessage notif_message;
 
         MessageNotifyReq();
@@ -293,20 +430,36 @@ class MessageNotifyReq : public MessageBody {
 
         virtual MessageTag tag() const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
 class MessageNotifyResp : public MessageBody {
     public:
+        static constexpr MessageStep STEP = MSG_RESP;
+        static constexpr MessageType TYPE = MSG_NOTIFY;
+
         virtual MessageTag tag() const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
 class MessageDeliverReq : public MessageBody {
     public:
+        static constexpr MessageStep STEP = MSG_REQ;
+        static constexpr MessageType TYPE = MSG_DELIVER;
+
         Username sender;
         NotifMessage notif_message;
         int64_t sent_at;
@@ -320,28 +473,52 @@ class MessageDeliverReq : public MessageBody {
 
         virtual MessageTag tag() const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
 class MessageDeliverResp : public MessageBody {
     public:
+        static constexpr MessageStep STEP = MSG_RESP;
+        static constexpr MessageType TYPE = MSG_DELIVER;
+
         virtual MessageTag tag() const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
 class MessageRmLookupReq : public MessageBody {
     public:
+        static constexpr MessageStep STEP = MSG_REQ;
+        static constexpr MessageType TYPE = MSG_RM_LOOKUP;
+
         virtual MessageTag tag() const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
 class MessageRmLookupResp : public MessageBody {
     public:
+        static constexpr MessageStep STEP = MSG_RESP;
+        static constexpr MessageType TYPE = MSG_RM_LOOKUP;
+
         std::set<Address> rms;
         std::optional<Address> primary;
 
@@ -353,6 +530,148 @@ class MessageRmLookupResp : public MessageBody {
     
         virtual MessageTag tag() const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
+        virtual void serialize(Serializer& serializer) const;
+        virtual void deserialize(Deserializer& deserializer);
+};
+
+/**
+ * Maps tags to message bodies through a flat table indexed by msg_tag_index,
+ * built at compile time from the list of bodies. Each body must declare its
+ * tag as STEP and TYPE constants.
+ */
+template <typename... Bodies>
+class MessageBodyRegistry {
+    public:
+        /**
+         * Creates a default body for the given tag, or returns null if no
+         * body is registered with it.
+         */
+        static std::shared_ptr<MessageBody> make(MessageTag const& tag);
+
+        /**
+         * Writes the body, registered with the given tag, through the concrete
+         * serializer S, so the fields of the body are written with direct
+         * calls. Returns false if no body is registered with the tag.
+         */
+        template <typename S>
+        static bool encode(
+            S& serializer,
+            MessageTag const& tag,
+            MessageBody const& body
+        );
+
+        /**
+         * Creates the body for the given tag and reads it through the concrete
+         * deserializer D, or returns null if no body is registered with it.
+         */
+        template <typename D>
+        static std::shared_ptr<MessageBody> decode(
+            D& deserializer,
+            MessageTag const& tag
+        );
+
+        static constexpr bool contains(MessageStep step, MessageType type);
+
+    private:
+        template <typename Entry>
+        using Table = std::array<Entry, MSG_TAG_COUNT>;
+
+        template <typename T>
+        static std::shared_ptr<MessageBody> make_body();
+
+        template <typename S, typename T>
+        static void encode_body(S& serializer, MessageBody const& body);
+
+        template <typename D, typename T>
+        static std::shared_ptr<MessageBody> decode_body(D& deserializer);
+
+        template <typename Entry>
+        static constexpr Table<Entry> make_table(
+            std::array<Entry, sizeof...(Bodies)> entries
+        );
+
+        template <typename Entry>
+        static Entry lookup(Table<Entry> const& table, MessageTag const& tag);
+
+        static constexpr bool has_unique_tags();
+};
+
+/**
+ * Every body a message can carry. Adding a message type means adding it here.
+ */
+using MessageBodies = MessageBodyRegistry<
+    MessageNopAck,
+    MessageErrorResp,
+    MessageClientConnReq,
+    MessageClientConnResp,
+    MessageServerConnReq,
+    MessageServerConnResp,
+    MessageDisconnectReq,
+    MessageDisconnectResp,
+    MessagePingReq,
+    MessagePingResp,
+    MessageFollowReq,
+    MessageFollowResp,
+    MessageNotifyReq,
+    MessageNotifyResp,
+    MessageDeliverReq,
+    MessageDeliverResp,
+    MessageRmLookupReq,
+    MessageRmLookupResp
+>;
+
+/**
+ * Body kept as the bytes it is encoded to, from the offset to the end of the
+ * datagram.
+ *
+ * Received bodies start out this way: only the tag is known, which is enough
+ * to answer or drop duplicates, and decode parses the bytes when the body is
+ * actually needed. The body owns the datagram it came from, so it is moved in
+ * rather than copied, and a pooled receive buffer goes back to its pool once
+ * the body is dropped.
+ *
+ * A body sent to many receivers can be encoded once with from_body; encoding
+ * a message with it in the same wire format then only encodes the header.
+ */
+class MessageRawBody final : public MessageBody {
+    private:
+        MessageTag tag_;
+        WireFormat wire_format_;
+        DatagramBuffer datagram;
+        size_t offset;
+
+    public:
+        MessageRawBody(
+            MessageTag tag,
+            WireFormat wire_format,
+            DatagramBuffer&& datagram,
+            size_t offset
+        );
+
+        static std::shared_ptr<MessageRawBody> from_body(
+            WireFormat wire_format,
+            MessageBody const& body
+        );
+
+        virtual MessageTag tag() const;
+
+        WireFormat wire_format() const;
+
+        char const *data() const;
+
+        size_t size() const;
+
+        /**
+         * Decodes the bytes from the offset to the end of the datagram as the
+         * body registered with the tag.
+         */
+        std::shared_ptr<MessageBody> decode() const;
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
@@ -362,6 +681,37 @@ class Message : public Serializable, public Deserializable {
         MessageHeader header;
         std::shared_ptr<MessageBody> body;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
+        /**
+         * Writes the magic number, the header and the given tag, i.e.
+         * everything but the body.
+         */
+        template <typename S>
+        void encode_header(S& serializer, MessageTag const& tag) const;
+
+        /**
+         * Reads only the magic number, the header and the tag, leaving the
+         * deserializer at the first byte of the body. Throws if no body is
+         * registered with the tag.
+         */
+        template <typename D>
+        MessageTag decode_header(D& deserializer);
+
+        /**
+         * Replaces a MessageRawBody by the body it encodes. Does nothing if
+         * the body is already decoded.
+         */
+        void decode_body();
+
+        /**
+         * The body, if it is a MessageRawBody, or null otherwise.
+         */
+        MessageRawBody const *raw_body() const;
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
@@ -373,8 +723,503 @@ class Enveloped {
 
         Address remote;
         Message message;
+        /**
+         * When the kernel received the datagram, in nanoseconds since the
+         * epoch, if the socket was set to take receive timestamps.
+         */
+        std::optional<int64_t> received_at_nanos;
+
+        /**
+         * Nanoseconds elapsed since the kernel received the datagram, i.e.
+         * how long the message has waited in the socket buffer and in this
+         * process so far, if there is a receive timestamp.
+         */
+        std::optional<int64_t> queueing_delay_nanos() const;
 };
 
+template <typename S>
+SerializerRef<S> operator<<(S& serializer, MessageError error)
+{
+    uint16_t code = error;
+    serializer << code;
+    return serializer;
+}
+
+template <typename D>
+DeserializerRef<D> operator>>(D& deserializer, MessageError& error)
+{
+    uint16_t code;
+    deserializer >> code;
+    error = msg_error_from_code(code);
+    return deserializer;
+}
+
+template <typename S>
+SerializerRef<S> operator<<(S& serializer, MessageStep step)
+{
+    uint16_t code = step;
+    serializer << code;
+    return serializer;
+}
+
+template <typename D>
+DeserializerRef<D> operator>>(D& deserializer, MessageStep& step)
+{
+    uint16_t code;
+    deserializer >> code;
+    step = msg_step_from_code(code);
+    return deserializer;
+}
+
+template <typename S>
+SerializerRef<S> operator<<(S& serializer, MessageType type)
+{
+    uint16_t code = type;
+    serializer << code;
+    return serializer;
+}
+
+template <typename D>
+DeserializerRef<D> operator>>(D& deserializer, MessageType& type)
+{
+    uint16_t code;
+    deserializer >> code;
+    type = msg_type_from_code(code);
+    return deserializer;
+}
+
+template <typename S>
+void MessageTag::encode(S& serializer) const
+{
+    serializer << this->step << this->type;
+}
+
+template <typename D>
+void MessageTag::decode(D& deserializer)
+{
+    deserializer >> this->step >> this->type;
+}
+
+template <typename S>
+void MessageHeader::encode(S& serializer) const
+{
+    serializer << this->seqn;
+    serializer.serialize_timestamp(this->timestamp);
+    serializer << this->election_counter;
+}
+
+template <typename D>
+void MessageHeader::decode(D& deserializer)
+{
+    deserializer >> this->seqn;
+    deserializer.deserialize_timestamp(this->timestamp);
+    deserializer >> this->election_counter;
+}
+
+template <typename S>
+void MessageNopAck::encode(S& serializer) const
+{
+}
+
+template <typename D>
+void MessageNopAck::decode(D& deserializer)
+{
+}
+
+template <typename S>
+void MessageErrorResp::encode(S& serializer) const
+{
+    serializer << (uint64_t) this->error;
+}
+
+template <typename D>
+void MessageErrorResp::decode(D& deserializer)
+{
+    uint64_t code;
+    deserializer >> code;
+    this->error = msg_error_from_code(code);
+}
+
+template <typename S>
+void MessageClientConnReq::encode(S& serializer) const
+{
+    serializer << this->username;
+}
+
+template <typename D>
+void MessageClientConnReq::decode(D& deserializer)
+{
+    deserializer >> this->username;
+}
+
+template <typename S>
+void MessageClientConnResp::encode(S& serializer) const
+{
+}
+
+template <typename D>
+void MessageClientConnResp::decode(D& deserializer)
+{
+}
+
+template <typename S>
+void MessageServerConnReq::encode(S& serializer) const
+{
+}
+
+template <typename D>
+void MessageServerConnReq::decode(D& deserializer)
+{
+}
+
+template <typename S>
+void MessageServerConnResp::encode(S& serializer) const
+{
+    serializer << this->members << this->coordinator;
+}
+
+template <typename D>
+void MessageServerConnResp::decode(D& deserializer)
+{
+    deserializer >> this->members >> this->coordinator;
+}
+
+template <typename S>
+void MessageDisconnectReq::encode(S& serializer) const
+{
+}
+
+template <typename D>
+void MessageDisconnectReq::decode(D& deserializer)
+{
+}
+
+template <typename S>
+void MessageDisconnectResp::encode(S& serializer) const
+{
+}
+
+template <typename D>
+void MessageDisconnectResp::decode(D& deserializer)
+{
+}
+
+template <typename S>
+void MessagePingReq::encode(S& serializer) const
+{
+}
+
+template <typename D>
+void MessagePingReq::decode(D& deserializer)
+{
+}
+
+template <typename S>
+void MessagePingResp::encode(S& serializer) const
+{
+}
+
+template <typename D>
+void MessagePingResp::decode(D& deserializer)
+{
+}
+
+template <typename S>
+void MessageFollowReq::encode(S& serializer) const
+{
+    serializer << this->username;
+}
+
+template <typename D>
+void MessageFollowReq::decode(D& deserializer)
+{
+    deserializer >> this->username;
+}
+
+template <typename S>
+void MessageFollowResp::encode(S& serializer) const
+{
+}
+
+template <typename D>
+void MessageFollowResp::decode(D& deserializer)
+{
+}
+
+template <typename S>
+void MessageNotifyReq::encode(S& serializer) const
+{
+    serializer << this->notif_message;
+}
+
+template <typename D>
+void MessageNotifyReq::decode(D& deserializer)
+{
+    deserializer >> this->notif_message;
+}
+
+template <typename S>
+void MessageNotifyResp::encode(S& serializer) const
+{
+}
+
+template <typename D>
+void MessageNotifyResp::decode(D& deserializer)
+{
+}
+
+template <typename S>
+void MessageDeliverReq::encode(S& serializer) const
+{
+    serializer << this->sender << this->notif_message;
+    serializer.serialize_timestamp(this->sent_at);
+}
+
+template <typename D>
+void MessageDeliverReq::decode(D& deserializer)
+{
+    deserializer >> this->sender >> this->notif_message;
+    deserializer.deserialize_timestamp(this->sent_at);
+}
+
+template <typename S>
+void MessageDeliverResp::encode(S& serializer) const
+{
+}
+
+template <typename D>
+void MessageDeliverResp::decode(D& deserializer)
+{
+}
+
+template <typename S>
+void MessageRmLookupReq::encode(S& serializer) const
+{
+}
+
+template <typename D>
+void MessageRmLookupReq::decode(D& deserializer)
+{
+}
+
+template <typename S>
+void MessageRmLookupResp::encode(S& serializer) const
+{
+    serializer << this->rms << this-> primary;
+}
+
+template <typename D>
+void MessageRmLookupResp::decode(D& deserializer)
+{
+    deserializer >> this->rms >> this-> primary;
+}
+
+template <typename... Bodies>
+std::shared_ptr<MessageBody> MessageBodyRegistry<Bodies...>::make(
+    MessageTag const& tag
+)
+{
+    using Factory = std::shared_ptr<MessageBody> (*)();
+    static constexpr Table<Factory> table = MessageBodyRegistry::make_table(
+        std::array<Factory, sizeof...(Bodies)> {
+            &MessageBodyRegistry::make_body<Bodies>...
+        }
+    );
+
+    Factory factory = MessageBodyRegistry::lookup(table, tag);
+    if (factory == nullptr) {
+        return std::shared_ptr<MessageBody>();
+    }
+    return factory();
+}
+
+template <typename... Bodies>
+template <typename S>
+bool MessageBodyRegistry<Bodies...>::encode(
+    S& serializer,
+    MessageTag const& tag,
+    MessageBody const& body
+)
+{
+    using Encoder = void (*)(S&, MessageBody const&);
+    static constexpr Table<Encoder> table = MessageBodyRegistry::make_table(
+        std::array<Encoder, sizeof...(Bodies)> {
+            &MessageBodyRegistry::encode_body<S, Bodies>...
+        }
+    );
+
+    Encoder encoder = MessageBodyRegistry::lookup(table, tag);
+    if (encoder == nullptr) {
+        return false;
+    }
+    encoder(serializer, body);
+    return true;
+}
+
+template <typename... Bodies>
+template <typename D>
+std::shared_ptr<MessageBody> MessageBodyRegistry<Bodies...>::decode(
+    D& deserializer,
+    MessageTag const& tag
+)
+{
+    using Decoder = std::shared_ptr<MessageBody> (*)(D&);
+    static constexpr Table<Decoder> table = MessageBodyRegistry::make_table(
+        std::array<Decoder, sizeof...(Bodies)> {
+            &MessageBodyRegistry::decode_body<D, Bodies>...
+        }
+    );
+
+    Decoder decoder = MessageBodyRegistry::lookup(table, tag);
+    if (decoder == nullptr) {
+        return std::shared_ptr<MessageBody>();
+    }
+    return decoder(deserializer);
+}
+
+template <typename... Bodies>
+constexpr bool MessageBodyRegistry<Bodies...>::contains(
+    MessageStep step,
+    MessageType type
+)
+{
+    return ((Bodies::STEP == step && Bodies::TYPE == type) || ...);
+}
+
+template <typename... Bodies>
+template <typename T>
+std::shared_ptr<MessageBody> MessageBodyRegistry<Bodies...>::make_body()
+{
+    return make_pooled<T>();
+}
+
+template <typename... Bodies>
+template <typename S, typename T>
+void MessageBodyRegistry<Bodies...>::encode_body(
+    S& serializer,
+    MessageBody const& body
+)
+{
+    static_cast<T const&>(body).encode(serializer);
+}
+
+template <typename... Bodies>
+template <typename D, typename T>
+std::shared_ptr<MessageBody> MessageBodyRegistry<Bodies...>::decode_body(
+    D& deserializer
+)
+{
+    std::shared_ptr<T> body = make_pooled<T>();
+    body->decode(deserializer);
+    return body;
+}
+
+template <typename... Bodies>
+template <typename Entry>
+constexpr typename MessageBodyRegistry<Bodies...>::template Table<Entry>
+    MessageBodyRegistry<Bodies...>::make_table(
+        std::array<Entry, sizeof...(Bodies)> entries
+    )
+{
+    static_assert(
+        MessageBodyRegistry::has_unique_tags(),
+        "a message tag is registered more than once"
+    );
+    size_t indices[] = { msg_tag_index(Bodies::STEP, Bodies::TYPE)... };
+    Table<Entry> table {};
+    for (size_t i = 0; i < sizeof...(Bodies); i++) {
+        table[indices[i]] = entries[i];
+    }
+    return table;
+}
+
+template <typename... Bodies>
+template <typename Entry>
+Entry MessageBodyRegistry<Bodies...>::lookup(
+    Table<Entry> const& table,
+    MessageTag const& tag
+)
+{
+    size_t index = msg_tag_index(tag.step, tag.type);
+    if (index >= table.size()) {
+        return nullptr;
+    }
+    return table[index];
+}
+
+template <typename... Bodies>
+constexpr bool MessageBodyRegistry<Bodies...>::has_unique_tags()
+{
+    size_t indices[] = { msg_tag_index(Bodies::STEP, Bodies::TYPE)... };
+    std::array<bool, MSG_TAG_COUNT> seen {};
+    for (size_t i = 0; i < sizeof...(Bodies); i++) {
+        if (seen[indices[i]]) {
+            return false;
+        }
+        seen[indices[i]] = true;
+    }
+    return true;
+}
+
+template <typename S>
+void Message::encode(S& serializer) const
+{
+    MessageBody const *body = this->body.get();
+    std::shared_ptr<MessageBody> decoded;
+    if (MessageRawBody const *raw_body = this->raw_body()) {
+        if constexpr (WritesEncoded<S>::value) {
+            if (raw_body->wire_format() == S::WIRE_FORMAT) {
+                this->encode_header(serializer, raw_body->tag());
+                serializer.write_encoded(raw_body->data(), raw_body->size());
+                return;
+            }
+        }
+        decoded = raw_body->decode();
+        body = decoded.get();
+    }
+
+    MessageTag tag = body->tag();
+    this->encode_header(serializer, tag);
+    if (!MessageBodies::encode(serializer, tag, *body)) {
+        serializer << *body;
+    }
+}
+
+template <typename S>
+void Message::encode_header(S& serializer, MessageTag const& tag) const
+{
+    serializer << MSG_MAGIC_NUMBER << this->header << tag;
+}
+
+template <typename D>
+void Message::decode(D& deserializer)
+{
+    MessageTag tag = this->decode_header(deserializer);
+    this->body = MessageBodies::decode(deserializer, tag);
+}
+
+template <typename D>
+MessageTag Message::decode_header(D& deserializer)
+{
+    try {
+        uint64_t maybe_magic_number;
+        deserializer >> maybe_magic_number;
+        if (maybe_magic_number != MSG_MAGIC_NUMBER) {
+            throw MessageOutOfProtocol();
+        }
+    } catch (DeserializationUnexpectedEof const& exc) {
+        throw MessageOutOfProtocol();
+    }
+    MessageTag tag;
+    deserializer >> this->header >> tag;
+    if (!MessageBodies::contains(tag.step, tag.type)) {
+        throw InvalidMessagePayload(
+            std::string("invalid message tag:  ") + tag.to_string()
+        );
+    }
+    return tag;
+}
+
 template <typename T>
 T& MessageBody::cast()
 {
@@ -78,13 +78,10 @@ bool NotifMessage::operator>=(NotifMessage const& other) const
 
 void NotifMessage::serialize(Serializer& serializer) const
 {
-    serializer << this->content();
+    this->encode(serializer);
 }
 
 void NotifMessage::deserialize(Deserializer& deserializer)
 {
-    std::string content;
-    deserializer >> content;
-    NotifMessage username(content);
-    *this = std::move(username);
+    this->decode(deserializer);
 }
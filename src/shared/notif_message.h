@@ -41,8 +41,28 @@ class NotifMessage : public Serializable, public Deserializable {
         bool operator>(NotifMessage const& other) const;
         bool operator>=(NotifMessage const& other) const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
+template <typename S>
+void NotifMessage::encode(S& serializer) const
+{
+    serializer << this->content();
+}
+
+template <typename D>
+void NotifMessage::decode(D& deserializer)
+{
+    std::string content;
+    deserializer >> content;
+    NotifMessage username(content);
+    *this = std::move(username);
+}
+
 #endif
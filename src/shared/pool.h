@@ -0,0 +1,339 @@
+#ifndef SHARED_POOL_H_
+#define SHARED_POOL_H_ 1
+
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <utility>
+
+/**
+ * Maximum number of freed blocks a thread keeps around per block type. Blocks
+ * freed beyond that go back to the global heap.
+ */
+constexpr size_t POOL_MAX_FREE_BLOCKS = 1024;
+
+/**
+ * Allocator that recycles single-object blocks through a free list of the
+ * thread that allocated them. With std::allocate_shared, the object and its
+ * control block live in one block, which is reused once the last reference
+ * drops, so steady-state allocation of short-lived objects, e.g. message
+ * bodies, does not touch the global heap.
+ *
+ * Blocks are often freed by some other thread than the one that allocated
+ * them, e.g. a body decoded by the handler thread of a ReliableSocket is
+ * dropped by the thread that received the request. Such blocks are pushed
+ * onto a lock-free stack of the allocating thread, which takes them all back
+ * once its own free list runs dry.
+ */
+template <typename T>
+class PoolAllocator {
+    public:
+        using value_type = T;
+
+        PoolAllocator() noexcept;
+
+        template <typename U>
+        PoolAllocator(PoolAllocator<U> const& other) noexcept;
+
+        T *allocate(size_t count);
+
+        void deallocate(T *block, size_t count) noexcept;
+
+    private:
+        class FreeBlock {
+            public:
+                FreeBlock *next;
+        };
+
+        /**
+         * Blocks allocated by a single thread. Only that thread touches the
+         * free list, while any thread may push onto the returned stack. It
+         * outlives the thread for as long as some of its blocks are alive.
+         */
+        class Owner {
+            public:
+                FreeBlock *head;
+                size_t size;
+                std::atomic<FreeBlock *> returned;
+                /**
+                 * Set once the thread exits, after which blocks go back to
+                 * the global heap instead.
+                 */
+                std::atomic<bool> closed;
+                /**
+                 * One for the thread, plus one for each block taken from the
+                 * global heap and not given back to it yet.
+                 */
+                std::atomic<size_t> refs;
+
+                Owner();
+
+                /**
+                 * Moves the returned blocks into the free list, giving back
+                 * to the global heap those beyond POOL_MAX_FREE_BLOCKS.
+                 */
+                void collect() noexcept;
+
+                /**
+                 * Pushes a block freed by some other thread onto the returned
+                 * stack.
+                 */
+                void give_back(FreeBlock *block) noexcept;
+
+                /**
+                 * Gives every returned block back to the global heap.
+                 */
+                void drain() noexcept;
+
+                /**
+                 * Drops the given number of references, deleting this once
+                 * none is left.
+                 */
+                void release(size_t count) noexcept;
+        };
+
+        class ThreadOwner {
+            public:
+                Owner *owner;
+
+                ThreadOwner();
+                ~ThreadOwner();
+        };
+
+        /**
+         * Every single-object block starts with the owner it goes back to,
+         * or nullptr if it was allocated while its thread was exiting. The
+         * object follows, aligned as operator new would align it. While the
+         * block is free, the header holds the link to the next free block.
+         */
+        static constexpr size_t HEADER_SIZE =
+            (sizeof(Owner *) + __STDCPP_DEFAULT_NEW_ALIGNMENT__ - 1)
+                / __STDCPP_DEFAULT_NEW_ALIGNMENT__
+                * __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+        static constexpr size_t BLOCK_SIZE = HEADER_SIZE + sizeof(T);
+
+        static_assert(
+            alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__,
+            "over-aligned types cannot be pooled"
+        );
+
+        static_assert(
+            sizeof(FreeBlock) <= HEADER_SIZE,
+            "the link of a free block must fit in its header"
+        );
+
+        /**
+         * The owner of the calling thread, or nullptr if the thread is
+         * exiting.
+         */
+        static Owner *thread_owner() noexcept;
+};
+
+template <typename T, typename U>
+bool operator==(PoolAllocator<T> const& left, PoolAllocator<U> const& right);
+
+template <typename T, typename U>
+bool operator!=(PoolAllocator<T> const& left, PoolAllocator<U> const& right);
+
+/**
+ * Same as std::make_shared, but the single allocation comes from a
+ * PoolAllocator.
+ */
+template <typename T, typename... Args>
+std::shared_ptr<T> make_pooled(Args&&... args);
+
+template <typename T>
+PoolAllocator<T>::PoolAllocator() noexcept
+{
+}
+
+template <typename T>
+template <typename U>
+PoolAllocator<T>::PoolAllocator(PoolAllocator<U> const& other) noexcept
+{
+}
+
+template <typename T>
+T *PoolAllocator<T>::allocate(size_t count)
+{
+    if (count != 1) {
+        return static_cast<T *>(::operator new(count * sizeof(T)));
+    }
+
+    Owner *owner = PoolAllocator::thread_owner();
+    if (owner != nullptr && owner->head == nullptr) {
+        owner->collect();
+    }
+
+    char *start;
+    if (owner != nullptr && owner->head != nullptr) {
+        FreeBlock *block = owner->head;
+        owner->head = block->next;
+        owner->size--;
+        start = reinterpret_cast<char *>(block);
+    } else {
+        start = static_cast<char *>(::operator new(BLOCK_SIZE));
+        if (owner != nullptr) {
+            owner->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    *reinterpret_cast<Owner **>(start) = owner;
+    return reinterpret_cast<T *>(start + HEADER_SIZE);
+}
+
+template <typename T>
+void PoolAllocator<T>::deallocate(T *block, size_t count) noexcept
+{
+    if (count != 1) {
+        ::operator delete(block);
+        return;
+    }
+
+    char *start = reinterpret_cast<char *>(block) - HEADER_SIZE;
+    Owner *owner = *reinterpret_cast<Owner **>(start);
+    FreeBlock *free_block = reinterpret_cast<FreeBlock *>(start);
+
+    if (owner == nullptr) {
+        ::operator delete(start);
+    } else if (owner == PoolAllocator::thread_owner()) {
+        if (owner->size < POOL_MAX_FREE_BLOCKS) {
+            free_block->next = owner->head;
+            owner->head = free_block;
+            owner->size++;
+        } else {
+            ::operator delete(start);
+            owner->release(1);
+        }
+    } else if (owner->closed.load()) {
+        ::operator delete(start);
+        owner->release(1);
+    } else {
+        owner->give_back(free_block);
+    }
+}
+
+template <typename T>
+PoolAllocator<T>::Owner::Owner() :
+    head(nullptr),
+    size(0),
+    returned(nullptr),
+    closed(false),
+    refs(1)
+{
+}
+
+template <typename T>
+void PoolAllocator<T>::Owner::collect() noexcept
+{
+    FreeBlock *block = this->returned.exchange(nullptr);
+    size_t freed = 0;
+    while (block != nullptr) {
+        FreeBlock *next = block->next;
+        if (this->size < POOL_MAX_FREE_BLOCKS) {
+            block->next = this->head;
+            this->head = block;
+            this->size++;
+        } else {
+            ::operator delete(block);
+            freed++;
+        }
+        block = next;
+    }
+    if (freed > 0) {
+        this->release(freed);
+    }
+}
+
+template <typename T>
+void PoolAllocator<T>::Owner::give_back(FreeBlock *block) noexcept
+{
+    this->refs.fetch_add(1, std::memory_order_relaxed);
+    block->next = this->returned.load(std::memory_order_relaxed);
+    while (!this->returned.compare_exchange_weak(block->next, block)) {
+    }
+    if (this->closed.load()) {
+        this->drain();
+    }
+    this->release(1);
+}
+
+template <typename T>
+void PoolAllocator<T>::Owner::drain() noexcept
+{
+    FreeBlock *block = this->returned.exchange(nullptr);
+    size_t freed = 0;
+    while (block != nullptr) {
+        FreeBlock *next = block->next;
+        ::operator delete(block);
+        freed++;
+        block = next;
+    }
+    if (freed > 0) {
+        this->release(freed);
+    }
+}
+
+template <typename T>
+void PoolAllocator<T>::Owner::release(size_t count) noexcept
+{
+    if (this->refs.fetch_sub(count, std::memory_order_acq_rel) == count) {
+        delete this;
+    }
+}
+
+template <typename T>
+PoolAllocator<T>::ThreadOwner::ThreadOwner() : owner(new Owner())
+{
+}
+
+template <typename T>
+PoolAllocator<T>::ThreadOwner::~ThreadOwner()
+{
+    Owner *owner = this->owner;
+    this->owner = nullptr;
+    owner->closed.store(true);
+
+    size_t freed = 0;
+    while (owner->head != nullptr) {
+        FreeBlock *block = owner->head;
+        owner->head = block->next;
+        ::operator delete(block);
+        freed++;
+    }
+    owner->size = 0;
+
+    owner->drain();
+    owner->release(freed + 1);
+}
+
+template <typename T>
+typename PoolAllocator<T>::Owner *PoolAllocator<T>::thread_owner() noexcept
+{
+    static thread_local ThreadOwner thread_owner;
+    return thread_owner.owner;
+}
+
+template <typename T, typename U>
+bool operator==(PoolAllocator<T> const& left, PoolAllocator<U> const& right)
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(PoolAllocator<T> const& left, PoolAllocator<U> const& right)
+{
+    return false;
+}
+
+template <typename T, typename... Args>
+std::shared_ptr<T> make_pooled(Args&&... args)
+{
+    return std::allocate_shared<T>(
+        PoolAllocator<T>(),
+        std::forward<Args>(args)...
+    );
+}
+
+#endif
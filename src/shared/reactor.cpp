@@ -0,0 +1,154 @@
+#include "reactor.h"
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+ReactorError::ReactorError(std::string const& message) :
+    full_message(message),
+    c_errno_(errno),
+    message(message)
+{
+    this->full_message += ": ";
+    this->full_message += strerror(errno);
+}
+
+int ReactorError::c_errno() const
+{
+    return this->c_errno_;
+}
+
+const char *ReactorError::what() const noexcept
+{
+    return this->full_message.c_str();
+}
+
+Reactor::Reactor() : woken_(false)
+{
+    this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (this->epoll_fd < 0) {
+        throw ReactorError("epoll create");
+    }
+
+    this->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (this->event_fd < 0) {
+        ReactorError error("eventfd create");
+        close(this->epoll_fd);
+        throw error;
+    }
+
+    struct epoll_event event;
+    bzero(&event, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = this->event_fd;
+    if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->event_fd, &event) < 0) {
+        ReactorError error("epoll watch eventfd");
+        close(this->event_fd);
+        close(this->epoll_fd);
+        throw error;
+    }
+}
+
+Reactor::~Reactor()
+{
+    close(this->event_fd);
+    close(this->epoll_fd);
+}
+
+void Reactor::watch(int fd)
+{
+    struct epoll_event event;
+    bzero(&event, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        if (errno != EPERM) {
+            throw ReactorError("epoll watch");
+        }
+        std::unique_lock lock(this->control_mutex);
+        this->always_readable.insert(fd);
+    }
+}
+
+void Reactor::unwatch(int fd)
+{
+    {
+        std::unique_lock lock(this->control_mutex);
+        if (this->always_readable.erase(fd) > 0) {
+            return;
+        }
+    }
+    if (epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, fd, nullptr) < 0) {
+        if (errno != ENOENT) {
+            throw ReactorError("epoll unwatch");
+        }
+    }
+}
+
+void Reactor::wake()
+{
+    this->woken_.store(true);
+    uint64_t increment = 1;
+    write(this->event_fd, &increment, sizeof(increment));
+}
+
+bool Reactor::woken() const
+{
+    return this->woken_.load();
+}
+
+ReactorEvent Reactor::wait(int timeout_ms)
+{
+    if (this->woken()) {
+        return REACTOR_WOKEN;
+    }
+    {
+        std::unique_lock lock(this->control_mutex);
+        if (!this->always_readable.empty()) {
+            return REACTOR_READABLE;
+        }
+    }
+
+    struct epoll_event events[2];
+    int count;
+    do {
+        count = epoll_wait(
+            this->epoll_fd,
+            events,
+            sizeof(events) / sizeof(events[0]),
+            timeout_ms
+        );
+        if (count < 0 && errno != EINTR) {
+            throw ReactorError("epoll wait");
+        }
+    } while (count < 0 && !this->woken());
+
+    if (this->woken()) {
+        return REACTOR_WOKEN;
+    }
+    if (count == 0) {
+        return REACTOR_TIMED_OUT;
+    }
+    return REACTOR_READABLE;
+}
+
+bool Reactor::wait_woken(int timeout_ms)
+{
+    if (this->woken()) {
+        return true;
+    }
+
+    struct pollfd fds[1];
+    fds[0].fd = this->event_fd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+
+    int status = poll(fds, sizeof(fds) / sizeof(fds[0]), timeout_ms);
+    if (status < 0 && errno != EINTR) {
+        throw ReactorError("reactor poll");
+    }
+    return this->woken();
+}
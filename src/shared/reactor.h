@@ -0,0 +1,88 @@
+#ifndef SHARED_REACTOR_H_
+#define SHARED_REACTOR_H_ 1
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <stdexcept>
+
+class ReactorError : public std::exception {
+    private:
+        std::string full_message;
+        int c_errno_;
+        std::string message;
+
+    public:
+        ReactorError(std::string const& message);
+        int c_errno() const;
+        virtual const char *what() const noexcept;
+};
+
+enum ReactorEvent {
+    /**
+     * A watched file descriptor is readable.
+     */
+    REACTOR_READABLE,
+    /**
+     * The reactor was woken up, see Reactor::wake.
+     */
+    REACTOR_WOKEN,
+    /**
+     * The timeout elapsed first.
+     */
+    REACTOR_TIMED_OUT
+};
+
+/**
+ * Waits with epoll for watched file descriptors to become readable, or for a
+ * wake-up signalled through an eventfd, so that threads blocked on input
+ * notice shutdown or disconnection right away instead of polling with a
+ * timeout.
+ */
+class Reactor {
+    private:
+        int epoll_fd;
+        int event_fd;
+        std::atomic<bool> woken_;
+        std::mutex control_mutex;
+        /**
+         * Descriptors epoll refuses to watch, such as regular files or
+         * /dev/null, which poll would report as always readable.
+         */
+        std::set<int> always_readable;
+
+    public:
+        Reactor();
+        Reactor(Reactor const& other) = delete;
+        Reactor& operator=(Reactor const& other) = delete;
+
+        ~Reactor();
+
+        void watch(int fd);
+
+        void unwatch(int fd);
+
+        /**
+         * Wakes every thread waiting on this reactor up, and makes every later
+         * wait return immediately as well. Async-signal-safe.
+         */
+        void wake();
+
+        bool woken() const;
+
+        /**
+         * Waits up to the timeout for a watched descriptor to be readable or
+         * for a wake-up, which takes precedence. A negative timeout waits
+         * forever.
+         */
+        ReactorEvent wait(int timeout_ms);
+
+        /**
+         * Waits up to the timeout for a wake-up only, ignoring the watched
+         * descriptors. Returns whether the reactor was woken.
+         */
+        bool wait_woken(int timeout_ms);
+};
+
+#endif
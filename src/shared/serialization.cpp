@@ -1,4 +1,7 @@
 #include <sstream>
+#include <charconv>
+#include <cctype>
+#include <cstring>
 #include "serialization.h"
 
 SerializationError::SerializationError(std::string const& message) :
@@ -42,10 +45,6 @@ DeserializationExpectedEof::DeserializationExpectedEof() : DeserializationError(
 {
 }
 
-Serializer::Serializer(std::ostream& stream) : stream(stream)
-{
-}
-
 Serializer& Serializer::operator<<(char const *data)
 {
     *this << std::string(data);
@@ -58,25 +57,25 @@ Serializer& Serializer::operator<<(Serializable const& data)
     return *this;
 }
 
-Serializer::~Serializer()
+Serializer& Serializer::serialize_timestamp(int64_t data)
 {
+    *this << data;
+    return *this;
 }
 
-Deserializer::Deserializer(std::istream& stream) : stream(stream)
+Serializer::~Serializer()
 {
 }
 
-Deserializer& Deserializer::ensure_eof()
+Deserializer& Deserializer::operator>>(Deserializable& data)
 {
-    if (!this->stream.eof()) {
-        throw DeserializationExpectedEof();
-    }
+    data.deserialize(*this);
     return *this;
 }
 
-Deserializer& Deserializer::operator>>(Deserializable& data)
+Deserializer& Deserializer::deserialize_timestamp(int64_t& data)
 {
-    data.deserialize(*this);
+    *this >> data;
     return *this;
 }
 
@@ -92,81 +91,241 @@ Deserializable::~Deserializable()
 {
 }
 
+/**
+ * Maximum number of characters of a plaintext integer, enough for the sign
+ * and the digits of any 64-bit integer.
+ */
+constexpr size_t PLAINTEXT_INT_MAX_LEN = 20;
+
+/**
+ * Same as append_plaintext_int, but writes the digits and the separator to a
+ * stream at once.
+ */
+template <typename T>
+static void write_plaintext_int(std::ostream& stream, T data)
+{
+    char digits[PLAINTEXT_INT_MAX_LEN + 1];
+    std::to_chars_result result =
+        std::to_chars(digits, digits + PLAINTEXT_INT_MAX_LEN, data);
+    *result.ptr = ';';
+    stream.write(digits, result.ptr + 1 - digits);
+}
+
+/**
+ * Parses the whole token as a decimal integer of type T, failing if it is
+ * empty, has stray characters or does not fit in T.
+ */
+template <typename T>
+static void parse_plaintext_int(
+    char const *token,
+    char const *end,
+    char const *type,
+    T& data
+)
+{
+    std::from_chars_result result = std::from_chars(token, end, data);
+    if (token == end || result.ptr != end || result.ec != std::errc()) {
+        throw PlaintextInvalidInt(type, std::string(token, end));
+    }
+}
+
+/**
+ * Reads a field up to the separator into a stack buffer and parses it with
+ * parse_plaintext_int. Fields too long to be an integer are rejected.
+ */
+template <typename T>
+static void read_plaintext_int(std::istream& stream, char const *type, T& data)
+{
+    char token[PLAINTEXT_INT_MAX_LEN];
+    size_t size = 0;
+    int byte;
+    while ((byte = stream.get()) != ';' && byte != EOF) {
+        if (size == PLAINTEXT_INT_MAX_LEN) {
+            std::string content(token, size);
+            content.push_back(byte);
+            while ((byte = stream.get()) != ';' && byte != EOF) {
+                content.push_back(byte);
+            }
+            throw PlaintextInvalidInt(type, content);
+        }
+        token[size] = byte;
+        size++;
+    }
+    if (byte == EOF) {
+        throw DeserializationUnexpectedEof();
+    }
+    parse_plaintext_int(token, token + size, type, data);
+}
+
 PlaintextSerializer::PlaintextSerializer(std::ostream& stream) :
-    Serializer(stream)
+    stream(stream)
 {
 }
 
-Serializer& PlaintextSerializer::operator<<(bool data)
+PlaintextSerializer& PlaintextSerializer::operator<<(bool data)
 {
     *this << (uint8_t) (data ? 1 : 0);
     return *this;
 }
 
-Serializer& PlaintextSerializer::operator<<(uint8_t data)
+PlaintextSerializer& PlaintextSerializer::operator<<(uint8_t data)
 {
-    *this << std::to_string(data);
+    write_plaintext_int(this->stream, data);
     return *this;
 }
 
-Serializer& PlaintextSerializer::operator<<(uint16_t data)
+PlaintextSerializer& PlaintextSerializer::operator<<(uint16_t data)
 {
-    *this << std::to_string(data);
+    write_plaintext_int(this->stream, data);
     return *this;
 }
 
-Serializer& PlaintextSerializer::operator<<(uint32_t data)
+PlaintextSerializer& PlaintextSerializer::operator<<(uint32_t data)
 {
-    *this << std::to_string(data);
+    write_plaintext_int(this->stream, data);
     return *this;
 }
 
-Serializer& PlaintextSerializer::operator<<(uint64_t data)
+PlaintextSerializer& PlaintextSerializer::operator<<(uint64_t data)
 {
-    *this << std::to_string(data);
+    write_plaintext_int(this->stream, data);
     return *this;
 }
 
-Serializer& PlaintextSerializer::operator<<(int8_t data)
+PlaintextSerializer& PlaintextSerializer::operator<<(int8_t data)
 {
-    *this << std::to_string(data);
+    write_plaintext_int(this->stream, data);
     return *this;
 }
 
-Serializer& PlaintextSerializer::operator<<(int16_t data)
+PlaintextSerializer& PlaintextSerializer::operator<<(int16_t data)
 {
-    *this << std::to_string(data);
+    write_plaintext_int(this->stream, data);
     return *this;
 }
 
-Serializer& PlaintextSerializer::operator<<(int32_t data)
+PlaintextSerializer& PlaintextSerializer::operator<<(int32_t data)
 {
-    *this << std::to_string(data);
+    write_plaintext_int(this->stream, data);
     return *this;
 }
 
-Serializer& PlaintextSerializer::operator<<(int64_t data)
+PlaintextSerializer& PlaintextSerializer::operator<<(int64_t data)
 {
-    *this << std::to_string(data);
+    write_plaintext_int(this->stream, data);
     return *this;
 }
 
-Serializer& PlaintextSerializer::operator<<(std::string const& data)
+PlaintextSerializer& PlaintextSerializer::operator<<(std::string const& data)
 {
-    for (char ch : data) {
-        switch (ch) {
-            case ';':
-            case '\\':
-                this->stream << '\\';
-            default:
-                this->stream << ch;
-                break;
+    char const *cursor = data.data();
+    char const *end = cursor + data.size();
+    while (cursor != end) {
+        char const *run_end = plaintext_find_escape(cursor, end);
+        this->stream.write(cursor, run_end - cursor);
+        if (run_end != end) {
+            this->stream << '\\' << *run_end;
+            run_end++;
         }
+        cursor = run_end;
     }
     this->stream << ';';
     return *this;
 }
 
+PlaintextBufferSerializer::PlaintextBufferSerializer(std::string& buffer) :
+    buffer(buffer)
+{
+}
+
+/**
+ * Appends the decimal digits of the given integer and the field separator.
+ * Digits never need escaping.
+ */
+template <typename T>
+static void append_plaintext_int(std::string& buffer, T data)
+{
+    char digits[PLAINTEXT_INT_MAX_LEN];
+    std::to_chars_result result =
+        std::to_chars(digits, digits + sizeof(digits), data);
+    buffer.append(digits, result.ptr);
+    buffer.push_back(';');
+}
+
+PlaintextBufferSerializer& PlaintextBufferSerializer::operator<<(bool data)
+{
+    *this << (uint8_t) (data ? 1 : 0);
+    return *this;
+}
+
+PlaintextBufferSerializer& PlaintextBufferSerializer::operator<<(uint8_t data)
+{
+    append_plaintext_int(this->buffer, data);
+    return *this;
+}
+
+PlaintextBufferSerializer& PlaintextBufferSerializer::operator<<(uint16_t data)
+{
+    append_plaintext_int(this->buffer, data);
+    return *this;
+}
+
+PlaintextBufferSerializer& PlaintextBufferSerializer::operator<<(uint32_t data)
+{
+    append_plaintext_int(this->buffer, data);
+    return *this;
+}
+
+PlaintextBufferSerializer& PlaintextBufferSerializer::operator<<(uint64_t data)
+{
+    append_plaintext_int(this->buffer, data);
+    return *this;
+}
+
+PlaintextBufferSerializer& PlaintextBufferSerializer::operator<<(int8_t data)
+{
+    append_plaintext_int(this->buffer, data);
+    return *this;
+}
+
+PlaintextBufferSerializer& PlaintextBufferSerializer::operator<<(int16_t data)
+{
+    append_plaintext_int(this->buffer, data);
+    return *this;
+}
+
+PlaintextBufferSerializer& PlaintextBufferSerializer::operator<<(int32_t data)
+{
+    append_plaintext_int(this->buffer, data);
+    return *this;
+}
+
+PlaintextBufferSerializer& PlaintextBufferSerializer::operator<<(int64_t data)
+{
+    append_plaintext_int(this->buffer, data);
+    return *this;
+}
+
+PlaintextBufferSerializer& PlaintextBufferSerializer::operator<<(
+    std::string const& data
+)
+{
+    char const *cursor = data.data();
+    char const *end = cursor + data.size();
+    while (cursor != end) {
+        char const *run_end = plaintext_find_escape(cursor, end);
+        this->buffer.append(cursor, run_end);
+        if (run_end != end) {
+            this->buffer.push_back('\\');
+            this->buffer.push_back(*run_end);
+            run_end++;
+        }
+        cursor = run_end;
+    }
+    this->buffer.push_back(';');
+    return *this;
+}
+
 PlaintextInvalidInt::PlaintextInvalidInt(
     std::string const& type,
     std::string const& content
@@ -190,7 +349,7 @@ char const *PlaintextInvalidInt::content() const
 }
 
 PlaintextDeserializer::PlaintextDeserializer(std::istream& stream) :
-    Deserializer(stream)
+    stream(stream)
 {
 }
 
@@ -206,7 +365,7 @@ Deserializer& PlaintextDeserializer::ensure_eof()
     return *this;
 }
 
-Deserializer& PlaintextDeserializer::operator>>(bool& data)
+PlaintextDeserializer& PlaintextDeserializer::operator>>(bool& data)
 {
     uint64_t integer;
     *this >> integer;
@@ -223,119 +382,524 @@ Deserializer& PlaintextDeserializer::operator>>(bool& data)
     return *this;
 }
 
-Deserializer& PlaintextDeserializer::operator>>(uint8_t& data)
+PlaintextDeserializer& PlaintextDeserializer::operator>>(uint8_t& data)
+{
+    read_plaintext_int(this->stream, "uint8", data);
+    return *this;}
+
+PlaintextDeserializer& PlaintextDeserializer::operator>>(uint16_t& data)
 {
-    uint64_t bigger;
-    *this >> bigger;
-    if (bigger > UINT8_MAX) {
-        throw PlaintextInvalidInt("uint8", std::to_string(bigger));
+    read_plaintext_int(this->stream, "uint16", data);
+    return *this;}
+
+PlaintextDeserializer& PlaintextDeserializer::operator>>(uint32_t& data)
+{
+    read_plaintext_int(this->stream, "uint32", data);
+    return *this;}
+
+PlaintextDeserializer& PlaintextDeserializer::operator>>(uint64_t& data)
+{
+    read_plaintext_int(this->stream, "uint64", data);
+    return *this;}
+
+PlaintextDeserializer& PlaintextDeserializer::operator>>(int8_t& data)
+{
+    read_plaintext_int(this->stream, "int8", data);
+    return *this;}
+
+PlaintextDeserializer& PlaintextDeserializer::operator>>(int16_t& data)
+{
+    read_plaintext_int(this->stream, "int16", data);
+    return *this;}
+
+PlaintextDeserializer& PlaintextDeserializer::operator>>(int32_t& data)
+{
+    read_plaintext_int(this->stream, "int32", data);
+    return *this;}
+
+PlaintextDeserializer& PlaintextDeserializer::operator>>(int64_t& data)
+{
+    read_plaintext_int(this->stream, "int64", data);
+    return *this;}
+
+PlaintextDeserializer& PlaintextDeserializer::operator>>(std::string& data)
+{
+    data.erase();
+    int byte;
+    while ((byte = this->stream.get()) != ';' && byte != EOF) {
+        if (byte == '\\') {
+            byte = this->stream.get();
+            if (byte == EOF) {
+                break;
+            }
+        }
+        data.push_back(byte);
+    }
+    if (byte == EOF) {
+        throw DeserializationUnexpectedEof();
     }
-    data = bigger;
     return *this;
 }
 
-Deserializer& PlaintextDeserializer::operator>>(uint16_t& data)
+PlaintextSpanDeserializer::PlaintextSpanDeserializer(
+    char const *data,
+    size_t size
+) :
+    cursor(data),
+    end(data + size)
+{
+}
+
+char const *PlaintextSpanDeserializer::next_separator()
 {
-    uint64_t bigger;
-    *this >> bigger;
-    if (bigger > UINT16_MAX) {
-        throw PlaintextInvalidInt("uint16", std::to_string(bigger));
+    void const *separator =
+        std::memchr(this->cursor, ';', this->end - this->cursor);
+    if (separator == nullptr) {
+        throw DeserializationUnexpectedEof();
     }
-    data = bigger;
-    return *this;
+    return static_cast<char const *>(separator);
 }
 
-Deserializer& PlaintextDeserializer::operator>>(uint32_t& data)
+Deserializer& PlaintextSpanDeserializer::ensure_eof()
 {
-    uint64_t bigger;
-    *this >> bigger;
-    if (bigger > UINT32_MAX) {
-        throw PlaintextInvalidInt("uint32", std::to_string(bigger));
+    for (; this->cursor != this->end; this->cursor++) {
+        if (!std::isspace((unsigned char) *this->cursor)) {
+            throw DeserializationExpectedEof();
+        }
     }
-    data = bigger;
     return *this;
 }
 
-Deserializer& PlaintextDeserializer::operator>>(uint64_t& data)
+char const *PlaintextSpanDeserializer::position() const
 {
-    std::string buf;
-    *this >> buf;
-    if (buf.empty()) {
-        throw PlaintextInvalidInt("uint64", buf);
+    return this->cursor;
+}
+
+PlaintextSpanDeserializer& PlaintextSpanDeserializer::operator>>(bool& data)
+{
+    uint64_t integer;
+    *this >> integer;
+    switch (integer) {
+        case 0:
+            data = false;
+            break;
+        case 1:
+            data = true;
+            break;
+        default:
+            throw PlaintextInvalidInt("bool", "can only be 0 or 1");
     }
-    char *end;
-    long long unsigned integer = strtoull(buf.c_str(), &end, 10);
-    if (*end != '\0') {
-        throw PlaintextInvalidInt("uint64", buf);
+    return *this;
+}
+
+PlaintextSpanDeserializer& PlaintextSpanDeserializer::operator>>(uint8_t& data)
+{
+    char const *token = this->cursor;
+    char const *separator = this->next_separator();
+    this->cursor = separator + 1;
+    parse_plaintext_int(token, separator, "uint8", data);
+    return *this;}
+
+PlaintextSpanDeserializer& PlaintextSpanDeserializer::operator>>(uint16_t& data)
+{
+    char const *token = this->cursor;
+    char const *separator = this->next_separator();
+    this->cursor = separator + 1;
+    parse_plaintext_int(token, separator, "uint16", data);
+    return *this;}
+
+PlaintextSpanDeserializer& PlaintextSpanDeserializer::operator>>(uint32_t& data)
+{
+    char const *token = this->cursor;
+    char const *separator = this->next_separator();
+    this->cursor = separator + 1;
+    parse_plaintext_int(token, separator, "uint32", data);
+    return *this;}
+
+PlaintextSpanDeserializer& PlaintextSpanDeserializer::operator>>(uint64_t& data)
+{
+    char const *token = this->cursor;
+    char const *separator = this->next_separator();
+    this->cursor = separator + 1;
+    parse_plaintext_int(token, separator, "uint64", data);
+    return *this;}
+
+PlaintextSpanDeserializer& PlaintextSpanDeserializer::operator>>(int8_t& data)
+{
+    char const *token = this->cursor;
+    char const *separator = this->next_separator();
+    this->cursor = separator + 1;
+    parse_plaintext_int(token, separator, "int8", data);
+    return *this;}
+
+PlaintextSpanDeserializer& PlaintextSpanDeserializer::operator>>(int16_t& data)
+{
+    char const *token = this->cursor;
+    char const *separator = this->next_separator();
+    this->cursor = separator + 1;
+    parse_plaintext_int(token, separator, "int16", data);
+    return *this;}
+
+PlaintextSpanDeserializer& PlaintextSpanDeserializer::operator>>(int32_t& data)
+{
+    char const *token = this->cursor;
+    char const *separator = this->next_separator();
+    this->cursor = separator + 1;
+    parse_plaintext_int(token, separator, "int32", data);
+    return *this;}
+
+PlaintextSpanDeserializer& PlaintextSpanDeserializer::operator>>(int64_t& data)
+{
+    char const *token = this->cursor;
+    char const *separator = this->next_separator();
+    this->cursor = separator + 1;
+    parse_plaintext_int(token, separator, "int64", data);
+    return *this;}
+
+PlaintextSpanDeserializer& PlaintextSpanDeserializer::operator>>(
+    std::string& data
+)
+{
+    data.erase();
+    for (;;) {
+        char const *run_end = plaintext_find_escape(this->cursor, this->end);
+        data.append(this->cursor, run_end);
+        if (run_end != this->end && *run_end == ';') {
+            this->cursor = run_end + 1;
+            break;
+        }
+        if (run_end == this->end || run_end + 1 == this->end) {
+            this->cursor = this->end;
+            throw DeserializationUnexpectedEof();
+        }
+        data.push_back(run_end[1]);
+        this->cursor = run_end + 2;
     }
-    data = integer;
     return *this;
 }
 
-Deserializer& PlaintextDeserializer::operator>>(int8_t& data)
+BinarySerializer::BinarySerializer(std::ostream& stream) : stream(stream)
+{
+}
+
+void BinarySerializer::write_le(uint64_t data, size_t width)
 {
-    int64_t bigger;
-    *this >> bigger;
-    if (bigger < INT8_MIN || bigger > INT8_MAX) {
-        throw PlaintextInvalidInt("int8", std::to_string(bigger));
+    char bytes[sizeof(uint64_t)];
+    for (size_t i = 0; i < width; i++) {
+        bytes[i] = (char) (data >> (i * 8));
     }
-    data = bigger;
+    this->stream.write(bytes, width);
+}
+
+BinarySerializer& BinarySerializer::operator<<(bool data)
+{
+    *this << (uint8_t) (data ? 1 : 0);
+    return *this;
+}
+
+BinarySerializer& BinarySerializer::operator<<(uint8_t data)
+{
+    this->write_le(data, sizeof(data));
+    return *this;
+}
+
+BinarySerializer& BinarySerializer::operator<<(uint16_t data)
+{
+    this->write_le(data, sizeof(data));
+    return *this;
+}
+
+BinarySerializer& BinarySerializer::operator<<(uint32_t data)
+{
+    this->write_le(data, sizeof(data));
+    return *this;
+}
+
+BinarySerializer& BinarySerializer::operator<<(uint64_t data)
+{
+    this->write_le(data, sizeof(data));
+    return *this;
+}
+
+BinarySerializer& BinarySerializer::operator<<(int8_t data)
+{
+    *this << (uint8_t) data;
+    return *this;
+}
+
+BinarySerializer& BinarySerializer::operator<<(int16_t data)
+{
+    *this << (uint16_t) data;
+    return *this;
+}
+
+BinarySerializer& BinarySerializer::operator<<(int32_t data)
+{
+    *this << (uint32_t) data;
+    return *this;
+}
+
+BinarySerializer& BinarySerializer::operator<<(int64_t data)
+{
+    *this << (uint64_t) data;
     return *this;
 }
 
-Deserializer& PlaintextDeserializer::operator>>(int16_t& data)
+BinarySerializer& BinarySerializer::operator<<(std::string const& data)
 {
-    int64_t bigger;
-    *this >> bigger;
-    if (bigger < INT16_MIN || bigger > INT16_MAX) {
-        throw PlaintextInvalidInt("int16", std::to_string(bigger));
+    if (data.size() > UINT32_MAX) {
+        throw SerializationError(
+            "string of length " + std::to_string(data.size()) + " is too long"
+        );
     }
-    data = bigger;
+    *this << (uint32_t) data.size();
+    this->stream.write(data.data(), data.size());
     return *this;
 }
 
-Deserializer& PlaintextDeserializer::operator>>(int32_t& data)
+BinaryBufferSerializer::BinaryBufferSerializer(std::string& buffer) :
+    buffer(buffer)
+{
+}
+
+BinaryBufferSerializer& BinaryBufferSerializer::operator<<(
+    std::string const& data
+)
 {
-    int64_t bigger;
-    *this >> bigger;
-    if (bigger < INT32_MIN || bigger > INT32_MAX) {
-        throw PlaintextInvalidInt("int32", std::to_string(bigger));
+    if (data.size() > UINT32_MAX) {
+        throw SerializationError(
+            "string of length " + std::to_string(data.size()) + " is too long"
+        );
     }
-    data = bigger;
+    *this << (uint32_t) data.size();
+    this->buffer.append(data);
     return *this;
 }
 
-Deserializer& PlaintextDeserializer::operator>>(int64_t& data)
+BinaryInvalidBool::BinaryInvalidBool(uint8_t byte) :
+    DeserializationError("found invalid boolean byte "),
+    byte_(byte)
+{
+    this->message += std::to_string(byte);
+}
+
+uint8_t BinaryInvalidBool::byte() const
 {
-    std::string buf;
-    *this >> buf;
-    if (buf.empty()) {
-        throw PlaintextInvalidInt("int64", buf);
+    return this->byte_;
+}
+
+BinaryDeserializer::BinaryDeserializer(std::istream& stream) :
+    stream(stream)
+{
+}
+
+uint64_t BinaryDeserializer::read_le(size_t width)
+{
+    char bytes[sizeof(uint64_t)];
+    this->stream.read(bytes, width);
+    if ((size_t) this->stream.gcount() != width) {
+        throw DeserializationUnexpectedEof();
+    }
+    uint64_t data = 0;
+    for (size_t i = 0; i < width; i++) {
+        data |= (uint64_t) (uint8_t) bytes[i] << (i * 8);
+    }
+    return data;
+}
+
+Deserializer& BinaryDeserializer::ensure_eof()
+{
+    if (this->stream.peek() != EOF) {
+        throw DeserializationExpectedEof();
     }
-    char *end;
-    long long signed integer = strtoll(buf.c_str(), &end, 10);
-    if (*end != '\0') {
-        throw PlaintextInvalidInt("int64", buf);
+    return *this;
+}
+
+BinaryDeserializer& BinaryDeserializer::operator>>(bool& data)
+{
+    uint8_t byte;
+    *this >> byte;
+    switch (byte) {
+        case 0:
+            data = false;
+            break;
+        case 1:
+            data = true;
+            break;
+        default:
+            throw BinaryInvalidBool(byte);
     }
-    data = integer;
     return *this;
 }
 
-Deserializer& PlaintextDeserializer::operator>>(std::string& data)
+BinaryDeserializer& BinaryDeserializer::operator>>(uint8_t& data)
+{
+    data = this->read_le(sizeof(data));
+    return *this;
+}
+
+BinaryDeserializer& BinaryDeserializer::operator>>(uint16_t& data)
+{
+    data = this->read_le(sizeof(data));
+    return *this;
+}
+
+BinaryDeserializer& BinaryDeserializer::operator>>(uint32_t& data)
+{
+    data = this->read_le(sizeof(data));
+    return *this;
+}
+
+BinaryDeserializer& BinaryDeserializer::operator>>(uint64_t& data)
+{
+    data = this->read_le(sizeof(data));
+    return *this;
+}
+
+BinaryDeserializer& BinaryDeserializer::operator>>(int8_t& data)
 {
+    data = (int8_t) this->read_le(sizeof(data));
+    return *this;
+}
+
+BinaryDeserializer& BinaryDeserializer::operator>>(int16_t& data)
+{
+    data = (int16_t) this->read_le(sizeof(data));
+    return *this;
+}
+
+BinaryDeserializer& BinaryDeserializer::operator>>(int32_t& data)
+{
+    data = (int32_t) this->read_le(sizeof(data));
+    return *this;
+}
+
+BinaryDeserializer& BinaryDeserializer::operator>>(int64_t& data)
+{
+    data = (int64_t) this->read_le(sizeof(data));
+    return *this;
+}
+
+BinaryDeserializer& BinaryDeserializer::operator>>(std::string& data)
+{
+    uint32_t size;
+    *this >> size;
     data.erase();
-    int byte;
-    while ((byte = this->stream.get()) != ';' && byte != EOF) {
-        if (byte == '\\') {
-            byte = this->stream.get();
-            if (byte == EOF) {
-                break;
-            }
+    char chunk[256];
+    while (size > 0) {
+        size_t chunk_size = size < sizeof(chunk) ? size : sizeof(chunk);
+        this->stream.read(chunk, chunk_size);
+        if ((size_t) this->stream.gcount() != chunk_size) {
+            throw DeserializationUnexpectedEof();
         }
-        data.push_back(byte);
+        data.append(chunk, chunk_size);
+        size -= chunk_size;
     }
-    if (byte == EOF) {
+    return *this;
+}
+
+BinarySpanDeserializer::BinarySpanDeserializer(char const *data, size_t size) :
+    cursor(data),
+    end(data + size)
+{
+}
+
+Deserializer& BinarySpanDeserializer::ensure_eof()
+{
+    if (this->cursor != this->end) {
+        throw DeserializationExpectedEof();
+    }
+    return *this;
+}
+
+char const *BinarySpanDeserializer::position() const
+{
+    return this->cursor;
+}
+
+BinarySpanDeserializer& BinarySpanDeserializer::operator>>(std::string& data)
+{
+    uint32_t size;
+    *this >> size;
+    if ((size_t) (this->end - this->cursor) < size) {
+        this->cursor = this->end;
+        throw DeserializationUnexpectedEof();
+    }
+    data.assign(this->cursor, size);
+    this->cursor += size;
+    return *this;
+}
+
+CompactBufferSerializer::CompactBufferSerializer(
+    std::string& buffer,
+    int64_t timestamp_base
+) :
+    buffer(buffer),
+    timestamp_base(timestamp_base)
+{
+}
+
+CompactBufferSerializer& CompactBufferSerializer::operator<<(
+    std::string const& data
+)
+{
+    this->write_varint(data.size());
+    this->buffer.append(data);
+    return *this;
+}
+
+Serializer& CompactBufferSerializer::serialize_timestamp(int64_t data)
+{
+    this->write_varint(
+        zigzag_encode((int64_t) ((uint64_t) data - this->timestamp_base))
+    );
+    return *this;
+}
+
+CompactInvalidVarint::CompactInvalidVarint(std::string const& type) :
+    DeserializationError("found invalid varint for type " + type)
+{
+}
+
+CompactSpanDeserializer::CompactSpanDeserializer(
+    char const *data,
+    size_t size,
+    int64_t timestamp_base
+) :
+    cursor(data),
+    end(data + size),
+    timestamp_base(timestamp_base)
+{
+}
+
+Deserializer& CompactSpanDeserializer::ensure_eof()
+{
+    if (this->cursor != this->end) {
+        throw DeserializationExpectedEof();
+    }
+    return *this;
+}
+
+char const *CompactSpanDeserializer::position() const
+{
+    return this->cursor;
+}
+
+CompactSpanDeserializer& CompactSpanDeserializer::operator>>(std::string& data)
+{
+    uint64_t size = this->read_varint("string length", UINT32_MAX);
+    if ((uint64_t) (this->end - this->cursor) < size) {
+        this->cursor = this->end;
         throw DeserializationUnexpectedEof();
     }
+    data.assign(this->cursor, size);
+    this->cursor += size;
+    return *this;
+}
+
+Deserializer& CompactSpanDeserializer::deserialize_timestamp(int64_t& data)
+{
+    int64_t delta = zigzag_decode(this->read_varint("timestamp", UINT64_MAX));
+    data = (int64_t) ((uint64_t) this->timestamp_base + delta);
     return *this;
 }
@@ -9,11 +9,28 @@
 #include <set>
 #include <map>
 #include <optional>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 class Serializable;
 
 class Deserializable;
 
+enum WireFormat {
+    WIRE_PLAINTEXT,
+    WIRE_BINARY,
+    WIRE_COMPACT
+};
+
+/**
+ * Base that the compact wire format encodes timestamps against, by default.
+ * Both ends of a connection must agree on it.
+ */
+constexpr int64_t COMPACT_TIMESTAMP_BASE = 1672531200;
+
 class SerializationError : public std::exception {
     protected:
         std::string message;
@@ -49,11 +66,7 @@ class DeserializationExpectedEof : public DeserializationError {
 };
 
 class Serializer {
-    protected:
-        std::ostream &stream;
     public:
-        Serializer(std::ostream& stream);
-
         virtual Serializer& operator<<(bool data) = 0;
         virtual Serializer& operator<<(uint8_t data) = 0;
         virtual Serializer& operator<<(uint16_t data) = 0;
@@ -68,36 +81,20 @@ class Serializer {
         virtual Serializer& operator<<(char const *data);
         virtual Serializer& operator<<(std::string const& data) = 0;
 
-        template <typename T>
-        Serializer& operator<<(std::optional<T> const& data);
-
-        template <typename T>
-        Serializer& operator<<(std::vector<T> const& data);
-
-        template <typename T>
-        Serializer& operator<<(std::deque<T> const& data);
-
-        template <typename T>
-        Serializer& operator<<(std::set<T> const& data);
-
-        template <typename K, typename V>
-        Serializer& operator<<(std::map<K, V> const& data);
-
-        template <typename A, typename B>
-        Serializer& operator<<(std::pair<A, B> const& data);
-
         virtual Serializer& operator<<(Serializable const& data);
 
+        /**
+         * Timestamps have their own entry point so that a format can encode
+         * them relative to a base. By default, same as an int64_t.
+         */
+        virtual Serializer& serialize_timestamp(int64_t data);
+
         virtual ~Serializer();
 };
 
 class Deserializer {
-    protected:
-        std::istream &stream;
     public:
-        Deserializer(std::istream& stream);
-
-        virtual Deserializer& ensure_eof();
+        virtual Deserializer& ensure_eof() = 0;
 
         virtual Deserializer& operator>>(bool& data) = 0;
         virtual Deserializer& operator>>(uint8_t& data) = 0;
@@ -112,26 +109,14 @@ class Deserializer {
 
         virtual Deserializer& operator>>(std::string& data) = 0;
 
-        template <typename T>
-        Deserializer& operator>>(std::optional<T>& data);
-
-        template <typename T>
-        Deserializer& operator>>(std::vector<T>& data);
-        
-        template <typename T>
-        Deserializer& operator>>(std::deque<T>& data);
-
-        template <typename T>
-        Deserializer& operator>>(std::set<T>& data);
-
-        template <typename K, typename V>
-        Deserializer& operator>>(std::map<K, V>& data);
-
-        template <typename A, typename B>
-        Deserializer& operator>>(std::pair<A, B>& data);
-
         virtual Deserializer& operator>>(Deserializable& data);
 
+        /**
+         * Counterpart of Serializer::serialize_timestamp. By default, same as
+         * an int64_t.
+         */
+        virtual Deserializer& deserialize_timestamp(int64_t& data);
+
         virtual ~Deserializer();
 };
 
@@ -147,155 +132,289 @@ class Deserializable {
         virtual ~Deserializable();
 };
 
-template <typename T>
-Serializer& Serializer::operator<<(std::optional<T> const& data)
+/**
+ * The container templates below are free functions generic over the concrete
+ * serializer, so that, given a final serializer class, every element is
+ * written with direct calls the compiler can inline. Given the base
+ * Serializer, they go through the virtual interface as usual.
+ */
+template <typename S>
+using SerializerRef = std::enable_if_t<std::is_base_of_v<Serializer, S>, S&>;
+
+template <typename D>
+using DeserializerRef =
+    std::enable_if_t<std::is_base_of_v<Deserializer, D>, D&>;
+
+/**
+ * Whether T provides a template encode(S&) member, written once for any
+ * serializer, in addition to its virtual serialize.
+ */
+template <typename S, typename T, typename = void>
+class HasEncode : public std::false_type {
+};
+
+template <typename S, typename T>
+class HasEncode<
+    S,
+    T,
+    std::void_t<decltype(std::declval<T const&>().encode(std::declval<S&>()))>
+> : public std::true_type {
+};
+
+/**
+ * Whether T provides a template decode(D&) member, written once for any
+ * deserializer, in addition to its virtual deserialize.
+ */
+template <typename D, typename T, typename = void>
+class HasDecode : public std::false_type {
+};
+
+template <typename D, typename T>
+class HasDecode<
+    D,
+    T,
+    std::void_t<decltype(std::declval<T&>().decode(std::declval<D&>()))>
+> : public std::true_type {
+};
+
+/**
+ * Whether the serializer declares its WIRE_FORMAT and can take bytes already
+ * encoded in that format through write_encoded.
+ */
+template <typename S, typename = void>
+class WritesEncoded : public std::false_type {
+};
+
+template <typename S>
+class WritesEncoded<
+    S,
+    std::void_t<
+        decltype(S::WIRE_FORMAT),
+        decltype(std::declval<S&>().write_encoded(nullptr, 0))
+    >
+> : public std::true_type {
+};
+
+template <typename S, typename T>
+std::enable_if_t<
+    std::is_base_of_v<Serializer, S> && HasEncode<S, T>::value,
+    S&
+> operator<<(S& serializer, T const& data)
+{
+    data.encode(serializer);
+    return serializer;
+}
+
+template <typename D, typename T>
+std::enable_if_t<
+    std::is_base_of_v<Deserializer, D> && HasDecode<D, T>::value,
+    D&
+> operator>>(D& deserializer, T& data)
+{
+    data.decode(deserializer);
+    return deserializer;
+}
+
+template <typename S, typename T>
+SerializerRef<S> operator<<(S& serializer, std::optional<T> const& data)
 {
     if (data) {
-        *this << ((uint8_t) 1) << *data;
+        serializer << ((uint8_t) 1) << *data;
     } else {
-        *this << ((uint8_t) 0) << *data;
+        serializer << ((uint8_t) 0);
     }
-    return *this;
+    return serializer;
 }
 
-template <typename T>
-Serializer& Serializer::operator<<(std::vector<T> const& data)
+template <typename S, typename T>
+SerializerRef<S> operator<<(S& serializer, std::vector<T> const& data)
 {
-    *this << (uint32_t) data.size();
+    serializer << (uint32_t) data.size();
     for (T const& element : data) {
-        *this << element;
+        serializer << element;
     }
-    return *this;
+    return serializer;
 }
 
-template <typename T>
-Serializer& Serializer::operator<<(std::deque<T> const& data)
+template <typename S, typename T>
+SerializerRef<S> operator<<(S& serializer, std::deque<T> const& data)
 {
-    *this << (uint32_t) data.size();
+    serializer << (uint32_t) data.size();
     for (T const& element : data) {
-        *this << element;
+        serializer << element;
     }
-    return *this;
+    return serializer;
 }
 
-template <typename T>
-Serializer& Serializer::operator<<(std::set<T> const& data)
+template <typename S, typename T>
+SerializerRef<S> operator<<(S& serializer, std::set<T> const& data)
 {
-    *this << (uint32_t) data.size();
+    serializer << (uint32_t) data.size();
     for (T const& element : data) {
-        *this << element;
+        serializer << element;
     }
-    return *this;
+    return serializer;
 }
 
-template <typename K, typename V>
-Serializer& Serializer::operator<<(std::map<K, V> const& data)
+template <typename S, typename K, typename V>
+SerializerRef<S> operator<<(S& serializer, std::map<K, V> const& data)
 {
-    *this << (uint32_t) data.size();
+    serializer << (uint32_t) data.size();
     for (auto const& entry : data) {
         K const& key = std::get<0>(entry);
         V const& value = std::get<1>(entry);
-        *this << key << value;
+        serializer << key << value;
     }
-    return *this;
+    return serializer;
 }
 
-template <typename A, typename B>
-Serializer& Serializer::operator<<(std::pair<A, B> const& data)
+template <typename S, typename A, typename B>
+SerializerRef<S> operator<<(S& serializer, std::pair<A, B> const& data)
 {
-    *this << std::get<0>(data) << std::get<1>(data);
-    return *this;
+    serializer << std::get<0>(data) << std::get<1>(data);
+    return serializer;
 }
 
-template <typename T>
-Deserializer& Deserializer::operator>>(std::optional<T>& data)
+template <typename D, typename T>
+DeserializerRef<D> operator>>(D& deserializer, std::optional<T>& data)
 {
     uint8_t present;
-    *this >> present;
+    deserializer >> present;
     if (present != 0) {
-        *this >> *data;
+        T value;
+        deserializer >> value;
+        data = std::move(value);
+    } else {
+        data.reset();
     }
-    return *this;
+    return deserializer;
 }
 
-template <typename T>
-Deserializer& Deserializer::operator>>(std::vector<T>& data)
+template <typename D, typename T>
+DeserializerRef<D> operator>>(D& deserializer, std::vector<T>& data)
 {
     uint32_t size;
-    *this >> size;
+    deserializer >> size;
     data.resize(size);
     for (T& element : data) {
-        *this >> element;
+        deserializer >> element;
     }
-    return *this;
+    return deserializer;
 }
 
-template <typename T>
-Deserializer& Deserializer::operator>>(std::deque<T>& data)
+template <typename D, typename T>
+DeserializerRef<D> operator>>(D& deserializer, std::deque<T>& data)
 {
     uint32_t size;
-    *this >> size;
+    deserializer >> size;
     data.clear();
     for (uint32_t i = 0; i < size; i++) {
         T element;
-        *this >> element;
+        deserializer >> element;
         data.push_back(std::move(element));
     }
-    return *this;
+    return deserializer;
 }
 
-template <typename T>
-Deserializer& Deserializer::operator>>(std::set<T>& data)
+template <typename D, typename T>
+DeserializerRef<D> operator>>(D& deserializer, std::set<T>& data)
 {
     uint32_t size;
-    *this >> size;
+    deserializer >> size;
     data.clear();
     for (uint32_t i = 0; i < size; i++) {
         T element;
-        *this >> element;
+        deserializer >> element;
         data.insert(std::move(element));
     }
-    return *this;
+    return deserializer;
 }
 
-template <typename K, typename V>
-Deserializer& Deserializer::operator>>(std::map<K, V>& data)
+template <typename D, typename K, typename V>
+DeserializerRef<D> operator>>(D& deserializer, std::map<K, V>& data)
 {
     uint32_t size;
-    *this >> size;
+    deserializer >> size;
     data.clear();
     for (uint32_t i = 0; i < size; i++) {
         K key;
         V value;
-        *this >> key >> value;
+        deserializer >> key >> value;
         data.insert(std::make_pair(std::move(key), std::move(value)));
     }
-    return *this;
+    return deserializer;
 }
 
-template <typename A, typename B>
-Deserializer& Deserializer::operator>>(std::pair<A, B>& data)
+template <typename D, typename A, typename B>
+DeserializerRef<D> operator>>(D& deserializer, std::pair<A, B>& data)
 {
-    *this >> std::get<0>(data) >> std::get<1>(data);
-    return *this;
+    deserializer >> std::get<0>(data) >> std::get<1>(data);
+    return deserializer;
 }
 
-class PlaintextSerializer : public Serializer {
+/**
+ * Finds the first character in the given range that the plaintext format must
+ * escape, i.e. a ';' or a '\\', or returns end if there is none. Scans 16 or
+ * 32 bytes at a time when SSE2 or AVX2 is available.
+ */
+char const *plaintext_find_escape(char const *begin, char const *end);
+
+class PlaintextSerializer final : public Serializer {
+    private:
+        std::ostream &stream;
+
     public:
         PlaintextSerializer(std::ostream& stream);
 
-        virtual Serializer& operator<<(bool data);
-        virtual Serializer& operator<<(uint8_t data);
-        virtual Serializer& operator<<(uint16_t data);
-        virtual Serializer& operator<<(uint32_t data);
-        virtual Serializer& operator<<(uint64_t data);
+        using Serializer::operator<<;
+
+        virtual PlaintextSerializer& operator<<(bool data);
+        virtual PlaintextSerializer& operator<<(uint8_t data);
+        virtual PlaintextSerializer& operator<<(uint16_t data);
+        virtual PlaintextSerializer& operator<<(uint32_t data);
+        virtual PlaintextSerializer& operator<<(uint64_t data);
+
+        virtual PlaintextSerializer& operator<<(int8_t data);
+        virtual PlaintextSerializer& operator<<(int16_t data);
+        virtual PlaintextSerializer& operator<<(int32_t data);
+        virtual PlaintextSerializer& operator<<(int64_t data);
+
+        virtual PlaintextSerializer& operator<<(std::string const& data);
+};
+
+/**
+ * Same format as PlaintextSerializer, but appends to a caller-owned buffer.
+ * Clearing and reusing the buffer between messages keeps its capacity, so
+ * steady-state encoding does not allocate.
+ */
+class PlaintextBufferSerializer final : public Serializer {
+    private:
+        std::string &buffer;
+
+    public:
+        static constexpr WireFormat WIRE_FORMAT = WIRE_PLAINTEXT;
+
+        PlaintextBufferSerializer(std::string& buffer);
+
+        /**
+         * Writes bytes already encoded in this format as they are.
+         */
+        void write_encoded(char const *data, size_t size);
 
-        virtual Serializer& operator<<(int8_t data);
-        virtual Serializer& operator<<(int16_t data);
-        virtual Serializer& operator<<(int32_t data);
-        virtual Serializer& operator<<(int64_t data);
+        using Serializer::operator<<;
 
-        virtual Serializer& operator<<(std::string const& data);
+        virtual PlaintextBufferSerializer& operator<<(bool data);
+        virtual PlaintextBufferSerializer& operator<<(uint8_t data);
+        virtual PlaintextBufferSerializer& operator<<(uint16_t data);
+        virtual PlaintextBufferSerializer& operator<<(uint32_t data);
+        virtual PlaintextBufferSerializer& operator<<(uint64_t data);
+
+        virtual PlaintextBufferSerializer& operator<<(int8_t data);
+        virtual PlaintextBufferSerializer& operator<<(int16_t data);
+        virtual PlaintextBufferSerializer& operator<<(int32_t data);
+        virtual PlaintextBufferSerializer& operator<<(int64_t data);
+
+        virtual PlaintextBufferSerializer& operator<<(std::string const& data);
 };
 
 class PlaintextInvalidInt : public DeserializationError {
@@ -312,24 +431,1173 @@ class PlaintextInvalidInt : public DeserializationError {
         char const *content() const;
 };
 
-class PlaintextDeserializer : public Deserializer {
+class PlaintextDeserializer final : public Deserializer {
+    private:
+        std::istream &stream;
+
     public:
         PlaintextDeserializer(std::istream& stream);
 
         virtual Deserializer& ensure_eof();
 
-        virtual Deserializer& operator>>(bool& data);
-        virtual Deserializer& operator>>(uint8_t& data);
-        virtual Deserializer& operator>>(uint16_t& data);
-        virtual Deserializer& operator>>(uint32_t& data);
-        virtual Deserializer& operator>>(uint64_t& data);
+        using Deserializer::operator>>;
+
+        virtual PlaintextDeserializer& operator>>(bool& data);
+        virtual PlaintextDeserializer& operator>>(uint8_t& data);
+        virtual PlaintextDeserializer& operator>>(uint16_t& data);
+        virtual PlaintextDeserializer& operator>>(uint32_t& data);
+        virtual PlaintextDeserializer& operator>>(uint64_t& data);
+
+        virtual PlaintextDeserializer& operator>>(int8_t& data);
+        virtual PlaintextDeserializer& operator>>(int16_t& data);
+        virtual PlaintextDeserializer& operator>>(int32_t& data);
+        virtual PlaintextDeserializer& operator>>(int64_t& data);
+
+        virtual PlaintextDeserializer& operator>>(std::string& data);
+};
+
+/**
+ * Same format as PlaintextDeserializer, but reads directly from a contiguous
+ * chunk of memory, e.g. a datagram buffer, without copying it. The memory must
+ * outlive the deserializer.
+ */
+class PlaintextSpanDeserializer final : public Deserializer {
+    private:
+        char const *cursor;
+        char const *end;
+
+    public:
+        PlaintextSpanDeserializer(char const *data, size_t size);
+
+        virtual Deserializer& ensure_eof();
+
+        /**
+         * Address of the next byte to be read.
+         */
+        char const *position() const;
+
+        using Deserializer::operator>>;
+
+        virtual PlaintextSpanDeserializer& operator>>(bool& data);
+        virtual PlaintextSpanDeserializer& operator>>(uint8_t& data);
+        virtual PlaintextSpanDeserializer& operator>>(uint16_t& data);
+        virtual PlaintextSpanDeserializer& operator>>(uint32_t& data);
+        virtual PlaintextSpanDeserializer& operator>>(uint64_t& data);
+
+        virtual PlaintextSpanDeserializer& operator>>(int8_t& data);
+        virtual PlaintextSpanDeserializer& operator>>(int16_t& data);
+        virtual PlaintextSpanDeserializer& operator>>(int32_t& data);
+        virtual PlaintextSpanDeserializer& operator>>(int64_t& data);
+
+        virtual PlaintextSpanDeserializer& operator>>(std::string& data);
+
+    private:
+        char const *next_separator();
+};
+
+/**
+ * Fixed-width little-endian integers, and strings prefixed by their length as
+ * an uint32.
+ */
+class BinarySerializer final : public Serializer {
+    private:
+        std::ostream &stream;
+
+    public:
+        BinarySerializer(std::ostream& stream);
+
+        using Serializer::operator<<;
+
+        virtual BinarySerializer& operator<<(bool data);
+        virtual BinarySerializer& operator<<(uint8_t data);
+        virtual BinarySerializer& operator<<(uint16_t data);
+        virtual BinarySerializer& operator<<(uint32_t data);
+        virtual BinarySerializer& operator<<(uint64_t data);
+
+        virtual BinarySerializer& operator<<(int8_t data);
+        virtual BinarySerializer& operator<<(int16_t data);
+        virtual BinarySerializer& operator<<(int32_t data);
+        virtual BinarySerializer& operator<<(int64_t data);
+
+        virtual BinarySerializer& operator<<(std::string const& data);
+
+    private:
+        void write_le(uint64_t data, size_t width);
+};
+
+/**
+ * Same format as BinarySerializer, but appends to a caller-owned buffer.
+ * Clearing and reusing the buffer between messages keeps its capacity, so
+ * steady-state encoding does not allocate.
+ */
+class BinaryBufferSerializer final : public Serializer {
+    private:
+        std::string &buffer;
+
+    public:
+        static constexpr WireFormat WIRE_FORMAT = WIRE_BINARY;
+
+        BinaryBufferSerializer(std::string& buffer);
+
+        /**
+         * Writes bytes already encoded in this format as they are.
+         */
+        void write_encoded(char const *data, size_t size);
+
+        using Serializer::operator<<;
+
+        virtual BinaryBufferSerializer& operator<<(bool data);
+        virtual BinaryBufferSerializer& operator<<(uint8_t data);
+        virtual BinaryBufferSerializer& operator<<(uint16_t data);
+        virtual BinaryBufferSerializer& operator<<(uint32_t data);
+        virtual BinaryBufferSerializer& operator<<(uint64_t data);
+
+        virtual BinaryBufferSerializer& operator<<(int8_t data);
+        virtual BinaryBufferSerializer& operator<<(int16_t data);
+        virtual BinaryBufferSerializer& operator<<(int32_t data);
+        virtual BinaryBufferSerializer& operator<<(int64_t data);
+
+        virtual BinaryBufferSerializer& operator<<(std::string const& data);
+
+    private:
+        void write_le(uint64_t data, size_t width);
+};
+
+class BinaryInvalidBool : public DeserializationError {
+    private:
+        uint8_t byte_;
+
+    public:
+        BinaryInvalidBool(uint8_t byte);
+        uint8_t byte() const;
+};
+
+class BinaryDeserializer final : public Deserializer {
+    private:
+        std::istream &stream;
+
+    public:
+        BinaryDeserializer(std::istream& stream);
+
+        virtual Deserializer& ensure_eof();
+
+        using Deserializer::operator>>;
+
+        virtual BinaryDeserializer& operator>>(bool& data);
+        virtual BinaryDeserializer& operator>>(uint8_t& data);
+        virtual BinaryDeserializer& operator>>(uint16_t& data);
+        virtual BinaryDeserializer& operator>>(uint32_t& data);
+        virtual BinaryDeserializer& operator>>(uint64_t& data);
+
+        virtual BinaryDeserializer& operator>>(int8_t& data);
+        virtual BinaryDeserializer& operator>>(int16_t& data);
+        virtual BinaryDeserializer& operator>>(int32_t& data);
+        virtual BinaryDeserializer& operator>>(int64_t& data);
+
+        virtual BinaryDeserializer& operator>>(std::string& data);
+
+    private:
+        uint64_t read_le(size_t width);
+};
+
+/**
+ * Same format as BinaryDeserializer, but reads directly from a contiguous
+ * chunk of memory, e.g. a datagram buffer, without copying it. The memory must
+ * outlive the deserializer.
+ */
+class BinarySpanDeserializer final : public Deserializer {
+    private:
+        char const *cursor;
+        char const *end;
+
+    public:
+        BinarySpanDeserializer(char const *data, size_t size);
+
+        virtual Deserializer& ensure_eof();
+
+        /**
+         * Address of the next byte to be read.
+         */
+        char const *position() const;
+
+        using Deserializer::operator>>;
+
+        virtual BinarySpanDeserializer& operator>>(bool& data);
+        virtual BinarySpanDeserializer& operator>>(uint8_t& data);
+        virtual BinarySpanDeserializer& operator>>(uint16_t& data);
+        virtual BinarySpanDeserializer& operator>>(uint32_t& data);
+        virtual BinarySpanDeserializer& operator>>(uint64_t& data);
+
+        virtual BinarySpanDeserializer& operator>>(int8_t& data);
+        virtual BinarySpanDeserializer& operator>>(int16_t& data);
+        virtual BinarySpanDeserializer& operator>>(int32_t& data);
+        virtual BinarySpanDeserializer& operator>>(int64_t& data);
+
+        virtual BinarySpanDeserializer& operator>>(std::string& data);
+
+    private:
+        uint64_t read_le(size_t width);
+};
+
+/**
+ * LEB128 varints for unsigned integers wider than a byte, zigzag varints for
+ * signed ones, and strings prefixed by their length as a varint. Timestamps are
+ * encoded as a zigzag delta against a base shared by both ends.
+ */
+class CompactBufferSerializer final : public Serializer {
+    private:
+        std::string &buffer;
+        int64_t timestamp_base;
+
+    public:
+        static constexpr WireFormat WIRE_FORMAT = WIRE_COMPACT;
+
+        CompactBufferSerializer(
+            std::string& buffer,
+            int64_t timestamp_base = COMPACT_TIMESTAMP_BASE
+        );
+
+        /**
+         * Writes bytes already encoded in this format as they are.
+         */
+        void write_encoded(char const *data, size_t size);
+
+        using Serializer::operator<<;
+
+        virtual CompactBufferSerializer& operator<<(bool data);
+        virtual CompactBufferSerializer& operator<<(uint8_t data);
+        virtual CompactBufferSerializer& operator<<(uint16_t data);
+        virtual CompactBufferSerializer& operator<<(uint32_t data);
+        virtual CompactBufferSerializer& operator<<(uint64_t data);
+
+        virtual CompactBufferSerializer& operator<<(int8_t data);
+        virtual CompactBufferSerializer& operator<<(int16_t data);
+        virtual CompactBufferSerializer& operator<<(int32_t data);
+        virtual CompactBufferSerializer& operator<<(int64_t data);
+
+        virtual CompactBufferSerializer& operator<<(std::string const& data);
+
+        virtual Serializer& serialize_timestamp(int64_t data);
+
+    private:
+        void write_varint(uint64_t data);
+};
+
+class CompactInvalidVarint : public DeserializationError {
+    public:
+        CompactInvalidVarint(std::string const& type);
+};
+
+/**
+ * Reads the format of CompactBufferSerializer directly from a contiguous chunk
+ * of memory, without copying it. The memory must outlive the deserializer.
+ */
+class CompactSpanDeserializer final : public Deserializer {
+    private:
+        char const *cursor;
+        char const *end;
+        int64_t timestamp_base;
+
+    public:
+        CompactSpanDeserializer(
+            char const *data,
+            size_t size,
+            int64_t timestamp_base = COMPACT_TIMESTAMP_BASE
+        );
+
+        virtual Deserializer& ensure_eof();
+
+        /**
+         * Address of the next byte to be read.
+         */
+        char const *position() const;
+
+        using Deserializer::operator>>;
+
+        virtual CompactSpanDeserializer& operator>>(bool& data);
+        virtual CompactSpanDeserializer& operator>>(uint8_t& data);
+        virtual CompactSpanDeserializer& operator>>(uint16_t& data);
+        virtual CompactSpanDeserializer& operator>>(uint32_t& data);
+        virtual CompactSpanDeserializer& operator>>(uint64_t& data);
+
+        virtual CompactSpanDeserializer& operator>>(int8_t& data);
+        virtual CompactSpanDeserializer& operator>>(int16_t& data);
+        virtual CompactSpanDeserializer& operator>>(int32_t& data);
+        virtual CompactSpanDeserializer& operator>>(int64_t& data);
+
+        virtual CompactSpanDeserializer& operator>>(std::string& data);
+
+        virtual Deserializer& deserialize_timestamp(int64_t& data);
 
-        virtual Deserializer& operator>>(int8_t& data);
-        virtual Deserializer& operator>>(int16_t& data);
-        virtual Deserializer& operator>>(int32_t& data);
-        virtual Deserializer& operator>>(int64_t& data);
+    private:
+        /**
+         * Reads a varint in its shortest encoding only, so that every value
+         * has a single form on the wire. Throws CompactInvalidVarint on
+         * overlong or out of range encodings.
+         */
+        uint64_t read_varint(char const *type, uint64_t max);
+};
+
+/**
+ * Counts how many bytes PlaintextBufferSerializer would write, without writing
+ * them.
+ */
+class PlaintextSizeSerializer final : public Serializer {
+    private:
+        size_t size_;
+
+    public:
+        static constexpr WireFormat WIRE_FORMAT = WIRE_PLAINTEXT;
+
+        PlaintextSizeSerializer();
+
+        size_t size() const;
+
+        /**
+         * Writes bytes already encoded in this format as they are.
+         */
+        void write_encoded(char const *data, size_t size);
+
+        using Serializer::operator<<;
+
+        virtual PlaintextSizeSerializer& operator<<(bool data);
+        virtual PlaintextSizeSerializer& operator<<(uint8_t data);
+        virtual PlaintextSizeSerializer& operator<<(uint16_t data);
+        virtual PlaintextSizeSerializer& operator<<(uint32_t data);
+        virtual PlaintextSizeSerializer& operator<<(uint64_t data);
+
+        virtual PlaintextSizeSerializer& operator<<(int8_t data);
+        virtual PlaintextSizeSerializer& operator<<(int16_t data);
+        virtual PlaintextSizeSerializer& operator<<(int32_t data);
+        virtual PlaintextSizeSerializer& operator<<(int64_t data);
+
+        virtual PlaintextSizeSerializer& operator<<(std::string const& data);
+
+    private:
+        void count_int(uint64_t magnitude, bool negative);
+};
+
+/**
+ * Counts how many bytes BinaryBufferSerializer would write, without writing
+ * them.
+ */
+class BinarySizeSerializer final : public Serializer {
+    private:
+        size_t size_;
+
+    public:
+        static constexpr WireFormat WIRE_FORMAT = WIRE_BINARY;
+
+        BinarySizeSerializer();
+
+        size_t size() const;
+
+        /**
+         * Writes bytes already encoded in this format as they are.
+         */
+        void write_encoded(char const *data, size_t size);
+
+        using Serializer::operator<<;
+
+        virtual BinarySizeSerializer& operator<<(bool data);
+        virtual BinarySizeSerializer& operator<<(uint8_t data);
+        virtual BinarySizeSerializer& operator<<(uint16_t data);
+        virtual BinarySizeSerializer& operator<<(uint32_t data);
+        virtual BinarySizeSerializer& operator<<(uint64_t data);
+
+        virtual BinarySizeSerializer& operator<<(int8_t data);
+        virtual BinarySizeSerializer& operator<<(int16_t data);
+        virtual BinarySizeSerializer& operator<<(int32_t data);
+        virtual BinarySizeSerializer& operator<<(int64_t data);
+
+        virtual BinarySizeSerializer& operator<<(std::string const& data);
+};
+
+/**
+ * Counts how many bytes CompactBufferSerializer would write, without writing
+ * them.
+ */
+class CompactSizeSerializer final : public Serializer {
+    private:
+        size_t size_;
+        int64_t timestamp_base;
+
+    public:
+        static constexpr WireFormat WIRE_FORMAT = WIRE_COMPACT;
 
-        virtual Deserializer& operator>>(std::string& data);
+        CompactSizeSerializer(int64_t timestamp_base = COMPACT_TIMESTAMP_BASE);
+
+        size_t size() const;
+
+        /**
+         * Writes bytes already encoded in this format as they are.
+         */
+        void write_encoded(char const *data, size_t size);
+
+        using Serializer::operator<<;
+
+        virtual CompactSizeSerializer& operator<<(bool data);
+        virtual CompactSizeSerializer& operator<<(uint8_t data);
+        virtual CompactSizeSerializer& operator<<(uint16_t data);
+        virtual CompactSizeSerializer& operator<<(uint32_t data);
+        virtual CompactSizeSerializer& operator<<(uint64_t data);
+
+        virtual CompactSizeSerializer& operator<<(int8_t data);
+        virtual CompactSizeSerializer& operator<<(int16_t data);
+        virtual CompactSizeSerializer& operator<<(int32_t data);
+        virtual CompactSizeSerializer& operator<<(int64_t data);
+
+        virtual CompactSizeSerializer& operator<<(std::string const& data);
+
+        virtual Serializer& serialize_timestamp(int64_t data);
+
+    private:
+        void count_varint(uint64_t data);
 };
 
+/**
+ * Number of bytes the data takes once serialized in the given wire format.
+ */
+template <typename T>
+size_t serialized_size(WireFormat wire_format, T const& data);
+
+/*
+ * The integer operators of the buffer serializers and span deserializers are
+ * defined inline, so that encoding or decoding a message through the concrete
+ * class compiles down to straight-line code.
+ */
+
+inline void BinaryBufferSerializer::write_le(uint64_t data, size_t width)
+{
+    char bytes[sizeof(uint64_t)];
+    for (size_t i = 0; i < width; i++) {
+        bytes[i] = (char) (data >> (i * 8));
+    }
+    this->buffer.append(bytes, width);
+}
+
+inline BinaryBufferSerializer& BinaryBufferSerializer::operator<<(bool data)
+{
+    *this << (uint8_t) (data ? 1 : 0);
+    return *this;
+}
+
+inline BinaryBufferSerializer& BinaryBufferSerializer::operator<<(uint8_t data)
+{
+    this->write_le(data, sizeof(data));
+    return *this;
+}
+
+inline BinaryBufferSerializer& BinaryBufferSerializer::operator<<(uint16_t data)
+{
+    this->write_le(data, sizeof(data));
+    return *this;
+}
+
+inline BinaryBufferSerializer& BinaryBufferSerializer::operator<<(uint32_t data)
+{
+    this->write_le(data, sizeof(data));
+    return *this;
+}
+
+inline BinaryBufferSerializer& BinaryBufferSerializer::operator<<(uint64_t data)
+{
+    this->write_le(data, sizeof(data));
+    return *this;
+}
+
+inline BinaryBufferSerializer& BinaryBufferSerializer::operator<<(int8_t data)
+{
+    *this << (uint8_t) data;
+    return *this;
+}
+
+inline BinaryBufferSerializer& BinaryBufferSerializer::operator<<(int16_t data)
+{
+    *this << (uint16_t) data;
+    return *this;
+}
+
+inline BinaryBufferSerializer& BinaryBufferSerializer::operator<<(int32_t data)
+{
+    *this << (uint32_t) data;
+    return *this;
+}
+
+inline BinaryBufferSerializer& BinaryBufferSerializer::operator<<(int64_t data)
+{
+    *this << (uint64_t) data;
+    return *this;
+}
+
+inline uint64_t BinarySpanDeserializer::read_le(size_t width)
+{
+    if ((size_t) (this->end - this->cursor) < width) {
+        throw DeserializationUnexpectedEof();
+    }
+    uint64_t data = 0;
+    for (size_t i = 0; i < width; i++) {
+        data |= (uint64_t) (uint8_t) this->cursor[i] << (i * 8);
+    }
+    this->cursor += width;
+    return data;
+}
+
+inline BinarySpanDeserializer& BinarySpanDeserializer::operator>>(bool& data)
+{
+    uint8_t byte;
+    *this >> byte;
+    switch (byte) {
+        case 0:
+            data = false;
+            break;
+        case 1:
+            data = true;
+            break;
+        default:
+            throw BinaryInvalidBool(byte);
+    }
+    return *this;
+}
+
+inline BinarySpanDeserializer& BinarySpanDeserializer::operator>>(uint8_t& data)
+{
+    data = this->read_le(sizeof(data));
+    return *this;
+}
+
+inline BinarySpanDeserializer& BinarySpanDeserializer::operator>>(
+    uint16_t& data
+)
+{
+    data = this->read_le(sizeof(data));
+    return *this;
+}
+
+inline BinarySpanDeserializer& BinarySpanDeserializer::operator>>(
+    uint32_t& data
+)
+{
+    data = this->read_le(sizeof(data));
+    return *this;
+}
+
+inline BinarySpanDeserializer& BinarySpanDeserializer::operator>>(
+    uint64_t& data
+)
+{
+    data = this->read_le(sizeof(data));
+    return *this;
+}
+
+inline BinarySpanDeserializer& BinarySpanDeserializer::operator>>(int8_t& data)
+{
+    data = (int8_t) this->read_le(sizeof(data));
+    return *this;
+}
+
+inline BinarySpanDeserializer& BinarySpanDeserializer::operator>>(int16_t& data)
+{
+    data = (int16_t) this->read_le(sizeof(data));
+    return *this;
+}
+
+inline BinarySpanDeserializer& BinarySpanDeserializer::operator>>(int32_t& data)
+{
+    data = (int32_t) this->read_le(sizeof(data));
+    return *this;
+}
+
+inline BinarySpanDeserializer& BinarySpanDeserializer::operator>>(int64_t& data)
+{
+    data = (int64_t) this->read_le(sizeof(data));
+    return *this;
+}
+
+inline char const *plaintext_find_escape(char const *begin, char const *end)
+{
+    char const *cursor = begin;
+
+#ifdef __AVX2__
+    __m256i const wide_separators = _mm256_set1_epi8(';');
+    __m256i const wide_escapes = _mm256_set1_epi8('\\');
+    while (end - cursor >= 32) {
+        __m256i chunk = _mm256_loadu_si256((__m256i const *) cursor);
+        __m256i matches = _mm256_or_si256(
+            _mm256_cmpeq_epi8(chunk, wide_separators),
+            _mm256_cmpeq_epi8(chunk, wide_escapes)
+        );
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(matches);
+        if (mask != 0) {
+            return cursor + __builtin_ctz(mask);
+        }
+        cursor += 32;
+    }
+#endif
+
+#ifdef __SSE2__
+    __m128i const separators = _mm_set1_epi8(';');
+    __m128i const escapes = _mm_set1_epi8('\\');
+    while (end - cursor >= 16) {
+        __m128i chunk = _mm_loadu_si128((__m128i const *) cursor);
+        __m128i matches = _mm_or_si128(
+            _mm_cmpeq_epi8(chunk, separators),
+            _mm_cmpeq_epi8(chunk, escapes)
+        );
+        uint32_t mask = (uint32_t) _mm_movemask_epi8(matches);
+        if (mask != 0) {
+            return cursor + __builtin_ctz(mask);
+        }
+        cursor += 16;
+    }
+#endif
+
+    while (cursor != end && *cursor != ';' && *cursor != '\\') {
+        cursor++;
+    }
+    return cursor;
+}
+
+inline uint64_t zigzag_encode(int64_t data)
+{
+    return ((uint64_t) data << 1) ^ (uint64_t) (data >> 63);
+}
+
+inline int64_t zigzag_decode(uint64_t data)
+{
+    return (int64_t) (data >> 1) ^ -(int64_t) (data & 1);
+}
+
+inline void CompactBufferSerializer::write_varint(uint64_t data)
+{
+    char bytes[10];
+    size_t size = 0;
+    while (data >= 0x80) {
+        bytes[size] = (char) (data | 0x80);
+        data >>= 7;
+        size++;
+    }
+    bytes[size] = (char) data;
+    size++;
+    this->buffer.append(bytes, size);
+}
+
+inline CompactBufferSerializer& CompactBufferSerializer::operator<<(bool data)
+{
+    *this << (uint8_t) (data ? 1 : 0);
+    return *this;
+}
+
+inline CompactBufferSerializer& CompactBufferSerializer::operator<<(
+    uint8_t data
+)
+{
+    this->buffer.push_back((char) data);
+    return *this;
+}
+
+inline CompactBufferSerializer& CompactBufferSerializer::operator<<(
+    uint16_t data
+)
+{
+    this->write_varint(data);
+    return *this;
+}
+
+inline CompactBufferSerializer& CompactBufferSerializer::operator<<(
+    uint32_t data
+)
+{
+    this->write_varint(data);
+    return *this;
+}
+
+inline CompactBufferSerializer& CompactBufferSerializer::operator<<(
+    uint64_t data
+)
+{
+    this->write_varint(data);
+    return *this;
+}
+
+inline CompactBufferSerializer& CompactBufferSerializer::operator<<(int8_t data)
+{
+    *this << (uint8_t) data;
+    return *this;
+}
+
+inline CompactBufferSerializer& CompactBufferSerializer::operator<<(
+    int16_t data
+)
+{
+    this->write_varint(zigzag_encode(data));
+    return *this;
+}
+
+inline CompactBufferSerializer& CompactBufferSerializer::operator<<(
+    int32_t data
+)
+{
+    this->write_varint(zigzag_encode(data));
+    return *this;
+}
+
+inline CompactBufferSerializer& CompactBufferSerializer::operator<<(
+    int64_t data
+)
+{
+    this->write_varint(zigzag_encode(data));
+    return *this;
+}
+
+inline uint64_t CompactSpanDeserializer::read_varint(
+    char const *type,
+    uint64_t max
+)
+{
+    uint64_t data = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (this->cursor == this->end) {
+            throw DeserializationUnexpectedEof();
+        }
+        uint8_t byte = (uint8_t) *this->cursor;
+        this->cursor++;
+        uint64_t bits = byte & 0x7f;
+        if (shift == 63 && bits > 1) {
+            throw CompactInvalidVarint(type);
+        }
+        data |= bits << shift;
+        if ((byte & 0x80) == 0) {
+            if (data > max || (byte == 0 && shift > 0)) {
+                throw CompactInvalidVarint(type);
+            }
+            return data;
+        }
+    }
+    throw CompactInvalidVarint(type);
+}
+
+inline CompactSpanDeserializer& CompactSpanDeserializer::operator>>(bool& data)
+{
+    uint8_t byte;
+    *this >> byte;
+    switch (byte) {
+        case 0:
+            data = false;
+            break;
+        case 1:
+            data = true;
+            break;
+        default:
+            throw BinaryInvalidBool(byte);
+    }
+    return *this;
+}
+
+inline CompactSpanDeserializer& CompactSpanDeserializer::operator>>(
+    uint8_t& data
+)
+{
+    if (this->cursor == this->end) {
+        throw DeserializationUnexpectedEof();
+    }
+    data = (uint8_t) *this->cursor;
+    this->cursor++;
+    return *this;
+}
+
+inline CompactSpanDeserializer& CompactSpanDeserializer::operator>>(
+    uint16_t& data
+)
+{
+    data = this->read_varint("uint16_t", UINT16_MAX);
+    return *this;
+}
+
+inline CompactSpanDeserializer& CompactSpanDeserializer::operator>>(
+    uint32_t& data
+)
+{
+    data = this->read_varint("uint32_t", UINT32_MAX);
+    return *this;
+}
+
+inline CompactSpanDeserializer& CompactSpanDeserializer::operator>>(
+    uint64_t& data
+)
+{
+    data = this->read_varint("uint64_t", UINT64_MAX);
+    return *this;
+}
+
+inline CompactSpanDeserializer& CompactSpanDeserializer::operator>>(
+    int8_t& data
+)
+{
+    uint8_t byte;
+    *this >> byte;
+    data = (int8_t) byte;
+    return *this;
+}
+
+inline CompactSpanDeserializer& CompactSpanDeserializer::operator>>(
+    int16_t& data
+)
+{
+    data = zigzag_decode(this->read_varint("int16_t", UINT16_MAX));
+    return *this;
+}
+
+inline CompactSpanDeserializer& CompactSpanDeserializer::operator>>(
+    int32_t& data
+)
+{
+    data = zigzag_decode(this->read_varint("int32_t", UINT32_MAX));
+    return *this;
+}
+
+inline CompactSpanDeserializer& CompactSpanDeserializer::operator>>(
+    int64_t& data
+)
+{
+    data = zigzag_decode(this->read_varint("int64_t", UINT64_MAX));
+    return *this;
+}
+
+inline PlaintextSizeSerializer::PlaintextSizeSerializer() : size_(0)
+{
+}
+
+inline size_t PlaintextSizeSerializer::size() const
+{
+    return this->size_;
+}
+
+inline void PlaintextSizeSerializer::count_int(
+    uint64_t magnitude,
+    bool negative
+)
+{
+    size_t digits = 1;
+    while (magnitude >= 10) {
+        magnitude /= 10;
+        digits++;
+    }
+    this->size_ += digits + (negative ? 1 : 0) + 1;
+}
+
+inline PlaintextSizeSerializer& PlaintextSizeSerializer::operator<<(bool data)
+{
+    *this << (uint8_t) (data ? 1 : 0);
+    return *this;
+}
+
+inline PlaintextSizeSerializer& PlaintextSizeSerializer::operator<<(
+    uint8_t data
+)
+{
+    this->count_int(data, false);
+    return *this;
+}
+
+inline PlaintextSizeSerializer& PlaintextSizeSerializer::operator<<(
+    uint16_t data
+)
+{
+    this->count_int(data, false);
+    return *this;
+}
+
+inline PlaintextSizeSerializer& PlaintextSizeSerializer::operator<<(
+    uint32_t data
+)
+{
+    this->count_int(data, false);
+    return *this;
+}
+
+inline PlaintextSizeSerializer& PlaintextSizeSerializer::operator<<(
+    uint64_t data
+)
+{
+    this->count_int(data, false);
+    return *this;
+}
+
+inline PlaintextSizeSerializer& PlaintextSizeSerializer::operator<<(
+    int8_t data
+)
+{
+    *this << (int64_t) data;
+    return *this;
+}
+
+inline PlaintextSizeSerializer& PlaintextSizeSerializer::operator<<(
+    int16_t data
+)
+{
+    *this << (int64_t) data;
+    return *this;
+}
+
+inline PlaintextSizeSerializer& PlaintextSizeSerializer::operator<<(
+    int32_t data
+)
+{
+    *this << (int64_t) data;
+    return *this;
+}
+
+inline PlaintextSizeSerializer& PlaintextSizeSerializer::operator<<(
+    int64_t data
+)
+{
+    uint64_t magnitude = data < 0 ? -(uint64_t) data : (uint64_t) data;
+    this->count_int(magnitude, data < 0);
+    return *this;
+}
+
+inline PlaintextSizeSerializer& PlaintextSizeSerializer::operator<<(
+    std::string const& data
+)
+{
+    char const *cursor = data.data();
+    char const *end = cursor + data.size();
+    this->size_ += data.size() + 1;
+    for (;;) {
+        cursor = plaintext_find_escape(cursor, end);
+        if (cursor == end) {
+            break;
+        }
+        this->size_++;
+        cursor++;
+    }
+    return *this;
+}
+
+inline BinarySizeSerializer::BinarySizeSerializer() : size_(0)
+{
+}
+
+inline size_t BinarySizeSerializer::size() const
+{
+    return this->size_;
+}
+
+inline BinarySizeSerializer& BinarySizeSerializer::operator<<(bool data)
+{
+    this->size_ += sizeof(uint8_t);
+    return *this;
+}
+
+inline BinarySizeSerializer& BinarySizeSerializer::operator<<(uint8_t data)
+{
+    this->size_ += sizeof(data);
+    return *this;
+}
+
+inline BinarySizeSerializer& BinarySizeSerializer::operator<<(uint16_t data)
+{
+    this->size_ += sizeof(data);
+    return *this;
+}
+
+inline BinarySizeSerializer& BinarySizeSerializer::operator<<(uint32_t data)
+{
+    this->size_ += sizeof(data);
+    return *this;
+}
+
+inline BinarySizeSerializer& BinarySizeSerializer::operator<<(uint64_t data)
+{
+    this->size_ += sizeof(data);
+    return *this;
+}
+
+inline BinarySizeSerializer& BinarySizeSerializer::operator<<(int8_t data)
+{
+    this->size_ += sizeof(data);
+    return *this;
+}
+
+inline BinarySizeSerializer& BinarySizeSerializer::operator<<(int16_t data)
+{
+    this->size_ += sizeof(data);
+    return *this;
+}
+
+inline BinarySizeSerializer& BinarySizeSerializer::operator<<(int32_t data)
+{
+    this->size_ += sizeof(data);
+    return *this;
+}
+
+inline BinarySizeSerializer& BinarySizeSerializer::operator<<(int64_t data)
+{
+    this->size_ += sizeof(data);
+    return *this;
+}
+
+inline BinarySizeSerializer& BinarySizeSerializer::operator<<(
+    std::string const& data
+)
+{
+    this->size_ += sizeof(uint32_t) + data.size();
+    return *this;
+}
+
+inline CompactSizeSerializer::CompactSizeSerializer(int64_t timestamp_base) :
+    size_(0),
+    timestamp_base(timestamp_base)
+{
+}
+
+inline size_t CompactSizeSerializer::size() const
+{
+    return this->size_;
+}
+
+inline void CompactSizeSerializer::count_varint(uint64_t data)
+{
+    size_t size = 1;
+    while (data >= 0x80) {
+        data >>= 7;
+        size++;
+    }
+    this->size_ += size;
+}
+
+inline CompactSizeSerializer& CompactSizeSerializer::operator<<(bool data)
+{
+    this->size_ += sizeof(uint8_t);
+    return *this;
+}
+
+inline CompactSizeSerializer& CompactSizeSerializer::operator<<(uint8_t data)
+{
+    this->size_ += sizeof(data);
+    return *this;
+}
+
+inline CompactSizeSerializer& CompactSizeSerializer::operator<<(uint16_t data)
+{
+    this->count_varint(data);
+    return *this;
+}
+
+inline CompactSizeSerializer& CompactSizeSerializer::operator<<(uint32_t data)
+{
+    this->count_varint(data);
+    return *this;
+}
+
+inline CompactSizeSerializer& CompactSizeSerializer::operator<<(uint64_t data)
+{
+    this->count_varint(data);
+    return *this;
+}
+
+inline CompactSizeSerializer& CompactSizeSerializer::operator<<(int8_t data)
+{
+    this->size_ += sizeof(data);
+    return *this;
+}
+
+inline CompactSizeSerializer& CompactSizeSerializer::operator<<(int16_t data)
+{
+    this->count_varint(zigzag_encode(data));
+    return *this;
+}
+
+inline CompactSizeSerializer& CompactSizeSerializer::operator<<(int32_t data)
+{
+    this->count_varint(zigzag_encode(data));
+    return *this;
+}
+
+inline CompactSizeSerializer& CompactSizeSerializer::operator<<(int64_t data)
+{
+    this->count_varint(zigzag_encode(data));
+    return *this;
+}
+
+inline CompactSizeSerializer& CompactSizeSerializer::operator<<(
+    std::string const& data
+)
+{
+    this->count_varint(data.size());
+    this->size_ += data.size();
+    return *this;
+}
+
+inline Serializer& CompactSizeSerializer::serialize_timestamp(int64_t data)
+{
+    this->count_varint(
+        zigzag_encode((int64_t) ((uint64_t) data - this->timestamp_base))
+    );
+    return *this;
+}
+
+inline void PlaintextBufferSerializer::write_encoded(
+    char const *data,
+    size_t size
+)
+{
+    this->buffer.append(data, size);
+}
+
+inline void BinaryBufferSerializer::write_encoded(char const *data, size_t size)
+{
+    this->buffer.append(data, size);
+}
+
+inline void CompactBufferSerializer::write_encoded(
+    char const *data,
+    size_t size
+)
+{
+    this->buffer.append(data, size);
+}
+
+inline void PlaintextSizeSerializer::write_encoded(
+    char const *data,
+    size_t size
+)
+{
+    this->size_ += size;
+}
+
+inline void BinarySizeSerializer::write_encoded(char const *data, size_t size)
+{
+    this->size_ += size;
+}
+
+inline void CompactSizeSerializer::write_encoded(char const *data, size_t size)
+{
+    this->size_ += size;
+}
+
+template <typename T>
+size_t serialized_size(WireFormat wire_format, T const& data)
+{
+    switch (wire_format) {
+        case WIRE_PLAINTEXT: {
+            PlaintextSizeSerializer serializer;
+            serializer << data;
+            return serializer.size();
+        }
+        case WIRE_BINARY: {
+            BinarySizeSerializer serializer;
+            serializer << data;
+            return serializer.size();
+        }
+        case WIRE_COMPACT: {
+            CompactSizeSerializer serializer;
+            serializer << data;
+            return serializer.size();
+        }
+    }
+    return 0;
+}
+
 #endif
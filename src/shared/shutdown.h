@@ -7,12 +7,21 @@
 #include <atomic>
 #include <memory>
 #include <condition_variable>
+#include "reactor.h"
 
 enum ShutdownEof {
     SHUTDOWN_ACTIVE_EOF,
     SHUTDOWN_PASSIVE_EOF
 };
 
+/**
+ * The reactor woken up when a graceful shutdown is signalled, either through
+ * signal_graceful_shutdown or SIGINT. Threads waiting for input can watch
+ * their descriptors with it, so that they return as soon as the program
+ * shuts down.
+ */
+Reactor& shutdown_reactor();
+
 void signal_graceful_shutdown();
 
 void wait_for_graceful_shutdown(ShutdownEof shutdown_eof);
@@ -1,4 +1,5 @@
 #include "socket.h"
+#include "uring.h"
 #include "log.h"
 #include "time.h"
 #include <cerrno>
@@ -7,6 +8,10 @@
 #include <poll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <netinet/udp.h>
+#include <climits>
+#include <deque>
 #include <arpa/inet.h>
 #include <iostream>
 #include <sstream>
@@ -41,17 +46,333 @@ const char *InvalidAddrLen::what() const noexcept
     return this->message.c_str();
 }
 
-Socket::Socket(size_t max_message_size) : max_message_size(max_message_size)
+MessageTooLarge::MessageTooLarge(size_t size, size_t max_size) :
+    size_(size),
+    max_size_(max_size),
+    message(
+        "message of "
+        + std::to_string(size)
+        + " bytes exceeds the maximum of "
+        + std::to_string(max_size)
+        + " bytes"
+    )
+{
+}
+
+size_t MessageTooLarge::size() const
+{
+    return this->size_;
+}
+
+size_t MessageTooLarge::max_size() const
+{
+    return this->max_size_;
+}
+
+const char *MessageTooLarge::what() const noexcept
+{
+    return this->message.c_str();
+}
+
+OutgoingDatagram::OutgoingDatagram(Address remote, std::string const& bytes) :
+    remote(remote),
+    bytes(&bytes)
+{
+}
+
+SocketStats::SocketStats() :
+    send_syscalls(0),
+    sent_messages(0),
+    sent_datagrams(0),
+    recv_syscalls(0),
+    received_messages(0),
+    received_datagrams(0),
+    kernel_drops(0),
+    recv_buffer_allocations(0)
+{
+}
+
+double SocketStats::datagrams_per_send_syscall() const
+{
+    if (this->send_syscalls == 0) {
+        return 0;
+    }
+    return (double) this->sent_datagrams / this->send_syscalls;
+}
+
+double SocketStats::datagrams_per_sent_message() const
+{
+    if (this->sent_messages == 0) {
+        return 0;
+    }
+    return (double) this->sent_datagrams / this->sent_messages;
+}
+
+double SocketStats::datagrams_per_recv_syscall() const
+{
+    if (this->recv_syscalls == 0) {
+        return 0;
+    }
+    return (double) this->received_datagrams / this->recv_syscalls;
+}
+
+double SocketStats::datagrams_per_received_message() const
+{
+    if (this->received_messages == 0) {
+        return 0;
+    }
+    return (double) this->received_datagrams / this->received_messages;
+}
+
+SocketBufferSizes::SocketBufferSizes() : recv(0), send(0)
+{
+}
+
+Transport::Transport(size_t max_message_size, WireFormat wire_format) :
+    max_message_size_(max_message_size),
+    wire_format_(wire_format)
+{
+}
+
+Transport::~Transport()
+{
+}
+
+WireFormat Transport::wire_format() const
+{
+    return this->wire_format_;
+}
+
+size_t Transport::max_message_size() const
+{
+    return this->max_message_size_;
+}
+
+size_t Transport::serialized_size(Message const& message) const
+{
+    return ::serialized_size(this->wire_format_, message);
+}
+
+void Transport::encode(Message const& message, std::string& datagram) const
+{
+    size_t size = this->serialized_size(message);
+    if (size > this->max_message_size_) {
+        throw MessageTooLarge(size, this->max_message_size_);
+    }
+
+    datagram.clear();
+    datagram.reserve(size);
+    switch (this->wire_format_) {
+        case WIRE_PLAINTEXT: {
+            PlaintextBufferSerializer serializer(datagram);
+            serializer << message;
+            break;
+        }
+        case WIRE_BINARY: {
+            BinaryBufferSerializer serializer(datagram);
+            serializer << message;
+            break;
+        }
+        case WIRE_COMPACT: {
+            CompactBufferSerializer serializer(datagram);
+            serializer << message;
+            break;
+        }
+    }
+}
+
+void Transport::send(Enveloped const& enveloped)
+{
+    std::string datagram;
+    this->encode(enveloped.message, datagram);
+    this->send_encoded(enveloped.remote, datagram);
+}
+
+bool Transport::set_drop_monitoring(bool enabled)
+{
+    return false;
+}
+
+bool Transport::set_busy_poll(uint64_t usecs)
+{
+    return false;
+}
+
+SocketBufferSizes Transport::set_buffer_sizes(size_t bytes)
+{
+    return this->buffer_sizes();
+}
+
+SocketBufferSizes Transport::buffer_sizes() const
+{
+    return SocketBufferSizes();
+}
+
+Enveloped Transport::decode_lazy(
+    DatagramBuffer&& buf,
+    size_t count,
+    Address remote
+) const
+{
+    Enveloped enveloped;
+    enveloped.remote = remote;
+
+    MessageTag tag;
+    size_t offset = 0;
+    switch (this->wire_format_) {
+        case WIRE_PLAINTEXT: {
+            PlaintextSpanDeserializer deserializer(buf.data(), count);
+            tag = enveloped.message.decode_header(deserializer);
+            offset = deserializer.position() - buf.data();
+            break;
+        }
+        case WIRE_BINARY: {
+            BinarySpanDeserializer deserializer(buf.data(), count);
+            tag = enveloped.message.decode_header(deserializer);
+            offset = deserializer.position() - buf.data();
+            break;
+        }
+        case WIRE_COMPACT: {
+            CompactSpanDeserializer deserializer(buf.data(), count);
+            tag = enveloped.message.decode_header(deserializer);
+            offset = deserializer.position() - buf.data();
+            break;
+        }
+    }
+
+    buf.resize(count);
+    enveloped.message.body = make_pooled<MessageRawBody>(
+        tag,
+        this->wire_format_,
+        std::move(buf),
+        offset
+    );
+
+    return enveloped;
+}
+
+void Transport::push_lazy(
+    std::vector<Enveloped>& batch,
+    DatagramBuffer&& buf,
+    size_t count,
+    Address remote,
+    std::optional<int64_t> received_at_nanos
+) const
+{
+    try {
+        batch.push_back(this->decode_lazy(std::move(buf), count, remote));
+        batch.back().received_at_nanos = received_at_nanos;
+    } catch (MessageOutOfProtocol const& exc) {
+    } catch (DeserializationError const& exc) {
+        Logger::with([&exc] (auto& output) {
+            output
+                << "failed to deserialize a packet: "
+                << exc.what()
+                << std::endl;
+        });
+    }
+}
+
+Socket::Counters::Counters() :
+    send_syscalls(0),
+    sent_messages(0),
+    sent_datagrams(0),
+    recv_syscalls(0),
+    received_messages(0),
+    received_datagrams(0),
+    kernel_drops(0)
+{
+}
+
+SocketStats Socket::Counters::load() const
+{
+    SocketStats stats;
+    stats.send_syscalls = this->send_syscalls.load();
+    stats.sent_messages = this->sent_messages.load();
+    stats.sent_datagrams = this->sent_datagrams.load();
+    stats.recv_syscalls = this->recv_syscalls.load();
+    stats.received_messages = this->received_messages.load();
+    stats.received_datagrams = this->received_datagrams.load();
+    stats.kernel_drops = this->kernel_drops.load();
+    return stats;
+}
+
+void Socket::Counters::store(SocketStats const& stats)
+{
+    this->send_syscalls.store(stats.send_syscalls);
+    this->sent_messages.store(stats.sent_messages);
+    this->sent_datagrams.store(stats.sent_datagrams);
+    this->recv_syscalls.store(stats.recv_syscalls);
+    this->received_messages.store(stats.received_messages);
+    this->received_datagrams.store(stats.received_datagrams);
+    this->kernel_drops.store(stats.kernel_drops);
+}
+
+void Socket::Counters::count_sends(
+    uint64_t syscalls,
+    uint64_t messages,
+    uint64_t datagrams
+)
+{
+    this->send_syscalls.fetch_add(syscalls, std::memory_order_relaxed);
+    this->sent_messages.fetch_add(messages, std::memory_order_relaxed);
+    this->sent_datagrams.fetch_add(datagrams, std::memory_order_relaxed);
+}
+
+void Socket::Counters::count_recvs(
+    uint64_t syscalls,
+    uint64_t messages,
+    uint64_t datagrams
+)
+{
+    this->recv_syscalls.fetch_add(syscalls, std::memory_order_relaxed);
+    this->received_messages.fetch_add(messages, std::memory_order_relaxed);
+    this->received_datagrams.fetch_add(datagrams, std::memory_order_relaxed);
+}
+
+Socket::Socket(
+    size_t max_message_size,
+    WireFormat wire_format,
+    SocketBackend backend
+) :
+    Transport(max_message_size, wire_format),
+    recv_pool(max_message_size + 1),
+    gso(false),
+    gro(false),
+    timestamps(false),
+    drop_monitoring(false)
 {
     this->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
     if (this->sockfd < 0) {
         throw SocketIoError("socket create");
     }
+    this->set_gso(true);
+    this->start_backend(backend);
 }
 
-Socket::Socket(Address bind_addr, size_t max_message_size) :
-    Socket(max_message_size)
-{
+Socket::Socket(
+    Address bind_addr,
+    size_t max_message_size,
+    WireFormat wire_format,
+    bool reuse_port,
+    SocketBackend backend
+) :
+    Socket(max_message_size, wire_format)
+{
+    if (reuse_port) {
+        int enable = 1;
+        int status = setsockopt(
+            this->sockfd,
+            SOL_SOCKET,
+            SO_REUSEPORT,
+            &enable,
+            sizeof(enable)
+        );
+        if (status < 0) {
+            throw SocketIoError("socket reuse port");
+        }
+    }
+
     struct sockaddr_in native_bind_addr;
 
     native_bind_addr.sin_family = AF_INET;
@@ -67,44 +388,596 @@ Socket::Socket(Address bind_addr, size_t max_message_size) :
     if (status < 0) {
         throw SocketIoError("socket bind");
     }
+
+    this->start_backend(backend);
 }
 
 Socket::Socket(Socket&& other) :
+    Transport(other.max_message_size_, other.wire_format_),
     sockfd(other.sockfd),
-    max_message_size(other.max_message_size)
+    send_buffer(std::move(other.send_buffer)),
+    recv_pool(std::move(other.recv_pool)),
+    recv_buffers(std::move(other.recv_buffers)),
+    recv_iovecs(std::move(other.recv_iovecs)),
+    recv_addrs(std::move(other.recv_addrs)),
+    recv_headers(std::move(other.recv_headers)),
+    recv_controls(std::move(other.recv_controls)),
+    send_iovecs(std::move(other.send_iovecs)),
+    send_addrs(std::move(other.send_addrs)),
+    send_headers(std::move(other.send_headers)),
+    send_controls(std::move(other.send_controls)),
+    send_segments(std::move(other.send_segments)),
+    gso(other.gso),
+    gro(other.gro),
+    timestamps(other.timestamps),
+    drop_monitoring(other.drop_monitoring),
+    pending_datagrams(std::move(other.pending_datagrams)),
+    uring(std::move(other.uring))
+{
+    this->counters.store(other.counters.load());
+    other.sockfd = -1;
+}
+
+Socket& Socket::operator=(Socket&& other)
 {
+    if (this->sockfd != other.sockfd) {
+        this->close();
+    }
+    this->max_message_size_ = other.max_message_size_;
+    this->wire_format_ = other.wire_format_;
+    this->send_buffer = std::move(other.send_buffer);
+    this->recv_pool = std::move(other.recv_pool);
+    this->recv_buffers = std::move(other.recv_buffers);
+    this->recv_iovecs = std::move(other.recv_iovecs);
+    this->recv_addrs = std::move(other.recv_addrs);
+    this->recv_headers = std::move(other.recv_headers);
+    this->recv_controls = std::move(other.recv_controls);
+    this->send_iovecs = std::move(other.send_iovecs);
+    this->send_addrs = std::move(other.send_addrs);
+    this->send_headers = std::move(other.send_headers);
+    this->send_controls = std::move(other.send_controls);
+    this->send_segments = std::move(other.send_segments);
+    this->gso = other.gso;
+    this->gro = other.gro;
+    this->timestamps = other.timestamps;
+    this->drop_monitoring = other.drop_monitoring;
+    this->pending_datagrams = std::move(other.pending_datagrams);
+    this->counters.store(other.counters.load());
+    this->uring = std::move(other.uring);
+    this->sockfd = other.sockfd;
     other.sockfd = -1;
+    return *this;
+}
+
+Socket::~Socket()
+{
+    this->close();
+}
+
+SocketBackend Socket::backend() const
+{
+    return this->uring ? SOCKET_IO_URING : SOCKET_POLL;
+}
+
+int Socket::readable_fd() const
+{
+    if (this->uring) {
+        return this->uring->readable_fd();
+    }
+    return this->sockfd;
+}
+
+bool Socket::set_gso(bool enabled)
+{
+    std::unique_lock lock(this->send_mutex);
+
+    if (enabled) {
+        int segment_size = 0;
+        socklen_t length = sizeof(segment_size);
+        int status = getsockopt(
+            this->sockfd,
+            SOL_UDP,
+            UDP_SEGMENT,
+            &segment_size,
+            &length
+        );
+        enabled = status == 0;
+    }
+    this->gso = enabled;
+    return this->gso;
+}
+
+bool Socket::gso_enabled() const
+{
+    return this->gso;
+}
+
+bool Socket::set_gro(bool enabled)
+{
+    if (this->uring) {
+        return false;
+    }
+
+    int value = enabled;
+    int status = setsockopt(
+        this->sockfd,
+        SOL_UDP,
+        UDP_GRO,
+        &value,
+        sizeof(value)
+    );
+    if (status < 0) {
+        this->gro = false;
+    } else {
+        this->gro = enabled;
+    }
+    return this->gro;
+}
+
+bool Socket::gro_enabled() const
+{
+    return this->gro;
+}
+
+bool Socket::set_timestamps(bool enabled)
+{
+    if (this->uring) {
+        return false;
+    }
+
+    int value = enabled;
+    int status = setsockopt(
+        this->sockfd,
+        SOL_SOCKET,
+        SO_TIMESTAMPNS,
+        &value,
+        sizeof(value)
+    );
+    if (status < 0) {
+        this->timestamps = false;
+    } else {
+        this->timestamps = enabled;
+    }
+    return this->timestamps;
+}
+
+bool Socket::timestamps_enabled() const
+{
+    return this->timestamps;
+}
+
+bool Socket::set_drop_monitoring(bool enabled)
+{
+    if (this->uring) {
+        return false;
+    }
+
+    int value = enabled;
+    int status = setsockopt(
+        this->sockfd,
+        SOL_SOCKET,
+        SO_RXQ_OVFL,
+        &value,
+        sizeof(value)
+    );
+    if (status < 0) {
+        this->drop_monitoring = false;
+    } else {
+        this->drop_monitoring = enabled;
+    }
+    return this->drop_monitoring;
+}
+
+bool Socket::drop_monitoring_enabled() const
+{
+    return this->drop_monitoring;
+}
+
+bool Socket::set_busy_poll(uint64_t usecs)
+{
+    int value = std::min(usecs, (uint64_t) INT_MAX);
+    int status = setsockopt(
+        this->sockfd,
+        SOL_SOCKET,
+        SO_BUSY_POLL,
+        &value,
+        sizeof(value)
+    );
+    return status >= 0;
+}
+
+SocketBufferSizes Socket::set_buffer_sizes(size_t bytes)
+{
+    int size = std::min(bytes, (size_t) INT_MAX);
+    int forced = setsockopt(
+        this->sockfd,
+        SOL_SOCKET,
+        SO_RCVBUFFORCE,
+        &size,
+        sizeof(size)
+    );
+    if (forced < 0) {
+        int status = setsockopt(
+            this->sockfd,
+            SOL_SOCKET,
+            SO_RCVBUF,
+            &size,
+            sizeof(size)
+        );
+        if (status < 0) {
+            throw SocketIoError("socket set receive buffer");
+        }
+    }
+
+    forced = setsockopt(
+        this->sockfd,
+        SOL_SOCKET,
+        SO_SNDBUFFORCE,
+        &size,
+        sizeof(size)
+    );
+    if (forced < 0) {
+        int status = setsockopt(
+            this->sockfd,
+            SOL_SOCKET,
+            SO_SNDBUF,
+            &size,
+            sizeof(size)
+        );
+        if (status < 0) {
+            throw SocketIoError("socket set send buffer");
+        }
+    }
+
+    return this->buffer_sizes();
+}
+
+SocketBufferSizes Socket::buffer_sizes() const
+{
+    SocketBufferSizes sizes;
+    int size = 0;
+    socklen_t length = sizeof(size);
+    if (getsockopt(this->sockfd, SOL_SOCKET, SO_RCVBUF, &size, &length) < 0) {
+        throw SocketIoError("socket get receive buffer");
+    }
+    sizes.recv = size;
+
+    length = sizeof(size);
+    if (getsockopt(this->sockfd, SOL_SOCKET, SO_SNDBUF, &size, &length) < 0) {
+        throw SocketIoError("socket get send buffer");
+    }
+    sizes.send = size;
+    return sizes;
+}
+
+SocketStats Socket::stats() const
+{
+    SocketStats stats = this->counters.load();
+    stats.recv_buffer_allocations = this->recv_pool.allocations();
+    return stats;
 }
 
-Socket& Socket::operator=(Socket&& other)
-{
-    if (this->sockfd != other.sockfd) {
-        this->close();
+Enveloped Socket::receive()
+{
+    DatagramBuffer buf;
+    Enveloped enveloped;
+    size_t count = this->receive_datagram(
+        buf,
+        enveloped.remote,
+        enveloped.received_at_nanos
+    );
+
+    switch (this->wire_format_) {
+        case WIRE_PLAINTEXT: {
+            PlaintextSpanDeserializer deserializer(buf.data(), count);
+            deserializer >> enveloped.message;
+            break;
+        }
+        case WIRE_BINARY: {
+            BinarySpanDeserializer deserializer(buf.data(), count);
+            deserializer >> enveloped.message;
+            break;
+        }
+        case WIRE_COMPACT: {
+            CompactSpanDeserializer deserializer(buf.data(), count);
+            deserializer >> enveloped.message;
+            break;
+        }
+    }
+
+    return enveloped;
+}
+
+std::optional<Enveloped> Socket::receive(int timeout_ms)
+{
+    if (this->poll_readable(timeout_ms)) {
+        return this->receive();
+    }
+    return std::optional<Enveloped>();
+}
+
+Enveloped Socket::receive_lazy()
+{
+    DatagramBuffer buf;
+    Address remote;
+    std::optional<int64_t> received_at_nanos;
+    size_t count = this->receive_datagram(buf, remote, received_at_nanos);
+    Enveloped enveloped = this->decode_lazy(std::move(buf), count, remote);
+    enveloped.received_at_nanos = received_at_nanos;
+    return enveloped;
+}
+
+std::optional<Enveloped> Socket::receive_lazy(int timeout_ms)
+{
+    if (this->poll_readable(timeout_ms)) {
+        return this->receive_lazy();
+    }
+    return std::optional<Enveloped>();
+}
+
+std::vector<Enveloped> Socket::receive_batch(size_t max_count, int timeout_ms)
+{
+    std::vector<Enveloped> batch;
+    if (max_count == 0) {
+        return batch;
+    }
+    if (timeout_ms != 0 && !this->poll_readable(timeout_ms)) {
+        return batch;
+    }
+
+    if (!this->pending_datagrams.empty()) {
+        this->drain_pending(batch);
+        return batch;
+    }
+
+    if (this->uring) {
+        DatagramBuffer buf;
+        size_t count;
+        Address remote;
+        batch.reserve(max_count);
+        for (size_t taken = 0; taken < max_count; taken++) {
+            if (buf.capacity() == 0) {
+                buf = this->recv_pool.take();
+            }
+            if (!this->uring->try_receive(buf, count, remote)) {
+                break;
+            }
+            this->push_lazy(
+                batch,
+                std::move(buf),
+                count,
+                remote,
+                std::optional<int64_t>()
+            );
+        }
+        this->counters.count_recvs(
+            this->uring->take_recv_syscalls(),
+            batch.size(),
+            batch.size()
+        );
+        return batch;
+    }
+
+    this->prepare_recv_batch(max_count);
+    int count = recvmmsg(
+        this->sockfd,
+        this->recv_headers.data(),
+        max_count,
+        MSG_DONTWAIT,
+        nullptr
+    );
+    this->counters.count_recvs(1, 0, 0);
+    if (count < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return batch;
+        }
+        throw SocketIoError("socket recvmmsg");
+    }
+
+    batch.reserve(count);
+    for (int i = 0; i < count; i++) {
+        struct msghdr& header = this->recv_headers[i].msg_hdr;
+        if (header.msg_namelen != sizeof(struct sockaddr_in)) {
+            throw InvalidAddrLen(
+                "Socket address unexpectedly has the wrong length"
+            );
+        }
+
+        Address remote;
+        remote.ipv4 = ntohl(this->recv_addrs[i].sin_addr.s_addr);
+        remote.port = ntohs(this->recv_addrs[i].sin_port);
+
+        if (this->gro) {
+            this->unpack_received(
+                header,
+                this->recv_headers[i].msg_len,
+                remote
+            );
+        } else {
+            ReceivedControls controls = this->read_controls(header);
+            this->push_lazy(
+                batch,
+                std::move(this->recv_buffers[i]),
+                this->recv_headers[i].msg_len,
+                remote,
+                controls.received_at_nanos
+            );
+        }
+    }
+
+    if (this->gro) {
+        this->drain_pending(batch);
+    } else {
+        this->counters.count_recvs(0, count, count);
+    }
+
+    return batch;
+}
+
+void Socket::send(Enveloped const& enveloped)
+{
+    std::unique_lock lock(this->send_mutex);
+
+    this->encode(enveloped.message, this->send_buffer);
+    this->send_encoded(enveloped.remote, this->send_buffer);
+}
+
+void Socket::send_encoded(Address const& remote, std::string const& datagram)
+{
+    if (this->uring) {
+        this->uring->send(remote, datagram);
+        this->counters.count_sends(this->uring->take_send_syscalls(), 1, 1);
+        return;
+    }
+
+    struct sockaddr_in receiver_addr_in;
+
+    receiver_addr_in.sin_family = AF_INET;
+    receiver_addr_in.sin_port = htons(remote.port);
+    receiver_addr_in.sin_addr.s_addr = htonl(remote.ipv4);
+    bzero(&receiver_addr_in.sin_zero, 8);
+
+    ssize_t result = sendto(
+        this->sockfd,
+        datagram.data(),
+        datagram.size(),
+        0,
+        (struct sockaddr *) &receiver_addr_in,
+        sizeof(receiver_addr_in)
+    );
+    this->counters.count_sends(1, 1, 1);
+
+    if (result < 0) {
+        throw SocketIoError("socket send");
+    }
+}
+
+void Socket::send_batch(std::vector<OutgoingDatagram> const& datagrams)
+{
+    if (this->uring) {
+        this->uring->send_batch(datagrams);
+        this->counters.count_sends(
+            this->uring->take_send_syscalls(),
+            datagrams.size(),
+            datagrams.size()
+        );
+        return;
+    }
+
+    std::unique_lock lock(this->send_mutex);
+
+    size_t sent = 0;
+    while (sent < datagrams.size()) {
+        size_t count = std::min(datagrams.size() - sent, (size_t) UIO_MAXIOV);
+        size_t headers = this->prepare_send_batch(datagrams, sent, count);
+        int result = sendmmsg(
+            this->sockfd,
+            this->send_headers.data(),
+            headers,
+            0
+        );
+        if (result < 0) {
+            if (headers < count && (errno == EIO || errno == EINVAL)) {
+                SocketIoError error("socket sendmmsg with GSO");
+                Logger::with([&error] (auto& output) {
+                    output
+                        << "UDP GSO is not usable, falling back to plain "
+                        << "sends: "
+                        << error.what()
+                        << std::endl;
+                });
+                this->gso = false;
+                continue;
+            }
+            throw SocketIoError("socket sendmmsg");
+        }
+
+        size_t sent_datagrams = 0;
+        for (int i = 0; i < result; i++) {
+            sent_datagrams += this->send_segments[i];
+        }
+        this->counters.count_sends(1, result, sent_datagrams);
+        sent += sent_datagrams;
     }
-    this->max_message_size = other.max_message_size;
-    this->sockfd = other.sockfd;
-    other.sockfd = -1;
-    return *this;
 }
 
-Socket::~Socket()
+void Socket::start_backend(SocketBackend backend)
 {
-    this->close();
+    if (backend != SOCKET_IO_URING) {
+        return;
+    }
+
+    try {
+        this->uring = std::make_unique<UringSocket>(
+            this->sockfd,
+            this->max_message_size_
+        );
+    } catch (UringUnsupported const& exc) {
+        Logger::with([&exc] (auto& output) {
+            output
+                << "io_uring is not available, falling back to poll: "
+                << exc.what()
+                << std::endl;
+        });
+    }
 }
 
-Enveloped Socket::receive()
+size_t Socket::receive_datagram(
+    DatagramBuffer& buf,
+    Address& remote,
+    std::optional<int64_t>& received_at_nanos
+)
 {
+    if (this->uring) {
+        buf = this->recv_pool.take();
+        size_t count;
+        while (!this->uring->try_receive(buf, count, remote)) {
+            this->uring->wait_readable(-1);
+        }
+        this->counters.count_recvs(this->uring->take_recv_syscalls(), 1, 1);
+        return count;
+    }
+
+    if (this->needs_controls() || !this->pending_datagrams.empty()) {
+        while (this->pending_datagrams.empty()) {
+            this->prepare_recv_batch(1);
+            struct msghdr& header = this->recv_headers[0].msg_hdr;
+            ssize_t count = recvmsg(this->sockfd, &header, 0);
+            this->counters.count_recvs(1, 0, 0);
+            if (count < 0) {
+                throw SocketIoError("socket recv");
+            }
+            if (header.msg_namelen != sizeof(struct sockaddr_in)) {
+                throw InvalidAddrLen(
+                    "Socket address unexpectedly has the wrong length"
+                );
+            }
+            Address sender;
+            sender.ipv4 = ntohl(this->recv_addrs[0].sin_addr.s_addr);
+            sender.port = ntohs(this->recv_addrs[0].sin_port);
+            this->unpack_received(header, count, sender);
+        }
+
+        PendingDatagram& datagram = this->pending_datagrams.front();
+        buf = std::move(datagram.bytes);
+        remote = datagram.remote;
+        received_at_nanos = datagram.received_at_nanos;
+        this->pending_datagrams.pop_front();
+        return buf.size();
+    }
+
     struct sockaddr_in sender_addr;
     socklen_t sender_len = sizeof(sender_addr);
-    std::string buf(this->max_message_size + 1, '\0');
+    buf = this->recv_pool.take();
     ssize_t count = recvfrom(
         this->sockfd,
         buf.data(),
-        this->max_message_size,
+        this->max_message_size_,
         0,
         (struct sockaddr *) &sender_addr,
         &sender_len
     );
+    this->counters.count_recvs(1, 1, 1);
     if (count < 0) {
         throw SocketIoError("socket recv");
     }
@@ -114,68 +987,263 @@ Enveloped Socket::receive()
         );
     }
 
-    Enveloped enveloped;
-
-    enveloped.remote.ipv4 = ntohl(sender_addr.sin_addr.s_addr);
-    enveloped.remote.port = ntohs(sender_addr.sin_port);
+    remote.ipv4 = ntohl(sender_addr.sin_addr.s_addr);
+    remote.port = ntohs(sender_addr.sin_port);
 
     buf.resize(count);
-    std::istringstream istream(buf);
-    PlaintextDeserializer deserializer_impl(istream);
-    Deserializer& deserializer = deserializer_impl;
-    deserializer >> enveloped.message;
+    return count;
+}
 
-    return enveloped;
+void Socket::prepare_recv_batch(size_t max_count)
+{
+    if (this->recv_headers.size() < max_count) {
+        this->recv_buffers.resize(max_count);
+        this->recv_iovecs.resize(max_count);
+        this->recv_addrs.resize(max_count);
+        this->recv_headers.resize(max_count);
+        this->recv_controls.resize(max_count);
+    }
+
+    size_t read_size = this->max_message_size_;
+    if (this->gro) {
+        read_size = SOCKET_GRO_BUFFER_SIZE;
+    }
+
+    for (size_t i = 0; i < max_count; i++) {
+        DatagramBuffer& buf = this->recv_buffers[i];
+        if (buf.capacity() < read_size + 1) {
+            if (read_size < this->recv_pool.buffer_size()) {
+                buf = this->recv_pool.take();
+            } else {
+                buf = DatagramBuffer(std::string(read_size + 1, '\0'));
+            }
+        }
+
+        this->recv_iovecs[i].iov_base = buf.data();
+        this->recv_iovecs[i].iov_len = read_size;
+
+        struct msghdr& header = this->recv_headers[i].msg_hdr;
+        bzero(&header, sizeof(header));
+        header.msg_name = &this->recv_addrs[i];
+        header.msg_namelen = sizeof(this->recv_addrs[i]);
+        header.msg_iov = &this->recv_iovecs[i];
+        header.msg_iovlen = 1;
+        if (this->needs_controls()) {
+            header.msg_control = this->recv_controls[i].bytes;
+            header.msg_controllen = sizeof(this->recv_controls[i].bytes);
+        }
+        this->recv_headers[i].msg_len = 0;
+    }
 }
 
-std::optional<Enveloped> Socket::receive(int timeout_ms)
+void Socket::unpack_received(
+    struct msghdr& header,
+    size_t count,
+    Address remote
+)
 {
-    struct pollfd fds[1];
-    fds[0].fd = this->sockfd;
-    fds[0].events = POLLIN;
-    fds[0].revents = 0;
+    ReceivedControls controls = this->read_controls(header);
+    size_t segment_size = count;
+    if (controls.gro_segment_size > 0) {
+        segment_size = controls.gro_segment_size;
+    }
 
-    int status = poll(fds, sizeof(fds) / sizeof(fds[0]), timeout_ms);
-    if (status < 0) {
-        throw SocketIoError("socket poll");
+    char const *bytes = (char const *) header.msg_iov[0].iov_base;
+    size_t offset = 0;
+    uint64_t segments = 0;
+    do {
+        size_t size = std::min(segment_size, count - offset);
+        PendingDatagram datagram;
+        datagram.bytes = this->recv_pool.take();
+        datagram.bytes.resize(std::min(size, this->max_message_size_));
+        memcpy(datagram.bytes.data(), bytes + offset, datagram.bytes.size());
+        datagram.remote = remote;
+        datagram.received_at_nanos = controls.received_at_nanos;
+        this->pending_datagrams.push_back(std::move(datagram));
+        offset += size;
+        segments++;
+    } while (offset < count);
+
+    this->counters.count_recvs(0, 1, segments);
+}
+
+Socket::ReceivedControls::ReceivedControls() : gro_segment_size(0)
+{
+}
+
+Socket::ReceivedControls Socket::read_controls(struct msghdr& header)
+{
+    ReceivedControls controls;
+    struct cmsghdr *control = CMSG_FIRSTHDR(&header);
+    while (control != nullptr) {
+        if (control->cmsg_level == SOL_UDP && control->cmsg_type == UDP_GRO) {
+            int gro_size;
+            memcpy(&gro_size, CMSG_DATA(control), sizeof(gro_size));
+            if (gro_size > 0) {
+                controls.gro_segment_size = gro_size;
+            }
+        } else if (
+            control->cmsg_level == SOL_SOCKET
+            && control->cmsg_type == SCM_TIMESTAMPNS
+        ) {
+            struct timespec time;
+            memcpy(&time, CMSG_DATA(control), sizeof(time));
+            controls.received_at_nanos =
+                (int64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+        } else if (
+            control->cmsg_level == SOL_SOCKET
+            && control->cmsg_type == SO_RXQ_OVFL
+        ) {
+            uint32_t drops;
+            memcpy(&drops, CMSG_DATA(control), sizeof(drops));
+            controls.kernel_drops = drops;
+            this->counters.kernel_drops.store(drops);
+        }
+        control = CMSG_NXTHDR(&header, control);
     }
-    if (fds[0].revents & POLLIN) {
-        return this->receive();
+    return controls;
+}
+
+bool Socket::needs_controls() const
+{
+    return this->gro || this->timestamps || this->drop_monitoring;
+}
+
+void Socket::drain_pending(std::vector<Enveloped>& batch)
+{
+    while (!this->pending_datagrams.empty()) {
+        PendingDatagram& datagram = this->pending_datagrams.front();
+        size_t count = datagram.bytes.size();
+        this->push_lazy(
+            batch,
+            std::move(datagram.bytes),
+            count,
+            datagram.remote,
+            datagram.received_at_nanos
+        );
+        this->pending_datagrams.pop_front();
     }
-    return std::optional<Enveloped>();
 }
 
-void Socket::send(Enveloped const& enveloped)
+size_t Socket::prepare_send_batch(
+    std::vector<OutgoingDatagram> const& datagrams,
+    size_t start,
+    size_t count
+)
 {
-    std::ostringstream ostream;
-    PlaintextSerializer serializer_impl(ostream);
-    Serializer& serializer = serializer_impl;
-    serializer << enveloped.message;
-    std::string buf = ostream.str();
+    if (this->send_headers.size() < count) {
+        this->send_iovecs.resize(count);
+        this->send_addrs.resize(count);
+        this->send_headers.resize(count);
+        this->send_controls.resize(count);
+        this->send_segments.resize(count);
+    }
 
-    struct sockaddr_in receiver_addr_in;
+    size_t headers = 0;
+    size_t i = 0;
+    while (i < count) {
+        OutgoingDatagram const& datagram = datagrams[start + i];
+        size_t segments = 1;
+        if (this->gso) {
+            segments = this->gso_run_length(datagrams, start + i, count - i);
+        }
 
-    receiver_addr_in.sin_family = AF_INET;
-    receiver_addr_in.sin_port = htons(enveloped.remote.port);
-    receiver_addr_in.sin_addr.s_addr = htonl(enveloped.remote.ipv4);
-    bzero(&receiver_addr_in.sin_zero, 8);
+        struct sockaddr_in& addr = this->send_addrs[headers];
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(datagram.remote.port);
+        addr.sin_addr.s_addr = htonl(datagram.remote.ipv4);
+        bzero(&addr.sin_zero, 8);
 
-    ssize_t result = sendto(
-        this->sockfd,
-        buf.data(),
-        buf.size(),
-        0,
-        (struct sockaddr *) &receiver_addr_in,
-        sizeof(receiver_addr_in)
-    );
+        for (size_t j = i; j < i + segments; j++) {
+            std::string const& bytes = *datagrams[start + j].bytes;
+            this->send_iovecs[j].iov_base = (void *) bytes.data();
+            this->send_iovecs[j].iov_len = bytes.size();
+        }
 
-    if (result < 0) {
-        throw SocketIoError("socket send");
+        struct msghdr& header = this->send_headers[headers].msg_hdr;
+        bzero(&header, sizeof(header));
+        header.msg_name = &addr;
+        header.msg_namelen = sizeof(addr);
+        header.msg_iov = &this->send_iovecs[i];
+        header.msg_iovlen = segments;
+        if (segments > 1) {
+            header.msg_control = this->send_controls[headers].bytes;
+            header.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+            struct cmsghdr *control = CMSG_FIRSTHDR(&header);
+            control->cmsg_level = SOL_UDP;
+            control->cmsg_type = UDP_SEGMENT;
+            control->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segment_size = datagram.bytes->size();
+            memcpy(CMSG_DATA(control), &segment_size, sizeof(segment_size));
+        }
+        this->send_headers[headers].msg_len = 0;
+        this->send_segments[headers] = segments;
+
+        headers++;
+        i += segments;
+    }
+
+    return headers;
+}
+
+size_t Socket::gso_run_length(
+    std::vector<OutgoingDatagram> const& datagrams,
+    size_t start,
+    size_t count
+) const
+{
+    OutgoingDatagram const& first = datagrams[start];
+    size_t segment_size = first.bytes->size();
+    if (segment_size == 0) {
+        return 1;
+    }
+
+    size_t total_size = segment_size;
+    size_t length = 1;
+    while (length < count && length < SOCKET_GSO_MAX_SEGMENTS) {
+        OutgoingDatagram const& next = datagrams[start + length];
+        size_t size = next.bytes->size();
+        if (
+            next.remote != first.remote
+            || size == 0
+            || size > segment_size
+            || total_size + size > SOCKET_GSO_MAX_BYTES
+        ) {
+            break;
+        }
+        total_size += size;
+        length++;
+        if (size < segment_size) {
+            break;
+        }
+    }
+    return length;
+}
+
+bool Socket::poll_readable(int timeout_ms)
+{
+    if (!this->pending_datagrams.empty()) {
+        return true;
+    }
+    if (this->uring) {
+        return this->uring->wait_readable(timeout_ms);
+    }
+
+    struct pollfd fds[1];
+    fds[0].fd = this->sockfd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+
+    int status = poll(fds, sizeof(fds) / sizeof(fds[0]), timeout_ms);
+    if (status < 0) {
+        throw SocketIoError("socket poll");
     }
+    return fds[0].revents & POLLIN;
 }
 
 void Socket::close()
 {
+    this->uring.reset();
     if (this->sockfd >= 0) {
         ::close(this->sockfd);
     }
@@ -246,12 +1314,32 @@ char const *MissedResponse::what() const noexcept
     return this->message.c_str();
 }
 
+CallbackCountMismatch::CallbackCountMismatch(
+    size_t request_count,
+    size_t callback_count
+) :
+    message(
+        "expected one callback for each of the "
+        + std::to_string(request_count)
+        + " requests, found "
+        + std::to_string(callback_count)
+    )
+{
+}
+
+char const *CallbackCountMismatch::what() const noexcept
+{
+    return this->message.c_str();
+}
+
 ReliableSocket::PendingResponse::PendingResponse(
     Enveloped enveloped,
+    std::string&& datagram,
     uint64_t max_req_attempts,
     std::optional<Channel<Enveloped>::Sender>&& callback
 ) :
     request(enveloped),
+    datagram(std::move(datagram)),
     cooldown_attempt(0),
     cooldown_counter(1),
     remaining_attempts(max_req_attempts),
@@ -271,15 +1359,31 @@ ReliableSocket::Connection::Connection(Enveloped connect_request) :
 }
 
 ReliableSocket::Inner::Inner(
-    Socket&& udp,
+    std::unique_ptr<Transport>&& transport,
     Config const& config,
     Channel<Enveloped>::Receiver&& handler_to_req_receiver
 ) :
-    udp(std::move(udp)),
+    transport(std::move(transport)),
     config(config),
     handler_to_req_receiver(std::move(handler_to_req_receiver)),
     election_counter(0)
 {
+    this->transport->set_drop_monitoring(true);
+    if (this->config.socket_buffer_packets > 0) {
+        this->config.socket_buffer_sizes = this->transport->set_buffer_sizes(
+            this->config.socket_buffer_packets
+                * this->transport->max_message_size()
+        );
+    } else {
+        this->config.socket_buffer_sizes = this->transport->buffer_sizes();
+    }
+    if (
+        this->config.socket_busy_poll_usecs > 0
+        && !this->transport->set_busy_poll(this->config.socket_busy_poll_usecs)
+    ) {
+        this->config.socket_busy_poll_usecs = 0;
+    }
+    this->reactor.watch(this->transport->readable_fd());
 }
 
 ReliableSocket::Config const& ReliableSocket::Inner::used_config() const
@@ -287,6 +1391,11 @@ ReliableSocket::Config const& ReliableSocket::Inner::used_config() const
     return this->config;
 }
 
+SocketStats ReliableSocket::Inner::socket_stats() const
+{
+    return this->transport->stats();
+}
+
 bool ReliableSocket::Inner::is_connected()
 {
     try {
@@ -296,6 +1405,12 @@ bool ReliableSocket::Inner::is_connected()
     }
 }
 
+bool ReliableSocket::Inner::has_connection(Address const& remote)
+{
+    std::unique_lock lock(this->net_control_mutex);
+    return this->connections.find(remote) != this->connections.end();
+}
+
 void ReliableSocket::Inner::send_req(
     Enveloped enveloped,
     std::optional<Channel<Enveloped>::Sender>&& callback
@@ -307,10 +1422,49 @@ void ReliableSocket::Inner::send_req(
 
     std::unique_lock lock(this->net_control_mutex);
 
-    this->unsafe_send_req(enveloped, std::move(callback));
+    if (auto datagram = this->unsafe_send_req(enveloped, std::move(callback))) {
+        this->transport->send_encoded(datagram->remote, *datagram->bytes);
+    }
+}
+
+void ReliableSocket::Inner::send_req_batch(
+    std::vector<Enveloped> const& enveloped_reqs,
+    std::vector<Channel<Enveloped>::Sender>&& callbacks
+)
+{
+    if (callbacks.size() != enveloped_reqs.size()) {
+        throw CallbackCountMismatch(enveloped_reqs.size(), callbacks.size());
+    }
+    for (Enveloped const& enveloped : enveloped_reqs) {
+        if (enveloped.message.body->tag().step != MSG_REQ) {
+            throw ExpectedRequest(enveloped);
+        }
+    }
+
+    std::unique_lock lock(this->net_control_mutex);
+
+    std::vector<OutgoingDatagram> batch;
+    batch.reserve(enveloped_reqs.size());
+    try {
+        for (size_t i = 0; i < enveloped_reqs.size(); i++) {
+            if (
+                auto datagram = this->unsafe_send_req(
+                    enveloped_reqs[i],
+                    std::make_optional(std::move(callbacks[i]))
+                )
+            ) {
+                batch.push_back(*datagram);
+            }
+        }
+    } catch (...) {
+        this->transport->send_batch(batch);
+        throw;
+    }
+
+    this->transport->send_batch(batch);
 }
 
-void ReliableSocket::Inner::unsafe_send_req(
+std::optional<OutgoingDatagram> ReliableSocket::Inner::unsafe_send_req(
     Enveloped enveloped,
     std::optional<Channel<Enveloped>::Sender>&& callback
 )
@@ -337,20 +1491,18 @@ void ReliableSocket::Inner::unsafe_send_req(
                 response.message.header.fill_resp(
                     enveloped.message.header.seqn
                 );
-                response.message.body = std::shared_ptr<MessageBody>(
-                    new MessageDisconnectResp
-                );
+                response.message.body = make_pooled<MessageDisconnectResp>();
                 std::optional<Channel<Enveloped>::Sender> moved_callback
                     = std::move(callback);
                 if (moved_callback) {
                     moved_callback->send(response);
                 }
-                return;
+                return std::optional<OutgoingDatagram>();
             }
 
             default: {
                 auto moved_callback_ = std::move(callback);
-                return;
+                return std::optional<OutgoingDatagram>();
             }
         }
     }
@@ -364,17 +1516,26 @@ void ReliableSocket::Inner::unsafe_send_req(
     }
 
     if (!was_disconnecting || callback.has_value()) {
-        connection.pending_responses.insert(std::make_pair(
+        std::string datagram;
+        this->transport->encode(enveloped.message, datagram);
+
+        auto inserted = connection.pending_responses.insert(std::make_pair(
             enveloped.message.header.seqn, 
             PendingResponse(
                 enveloped,
+                std::move(datagram),
                 this->config.max_req_attempts,
                 std::move(callback)
             )
         ));
 
-        this->udp.send(enveloped);
+        return std::make_optional(OutgoingDatagram(
+            enveloped.remote,
+            std::get<1>(*inserted.first).datagram
+        ));
     }
+
+    return std::optional<OutgoingDatagram>();
 }
 
 void ReliableSocket::Inner::send_resp(Enveloped enveloped)
@@ -392,9 +1553,13 @@ void ReliableSocket::Inner::unsafe_send_resp(Enveloped enveloped)
 {
     Connection& connection = this->connections[enveloped.remote];
 
+    std::string datagram;
+    this->transport->encode(enveloped.message, datagram);
+
     if (
-        connection.cached_sent_resp_queue.size()
-        < this->config.max_cached_sent_resps
+        !connection.cached_sent_resp_queue.empty()
+        && connection.cached_sent_resp_queue.size()
+            >= this->config.max_cached_sent_resps
     ) {
         connection.cached_sent_resps.erase(
             connection.cached_sent_resp_queue.front()
@@ -403,11 +1568,14 @@ void ReliableSocket::Inner::unsafe_send_resp(Enveloped enveloped)
     }
 
     connection.cached_sent_resp_queue.push(enveloped.message.header.seqn);
-    connection.cached_sent_resps.insert(std::make_pair(
+    auto inserted = connection.cached_sent_resps.insert(std::make_pair(
         enveloped.message.header.seqn,
-        enveloped
+        std::move(datagram)
     ));
-    this->udp.send(enveloped);
+    this->transport->send_encoded(
+        enveloped.remote,
+        std::get<1>(*inserted.first)
+    );
 }
 
 Enveloped ReliableSocket::Inner::unsafe_forceful_disconnect(Address remote)
@@ -415,26 +1583,43 @@ Enveloped ReliableSocket::Inner::unsafe_forceful_disconnect(Address remote)
     this->connections.erase(remote);
     Enveloped fake_req;
     fake_req.remote = remote;
-    fake_req.message.body = std::shared_ptr<MessageBody>(
-        new MessageDisconnectReq
-    );
+    fake_req.message.body = make_pooled<MessageDisconnectReq>();
     fake_req.message.header.election_counter =
         this->unsafe_get_election_counter();
     fake_req.message.header.fill_req();
     return fake_req;
 }
 
-std::optional<Enveloped> ReliableSocket::Inner::receive_raw(int poll_timeout_ms)
+std::vector<Enveloped> ReliableSocket::Inner::receive_raw_batch()
 {
-    while (this->is_connected()) {
-        try {
-            if (auto enveloped = this->udp.receive(poll_timeout_ms)) {
-                return std::optional<Enveloped>(enveloped);
+    if (this->config.busy_poll_nanos > 0) {
+        auto deadline = std::chrono::steady_clock::now()
+            + std::chrono::nanoseconds(this->config.busy_poll_nanos);
+        while (!this->reactor.woken()) {
+            std::vector<Enveloped> batch = this->transport->receive_batch(
+                this->config.recv_batch_size,
+                0
+            );
+            if (!batch.empty()) {
+                return batch;
+            }
+            if (std::chrono::steady_clock::now() >= deadline) {
+                break;
             }
-        } catch (MessageOutOfProtocol const &exc) {
+            std::this_thread::yield();
         }
     }
-    return std::optional<Enveloped>();
+
+    while (this->reactor.wait(-1) == REACTOR_READABLE) {
+        std::vector<Enveloped> batch = this->transport->receive_batch(
+            this->config.recv_batch_size,
+            0
+        );
+        if (!batch.empty()) {
+            return batch;
+        }
+    }
+    return std::vector<Enveloped>();
 }
 
 Enveloped ReliableSocket::Inner::receive()
@@ -478,10 +1663,8 @@ std::optional<Enveloped> ReliableSocket::Inner::unsafe_handle_req(
         response.message.header.fill_resp(
             enveloped.message.header.seqn
         );
-        response.message.body = std::shared_ptr<MessageBody>(
-            new MessagePingResp
-        );
-        this->udp.send(response);
+        response.message.body = make_pooled<MessagePingResp>();
+        this->transport->send(response);
         return std::optional<Enveloped>();
     }
 
@@ -504,10 +1687,8 @@ std::optional<Enveloped> ReliableSocket::Inner::unsafe_handle_req(
                 response.message.header.fill_resp(
                     enveloped.message.header.seqn
                 );
-                response.message.body = std::shared_ptr<MessageBody>(
-                    new MessageDisconnectResp
-                );
-                this->udp.send(response);
+                response.message.body = make_pooled<MessageDisconnectResp>();
+                this->transport->send(response);
                 return std::optional<Enveloped>();
             }
 
@@ -519,10 +1700,9 @@ std::optional<Enveloped> ReliableSocket::Inner::unsafe_handle_req(
                 response.message.header.fill_resp(
                     enveloped.message.header.seqn
                 );
-                response.message.body = std::shared_ptr<MessageBody>(
-                    new MessageErrorResp(MSG_NO_CONNECTION)
-                );
-                this->udp.send(response);
+                response.message.body =
+                    make_pooled<MessageErrorResp>(MSG_NO_CONNECTION);
+                this->transport->send(response);
                 return std::optional<Enveloped>();
             }
         }
@@ -535,11 +1715,15 @@ std::optional<Enveloped> ReliableSocket::Inner::unsafe_handle_req(
             connection.cached_sent_resps.find(enveloped.message.header.seqn);
         resp_search != connection.cached_sent_resps.end()
     ) {
-        Enveloped response = std::get<1>(*resp_search);
-        this->udp.send(response);
+        this->transport->send_encoded(
+            enveloped.remote,
+            std::get<1>(*resp_search)
+        );
     } else if (
-        connection.received_seqn_set.add(enveloped.message.header.seqn)
+        !connection.received_seqn_set.contains(enveloped.message.header.seqn)
     ) {
+        enveloped.message.decode_body();
+        connection.received_seqn_set.add(enveloped.message.header.seqn);
         return std::make_optional(enveloped);
     }
 
@@ -553,10 +1737,18 @@ void ReliableSocket::Inner::unsafe_handle_resp(Enveloped enveloped)
         conn_search != this->connections.end()
     ) {
         Connection& connection = std::get<1>(*conn_search);
-        if (auto pending_node = connection.pending_responses.extract(
-            enveloped.message.header.seqn
-        )) {
-            PendingResponse pending = pending_node.mapped();
+        if (
+            auto pending_search = connection.pending_responses.find(
+                enveloped.message.header.seqn
+            );
+            pending_search != connection.pending_responses.end()
+        ) {
+            if (std::get<1>(*pending_search).callback.has_value()) {
+                enveloped.message.decode_body();
+            }
+            auto pending_node =
+                connection.pending_responses.extract(pending_search);
+            PendingResponse& pending = pending_node.mapped();
             if (pending.callback.has_value()) {
                 pending.callback->send(enveloped);
             }
@@ -573,6 +1765,9 @@ std::vector<Enveloped> ReliableSocket::Inner::bump()
 
     std::vector<Enveloped> fake_disconnect_reqs;
 
+    std::vector<OutgoingDatagram> batch;
+    std::deque<std::string> ping_datagrams;
+
     std::set<uint64_t> seqn_to_be_removed;
     std::set<Address> addresses_to_be_removed;
     for (auto& conn_entry : this->connections) {
@@ -595,7 +1790,9 @@ std::vector<Enveloped> ReliableSocket::Inner::bump()
                     }
                 } else {
                     pending.remaining_attempts--;
-                    this->udp.send(pending.request);
+                    batch.push_back(
+                        OutgoingDatagram(address, pending.datagram)
+                    );
                 }
 
                 pending.cooldown_attempt++;
@@ -625,17 +1822,26 @@ std::vector<Enveloped> ReliableSocket::Inner::bump()
             if (offset % this->config.ping_interval == 0) {
                 Enveloped ping_request;
                 ping_request.remote = address;
-                ping_request.message.body = std::shared_ptr<MessageBody>(
-                    new MessagePingReq
-                );
+                ping_request.message.body = make_pooled<MessagePingReq>();
                 ping_request.message.header.election_counter = 
                     this->unsafe_get_election_counter();
                 ping_request.message.header.fill_req();
-                this->udp.send(ping_request);
+                ping_datagrams.emplace_back();
+                this->transport->encode(
+                    ping_request.message,
+                    ping_datagrams.back()
+                );
+                batch.push_back(
+                    OutgoingDatagram(address, ping_datagrams.back())
+                );
             }
         }
     }
 
+    if (!batch.empty()) {
+        this->transport->send_batch(batch);
+    }
+
     for (Address address : addresses_to_be_removed) {
         fake_disconnect_reqs.push_back(
             this->unsafe_forceful_disconnect(address)
@@ -648,24 +1854,37 @@ std::vector<Enveloped> ReliableSocket::Inner::bump()
 void ReliableSocket::Inner::disconnect()
 {
     this->handler_to_req_receiver.disconnect();
+    this->reactor.wake();
 
     std::unique_lock lock(this->net_control_mutex);
 
+    std::vector<OutgoingDatagram> batch;
     Enveloped disconnect_req;
-    disconnect_req.message.body = std::shared_ptr<MessageBody>(
-        new MessageDisconnectReq
-    );
+    disconnect_req.message.body = make_pooled<MessageDisconnectReq>();
     for (auto& conn_entry : this->connections) {
         Address address = std::get<0>(conn_entry);
         disconnect_req.remote = address;
-        this->unsafe_send_req(
-            disconnect_req,
-            std::optional<Channel<Enveloped>::Sender>()
-        );
+        if (
+            auto datagram = this->unsafe_send_req(
+                disconnect_req,
+                std::optional<Channel<Enveloped>::Sender>()
+            )
+        ) {
+            batch.push_back(*datagram);
+        }
     }
+    this->transport->send_batch(batch);
     this->connections.clear();
 }
 
+bool ReliableSocket::Inner::wait_disconnect(int timeout_ms)
+{
+    if (!this->is_connected()) {
+        return true;
+    }
+    return this->reactor.wait_woken(timeout_ms);
+}
+
 void ReliableSocket::Inner::unsafe_set_election_counter(uint64_t counter)
 {
     this->election_counter = counter;
@@ -697,7 +1916,10 @@ ReliableSocket::Config::Config() :
     max_disconnect_count(5000),
     ping_start(1000),
     ping_interval(500),
-    poll_timeout_ms(10)
+    recv_batch_size(32),
+    socket_buffer_packets(1024),
+    busy_poll_nanos(0),
+    socket_busy_poll_usecs(0)
 {
 }
 
@@ -765,9 +1987,35 @@ ReliableSocket::Config& ReliableSocket::Config::with_ping_interval(
     return *this;
 }
 
-ReliableSocket::Config& ReliableSocket::Config::with_poll_timeout_ms(int val)
+ReliableSocket::Config& ReliableSocket::Config::with_recv_batch_size(
+    size_t val
+)
+{
+    this->recv_batch_size = val;
+    return *this;
+}
+
+ReliableSocket::Config& ReliableSocket::Config::with_socket_buffer_packets(
+    uint64_t val
+)
+{
+    this->socket_buffer_packets = val;
+    return *this;
+}
+
+ReliableSocket::Config& ReliableSocket::Config::with_busy_poll_nanos(
+    uint64_t val
+)
+{
+    this->busy_poll_nanos = val;
+    return *this;
+}
+
+ReliableSocket::Config& ReliableSocket::Config::with_socket_busy_poll_usecs(
+    uint64_t val
+)
 {
-    this->poll_timeout_ms = val;
+    this->socket_busy_poll_usecs = val;
     return *this;
 }
 
@@ -806,7 +2054,26 @@ void ReliableSocket::Config::report(std::ostream& stream) const
         << "- minimum timeout before disconnecting: "
         << min_ping_timeout_ns.to_string()
         << std::endl
+        << "- socket buffers: target of "
+        << this->socket_buffer_packets
+        << " packets, granted "
+        << this->socket_buffer_sizes.recv
+        << " bytes to receive and "
+        << this->socket_buffer_sizes.send
+        << " bytes to send"
+        << std::endl
     ;
+    if (this->busy_poll_nanos > 0) {
+        ReportTime busy_poll(this->busy_poll_nanos, ReportTime::NS);
+        stream
+            << "- busy polling: up to "
+            << busy_poll.to_string()
+            << " before parking, SO_BUSY_POLL of "
+            << this->socket_busy_poll_usecs
+            << "us"
+            << std::endl
+        ;
+    }
 }
 
 ReliableSocket::SentReq::SentReq(
@@ -904,25 +2171,17 @@ ReliableSocket::ReliableSocket(
 
     input_thread([
         inner,
-        poll_timeout_ms = config.poll_timeout_ms,
         channel = std::move(input_to_handler_channel.sender)
     ] () mutable {
         try {
             bool connected = true;
             while (connected) {
-                try {
-                    if (auto enveloped = inner->receive_raw(poll_timeout_ms)) {
-                        channel.send(*enveloped); 
-                    } else {
-                        connected = false;
-                    }
-                } catch (DeserializationError const& exc) {
-                    Logger::with([&exc] (auto& output) {
-                        output
-                            << "failed to deserialize a packet: "
-                            << exc.what()
-                            << std::endl;
-                    });
+                std::vector<Enveloped> batch =
+                    inner->receive_raw_batch();
+                if (batch.empty()) {
+                    connected = false;
+                } else {
+                    channel.send_all(std::move(batch));
                 }
             }
         } catch (ChannelDisconnected const& exc) {
@@ -937,8 +2196,17 @@ ReliableSocket::ReliableSocket(
         try {
             for (;;) {
                 Enveloped enveloped = from_input.receive();
-                if (auto request = inner->handle(enveloped)) {
-                    to_req_receiver.send(*request);
+                try {
+                    if (auto request = inner->handle(enveloped)) {
+                        to_req_receiver.send(*request);
+                    }
+                } catch (DeserializationError const& exc) {
+                    Logger::with([&exc] (auto& output) {
+                        output
+                            << "failed to deserialize a packet: "
+                            << exc.what()
+                            << std::endl;
+                    });
                 }
             }
         } catch (ChannelDisconnected const& exc) {
@@ -978,14 +2246,14 @@ ReliableSocket::ReliableSocket(
 }
 
 ReliableSocket::ReliableSocket(
-    Socket&& udp,
+    std::unique_ptr<Transport>&& transport,
     Config const& config,
     Channel<Enveloped>&& input_to_handler_channel,
     Channel<Enveloped>&& handler_to_recv_req_channel
 ) :
     ReliableSocket(
         std::shared_ptr<Inner>(new Inner(
-            std::move(udp),
+            std::move(transport),
             config,
             std::move(handler_to_recv_req_channel.receiver)
         )),
@@ -1001,7 +2269,18 @@ ReliableSocket::ReliableSocket(
     Config const& config
 ) :
     ReliableSocket(
-        std::move(udp),
+        std::unique_ptr<Transport>(new Socket(std::move(udp))),
+        config
+    )
+{
+}
+
+ReliableSocket::ReliableSocket(
+    std::unique_ptr<Transport>&& transport,
+    Config const& config
+) :
+    ReliableSocket(
+        std::move(transport),
         config,
         Channel<Enveloped>(),
         Channel<Enveloped>()
@@ -1049,6 +2328,16 @@ ReliableSocket::Config const& ReliableSocket::config() const
     return this->inner->used_config();
 }
 
+bool ReliableSocket::has_connection(Address const& remote) const
+{
+    return this->inner->has_connection(remote);
+}
+
+SocketStats ReliableSocket::socket_stats() const
+{
+    return this->inner->socket_stats();
+}
+
 ReliableSocket::SentReq ReliableSocket::send_req(Enveloped enveloped)
 {
     Channel<Enveloped> channel;
@@ -1059,6 +2348,25 @@ ReliableSocket::SentReq ReliableSocket::send_req(Enveloped enveloped)
     return ReliableSocket::SentReq(enveloped, std::move(channel.receiver));
 }
 
+std::vector<ReliableSocket::SentReq> ReliableSocket::send_req_batch(
+    std::vector<Enveloped> const& enveloped_reqs
+)
+{
+    std::vector<Channel<Enveloped>::Sender> callbacks;
+    std::vector<SentReq> sent_reqs;
+    callbacks.reserve(enveloped_reqs.size());
+    sent_reqs.reserve(enveloped_reqs.size());
+    for (Enveloped const& enveloped : enveloped_reqs) {
+        Channel<Enveloped> channel;
+        callbacks.push_back(std::move(channel.sender));
+        sent_reqs.push_back(
+            ReliableSocket::SentReq(enveloped, std::move(channel.receiver))
+        );
+    }
+    this->inner->send_req_batch(enveloped_reqs, std::move(callbacks));
+    return sent_reqs;
+}
+
 ReliableSocket::ReceivedReq ReliableSocket::receive_req()
 {
     Enveloped req_enveloped = this->inner->receive();
@@ -1075,10 +2383,12 @@ void ReliableSocket::disconnect_timeout(
     uint64_t intervals
 )
 {
-    while (this->inner->is_connected() && intervals > 0) {
-        std::this_thread::sleep_for(std::chrono::nanoseconds(interval_nanos));
-        intervals--;
+    uint64_t max_ms = INT_MAX;
+    uint64_t timeout_ms = max_ms;
+    if (intervals == 0 || interval_nanos <= max_ms * 1000000 / intervals) {
+        timeout_ms = (interval_nanos * intervals + 999999) / 1000000;
     }
+    this->inner->wait_disconnect(timeout_ms);
     this->inner->disconnect();
 }
 
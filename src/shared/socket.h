@@ -3,15 +3,42 @@
 
 #include <stdexcept>
 #include <cstdint>
+#include <atomic>
+#include <deque>
 #include <optional>
 #include <functional>
+#include <memory>
 #include <map>
 #include <set>
 #include <thread>
+#include <mutex>
+#include <vector>
+#include <sys/socket.h>
+#include <netinet/in.h>
 #include "message.h"
 #include "address.h"
 #include "channel.h"
 #include "seqn_set.h"
+#include "reactor.h"
+#include "datagram_buffer.h"
+
+/**
+ * Maximum number of datagrams sent as segments of a single UDP GSO send, as
+ * limited by the kernel.
+ */
+constexpr size_t SOCKET_GSO_MAX_SEGMENTS = 64;
+
+/**
+ * Maximum number of payload bytes of a single UDP GSO send, the largest UDP
+ * payload over IPv4.
+ */
+constexpr size_t SOCKET_GSO_MAX_BYTES = 65507;
+
+/**
+ * Size of the buffers datagrams are received into with UDP GRO, large enough
+ * for anything the kernel coalesces.
+ */
+constexpr size_t SOCKET_GRO_BUFFER_SIZE = 65536;
 
 class SocketError : public std::exception {};
 
@@ -36,27 +63,487 @@ class InvalidAddrLen : public SocketError {
         virtual const char *what() const noexcept;
 };
 
-class Socket {
+class MessageTooLarge : public SocketError {
     private:
+        size_t size_;
+        size_t max_size_;
+        std::string message;
+
+    public:
+        MessageTooLarge(size_t size, size_t max_size);
+        size_t size() const;
+        size_t max_size() const;
+        virtual const char *what() const noexcept;
+};
+
+/**
+ * A datagram encoded by Transport::encode, with its destination, to be sent
+ * by Transport::send_batch. The bytes are borrowed and must outlive the send.
+ */
+class OutgoingDatagram {
+    public:
+        Address remote;
+        std::string const *bytes;
+
+        OutgoingDatagram(Address remote, std::string const& bytes);
+};
+
+/**
+ * How a Socket exchanges datagrams with the kernel.
+ */
+enum SocketBackend {
+    /**
+     * poll, then recvfrom or recvmmsg to receive, sendto or sendmmsg to send.
+     */
+    SOCKET_POLL,
+    /**
+     * io_uring, as done by UringSocket. Falls back to SOCKET_POLL when the
+     * kernel does not support it.
+     */
+    SOCKET_IO_URING
+};
+
+/**
+ * How much a Socket got out of each syscall. A message is what the kernel
+ * stack handles as one packet, which carries several datagrams as segments
+ * with UDP GSO or GRO. Only the SOCKET_POLL backend is counted.
+ */
+class SocketStats {
+    public:
+        uint64_t send_syscalls;
+        uint64_t sent_messages;
+        uint64_t sent_datagrams;
+        uint64_t recv_syscalls;
+        uint64_t received_messages;
+        uint64_t received_datagrams;
+        /**
+         * Datagrams the kernel dropped because the receive queue was full,
+         * as of the last datagram received. Only counted with drop
+         * monitoring on.
+         */
+        uint64_t kernel_drops;
+        /**
+         * Receive buffers allocated because none was idle in the pool.
+         * Stays put once the pool has warmed up.
+         */
+        uint64_t recv_buffer_allocations;
+
+        SocketStats();
+
+        double datagrams_per_send_syscall() const;
+        double datagrams_per_sent_message() const;
+        double datagrams_per_recv_syscall() const;
+        double datagrams_per_received_message() const;
+};
+
+/**
+ * Sizes of the kernel buffers of a socket, in bytes, as read back from the
+ * kernel.
+ */
+class SocketBufferSizes {
+    public:
+        size_t recv;
+        size_t send;
+
+        SocketBufferSizes();
+};
+
+/**
+ * Exchanges datagrams with remote addresses on behalf of a ReliableSocket:
+ * Socket does it through the kernel, over UDP, and LoopbackTransport in
+ * memory. Encoding and lazy decoding are shared, so that every transport
+ * carries the same bytes.
+ */
+class Transport {
+    protected:
+        size_t max_message_size_;
+        WireFormat wire_format_;
+
+        Transport(size_t max_message_size, WireFormat wire_format);
+
+        /**
+         * Decodes only the header and the tag of the datagram, leaving the
+         * body as a MessageRawBody that owns the buffer.
+         */
+        Enveloped decode_lazy(
+            DatagramBuffer&& buf,
+            size_t count,
+            Address remote
+        ) const;
+
+        /**
+         * Decodes the datagram as in decode_lazy and appends it to the
+         * batch, skipping it if it is out of the protocol or malformed.
+         */
+        void push_lazy(
+            std::vector<Enveloped>& batch,
+            DatagramBuffer&& buf,
+            size_t count,
+            Address remote,
+            std::optional<int64_t> received_at_nanos
+        ) const;
+
+    public:
+        virtual ~Transport();
+
+        WireFormat wire_format() const;
+
+        size_t max_message_size() const;
+
+        /**
+         * Number of bytes the message takes in a datagram sent through this
+         * transport.
+         */
+        size_t serialized_size(Message const& message) const;
+
+        /**
+         * Encodes the message into the datagram exactly as send would,
+         * throwing MessageTooLarge if it does not fit. The datagram can then
+         * be sent any number of times through send_encoded.
+         */
+        void encode(Message const& message, std::string& datagram) const;
+
+        /**
+         * A descriptor that polls readable when datagrams may be received,
+         * to be watched by a Reactor.
+         */
+        virtual int readable_fd() const = 0;
+
+        /**
+         * Waits up to the timeout for datagrams, then takes up to about
+         * max_count of them, lazily decoded. Datagrams out of the protocol
+         * are skipped, and malformed ones are logged and skipped. Returns an
+         * empty batch on timeout. A zero timeout does not wait at all.
+         */
+        virtual std::vector<Enveloped> receive_batch(
+            size_t max_count,
+            int timeout_ms
+        ) = 0;
+
+        virtual void send(Enveloped const& enveloped);
+
+        virtual void send_encoded(
+            Address const& remote,
+            std::string const& datagram
+        ) = 0;
+
+        /**
+         * Sends every datagram in order.
+         */
+        virtual void send_batch(
+            std::vector<OutgoingDatagram> const& datagrams
+        ) = 0;
+
+        /**
+         * Snapshot of the counters of datagrams sent and received so far.
+         */
+        virtual SocketStats stats() const = 0;
+
+        /**
+         * Kernel tuning, see Socket. Transports without a kernel socket
+         * refuse drop monitoring and busy polling, and have no buffers to
+         * size, reported as zero.
+         */
+        virtual bool set_drop_monitoring(bool enabled);
+        virtual bool set_busy_poll(uint64_t usecs);
+        virtual SocketBufferSizes set_buffer_sizes(size_t bytes);
+        virtual SocketBufferSizes buffer_sizes() const;
+};
+
+class UringSocket;
+
+class Socket : public Transport {
+    private:
+        class Counters {
+            public:
+                std::atomic<uint64_t> send_syscalls;
+                std::atomic<uint64_t> sent_messages;
+                std::atomic<uint64_t> sent_datagrams;
+                std::atomic<uint64_t> recv_syscalls;
+                std::atomic<uint64_t> received_messages;
+                std::atomic<uint64_t> received_datagrams;
+                std::atomic<uint64_t> kernel_drops;
+
+                Counters();
+
+                SocketStats load() const;
+
+                void store(SocketStats const& stats);
+
+                void count_sends(
+                    uint64_t syscalls,
+                    uint64_t messages,
+                    uint64_t datagrams
+                );
+
+                void count_recvs(
+                    uint64_t syscalls,
+                    uint64_t messages,
+                    uint64_t datagrams
+                );
+        };
+
+        /**
+         * Room for the control messages of a send, i.e. a UDP GSO segment
+         * size, or of a receive, i.e. a UDP GRO segment size, a receive
+         * timestamp and a count of kernel drops.
+         */
+        class ControlBuffer {
+            public:
+                alignas(struct cmsghdr) char bytes[
+                    CMSG_SPACE(sizeof(int))
+                        + CMSG_SPACE(sizeof(struct timespec))
+                        + CMSG_SPACE(sizeof(uint32_t))
+                ];
+        };
+
+        /**
+         * What the control messages of a receive carried.
+         */
+        class ReceivedControls {
+            public:
+                size_t gro_segment_size;
+                std::optional<int64_t> received_at_nanos;
+                std::optional<uint32_t> kernel_drops;
+
+                ReceivedControls();
+        };
+
+        class PendingDatagram {
+            public:
+                DatagramBuffer bytes;
+                Address remote;
+                std::optional<int64_t> received_at_nanos;
+        };
+
         int sockfd;
-        size_t max_message_size;
+        std::mutex send_mutex;
+        std::string send_buffer;
+        /**
+         * Buffers every received datagram is read into, handed downstream
+         * with it, e.g. in a lazily decoded body, and recycled once that
+         * lets go of it.
+         */
+        DatagramBufferPool recv_pool;
+        std::vector<DatagramBuffer> recv_buffers;
+        std::vector<struct iovec> recv_iovecs;
+        std::vector<struct sockaddr_in> recv_addrs;
+        std::vector<struct mmsghdr> recv_headers;
+        std::vector<ControlBuffer> recv_controls;
+        std::vector<struct iovec> send_iovecs;
+        std::vector<struct sockaddr_in> send_addrs;
+        std::vector<struct mmsghdr> send_headers;
+        std::vector<ControlBuffer> send_controls;
+        /**
+         * Number of datagrams each send header carries as segments.
+         */
+        std::vector<size_t> send_segments;
+        bool gso;
+        bool gro;
+        bool timestamps;
+        bool drop_monitoring;
+        /**
+         * Datagrams received through recvmsg, e.g. segments of a GRO
+         * receive, not yet returned by receive or receive_lazy.
+         */
+        std::deque<PendingDatagram> pending_datagrams;
+        Counters counters;
+        std::unique_ptr<UringSocket> uring;
 
     public:
-        Socket(size_t max_message_size);
-        Socket(Address bind_addr, size_t max_message_size);
+        Socket(
+            size_t max_message_size,
+            WireFormat wire_format = WIRE_PLAINTEXT,
+            SocketBackend backend = SOCKET_POLL
+        );
+        /**
+         * Binds to the address. With reuse_port, SO_REUSEPORT is set first,
+         * so that several sockets can bind to the same address and the kernel
+         * spreads incoming datagrams across them by hashing the remote
+         * address, which keeps each remote on one of the sockets.
+         */
+        Socket(
+            Address bind_addr,
+            size_t max_message_size,
+            WireFormat wire_format = WIRE_PLAINTEXT,
+            bool reuse_port = false,
+            SocketBackend backend = SOCKET_POLL
+        );
         Socket(Socket&& other);
         Socket(Socket const& other) = delete;
         Socket& operator=(Socket const& obj) = delete;
         Socket& operator=(Socket&& obj);
 
-        ~Socket();
+        virtual ~Socket();
+
+        /**
+         * The backend actually in use, which is SOCKET_POLL if io_uring was
+         * asked for but is not supported.
+         */
+        SocketBackend backend() const;
+
+        virtual int readable_fd() const;
+
+        /**
+         * Turns UDP GSO on or off. When on, send_batch sends each run of
+         * datagrams to the same remote, all of the same size but the last,
+         * as segments of a single message, so that the kernel stack handles
+         * the run once. On by default if the kernel supports it. Returns
+         * whether it is on.
+         */
+        bool set_gso(bool enabled);
+
+        bool gso_enabled() const;
+
+        /**
+         * Turns UDP GRO on or off. When on, the kernel may hand several
+         * datagrams from the same remote over as a single message, which is
+         * split back here, at the cost of receiving into much larger
+         * buffers. Off by default, and not supported by the io_uring
+         * backend. Returns whether it is on.
+         */
+        bool set_gro(bool enabled);
+
+        bool gro_enabled() const;
+
+        /**
+         * Turns kernel receive timestamps, i.e. SO_TIMESTAMPNS, on or off.
+         * When on, every received Enveloped carries the time the kernel
+         * received its datagram. Off by default, and not supported by the
+         * io_uring backend. Returns whether it is on.
+         */
+        bool set_timestamps(bool enabled);
+
+        bool timestamps_enabled() const;
+
+        /**
+         * Turns SO_RXQ_OVFL on or off. When on, received datagrams come with
+         * the number of datagrams the kernel has dropped so far because the
+         * receive queue was full, kept in the stats. Off by default, and not
+         * supported by the io_uring backend. Returns whether it is on.
+         */
+        virtual bool set_drop_monitoring(bool enabled);
+
+        bool drop_monitoring_enabled() const;
+
+        /**
+         * Sets SO_BUSY_POLL, so that receiving polls the device queue for up
+         * to the given microseconds instead of waiting for an interrupt.
+         * Raising it past the net.core.busy_read sysctl needs CAP_NET_ADMIN.
+         * Returns whether the kernel accepted it.
+         */
+        virtual bool set_busy_poll(uint64_t usecs);
+
+        /**
+         * Asks for kernel buffers of the given size in each direction, past
+         * the system maximum if privileged, and returns the sizes the kernel
+         * actually granted. The kernel doubles the sizes asked for, to
+         * account for its bookkeeping, and caps them otherwise.
+         */
+        virtual SocketBufferSizes set_buffer_sizes(size_t bytes);
+
+        virtual SocketBufferSizes buffer_sizes() const;
+
+        /**
+         * Snapshot of the counters of datagrams and syscalls so far.
+         */
+        virtual SocketStats stats() const;
 
         Enveloped receive();
         std::optional<Enveloped> receive(int timeout_ms);
 
-        void send(Enveloped const& enveloped);
+        /**
+         * Same as receive, but only the header and the tag are decoded. The
+         * body is left as a MessageRawBody, to be decoded by
+         * Message::decode_body once it is actually needed.
+         */
+        Enveloped receive_lazy();
+        std::optional<Enveloped> receive_lazy(int timeout_ms);
+
+        /**
+         * Waits up to the timeout for datagrams, then takes up to max_count
+         * of them with a single recvmmsg call, or more if GRO coalesced some
+         * of them. Messages are decoded as in
+         * receive_lazy. Datagrams out of the protocol are skipped, and
+         * malformed ones are logged and skipped, so that one bad datagram
+         * does not cost the rest of the batch. Returns an empty batch on
+         * timeout. A zero timeout does not poll at all.
+         */
+        virtual std::vector<Enveloped> receive_batch(
+            size_t max_count,
+            int timeout_ms
+        );
+
+        virtual void send(Enveloped const& enveloped);
+
+        virtual void send_encoded(
+            Address const& remote,
+            std::string const& datagram
+        );
+
+        /**
+         * Sends every datagram in order, with as few sendmmsg calls as the
+         * kernel allows.
+         */
+        virtual void send_batch(std::vector<OutgoingDatagram> const& datagrams);
     
     private:
+        void start_backend(SocketBackend backend);
+
+        size_t receive_datagram(
+            DatagramBuffer& buf,
+            Address& remote,
+            std::optional<int64_t>& received_at_nanos
+        );
+
+        void prepare_recv_batch(size_t max_count);
+
+        /**
+         * Splits a received message into its datagrams, several if GRO
+         * coalesced them, which are queued as pending along with the receive
+         * timestamp.
+         */
+        void unpack_received(
+            struct msghdr& header,
+            size_t count,
+            Address remote
+        );
+
+        /**
+         * Reads the control messages of a receive, keeping track of kernel
+         * drops.
+         */
+        ReceivedControls read_controls(struct msghdr& header);
+
+        /**
+         * Whether receives need recvmsg, with room for control messages.
+         */
+        bool needs_controls() const;
+
+        void drain_pending(std::vector<Enveloped>& batch);
+
+        /**
+         * Fills send headers for up to count datagrams from start, merging
+         * runs into GSO messages if enabled. Returns the number of headers.
+         */
+        size_t prepare_send_batch(
+            std::vector<OutgoingDatagram> const& datagrams,
+            size_t start,
+            size_t count
+        );
+
+        /**
+         * Number of datagrams from start, at most count, that can go out as
+         * segments of a single GSO message.
+         */
+        size_t gso_run_length(
+            std::vector<OutgoingDatagram> const& datagrams,
+            size_t start,
+            size_t count
+        ) const;
+
+        bool poll_readable(int timeout_ms);
+
         void close();
 };
 
@@ -99,6 +586,20 @@ class MissedResponse : public std::exception {
         virtual char const *what() const noexcept;
 };
 
+/**
+ * Thrown when a batch of requests is not given exactly one callback per
+ * request.
+ */
+class CallbackCountMismatch : public std::exception {
+    private:
+        std::string message;
+
+    public:
+        CallbackCountMismatch(size_t request_count, size_t callback_count);
+
+        virtual char const *what() const noexcept;
+};
+
 /**
  * # Problem
  *
@@ -137,7 +638,31 @@ class ReliableSocket {
                 uint64_t max_disconnect_count;
                 uint64_t ping_start;
                 uint64_t ping_interval;
-                int poll_timeout_ms;
+                size_t recv_batch_size;
+                /**
+                 * Number of datagrams of the maximum message size the kernel
+                 * buffers of the socket should hold in each direction. Zero
+                 * keeps the kernel defaults.
+                 */
+                uint64_t socket_buffer_packets;
+                /**
+                 * Buffer sizes the kernel granted, read back once a
+                 * ReliableSocket uses this configuration, and zero before
+                 * that.
+                 */
+                SocketBufferSizes socket_buffer_sizes;
+                /**
+                 * How long the input thread keeps trying to receive without
+                 * blocking, once it runs out of datagrams, before parking in
+                 * the reactor until the socket is readable. Trades a core for
+                 * latency. Zero, the default, parks right away.
+                 */
+                uint64_t busy_poll_nanos;
+                /**
+                 * SO_BUSY_POLL value set on the socket, in microseconds. Zero
+                 * leaves it unset, and so does a socket that refuses it.
+                 */
+                uint64_t socket_busy_poll_usecs;
 
                 Config();
 
@@ -149,7 +674,10 @@ class ReliableSocket {
                 Config& with_max_disconnect_count(uint64_t val);
                 Config& with_ping_start(uint64_t ping_start);
                 Config& with_ping_interval(uint64_t ping_interval);
-                Config& with_poll_timeout_ms(int val);
+                Config& with_recv_batch_size(size_t val);
+                Config& with_socket_buffer_packets(uint64_t val);
+                Config& with_busy_poll_nanos(uint64_t val);
+                Config& with_socket_busy_poll_usecs(uint64_t val);
 
                 uint64_t min_response_timeout_ns() const;
                 uint64_t min_ping_timeout_ns() const;
@@ -161,6 +689,11 @@ class ReliableSocket {
         class PendingResponse {
             public:
                 Enveloped request;
+                /**
+                 * The request as encoded by the socket, so retransmits do not
+                 * encode it again.
+                 */
+                std::string datagram;
                 uint64_t cooldown_attempt;
                 uint64_t cooldown_counter;
                 uint64_t remaining_attempts;
@@ -168,6 +701,7 @@ class ReliableSocket {
 
                 PendingResponse(
                     Enveloped enveloped,
+                    std::string&& datagram,
                     uint64_t max_req_attempts,
                     std::optional<Channel<Enveloped>::Sender>&& callback
                 );
@@ -180,7 +714,11 @@ class ReliableSocket {
                 bool disconnecting;
                 SeqnSet received_seqn_set;
                 std::queue<uint64_t> cached_sent_resp_queue;
-                std::map<uint64_t, Enveloped> cached_sent_resps;
+                /**
+                 * Encoded responses by the seqn of their requests, resent as
+                 * they are when a request is repeated.
+                 */
+                std::map<uint64_t, std::string> cached_sent_resps;
                 std::map<uint64_t, PendingResponse> pending_responses;
 
                 Connection();
@@ -190,8 +728,12 @@ class ReliableSocket {
 
         class Inner {
             private:
-                Socket udp;
+                std::unique_ptr<Transport> transport;
                 Config config;
+                /**
+                 * Watches the transport, and is woken up on disconnection.
+                 */
+                Reactor reactor;
 
                 Channel<Enveloped>::Receiver handler_to_req_receiver;
 
@@ -202,21 +744,42 @@ class ReliableSocket {
 
             public:
                 Inner(
-                    Socket&& udp,
+                    std::unique_ptr<Transport>&& transport,
                     Config const& config,
                     Channel<Enveloped>::Receiver&& handler_to_req_receiver
                 );
 
                 Config const& used_config() const;
 
+                SocketStats socket_stats() const;
+
                 bool is_connected();
 
+                bool has_connection(Address const& remote);
+
                 void send_req(
                     Enveloped enveloped,
                     std::optional<Channel<Enveloped>::Sender>&& callback
                 );
 
-                void unsafe_send_req(
+                /**
+                 * Sends all requests with a single batch, so a fan-out costs
+                 * one syscall per UIO_MAXIOV datagrams instead of one each.
+                 * If a request cannot be encoded, the requests before it are
+                 * still sent before the error is thrown, while those after it
+                 * are dropped along with their callbacks.
+                 */
+                void send_req_batch(
+                    std::vector<Enveloped> const& enveloped_reqs,
+                    std::vector<Channel<Enveloped>::Sender>&& callbacks
+                );
+
+                /**
+                 * Registers the request as pending and returns its datagram,
+                 * which the caller must send while still holding the lock.
+                 * Returns nothing if there is nothing to send.
+                 */
+                std::optional<OutgoingDatagram> unsafe_send_req(
                     Enveloped enveloped,
                     std::optional<Channel<Enveloped>::Sender>&& callback
                 );
@@ -227,7 +790,12 @@ class ReliableSocket {
 
                 Enveloped unsafe_forceful_disconnect(Address remote);
 
-                std::optional<Enveloped> receive_raw(int poll_timeout_ms);
+                /**
+                 * Waits for the next batch of received messages, with their
+                 * bodies still raw, busy polling first if configured to.
+                 * Returns an empty batch once disconnected.
+                 */
+                std::vector<Enveloped> receive_raw_batch();
 
                 Enveloped receive();
 
@@ -241,6 +809,12 @@ class ReliableSocket {
 
                 void disconnect();
 
+                /**
+                 * Waits up to the timeout for the socket to be disconnected.
+                 * Returns whether it was.
+                 */
+                bool wait_disconnect(int timeout_ms);
+
                 void unsafe_set_election_counter(uint64_t counter);
 
                 uint64_t unsafe_get_election_counter() const;
@@ -314,7 +888,7 @@ class ReliableSocket {
         );
 
         ReliableSocket(
-            Socket&& udp,
+            std::unique_ptr<Transport>&& transport,
             Config const& config,
             Channel<Enveloped>&& input_to_handler_channel,
             Channel<Enveloped>&& handler_to_recv_req_channel
@@ -329,14 +903,43 @@ class ReliableSocket {
             Config const& config = Config()
         );
 
+        /**
+         * Same as above, but over any transport, e.g. a LoopbackTransport.
+         */
+        ReliableSocket(
+            std::unique_ptr<Transport>&& transport,
+            Config const& config = Config()
+        );
+
         Config const& config() const;
 
+        /**
+         * Whether a connection with the remote is open on this socket.
+         */
+        bool has_connection(Address const& remote) const;
+
+        /**
+         * Counters of the underlying transport.
+         */
+        SocketStats socket_stats() const;
+
         ReliableSocket(ReliableSocket&& other);
         ReliableSocket& operator=(ReliableSocket&& other);
 
         ~ReliableSocket();
 
         SentReq send_req(Enveloped message);
+
+        /**
+         * Same as calling send_req for each request, but their datagrams are
+         * sent together, with as few syscalls as possible. If a request
+         * cannot be encoded, e.g. it is too large, the requests before it are
+         * still sent before the error is thrown.
+         */
+        std::vector<SentReq> send_req_batch(
+            std::vector<Enveloped> const& enveloped_reqs
+        );
+
         ReceivedReq receive_req();
 
         void disconnect();
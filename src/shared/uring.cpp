@@ -0,0 +1,644 @@
+#include "uring.h"
+#include "log.h"
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+
+/**
+ * User data of the multishot recvmsg in the receiving ring.
+ */
+constexpr __u64 URING_RECV_USER_DATA = 0;
+
+/**
+ * User data of the request cancelling the multishot recvmsg.
+ */
+constexpr __u64 URING_CANCEL_USER_DATA = 1;
+
+/**
+ * Buffer group the receive buffers are registered under.
+ */
+constexpr __u16 URING_RECV_BUFFER_GROUP = 0;
+
+UringUnsupported::UringUnsupported(std::string const& message) :
+    message(message)
+{
+}
+
+const char *UringUnsupported::what() const noexcept
+{
+    return this->message.c_str();
+}
+
+IoUring::IoUring(unsigned entries, unsigned cq_entries) :
+    ring_fd(-1),
+    features_(0),
+    sq_ring(MAP_FAILED),
+    sq_ring_size(0),
+    cq_ring(MAP_FAILED),
+    cq_ring_size(0),
+    sqes((struct io_uring_sqe *) MAP_FAILED),
+    sqes_size(0),
+    pending_submissions(0),
+    enters(0)
+{
+    struct io_uring_params params;
+    bzero(&params, sizeof(params));
+    if (cq_entries > 0) {
+        params.flags |= IORING_SETUP_CQSIZE;
+        params.cq_entries = cq_entries;
+    }
+
+    this->ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (this->ring_fd < 0) {
+        throw UringUnsupported(
+            std::string("io_uring setup: ") + strerror(errno)
+        );
+    }
+    this->features_ = params.features;
+
+    this->sq_ring_size =
+        params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    this->cq_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (this->features_ & IORING_FEAT_SINGLE_MMAP) {
+        this->sq_ring_size = std::max(this->sq_ring_size, this->cq_ring_size);
+    }
+
+    this->sq_ring = mmap(
+        nullptr,
+        this->sq_ring_size,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE,
+        this->ring_fd,
+        IORING_OFF_SQ_RING
+    );
+    if (this->sq_ring == MAP_FAILED) {
+        int c_errno = errno;
+        this->close();
+        throw UringUnsupported(
+            std::string("io_uring mmap: ") + strerror(c_errno)
+        );
+    }
+
+    if (this->features_ & IORING_FEAT_SINGLE_MMAP) {
+        this->cq_ring = this->sq_ring;
+    } else {
+        this->cq_ring = mmap(
+            nullptr,
+            this->cq_ring_size,
+            PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE,
+            this->ring_fd,
+            IORING_OFF_CQ_RING
+        );
+        if (this->cq_ring == MAP_FAILED) {
+            int c_errno = errno;
+            this->close();
+            throw UringUnsupported(
+                std::string("io_uring mmap: ") + strerror(c_errno)
+            );
+        }
+    }
+
+    this->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    this->sqes = (struct io_uring_sqe *) mmap(
+        nullptr,
+        this->sqes_size,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE,
+        this->ring_fd,
+        IORING_OFF_SQES
+    );
+    if (this->sqes == MAP_FAILED) {
+        int c_errno = errno;
+        this->close();
+        throw UringUnsupported(
+            std::string("io_uring mmap: ") + strerror(c_errno)
+        );
+    }
+
+    char *sq_base = (char *) this->sq_ring;
+    char *cq_base = (char *) this->cq_ring;
+    this->sq_head = (unsigned *) (sq_base + params.sq_off.head);
+    this->sq_tail = (unsigned *) (sq_base + params.sq_off.tail);
+    this->sq_mask = *(unsigned *) (sq_base + params.sq_off.ring_mask);
+    this->cq_head = (unsigned *) (cq_base + params.cq_off.head);
+    this->cq_tail = (unsigned *) (cq_base + params.cq_off.tail);
+    this->cq_mask = *(unsigned *) (cq_base + params.cq_off.ring_mask);
+    this->cqes = (struct io_uring_cqe *) (cq_base + params.cq_off.cqes);
+
+    unsigned *sq_array = (unsigned *) (sq_base + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; i++) {
+        sq_array[i] = i;
+    }
+}
+
+IoUring::~IoUring()
+{
+    this->close();
+}
+
+int IoUring::fd() const
+{
+    return this->ring_fd;
+}
+
+unsigned IoUring::features() const
+{
+    return this->features_;
+}
+
+struct io_uring_sqe *IoUring::next_sqe()
+{
+    unsigned head = __atomic_load_n(this->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *this->sq_tail;
+    if (tail - head > this->sq_mask) {
+        return nullptr;
+    }
+
+    struct io_uring_sqe *sqe = &this->sqes[tail & this->sq_mask];
+    bzero(sqe, sizeof(*sqe));
+    __atomic_store_n(this->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    this->pending_submissions++;
+    return sqe;
+}
+
+void IoUring::submit()
+{
+    while (this->pending_submissions > 0) {
+        this->enters++;
+        int submitted = syscall(
+            __NR_io_uring_enter,
+            this->ring_fd,
+            this->pending_submissions,
+            0,
+            0,
+            nullptr,
+            0
+        );
+        if (submitted < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw SocketIoError("io_uring submit");
+        }
+        if (submitted == 0) {
+            break;
+        }
+        this->pending_submissions -= submitted;
+    }
+}
+
+bool IoUring::wait(int timeout_ms)
+{
+    if (this->peek() != nullptr) {
+        this->submit();
+        return true;
+    }
+
+    unsigned flags = IORING_ENTER_GETEVENTS;
+    struct __kernel_timespec timeout;
+    struct io_uring_getevents_arg arg;
+    void *arg_ptr = nullptr;
+    size_t arg_size = 0;
+    if (timeout_ms >= 0) {
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (timeout_ms % 1000) * 1000 * 1000;
+        bzero(&arg, sizeof(arg));
+        arg.ts = (__u64) &timeout;
+        flags |= IORING_ENTER_EXT_ARG;
+        arg_ptr = &arg;
+        arg_size = sizeof(arg);
+    }
+
+    for (;;) {
+        this->enters++;
+        int submitted = syscall(
+            __NR_io_uring_enter,
+            this->ring_fd,
+            this->pending_submissions,
+            1,
+            flags,
+            arg_ptr,
+            arg_size
+        );
+        if (submitted >= 0) {
+            this->pending_submissions -= submitted;
+            if (this->peek() != nullptr) {
+                return true;
+            }
+        } else if (errno == ETIME) {
+            return this->peek() != nullptr;
+        } else if (errno == EINTR) {
+            if (timeout_ms >= 0) {
+                return this->peek() != nullptr;
+            }
+        } else {
+            throw SocketIoError("io_uring wait");
+        }
+    }
+}
+
+struct io_uring_cqe *IoUring::peek()
+{
+    unsigned head = *this->cq_head;
+    unsigned tail = __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return nullptr;
+    }
+    return &this->cqes[head & this->cq_mask];
+}
+
+void IoUring::consume()
+{
+    __atomic_store_n(this->cq_head, *this->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+uint64_t IoUring::take_enters()
+{
+    uint64_t enters = this->enters;
+    this->enters = 0;
+    return enters;
+}
+
+void IoUring::close()
+{
+    if (this->sqes != MAP_FAILED) {
+        munmap(this->sqes, this->sqes_size);
+    }
+    if (this->cq_ring != MAP_FAILED && this->cq_ring != this->sq_ring) {
+        munmap(this->cq_ring, this->cq_ring_size);
+    }
+    if (this->sq_ring != MAP_FAILED) {
+        munmap(this->sq_ring, this->sq_ring_size);
+    }
+    if (this->ring_fd >= 0) {
+        ::close(this->ring_fd);
+    }
+}
+
+UringSocket::UringSocket(int sockfd, size_t max_message_size) :
+    sockfd(sockfd),
+    max_message_size(max_message_size),
+    buffer_size(
+        sizeof(struct io_uring_recvmsg_out)
+            + sizeof(struct sockaddr_in)
+            + max_message_size
+    ),
+    recv_ring(8, 2 * URING_RECV_BUFFERS),
+    buf_ring((struct io_uring_buf *) MAP_FAILED),
+    buf_ring_size(URING_RECV_BUFFERS * sizeof(struct io_uring_buf)),
+    recv_buffers(URING_RECV_BUFFERS * buffer_size),
+    recv_armed(false),
+    send_ring(URING_SEND_SLOTS),
+    send_slots(URING_SEND_SLOTS)
+{
+    if (!(this->recv_ring.features() & IORING_FEAT_EXT_ARG)) {
+        throw UringUnsupported("io_uring cannot wait with a timeout");
+    }
+
+    this->buf_ring = (struct io_uring_buf *) mmap(
+        nullptr,
+        this->buf_ring_size,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS,
+        -1,
+        0
+    );
+    if (this->buf_ring == MAP_FAILED) {
+        throw UringUnsupported(
+            std::string("io_uring buffer ring: ") + strerror(errno)
+        );
+    }
+
+    struct io_uring_buf_reg registration;
+    bzero(&registration, sizeof(registration));
+    registration.ring_addr = (__u64) this->buf_ring;
+    registration.ring_entries = URING_RECV_BUFFERS;
+    registration.bgid = URING_RECV_BUFFER_GROUP;
+    int status = syscall(
+        __NR_io_uring_register,
+        this->recv_ring.fd(),
+        IORING_REGISTER_PBUF_RING,
+        &registration,
+        1
+    );
+    if (status < 0) {
+        int c_errno = errno;
+        munmap(this->buf_ring, this->buf_ring_size);
+        throw UringUnsupported(
+            std::string("io_uring buffer ring: ") + strerror(c_errno)
+        );
+    }
+
+    for (unsigned i = 0; i < URING_RECV_BUFFERS; i++) {
+        this->recycle_buffer(i);
+    }
+
+    bzero(&this->recv_header, sizeof(this->recv_header));
+    this->recv_header.msg_namelen = sizeof(struct sockaddr_in);
+
+    for (size_t i = 0; i < this->send_slots.size(); i++) {
+        this->free_send_slots.push_back(i);
+    }
+
+    this->arm_recv();
+    this->recv_ring.submit();
+
+    struct io_uring_cqe *cqe = this->recv_ring.peek();
+    if (cqe != nullptr && cqe->res < 0) {
+        int c_errno = -cqe->res;
+        munmap(this->buf_ring, this->buf_ring_size);
+        throw UringUnsupported(
+            std::string("io_uring multishot recvmsg: ") + strerror(c_errno)
+        );
+    }
+}
+
+UringSocket::~UringSocket()
+{
+    try {
+        std::unique_lock lock(this->send_mutex);
+        while (this->free_send_slots.size() < this->send_slots.size()) {
+            this->send_ring.wait(-1);
+            this->unsafe_reap_sends();
+        }
+    } catch (SocketError const& exc) {
+    }
+
+    this->cancel_recv();
+
+    munmap(this->buf_ring, this->buf_ring_size);
+}
+
+bool UringSocket::wait_readable(int timeout_ms)
+{
+    std::unique_lock lock(this->recv_mutex);
+
+    for (;;) {
+        if (this->unsafe_next_datagram() != nullptr) {
+            return true;
+        }
+        if (!this->recv_armed) {
+            this->arm_recv();
+        }
+        if (!this->recv_ring.wait(timeout_ms)) {
+            return false;
+        }
+    }
+}
+
+bool UringSocket::try_receive(
+    DatagramBuffer& buf,
+    size_t& count,
+    Address& remote
+)
+{
+    std::unique_lock lock(this->recv_mutex);
+
+    struct io_uring_cqe *cqe = this->unsafe_next_datagram();
+    if (cqe == nullptr) {
+        this->unsafe_rearm_recv();
+        return false;
+    }
+
+    unsigned flags = cqe->flags;
+    if (!(flags & IORING_CQE_F_MORE)) {
+        this->recv_armed = false;
+    }
+    this->recv_ring.consume();
+
+    unsigned buffer_id = flags >> IORING_CQE_BUFFER_SHIFT;
+    char const *buffer =
+        this->recv_buffers.data() + buffer_id * this->buffer_size;
+    struct io_uring_recvmsg_out out;
+    memcpy(&out, buffer, sizeof(out));
+    struct sockaddr_in sender_addr;
+    memcpy(&sender_addr, buffer + sizeof(out), sizeof(sender_addr));
+    char const *payload = buffer
+        + sizeof(out)
+        + this->recv_header.msg_namelen
+        + this->recv_header.msg_controllen;
+
+    count = std::min((size_t) out.payloadlen, this->max_message_size);
+    count = std::min(count, buf.capacity());
+    memcpy(buf.data(), payload, count);
+    buf.resize(count);
+    this->recycle_buffer(buffer_id);
+    this->unsafe_rearm_recv();
+
+    if (out.namelen != sizeof(sender_addr)) {
+        throw InvalidAddrLen(
+            "Socket address unexpectedly has the wrong length"
+        );
+    }
+    remote.ipv4 = ntohl(sender_addr.sin_addr.s_addr);
+    remote.port = ntohs(sender_addr.sin_port);
+    return true;
+}
+
+void UringSocket::send(Address const& remote, std::string const& datagram)
+{
+    std::unique_lock lock(this->send_mutex);
+
+    this->unsafe_reap_sends();
+    this->unsafe_queue_send(remote, datagram);
+    this->send_ring.submit();
+}
+
+void UringSocket::send_batch(std::vector<OutgoingDatagram> const& datagrams)
+{
+    std::unique_lock lock(this->send_mutex);
+
+    this->unsafe_reap_sends();
+    for (OutgoingDatagram const& datagram : datagrams) {
+        this->unsafe_queue_send(datagram.remote, *datagram.bytes);
+    }
+    this->send_ring.submit();
+}
+
+uint64_t UringSocket::take_recv_syscalls()
+{
+    std::unique_lock lock(this->recv_mutex);
+    return this->recv_ring.take_enters();
+}
+
+uint64_t UringSocket::take_send_syscalls()
+{
+    std::unique_lock lock(this->send_mutex);
+    return this->send_ring.take_enters();
+}
+
+int UringSocket::readable_fd() const
+{
+    return this->recv_ring.fd();
+}
+
+void UringSocket::unsafe_rearm_recv()
+{
+    if (!this->recv_armed) {
+        this->arm_recv();
+        this->recv_ring.submit();
+    }
+}
+
+void UringSocket::arm_recv()
+{
+    struct io_uring_sqe *sqe = this->recv_ring.next_sqe();
+    if (sqe == nullptr) {
+        this->recv_ring.submit();
+        sqe = this->recv_ring.next_sqe();
+    }
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = this->sockfd;
+    sqe->addr = (__u64) &this->recv_header;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_RECV_BUFFER_GROUP;
+    sqe->user_data = URING_RECV_USER_DATA;
+    this->recv_armed = true;
+}
+
+struct io_uring_cqe *UringSocket::unsafe_next_datagram()
+{
+    struct io_uring_cqe *cqe;
+    while ((cqe = this->recv_ring.peek()) != nullptr) {
+        __u64 user_data = cqe->user_data;
+        int result = cqe->res;
+        unsigned flags = cqe->flags;
+        if (
+            user_data == URING_RECV_USER_DATA
+            && result >= 0
+            && (flags & IORING_CQE_F_BUFFER)
+        ) {
+            return cqe;
+        }
+        this->recv_ring.consume();
+
+        if (user_data != URING_RECV_USER_DATA) {
+            continue;
+        }
+        if (!(flags & IORING_CQE_F_MORE)) {
+            this->recv_armed = false;
+        }
+        if (result < 0 && result != -ENOBUFS && result != -ECANCELED) {
+            errno = -result;
+            throw SocketIoError("socket io_uring recvmsg");
+        }
+    }
+    return nullptr;
+}
+
+void UringSocket::recycle_buffer(unsigned buffer_id)
+{
+    __u16 tail = this->buf_ring[0].resv;
+    struct io_uring_buf *buf =
+        &this->buf_ring[tail & (URING_RECV_BUFFERS - 1)];
+    buf->addr = (__u64) (this->recv_buffers.data()
+        + buffer_id * this->buffer_size);
+    buf->len = this->buffer_size;
+    buf->bid = buffer_id;
+    __atomic_store_n(&this->buf_ring[0].resv, tail + 1, __ATOMIC_RELEASE);
+}
+
+void UringSocket::unsafe_queue_send(
+    Address const& remote,
+    std::string const& bytes
+)
+{
+    while (this->free_send_slots.empty()) {
+        this->send_ring.wait(-1);
+        this->unsafe_reap_sends();
+    }
+    size_t index = this->free_send_slots.back();
+    this->free_send_slots.pop_back();
+
+    SendSlot& slot = this->send_slots[index];
+    slot.bytes.assign(bytes);
+
+    slot.addr.sin_family = AF_INET;
+    slot.addr.sin_port = htons(remote.port);
+    slot.addr.sin_addr.s_addr = htonl(remote.ipv4);
+    bzero(&slot.addr.sin_zero, 8);
+
+    slot.iov.iov_base = slot.bytes.data();
+    slot.iov.iov_len = slot.bytes.size();
+
+    bzero(&slot.header, sizeof(slot.header));
+    slot.header.msg_name = &slot.addr;
+    slot.header.msg_namelen = sizeof(slot.addr);
+    slot.header.msg_iov = &slot.iov;
+    slot.header.msg_iovlen = 1;
+
+    struct io_uring_sqe *sqe = this->send_ring.next_sqe();
+    if (sqe == nullptr) {
+        this->send_ring.submit();
+        sqe = this->send_ring.next_sqe();
+    }
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = this->sockfd;
+    sqe->addr = (__u64) &slot.header;
+    sqe->len = 1;
+    sqe->user_data = index;
+}
+
+void UringSocket::unsafe_reap_sends()
+{
+    struct io_uring_cqe *cqe;
+    while ((cqe = this->send_ring.peek()) != nullptr) {
+        int result = cqe->res;
+        this->free_send_slots.push_back(cqe->user_data);
+        this->send_ring.consume();
+
+        if (result < 0) {
+            Logger::with([result] (auto& output) {
+                output
+                    << "failed to send a datagram: "
+                    << strerror(-result)
+                    << std::endl;
+            });
+        }
+    }
+}
+
+void UringSocket::cancel_recv()
+{
+    std::unique_lock lock(this->recv_mutex);
+
+    if (!this->recv_armed) {
+        return;
+    }
+
+    try {
+        struct io_uring_sqe *sqe = this->recv_ring.next_sqe();
+        if (sqe == nullptr) {
+            this->recv_ring.submit();
+            sqe = this->recv_ring.next_sqe();
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = URING_RECV_USER_DATA;
+        sqe->user_data = URING_CANCEL_USER_DATA;
+
+        while (this->recv_armed) {
+            this->recv_ring.wait(-1);
+            struct io_uring_cqe *cqe;
+            while ((cqe = this->recv_ring.peek()) != nullptr) {
+                bool final = cqe->user_data == URING_RECV_USER_DATA
+                    && !(cqe->flags & IORING_CQE_F_MORE);
+                this->recv_ring.consume();
+                if (final) {
+                    this->recv_armed = false;
+                }
+            }
+        }
+    } catch (SocketError const& exc) {
+    }
+}
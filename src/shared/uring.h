@@ -0,0 +1,240 @@
+#ifndef SHARED_URING_H_
+#define SHARED_URING_H_ 1
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "socket.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf;
+
+/**
+ * Number of buffers in the ring the kernel fills with received datagrams.
+ * Must be a power of two.
+ */
+constexpr unsigned URING_RECV_BUFFERS = 256;
+
+/**
+ * Maximum number of sends in flight at once. Must be a power of two.
+ */
+constexpr unsigned URING_SEND_SLOTS = 256;
+
+/**
+ * Thrown when the kernel does not support some io_uring feature a
+ * UringSocket needs, so that the caller can fall back to plain syscalls.
+ */
+class UringUnsupported : public SocketError {
+    private:
+        std::string message;
+
+    public:
+        UringUnsupported(std::string const& message);
+        virtual const char *what() const noexcept;
+};
+
+/**
+ * A single io_uring instance, set up and driven through raw syscalls, with
+ * its submission and completion queues mapped into memory. Not thread-safe.
+ */
+class IoUring {
+    private:
+        int ring_fd;
+        unsigned features_;
+        void *sq_ring;
+        size_t sq_ring_size;
+        void *cq_ring;
+        size_t cq_ring_size;
+        struct io_uring_sqe *sqes;
+        size_t sqes_size;
+        unsigned *sq_head;
+        unsigned *sq_tail;
+        unsigned sq_mask;
+        unsigned *cq_head;
+        unsigned *cq_tail;
+        unsigned cq_mask;
+        struct io_uring_cqe *cqes;
+        unsigned pending_submissions;
+        uint64_t enters;
+
+    public:
+        /**
+         * Sets up a ring with the given number of submission entries and, if
+         * not zero, the given number of completion entries. Throws
+         * UringUnsupported if the kernel cannot.
+         */
+        IoUring(unsigned entries, unsigned cq_entries = 0);
+        IoUring(IoUring const& other) = delete;
+        IoUring& operator=(IoUring const& other) = delete;
+
+        ~IoUring();
+
+        int fd() const;
+
+        unsigned features() const;
+
+        /**
+         * Returns a cleared submission entry, or nullptr if the submission
+         * queue is full and must be submitted first.
+         */
+        struct io_uring_sqe *next_sqe();
+
+        /**
+         * Hands every prepared submission entry to the kernel, without
+         * waiting for any completion.
+         */
+        void submit();
+
+        /**
+         * Submits pending entries, then waits up to the timeout for at least
+         * one completion. A negative timeout waits forever. Returns whether
+         * a completion is available.
+         */
+        bool wait(int timeout_ms);
+
+        /**
+         * The oldest completion not yet consumed, or nullptr if there is
+         * none.
+         */
+        struct io_uring_cqe *peek();
+
+        void consume();
+
+        /**
+         * Number of io_uring_enter syscalls made since the last call.
+         */
+        uint64_t take_enters();
+
+    private:
+        void close();
+};
+
+/**
+ * The io_uring backend of Socket. A multishot recvmsg stays armed against a
+ * ring of provided buffers, so datagrams are received without a syscall each,
+ * and sends are queued and submitted without waiting for their completion.
+ * Receiving and sending use separate rings, so that a thread blocked waiting
+ * for datagrams does not hold back senders.
+ */
+class UringSocket {
+    private:
+        class SendSlot {
+            public:
+                std::string bytes;
+                struct sockaddr_in addr;
+                struct iovec iov;
+                struct msghdr header;
+        };
+
+        int sockfd;
+        size_t max_message_size;
+        size_t buffer_size;
+
+        std::mutex recv_mutex;
+        IoUring recv_ring;
+        /**
+         * The ring of provided buffers shared with the kernel, whose tail
+         * overlays the reserved field of the first entry.
+         */
+        struct io_uring_buf *buf_ring;
+        size_t buf_ring_size;
+        std::vector<char> recv_buffers;
+        struct msghdr recv_header;
+        bool recv_armed;
+
+        std::mutex send_mutex;
+        IoUring send_ring;
+        std::vector<SendSlot> send_slots;
+        std::vector<size_t> free_send_slots;
+
+    public:
+        /**
+         * Starts receiving from the socket, which must outlive this object.
+         * Throws UringUnsupported if the kernel lacks multishot recvmsg,
+         * provided buffer rings or waiting with a timeout.
+         */
+        UringSocket(int sockfd, size_t max_message_size);
+        UringSocket(UringSocket const& other) = delete;
+        UringSocket& operator=(UringSocket const& other) = delete;
+
+        /**
+         * Cancels the armed receive and waits for the sends in flight, so
+         * that the kernel no longer touches any buffer.
+         */
+        ~UringSocket();
+
+        /**
+         * Waits up to the timeout for a received datagram. A negative
+         * timeout waits forever.
+         */
+        bool wait_readable(int timeout_ms);
+
+        /**
+         * Takes the next received datagram, if there is one, without
+         * blocking, copying it into the buffer. The payload is truncated to
+         * the maximum message size, or to the buffer capacity.
+         */
+        bool try_receive(DatagramBuffer& buf, size_t& count, Address& remote);
+
+        /**
+         * A descriptor that polls readable once a completion is available.
+         * The receive is kept armed after every try_receive, so waiting on it
+         * with epoll is as good as wait_readable.
+         */
+        int readable_fd() const;
+
+        /**
+         * Copies the datagram and queues it to be sent. Errors are only known
+         * once the send completes, after this has returned, so they are
+         * logged, as any other lost datagram would be.
+         */
+        void send(Address const& remote, std::string const& datagram);
+
+        /**
+         * Same as send for every datagram, but submitted together.
+         */
+        void send_batch(std::vector<OutgoingDatagram> const& datagrams);
+
+        /**
+         * Number of syscalls made to receive since the last call, including
+         * those waiting for a datagram.
+         */
+        uint64_t take_recv_syscalls();
+
+        /**
+         * Number of syscalls made to send since the last call.
+         */
+        uint64_t take_send_syscalls();
+
+    private:
+        /**
+         * Consumes completions that carry no datagram, keeping track of
+         * whether the receive is still armed, and returns the first one that
+         * carries a datagram, left in the queue, or nullptr if there is none.
+         * The multishot recvmsg ends, among other reasons, when the kernel
+         * runs out of buffers.
+         */
+        struct io_uring_cqe *unsafe_next_datagram();
+
+        void arm_recv();
+
+        /**
+         * Arms the receive again and submits it, if it ended.
+         */
+        void unsafe_rearm_recv();
+
+        void recycle_buffer(unsigned buffer_id);
+
+        void unsafe_queue_send(Address const& remote, std::string const& bytes);
+
+        void unsafe_reap_sends();
+
+        void cancel_recv();
+};
+
+#endif
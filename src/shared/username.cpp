@@ -102,13 +102,10 @@ bool Username::operator>=(Username const& other) const
 
 void Username::serialize(Serializer& serializer) const
 {
-    serializer << this->content();
+    this->encode(serializer);
 }
 
 void Username::deserialize(Deserializer& deserializer)
 {
-    std::string content;
-    deserializer >> content;
-    Username username(content);
-    *this = std::move(username);
+    this->decode(deserializer);
 }
@@ -41,8 +41,28 @@ class Username : public Serializable, public Deserializable {
         bool operator>(Username const& other) const;
         bool operator>=(Username const& other) const;
 
+        template <typename S>
+        void encode(S& serializer) const;
+        template <typename D>
+        void decode(D& deserializer);
+
         virtual void serialize(Serializer& serializer) const;
         virtual void deserialize(Deserializer& deserializer);
 };
 
+template <typename S>
+void Username::encode(S& serializer) const
+{
+    serializer << this->content();
+}
+
+template <typename D>
+void Username::decode(D& deserializer)
+{
+    std::string content;
+    deserializer >> content;
+    Username username(content);
+    *this = std::move(username);
+}
+
 #endif
@@ -1,12 +1,16 @@
 #include "server.h"
 #include "../server/data.h"
+#include "../server/comm_manager.h"
+#include "../shared/loopback.h"
 
 static TestSuite server_data_test_suite();
+static TestSuite server_comm_test_suite();
 
 TestSuite server_test_suite()
 {
     return TestSuite()
         .append(server_data_test_suite())
+        .append(server_comm_test_suite())
     ;
 }
 
@@ -536,3 +540,80 @@ static TestSuite server_data_test_suite()
         })
     ;
 }
+
+static TestSuite server_comm_test_suite()
+{
+    return TestSuite()
+        .test("notifications reach a follower in order despite loss", [] {
+            std::shared_ptr<LoopbackNetwork> network(new LoopbackNetwork(
+                LoopbackConditions().with_loss(0.3).with_seed(3)
+            ));
+            Address server_address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            std::vector<std::shared_ptr<ReliableSocket>> sockets {
+                std::shared_ptr<ReliableSocket>(new ReliableSocket(
+                    std::unique_ptr<Transport>(
+                        new LoopbackTransport(network, server_address, 500)
+                    )
+                ))
+            };
+            std::unique_ptr<LoopbackTransport> client_transport(
+                new LoopbackTransport(network, 500)
+            );
+            Address client_address = client_transport->address();
+            ReliableSocket client(std::move(client_transport));
+
+            ThreadTracker thread_tracker;
+            Channel<ReliableSocket::ReceivedReq> to_profile_man;
+            Channel<Enveloped> from_notif_man;
+            start_server_communication_manager(
+                thread_tracker,
+                sockets,
+                std::move(to_profile_man.sender),
+                std::move(from_notif_man.receiver)
+            );
+
+            Enveloped conn_req;
+            conn_req.remote = server_address;
+            conn_req.message.body = make_pooled<MessageClientConnReq>(
+                Username("@follower")
+            );
+            ReliableSocket::SentReq sent_conn_req = client.send_req(conn_req);
+            std::move(to_profile_man.receiver.receive()).send_resp(
+                make_pooled<MessageClientConnResp>()
+            );
+            std::move(sent_conn_req).receive_resp();
+
+            constexpr int64_t notif_count = 8;
+            for (int64_t i = 0; i < notif_count; i++) {
+                Enveloped notif;
+                notif.remote = client_address;
+                notif.message.body = make_pooled<MessageDeliverReq>(
+                    Username("@followed"),
+                    NotifMessage("notification " + std::to_string(i)),
+                    i
+                );
+                from_notif_man.sender.send(notif);
+            }
+
+            for (int64_t i = 0; i < notif_count; i++) {
+                ReliableSocket::ReceivedReq received = client.receive_req();
+                int64_t sent_at = received.req_enveloped().message.body
+                    ->cast<MessageDeliverReq>().sent_at;
+                TEST_ASSERT(
+                    "expected notification " + std::to_string(i)
+                        + ", found " + std::to_string(sent_at),
+                    sent_at == i
+                );
+                std::move(received).send_resp(
+                    make_pooled<MessageDeliverResp>()
+                );
+            }
+
+            LoopbackStats stats = network->stats();
+            TEST_ASSERT(
+                "found " + std::to_string(stats.lost) + " lost",
+                stats.lost > 0
+            );
+        })
+    ;
+}
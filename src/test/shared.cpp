@@ -1,11 +1,18 @@
 #include <set>
 #include <thread>
 #include <atomic>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
 #include "shared.h"
 #include "../shared/address.h"
 #include "../shared/message.h"
 #include "../shared/socket.h"
+#include "../shared/uring.h"
+#include "../shared/loopback.h"
 #include "../shared/channel.h"
+#include "../shared/reactor.h"
+#include "../shared/pool.h"
 #include "../shared/tracker.h"
 #include "../shared/username.h"
 #include "../shared/notif_message.h"
@@ -15,8 +22,16 @@ static TestSuite parse_udp_port_test_suite();
 static TestSuite parse_ipv4_test_suite();
 static TestSuite plaintext_ser_test_suite();
 static TestSuite plaintext_de_test_suite();
+static TestSuite plaintext_span_de_test_suite();
+static TestSuite binary_ser_test_suite();
+static TestSuite binary_de_test_suite();
+static TestSuite compact_test_suite();
+static TestSuite message_registry_test_suite();
+static TestSuite pool_test_suite();
 static TestSuite socket_test_suite();
+static TestSuite loopback_test_suite();
 static TestSuite channel_test_suite();
+static TestSuite reactor_test_suite();
 static TestSuite reliable_socket_test_suite();
 static TestSuite thread_tracker_test_suite();
 static TestSuite username_test_suite();
@@ -24,6 +39,8 @@ static TestSuite notif_message_test_suite();
 static TestSuite string_ext_test_suite();
 static TestSuite seqn_set_test_suite();
 
+static int64_t realtime_nanos();
+
 TestSuite shared_test_suite()
 {
     return TestSuite()
@@ -32,8 +49,16 @@ TestSuite shared_test_suite()
         .append(parse_ipv4_test_suite())
         .append(plaintext_ser_test_suite())
         .append(plaintext_de_test_suite())
+        .append(plaintext_span_de_test_suite())
+        .append(binary_ser_test_suite())
+        .append(binary_de_test_suite())
+        .append(compact_test_suite())
+        .append(message_registry_test_suite())
+        .append(pool_test_suite())
         .append(socket_test_suite())
+        .append(loopback_test_suite())
         .append(channel_test_suite())
+        .append(reactor_test_suite())
         .append(reliable_socket_test_suite())
         .append(thread_tracker_test_suite())
         .append(username_test_suite())
@@ -491,101 +516,2068 @@ static TestSuite plaintext_de_test_suite()
                 throwed
             );
         })
+
+        .test("deserialize overlong int chars", [] {
+            std::istringstream istream("000000000000000000000000000001;2;");
+            PlaintextDeserializer deserializer_impl(istream);
+            Deserializer& deserializer = deserializer_impl;
+
+            uint64_t actual;
+
+            bool throwed = false;
+            try {
+                 deserializer >> actual;
+            } catch (PlaintextInvalidInt const &exception) {
+                throwed = true;
+            }
+            TEST_ASSERT(
+                std::string("should throw, but found ")
+                    + std::to_string(actual),
+                throwed
+            );
+
+            deserializer >> actual;
+            TEST_ASSERT(
+                "should resume at next field, found " + std::to_string(actual),
+                actual == 2
+            );
+        })
     ;
 }
 
-static TestSuite socket_test_suite()
+static TestSuite plaintext_span_de_test_suite()
 {
     return TestSuite()
-        .test("basic send and receive", [] {
-            Socket client(500);
-            Socket server(Address(make_ipv4({ 127, 0, 0, 1 }), 8082), 500);
-            Enveloped enveloped;
-            enveloped.remote = Address(make_ipv4({ 127, 0, 0, 1 }), 8082);
-            enveloped.message;
-            enveloped.message.header.fill_req();
-            enveloped.message.body = std::shared_ptr<MessageBody>(
-                new MessageClientConnReq(Username("@bruno"))
+        .test("span deserialize fields of all types", [] {
+            std::string buf(
+                "1;138;1243;78679;143;-14;-8430;-32;The End;2;-1;3;-79;"
             );
-            client.send(enveloped);
+            PlaintextSpanDeserializer deserializer_impl(buf.data(), buf.size());
+            Deserializer& deserializer = deserializer_impl;
 
-            Enveloped received = server.receive();
+            bool bool_field;
+            uint8_t u8_field;
+            uint16_t u16_field;
+            uint32_t u32_field;
+            uint64_t u64_field;
+            int8_t i8_field;
+            int16_t i16_field;
+            int32_t i32_field;
+            std::string text_field;
+            std::vector<int16_t> vec_field;
+            int64_t i64_field;
+
+            deserializer
+                >> bool_field
+                >> u8_field
+                >> u16_field
+                >> u32_field
+                >> u64_field
+                >> i8_field
+                >> i16_field
+                >> i32_field
+                >> text_field
+                >> vec_field
+                >> i64_field;
+            deserializer.ensure_eof();
 
+            TEST_ASSERT("bool field", bool_field);
             TEST_ASSERT(
-                std::string("basic recevied ipv4 address is wrong, address: ")
-                    + received.remote.to_string(),
-                received.remote.ipv4 == make_ipv4({ 127, 0, 0, 1 })
+                std::string("uint8 field, found ") + std::to_string(u8_field),
+                u8_field == 138
+            );
+            TEST_ASSERT(
+                std::string("uint16 field, found ") + std::to_string(u16_field),
+                u16_field == 1243
+            );
+            TEST_ASSERT(
+                std::string("uint32 field, found ") + std::to_string(u32_field),
+                u32_field == 78679
+            );
+            TEST_ASSERT(
+                std::string("uint64 field, found ") + std::to_string(u64_field),
+                u64_field == 143
+            );
+            TEST_ASSERT(
+                std::string("int8 field, found ") + std::to_string(i8_field),
+                i8_field == -14
+            );
+            TEST_ASSERT(
+                std::string("int16 field, found ") + std::to_string(i16_field),
+                i16_field == -8430
+            );
+            TEST_ASSERT(
+                std::string("int32 field, found ") + std::to_string(i32_field),
+                i32_field == -32
+            );
+            TEST_ASSERT(
+                std::string("text field, found ") + text_field,
+                text_field == "The End"
+            );
+            TEST_ASSERT(
+                std::string("vector field, found length ")
+                    + std::to_string(vec_field.size()),
+                (vec_field == std::vector<int16_t> { -1, 3 })
+            );
+            TEST_ASSERT(
+                std::string("int64 field, found ") + std::to_string(i64_field),
+                i64_field == -79
+            );
+        })
+
+        .test("span deserialize strings with various escapes", [] {
+            std::string buf(
+                "The End;The\\; End;The\\\\ End;The\\\\\\; End;"
             );
+            PlaintextSpanDeserializer deserializer_impl(buf.data(), buf.size());
+            Deserializer& deserializer = deserializer_impl;
+
+            std::string fields[4];
+
+            deserializer >> fields[0] >> fields[1] >> fields[2] >> fields[3];
 
             TEST_ASSERT(
-                std::string("basic recevied port is wrong, address: ")
-                    + received.remote.to_string(),
-                received.remote.port != 8082
+                std::string("field 0, found: ") + fields[0],
+                fields[0] == "The End"
+            );
+            TEST_ASSERT(
+                std::string("field 1, found: ") + fields[1],
+                fields[1] == "The; End"
+            );
+            TEST_ASSERT(
+                std::string("field 2, found: ") + fields[2],
+                fields[2] == "The\\ End"
+            );
+            TEST_ASSERT(
+                std::string("field 3, found: ") + fields[3],
+                fields[3] == "The\\; End"
             );
+        })
+
+        .test("span deserialize does not read past the span", [] {
+            std::string buf("2;3;");
+            PlaintextSpanDeserializer deserializer_impl(buf.data(), 2);
+            Deserializer& deserializer = deserializer_impl;
+
+            int64_t int_field;
+            uint64_t actual = 0;
+
+            deserializer >> int_field;
+
+            bool throwed = false;
+            try {
+                 deserializer >> actual;
+            } catch (DeserializationUnexpectedEof const &exception) {
+                throwed = true;
+            }
 
             TEST_ASSERT(
-                "found message tag: "
-                    + received.message.body->tag().to_string(),
-                received.message.body->tag() == MessageTag(MSG_REQ, MSG_CLIENT_CONN)
+                std::string("int field, found: ") + std::to_string(int_field),
+                int_field == 2
             );
+            TEST_ASSERT(
+                std::string("should throw, but found ") + std::to_string(actual),
+                throwed
+            );
+        })
 
-            MessageClientConnReq const& casted_body =
-                received.message.body->cast<MessageClientConnReq>();
+        .test("span deserialize bad int chars", [] {
+            std::string buf("-1230;1a;");
+            PlaintextSpanDeserializer deserializer_impl(buf.data(), buf.size());
+            Deserializer& deserializer = deserializer_impl;
+
+            uint16_t unsigned_field = 0;
+            int64_t signed_field = 0;
+
+            bool unsigned_throwed = false;
+            try {
+                 deserializer >> unsigned_field;
+            } catch (PlaintextInvalidInt const &exception) {
+                unsigned_throwed = true;
+            }
+            bool signed_throwed = false;
+            try {
+                 deserializer >> signed_field;
+            } catch (PlaintextInvalidInt const &exception) {
+                signed_throwed = true;
+            }
 
             TEST_ASSERT(
-                std::string("message username should be \"bruno\", found: ")
-                    + casted_body.username.content(),
-                casted_body.username == Username("@bruno")
+                std::string("should throw, but found ")
+                    + std::to_string(unsigned_field),
+                unsigned_throwed
+            );
+            TEST_ASSERT(
+                std::string("should throw, but found ")
+                    + std::to_string(signed_field),
+                signed_throwed
             );
         })
 
-        .test("full message workflow", [] {
-            Socket client(500);
-            Socket server(Address(make_ipv4({ 127, 0, 0, 1 }), 8082), 500);
+        .test("find escapes at every position of long strings", [] {
+            for (size_t size = 0; size < 80; size++) {
+                for (size_t position = 0; position <= size; position++) {
+                    std::string text(size, 'a');
+                    if (position < size) {
+                        text[position] = position % 2 == 0 ? ';' : '\\';
+                    }
+                    char const *found = plaintext_find_escape(
+                        text.data(),
+                        text.data() + text.size()
+                    );
+                    TEST_ASSERT(
+                        "size " + std::to_string(size)
+                            + ", position " + std::to_string(position)
+                            + ", found " + std::to_string(found - text.data()),
+                        found == text.data() + position
+                    );
 
-            Enveloped request;
-            request.remote = Address(make_ipv4({ 127, 0, 0, 1 }), 8082);
-            request.message.header.fill_req();
-            request.message.body = std::shared_ptr<MessageBody>(
-                new MessageClientConnReq(Username("@bruno"))
+                    std::string buf;
+                    PlaintextBufferSerializer serializer(buf);
+                    serializer << text;
+                    PlaintextSpanDeserializer deserializer(
+                        buf.data(),
+                        buf.size()
+                    );
+                    std::string decoded;
+                    deserializer >> decoded;
+                    deserializer.ensure_eof();
+                    TEST_ASSERT("round trip of " + text, decoded == text);
+                }
+            }
+        })
+    ;
+}
+
+static TestSuite binary_ser_test_suite()
+{
+    return TestSuite()
+        .test("binary serialize fields of all types", [] {
+            std::ostringstream ostream;
+            BinarySerializer serializer_impl(ostream);
+            Serializer& serializer = serializer_impl;
+            serializer
+                << (uint8_t) 138
+                << true
+                << (uint16_t) 0x1234
+                << (uint32_t) 0x12345678
+                << (int8_t) -2
+                << "ab;"
+                << (int16_t) -2
+                << std::vector<int32_t> { -1 }
+                << (uint64_t) 0x0102030405060708;
+            std::string actual = ostream.str();
+            std::string expected(
+                "\x8a"
+                "\x01"
+                "\x34\x12"
+                "\x78\x56\x34\x12"
+                "\xfe"
+                "\x03\x00\x00\x00" "ab;"
+                "\xfe\xff"
+                "\x01\x00\x00\x00" "\xff\xff\xff\xff"
+                "\x08\x07\x06\x05\x04\x03\x02\x01",
+                34
+            );
+            TEST_ASSERT(
+                std::string("found ") + std::to_string(actual.size())
+                    + " bytes",
+                actual == expected
             );
-            client.send(request);
+        })
+    ;
+}
 
-            Enveloped received_req = server.receive();
+static TestSuite binary_de_test_suite()
+{
+    return TestSuite()
+        .test("binary round trip of all types", [] {
+            std::ostringstream ostream;
+            BinarySerializer serializer_impl(ostream);
+            Serializer& serializer = serializer_impl;
+            serializer
+                << true
+                << (uint8_t) 138
+                << (uint16_t) 1243
+                << (uint32_t) 78679
+                << (uint64_t) UINT64_MAX
+                << (int8_t) -14
+                << (int16_t) -8430
+                << (int32_t) -32
+                << "The; End\\"
+                << std::optional<Address>(Address(make_ipv4({ 1, 2, 3, 4 }), 5))
+                << std::optional<Address>()
+                << (int64_t) INT64_MIN;
+
+            std::istringstream istream(ostream.str());
+            BinaryDeserializer deserializer_impl(istream);
+            Deserializer& deserializer = deserializer_impl;
+
+            bool bool_field;
+            uint8_t u8_field;
+            uint16_t u16_field;
+            uint32_t u32_field;
+            uint64_t u64_field;
+            int8_t i8_field;
+            int16_t i16_field;
+            int32_t i32_field;
+            std::string text_field;
+            std::optional<Address> present_field;
+            std::optional<Address> absent_field(Address(1, 1));
+            int64_t i64_field;
+
+            deserializer
+                >> bool_field
+                >> u8_field
+                >> u16_field
+                >> u32_field
+                >> u64_field
+                >> i8_field
+                >> i16_field
+                >> i32_field
+                >> text_field
+                >> present_field
+                >> absent_field
+                >> i64_field;
+            deserializer.ensure_eof();
 
+            TEST_ASSERT("bool field", bool_field);
             TEST_ASSERT(
-                "found " + received_req.message.body->tag().to_string(),
-                received_req.message.body->tag()
-                    == MessageTag(MSG_REQ, MSG_CLIENT_CONN)
+                std::string("uint8 field, found ") + std::to_string(u8_field),
+                u8_field == 138
             );
+            TEST_ASSERT(
+                std::string("uint16 field, found ") + std::to_string(u16_field),
+                u16_field == 1243
+            );
+            TEST_ASSERT(
+                std::string("uint32 field, found ") + std::to_string(u32_field),
+                u32_field == 78679
+            );
+            TEST_ASSERT(
+                std::string("uint64 field, found ") + std::to_string(u64_field),
+                u64_field == UINT64_MAX
+            );
+            TEST_ASSERT(
+                std::string("int8 field, found ") + std::to_string(i8_field),
+                i8_field == -14
+            );
+            TEST_ASSERT(
+                std::string("int16 field, found ") + std::to_string(i16_field),
+                i16_field == -8430
+            );
+            TEST_ASSERT(
+                std::string("int32 field, found ") + std::to_string(i32_field),
+                i32_field == -32
+            );
+            TEST_ASSERT(
+                std::string("text field, found ") + text_field,
+                text_field == "The; End\\"
+            );
+            TEST_ASSERT(
+                "present optional field",
+                present_field == Address(make_ipv4({ 1, 2, 3, 4 }), 5)
+            );
+            TEST_ASSERT("absent optional field", !absent_field.has_value());
+            TEST_ASSERT(
+                std::string("int64 field, found ") + std::to_string(i64_field),
+                i64_field == INT64_MIN
+            );
+        })
+
+        .test("binary span round trip of a message", [] {
+            Message message;
+            message.header.fill_req();
+            message.header.election_counter = 7;
+            message.body = std::shared_ptr<MessageBody>(
+                new MessageFollowReq(Username("@bruno"))
+            );
+
+            std::ostringstream ostream;
+            BinarySerializer serializer_impl(ostream);
+            Serializer& serializer = serializer_impl;
+            serializer << message;
+            std::string buf = ostream.str();
+
+            BinarySpanDeserializer deserializer_impl(buf.data(), buf.size());
+            Deserializer& deserializer = deserializer_impl;
+            Message decoded;
+            deserializer >> decoded;
+            deserializer.ensure_eof();
+
+            TEST_ASSERT(
+                "found seqn: " + std::to_string(decoded.header.seqn),
+                decoded.header.seqn == message.header.seqn
+            );
+            TEST_ASSERT(
+                "found election counter: "
+                    + std::to_string(decoded.header.election_counter),
+                decoded.header.election_counter == 7
+            );
+            TEST_ASSERT(
+                "found username: "
+                    + decoded.body->cast<MessageFollowReq>().username.content(),
+                decoded.body->cast<MessageFollowReq>().username
+                    == Username("@bruno")
+            );
+        })
+
+        .test("binary span deserialize truncated string", [] {
+            std::string buf("\x05\x00\x00\x00" "abc", 7);
+            BinarySpanDeserializer deserializer_impl(buf.data(), buf.size());
+            Deserializer& deserializer = deserializer_impl;
+
+            std::string actual;
+
+            bool throwed = false;
+            try {
+                deserializer >> actual;
+            } catch (DeserializationUnexpectedEof const &exception) {
+                throwed = true;
+            }
+            TEST_ASSERT("should throw, but found " + actual, throwed);
+        })
+
+        .test("binary deserialize truncated input", [] {
+            std::istringstream istream(std::string("\x01\x02\x03", 3));
+            BinaryDeserializer deserializer_impl(istream);
+            Deserializer& deserializer = deserializer_impl;
+
+            uint32_t actual = 0;
+
+            bool throwed = false;
+            try {
+                deserializer >> actual;
+            } catch (DeserializationUnexpectedEof const &exception) {
+                throwed = true;
+            }
+            TEST_ASSERT(
+                std::string("should throw, but found ")
+                    + std::to_string(actual),
+                throwed
+            );
+        })
+
+        .test("binary deserialize invalid bool", [] {
+            std::istringstream istream(std::string("\x02", 1));
+            BinaryDeserializer deserializer_impl(istream);
+            Deserializer& deserializer = deserializer_impl;
+
+            bool actual = false;
+
+            bool throwed = false;
+            try {
+                deserializer >> actual;
+            } catch (BinaryInvalidBool const &exception) {
+                throwed = true;
+            }
+            TEST_ASSERT("should throw on bool byte 2", throwed);
+        })
+
+        .test("binary deserialize trailing data", [] {
+            std::istringstream istream(std::string("\x01\x02", 2));
+            BinaryDeserializer deserializer_impl(istream);
+            Deserializer& deserializer = deserializer_impl;
+
+            uint8_t actual;
+            deserializer >> actual;
+
+            bool throwed = false;
+            try {
+                deserializer.ensure_eof();
+            } catch (DeserializationExpectedEof const &exception) {
+                throwed = true;
+            }
+            TEST_ASSERT("should throw on trailing byte", throwed);
+        })
+    ;
+}
+
+static TestSuite compact_test_suite()
+{
+    return TestSuite()
+        .test("compact serialize fields of all types", [] {
+            std::string actual;
+            CompactBufferSerializer serializer_impl(actual, 1000);
+            Serializer& serializer = serializer_impl;
+            serializer
+                << (uint8_t) 138
+                << true
+                << (uint16_t) 300
+                << (uint32_t) 1
+                << (int8_t) -2
+                << "ab;"
+                << (int16_t) -2
+                << std::vector<int32_t> { -1, 64 }
+                << (uint64_t) UINT64_MAX;
+            serializer.serialize_timestamp(999);
+            std::string expected(
+                "\x8a"
+                "\x01"
+                "\xac\x02"
+                "\x01"
+                "\xfe"
+                "\x03" "ab;"
+                "\x03"
+                "\x02" "\x01" "\x80\x01"
+                "\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01"
+                "\x01",
+                26
+            );
+            TEST_ASSERT(
+                std::string("found ") + std::to_string(actual.size())
+                    + " bytes",
+                actual == expected
+            );
+        })
+
+        .test("compact round trip of all types", [] {
+            std::string buf;
+            CompactBufferSerializer serializer_impl(buf);
+            Serializer& serializer = serializer_impl;
+            serializer
+                << true
+                << (uint16_t) UINT16_MAX
+                << (uint32_t) 78679
+                << (uint64_t) UINT64_MAX
+                << (int8_t) -14
+                << (int16_t) INT16_MIN
+                << (int32_t) INT32_MAX
+                << "The; End\\"
+                << (int64_t) INT64_MIN;
+            serializer.serialize_timestamp(INT64_MAX);
+
+            CompactSpanDeserializer deserializer_impl(buf.data(), buf.size());
+            Deserializer& deserializer = deserializer_impl;
+
+            bool bool_field;
+            uint16_t u16_field;
+            uint32_t u32_field;
+            uint64_t u64_field;
+            int8_t i8_field;
+            int16_t i16_field;
+            int32_t i32_field;
+            std::string text_field;
+            int64_t i64_field;
+            int64_t timestamp_field;
+
+            deserializer
+                >> bool_field
+                >> u16_field
+                >> u32_field
+                >> u64_field
+                >> i8_field
+                >> i16_field
+                >> i32_field
+                >> text_field
+                >> i64_field;
+            deserializer.deserialize_timestamp(timestamp_field);
+            deserializer.ensure_eof();
+
+            TEST_ASSERT("bool field", bool_field);
+            TEST_ASSERT(
+                std::string("uint16 field, found ") + std::to_string(u16_field),
+                u16_field == UINT16_MAX
+            );
+            TEST_ASSERT(
+                std::string("uint32 field, found ") + std::to_string(u32_field),
+                u32_field == 78679
+            );
+            TEST_ASSERT(
+                std::string("uint64 field, found ") + std::to_string(u64_field),
+                u64_field == UINT64_MAX
+            );
+            TEST_ASSERT(
+                std::string("int8 field, found ") + std::to_string(i8_field),
+                i8_field == -14
+            );
+            TEST_ASSERT(
+                std::string("int16 field, found ") + std::to_string(i16_field),
+                i16_field == INT16_MIN
+            );
+            TEST_ASSERT(
+                std::string("int32 field, found ") + std::to_string(i32_field),
+                i32_field == INT32_MAX
+            );
+            TEST_ASSERT(
+                std::string("text field, found ") + text_field,
+                text_field == "The; End\\"
+            );
+            TEST_ASSERT(
+                std::string("int64 field, found ") + std::to_string(i64_field),
+                i64_field == INT64_MIN
+            );
+            TEST_ASSERT(
+                std::string("timestamp field, found ")
+                    + std::to_string(timestamp_field),
+                timestamp_field == INT64_MAX
+            );
+        })
+
+        .test("compact header is smaller than binary", [] {
+            Message message;
+            message.header.fill_req();
+            message.header.election_counter = 2;
+            message.body = std::shared_ptr<MessageBody>(new MessagePingReq);
+
+            std::string binary_buf;
+            BinaryBufferSerializer binary_impl(binary_buf);
+            Serializer& binary = binary_impl;
+            binary << message;
+
+            std::string compact_buf;
+            CompactBufferSerializer compact_impl(compact_buf);
+            Serializer& compact = compact_impl;
+            compact << message;
+
+            TEST_ASSERT(
+                "compact " + std::to_string(compact_buf.size())
+                    + " bytes, binary "
+                    + std::to_string(binary_buf.size()) + " bytes",
+                compact_buf.size() < binary_buf.size()
+            );
+
+            CompactSpanDeserializer deserializer_impl(
+                compact_buf.data(),
+                compact_buf.size()
+            );
+            Deserializer& deserializer = deserializer_impl;
+            Message decoded;
+            deserializer >> decoded;
+            deserializer.ensure_eof();
+
+            TEST_ASSERT(
+                "found timestamp: " + std::to_string(decoded.header.timestamp),
+                decoded.header.timestamp == message.header.timestamp
+            );
+            TEST_ASSERT(
+                "found seqn: " + std::to_string(decoded.header.seqn),
+                decoded.header.seqn == message.header.seqn
+            );
+        })
+
+        .test("compact deserialize overlong varint", [] {
+            std::string buf(11, '\x80');
+            CompactSpanDeserializer deserializer_impl(buf.data(), buf.size());
+            Deserializer& deserializer = deserializer_impl;
+
+            uint64_t actual = 0;
+
+            bool throwed = false;
+            try {
+                deserializer >> actual;
+            } catch (CompactInvalidVarint const &exception) {
+                throwed = true;
+            }
+            TEST_ASSERT(
+                std::string("should throw, but found ")
+                    + std::to_string(actual),
+                throwed
+            );
+        })
+
+        .test("compact deserialize non-canonical varint", [] {
+            std::string buf("\x81\x00", 2);
+            CompactSpanDeserializer deserializer_impl(buf.data(), buf.size());
+            Deserializer& deserializer = deserializer_impl;
+
+            uint64_t actual = 0;
+
+            bool throwed = false;
+            try {
+                deserializer >> actual;
+            } catch (CompactInvalidVarint const &exception) {
+                throwed = true;
+            }
+            TEST_ASSERT(
+                std::string("should throw, but found ")
+                    + std::to_string(actual),
+                throwed
+            );
+        })
+
+        .test("compact deserialize varint out of range", [] {
+            std::string buf("\x80\x80\x04", 3);
+            CompactSpanDeserializer deserializer_impl(buf.data(), buf.size());
+            Deserializer& deserializer = deserializer_impl;
+
+            uint16_t actual = 0;
+
+            bool throwed = false;
+            try {
+                deserializer >> actual;
+            } catch (CompactInvalidVarint const &exception) {
+                throwed = true;
+            }
+            TEST_ASSERT(
+                std::string("should throw, but found ")
+                    + std::to_string(actual),
+                throwed
+            );
+        })
+
+        .test("compact deserialize truncated varint", [] {
+            std::string buf("\x80", 1);
+            CompactSpanDeserializer deserializer_impl(buf.data(), buf.size());
+            Deserializer& deserializer = deserializer_impl;
+
+            uint32_t actual = 0;
+
+            bool throwed = false;
+            try {
+                deserializer >> actual;
+            } catch (DeserializationUnexpectedEof const &exception) {
+                throwed = true;
+            }
+            TEST_ASSERT(
+                std::string("should throw, but found ")
+                    + std::to_string(actual),
+                throwed
+            );
+        })
+    ;
+}
+
+static TestSuite message_registry_test_suite()
+{
+    return TestSuite()
+        .test("registry makes bodies only for registered tags", [] {
+            for (size_t step = 0; step < MSG_STEP_COUNT; step++) {
+                for (size_t type = 0; type < MSG_TYPE_COUNT; type++) {
+                    MessageTag tag((MessageStep) step, (MessageType) type);
+                    std::shared_ptr<MessageBody> body =
+                        MessageBodies::make(tag);
+                    if (MessageBodies::contains(tag.step, tag.type)) {
+                        TEST_ASSERT(
+                            "missing body for " + tag.to_string(),
+                            body && body->tag() == tag
+                        );
+                    } else {
+                        TEST_ASSERT(
+                            "unexpected body for " + tag.to_string(),
+                            !body
+                        );
+                    }
+                }
+            }
+        })
+
+        .test("deserialize message with unregistered tag", [] {
+            std::string buf;
+            BinaryBufferSerializer serializer_impl(buf);
+            Serializer& serializer = serializer_impl;
+            serializer
+                << MSG_MAGIC_NUMBER
+                << MessageHeader()
+                << MessageTag(MSG_ACK, MSG_PING);
+
+            BinarySpanDeserializer deserializer_impl(buf.data(), buf.size());
+            Deserializer& deserializer = deserializer_impl;
+            Message decoded;
+
+            bool throwed = false;
+            try {
+                deserializer >> decoded;
+            } catch (InvalidMessagePayload const &exception) {
+                throwed = true;
+            }
+            TEST_ASSERT("should throw on ACK/PING", throwed);
+        })
+    ;
+}
+
+static TestSuite pool_test_suite()
+{
+    return TestSuite()
+        .test("pooled block is recycled after last reference drops", [] {
+            std::shared_ptr<MessageBody> first =
+                make_pooled<MessageErrorResp>(MSG_BAD);
+            MessageBody const *first_address = first.get();
+            first.reset();
+
+            std::shared_ptr<MessageBody> second =
+                make_pooled<MessageErrorResp>(MSG_NO_CONNECTION);
+            TEST_ASSERT(
+                "block should be reused",
+                second.get() == first_address
+            );
+            TEST_ASSERT(
+                "recycled body should be constructed again",
+                second->cast<MessageErrorResp>().error == MSG_NO_CONNECTION
+            );
+        })
+
+        .test("live pooled blocks are distinct", [] {
+            std::shared_ptr<MessageBody> first = make_pooled<MessagePingReq>();
+            std::shared_ptr<MessageBody> second = make_pooled<MessagePingReq>();
+            std::shared_ptr<MessageBody> copy = first;
+            TEST_ASSERT("blocks should differ", first.get() != second.get());
+
+            first.reset();
+            std::shared_ptr<MessageBody> third = make_pooled<MessagePingReq>();
+            TEST_ASSERT(
+                "block still referenced should not be reused",
+                third.get() != copy.get() && third.get() != second.get()
+            );
+        })
+
+        .test("pooled block freed by another thread", [] {
+            std::shared_ptr<MessageBody> body = make_pooled<MessagePingResp>();
+            std::thread thread([body = std::move(body)] () mutable {
+                body.reset();
+            });
+            thread.join();
+            std::shared_ptr<MessageBody> other = make_pooled<MessagePingResp>();
+            TEST_ASSERT(
+                "body should be allocated",
+                other->tag().type == MSG_PING
+            );
+        })
+
+        .test("pooled block goes back to the allocating thread", [] {
+            class Probe {
+                public:
+                    uint64_t value;
+            };
+
+            std::shared_ptr<Probe> probe = make_pooled<Probe>();
+            Probe *first_address = probe.get();
+            std::thread thread([probe = std::move(probe)] () mutable {
+                probe.reset();
+            });
+            thread.join();
+
+            std::shared_ptr<Probe> recycled = make_pooled<Probe>();
+            TEST_ASSERT(
+                "block freed by another thread should be reused",
+                recycled.get() == first_address
+            );
+        })
+
+        .test("pooled block outlives the allocating thread", [] {
+            class Probe {
+                public:
+                    uint64_t value;
+            };
+
+            std::vector<std::shared_ptr<Probe>> probes;
+            std::thread thread([&probes] {
+                for (size_t i = 0; i < 4; i++) {
+                    probes.push_back(make_pooled<Probe>());
+                    probes.back()->value = i;
+                }
+                probes.push_back(make_pooled<Probe>());
+                probes.pop_back();
+            });
+            thread.join();
+
+            for (size_t i = 0; i < probes.size(); i++) {
+                TEST_ASSERT(
+                    "found value " + std::to_string(probes[i]->value),
+                    probes[i]->value == i
+                );
+            }
+            probes.clear();
+            std::shared_ptr<Probe> other = make_pooled<Probe>();
+            other->value = 1;
+            TEST_ASSERT("block should be allocated", other->value == 1);
+        })
+
+        .test("datagram buffer goes back to its pool", [] {
+            DatagramBufferPool pool(64, 2);
+            char const *first_address;
+            {
+                DatagramBuffer buffer = pool.take();
+                TEST_ASSERT(
+                    "found capacity " + std::to_string(buffer.capacity()),
+                    buffer.capacity() == 64 && buffer.size() == 0
+                );
+                buffer.resize(100);
+                TEST_ASSERT("size should be capped", buffer.size() == 64);
+                first_address = buffer.data();
+            }
+            TEST_ASSERT("buffer should be idle", pool.idle_count() == 1);
+
+            DatagramBuffer second = pool.take();
+            TEST_ASSERT(
+                "storage should be reused",
+                second.data() == first_address && pool.allocations() == 1
+            );
+            DatagramBuffer moved = std::move(second);
+            TEST_ASSERT("moved-from should be empty", second.capacity() == 0);
+            std::thread thread([moved = std::move(moved)] () mutable {
+                DatagramBuffer dropped = std::move(moved);
+            });
+            thread.join();
+            TEST_ASSERT("buffer should be back", pool.idle_count() == 1);
+        })
+
+        .test("datagram buffer pool keeps at most its capacity", [] {
+            DatagramBufferPool pool(64, 2);
+            {
+                std::vector<DatagramBuffer> buffers;
+                for (size_t i = 0; i < 5; i++) {
+                    buffers.push_back(pool.take());
+                }
+                buffers.push_back(DatagramBuffer(std::string("not pooled")));
+            }
+            TEST_ASSERT(
+                "found " + std::to_string(pool.idle_count()) + " idle",
+                pool.idle_count() == 2 && pool.allocations() == 5
+            );
+        })
+    ;
+}
+
+static TestSuite socket_test_suite()
+{
+    return TestSuite()
+        .test("basic send and receive", [] {
+            Socket client(500);
+            Socket server(Address(make_ipv4({ 127, 0, 0, 1 }), 8082), 500);
+            Enveloped enveloped;
+            enveloped.remote = Address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            enveloped.message;
+            enveloped.message.header.fill_req();
+            enveloped.message.body = std::shared_ptr<MessageBody>(
+                new MessageClientConnReq(Username("@bruno"))
+            );
+            client.send(enveloped);
+
+            Enveloped received = server.receive();
+
+            TEST_ASSERT(
+                std::string("basic recevied ipv4 address is wrong, address: ")
+                    + received.remote.to_string(),
+                received.remote.ipv4 == make_ipv4({ 127, 0, 0, 1 })
+            );
+
+            TEST_ASSERT(
+                std::string("basic recevied port is wrong, address: ")
+                    + received.remote.to_string(),
+                received.remote.port != 8082
+            );
+
+            TEST_ASSERT(
+                "found message tag: "
+                    + received.message.body->tag().to_string(),
+                received.message.body->tag() == MessageTag(MSG_REQ, MSG_CLIENT_CONN)
+            );
+
+            MessageClientConnReq const& casted_body =
+                received.message.body->cast<MessageClientConnReq>();
+
+            TEST_ASSERT(
+                std::string("message username should be \"bruno\", found: ")
+                    + casted_body.username.content(),
+                casted_body.username == Username("@bruno")
+            );
+        })
+
+        .test("full message workflow", [] {
+            Socket client(500);
+            Socket server(Address(make_ipv4({ 127, 0, 0, 1 }), 8082), 500);
+
+            Enveloped request;
+            request.remote = Address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            request.message.header.fill_req();
+            request.message.body = std::shared_ptr<MessageBody>(
+                new MessageClientConnReq(Username("@bruno"))
+            );
+            client.send(request);
+
+            Enveloped received_req = server.receive();
+
+            TEST_ASSERT(
+                "found " + received_req.message.body->tag().to_string(),
+                received_req.message.body->tag()
+                    == MessageTag(MSG_REQ, MSG_CLIENT_CONN)
+            );
+
+            MessageClientConnReq const& casted_req_body =
+                received_req.message.body->cast<MessageClientConnReq>();
+
+            TEST_ASSERT(
+                "message username should be \"bruno\", found: "
+                    + casted_req_body.username.content(),
+                casted_req_body.username == Username("@bruno")
+            );
+
+            Enveloped response;
+            response.remote = received_req.remote;
+            response.message.header.fill_resp(received_req.message.header.seqn);
+            response.message.body = std::shared_ptr<MessageClientConnResp>(
+                new MessageClientConnResp
+            );
+            server.send(response);
+
+            Enveloped received_resp = client.receive();
+
+            TEST_ASSERT(
+                "found " + received_resp.message.body->tag().to_string(),
+                received_resp.message.body->tag()
+                    == MessageTag(MSG_RESP, MSG_CLIENT_CONN)
+            );
+
+            MessageClientConnResp const& casted_resp_body =
+                received_resp.message.body->cast<MessageClientConnResp>();
+        })
+
+        .test("steady-state send does not allocate", [] {
+            for (
+                WireFormat wire_format
+                : { WIRE_PLAINTEXT, WIRE_BINARY, WIRE_COMPACT }
+            ) {
+                Socket client(500, wire_format);
+                Socket server(
+                    Address(make_ipv4({ 127, 0, 0, 1 }), 8082),
+                    500,
+                    wire_format
+                );
+                Enveloped enveloped;
+                enveloped.remote = Address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+                enveloped.message.header.fill_req();
+                enveloped.message.body = std::shared_ptr<MessageBody>(
+                    new MessageDeliverReq(
+                        Username("@bruno"),
+                        NotifMessage("a long enough notification; with \\"),
+                        1234
+                    )
+                );
+                client.send(enveloped);
+
+                uint64_t allocations_before = thread_allocation_count();
+                for (size_t i = 0; i < 16; i++) {
+                    client.send(enveloped);
+                }
+                uint64_t allocations =
+                    thread_allocation_count() - allocations_before;
+
+                TEST_ASSERT(
+                    "wire format " + std::to_string(wire_format)
+                        + " allocated " + std::to_string(allocations)
+                        + " times",
+                    allocations == 0
+                );
+            }
+        })
+
+        .test("serialized size matches the encoded size", [] {
+            std::set<Address> addresses {
+                Address(make_ipv4({ 192, 168, 0, 10 }), 8080),
+                Address(make_ipv4({ 10, 0, 0, 1 }), 65535)
+            };
+            std::vector<std::shared_ptr<MessageBody>> bodies {
+                make_pooled<MessageNopAck>(),
+                make_pooled<MessageErrorResp>(MSG_NO_CONNECTION),
+                make_pooled<MessageFollowReq>(Username("@someone_else")),
+                make_pooled<MessageServerConnResp>(),
+                make_pooled<MessageDeliverReq>(
+                    Username("@bruno"),
+                    NotifMessage("a long enough notification; with \\"),
+                    -1234
+                ),
+                make_pooled<MessageRmLookupResp>(
+                    addresses,
+                    std::optional<Address>(*addresses.begin())
+                )
+            };
+            for (
+                WireFormat wire_format
+                : { WIRE_PLAINTEXT, WIRE_BINARY, WIRE_COMPACT }
+            ) {
+                Socket socket(500, wire_format);
+                for (auto const& body : bodies) {
+                    Message message;
+                    message.header.fill_req();
+                    message.header.election_counter = 300;
+                    message.body = body;
+
+                    std::string buf;
+                    switch (wire_format) {
+                        case WIRE_PLAINTEXT: {
+                            PlaintextBufferSerializer serializer(buf);
+                            serializer << message;
+                            break;
+                        }
+                        case WIRE_BINARY: {
+                            BinaryBufferSerializer serializer(buf);
+                            serializer << message;
+                            break;
+                        }
+                        case WIRE_COMPACT: {
+                            CompactBufferSerializer serializer(buf);
+                            serializer << message;
+                            break;
+                        }
+                    }
+
+                    size_t size = socket.serialized_size(message);
+                    TEST_ASSERT(
+                        "wire format " + std::to_string(wire_format)
+                            + ", tag " + body->tag().to_string()
+                            + ", expected " + std::to_string(buf.size())
+                            + ", found " + std::to_string(size),
+                        size == buf.size()
+                    );
+                }
+            }
+        })
+
+        .test("send rejects messages above the maximum size", [] {
+            Socket client(64);
+            Enveloped enveloped;
+            enveloped.remote = Address(make_ipv4({ 127, 0, 0, 1 }), 8083);
+            enveloped.message.header.fill_req();
+            enveloped.message.body = make_pooled<MessageNotifyReq>(
+                NotifMessage(std::string(NotifMessage::MAX_LEN, 'a'))
+            );
+
+            bool throwed = false;
+            try {
+                client.send(enveloped);
+            } catch (MessageTooLarge const& exception) {
+                throwed = exception.max_size() == 64
+                    && exception.size() > exception.max_size();
+            }
+            TEST_ASSERT("should throw MessageTooLarge", throwed);
+        })
+
+        .test("receive a batch, skipping datagrams out of protocol", [] {
+            Socket client(500, WIRE_BINARY);
+            Socket server(
+                Address(make_ipv4({ 127, 0, 0, 1 }), 8082),
+                500,
+                WIRE_BINARY
+            );
+            Address server_address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+
+            std::vector<uint64_t> seqns;
+            for (size_t i = 0; i < 5; i++) {
+                if (i == 2) {
+                    client.send_encoded(server_address, "not a message");
+                }
+                Enveloped enveloped;
+                enveloped.remote = server_address;
+                enveloped.message.header.fill_req();
+                enveloped.message.body = make_pooled<MessageFollowReq>(
+                    Username("@user" + std::to_string(i))
+                );
+                client.send(enveloped);
+                seqns.push_back(enveloped.message.header.seqn);
+            }
+
+            std::vector<Enveloped> received;
+            while (received.size() < seqns.size()) {
+                std::vector<Enveloped> batch = server.receive_batch(4, 1000);
+                TEST_ASSERT("should not time out", !batch.empty());
+                TEST_ASSERT(
+                    "found batch size " + std::to_string(batch.size()),
+                    batch.size() <= 4
+                );
+                for (Enveloped& enveloped : batch) {
+                    received.push_back(std::move(enveloped));
+                }
+            }
+
+            for (size_t i = 0; i < seqns.size(); i++) {
+                TEST_ASSERT(
+                    "found seqn "
+                        + std::to_string(received[i].message.header.seqn)
+                        + " at " + std::to_string(i),
+                    received[i].message.header.seqn == seqns[i]
+                );
+                received[i].message.decode_body();
+                Username username =
+                    received[i].message.body->cast<MessageFollowReq>().username;
+                TEST_ASSERT(
+                    "found username " + username.content(),
+                    username == Username("@user" + std::to_string(i))
+                );
+            }
+
+            TEST_ASSERT(
+                "should time out with nothing left",
+                server.receive_batch(4, 0).empty()
+            );
+        })
+
+        .test("send a batch to several sockets", [] {
+            Socket client(500, WIRE_BINARY);
+            std::vector<Socket> servers;
+            std::vector<std::string> datagrams;
+            std::vector<uint64_t> seqns;
+            for (uint16_t port = 8082; port < 8085; port++) {
+                servers.push_back(Socket(
+                    Address(make_ipv4({ 127, 0, 0, 1 }), port),
+                    500,
+                    WIRE_BINARY
+                ));
+                Message message;
+                message.header.fill_req();
+                message.body = make_pooled<MessagePingReq>();
+                seqns.push_back(message.header.seqn);
+                datagrams.emplace_back();
+                client.encode(message, datagrams.back());
+            }
+
+            std::vector<OutgoingDatagram> batch;
+            for (size_t i = 0; i < servers.size(); i++) {
+                batch.push_back(OutgoingDatagram(
+                    Address(make_ipv4({ 127, 0, 0, 1 }), 8082 + i),
+                    datagrams[i]
+                ));
+            }
+            client.send_batch(batch);
+
+            for (size_t i = 0; i < servers.size(); i++) {
+                std::optional<Enveloped> received = servers[i].receive(1000);
+                TEST_ASSERT(
+                    "server " + std::to_string(i) + " should receive",
+                    received.has_value()
+                );
+                TEST_ASSERT(
+                    "found seqn "
+                        + std::to_string(received->message.header.seqn),
+                    received->message.header.seqn == seqns[i]
+                );
+            }
+        })
+
+        .test("send runs of a batch to one remote as GSO segments", [] {
+            Address first_address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            Address second_address(make_ipv4({ 127, 0, 0, 1 }), 8083);
+            Socket client(500, WIRE_BINARY);
+            Socket first(first_address, 500, WIRE_BINARY);
+            Socket second(second_address, 500, WIRE_BINARY);
+
+            std::vector<Address> remotes;
+            for (size_t i = 0; i < 20; i++) {
+                remotes.push_back(first_address);
+            }
+            remotes.push_back(second_address);
+            for (size_t i = 0; i < 5; i++) {
+                remotes.push_back(first_address);
+            }
+
+            std::vector<std::string> datagrams(remotes.size());
+            std::vector<uint64_t> first_seqns;
+            std::vector<OutgoingDatagram> batch;
+            for (size_t i = 0; i < remotes.size(); i++) {
+                Message message;
+                message.header.fill_req();
+                message.body = make_pooled<MessagePingReq>();
+                client.encode(message, datagrams[i]);
+                batch.push_back(OutgoingDatagram(remotes[i], datagrams[i]));
+                if (remotes[i] == first_address) {
+                    first_seqns.push_back(message.header.seqn);
+                }
+            }
+            client.send_batch(batch);
+
+            std::vector<Enveloped> received;
+            while (received.size() < first_seqns.size()) {
+                std::vector<Enveloped> batch = first.receive_batch(32, 1000);
+                TEST_ASSERT("should not time out", !batch.empty());
+                for (Enveloped& enveloped : batch) {
+                    received.push_back(std::move(enveloped));
+                }
+            }
+            for (size_t i = 0; i < first_seqns.size(); i++) {
+                TEST_ASSERT(
+                    "found seqn "
+                        + std::to_string(received[i].message.header.seqn)
+                        + " at " + std::to_string(i),
+                    received[i].message.header.seqn == first_seqns[i]
+                );
+            }
+            TEST_ASSERT(
+                "second socket should receive",
+                second.receive(1000).has_value()
+            );
+
+            SocketStats stats = client.stats();
+            size_t expected_messages = client.gso_enabled() ? 3 : 26;
+            TEST_ASSERT(
+                "found " + std::to_string(stats.send_syscalls) + " syscalls",
+                stats.send_syscalls == 1
+            );
+            TEST_ASSERT(
+                "found " + std::to_string(stats.sent_messages) + " messages",
+                stats.sent_messages == expected_messages
+            );
+            TEST_ASSERT(
+                "found " + std::to_string(stats.sent_datagrams) + " datagrams",
+                stats.sent_datagrams == remotes.size()
+            );
+        })
+
+        .test("send a batch one message per datagram without GSO", [] {
+            Address server_address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            Socket client(500, WIRE_BINARY);
+            Socket server(server_address, 500, WIRE_BINARY);
+            TEST_ASSERT("GSO should be turned off", !client.set_gso(false));
+
+            Message message;
+            message.header.fill_req();
+            message.body = make_pooled<MessagePingReq>();
+            std::string datagram;
+            client.encode(message, datagram);
+            std::vector<OutgoingDatagram> batch(
+                10,
+                OutgoingDatagram(server_address, datagram)
+            );
+            client.send_batch(batch);
+
+            size_t received = 0;
+            while (received < batch.size()) {
+                size_t count = server.receive_batch(32, 1000).size();
+                TEST_ASSERT("should not time out", count > 0);
+                received += count;
+            }
+
+            SocketStats stats = client.stats();
+            TEST_ASSERT(
+                "found " + std::to_string(stats.sent_messages) + " messages",
+                stats.sent_messages == batch.size()
+            );
+            TEST_ASSERT(
+                "found " + std::to_string(stats.sent_datagrams) + " datagrams",
+                stats.sent_datagrams == batch.size()
+            );
+        })
+
+        .test("receive GSO segments coalesced with GRO", [] {
+            Address server_address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            Socket client(500, WIRE_BINARY);
+            Socket server(server_address, 500, WIRE_BINARY);
+            bool gro = server.set_gro(true);
+
+            std::vector<std::string> datagrams(33);
+            std::vector<uint64_t> seqns;
+            std::vector<OutgoingDatagram> batch;
+            for (size_t i = 0; i < datagrams.size(); i++) {
+                Message message;
+                message.header.fill_req();
+                message.body = make_pooled<MessagePingReq>();
+                client.encode(message, datagrams[i]);
+                seqns.push_back(message.header.seqn);
+                if (i < 30) {
+                    batch.push_back(
+                        OutgoingDatagram(server_address, datagrams[i])
+                    );
+                }
+            }
+            client.send_batch(batch);
+
+            std::vector<Enveloped> received;
+            while (received.size() < batch.size()) {
+                std::vector<Enveloped> batch = server.receive_batch(4, 1000);
+                TEST_ASSERT("should not time out", !batch.empty());
+                for (Enveloped& enveloped : batch) {
+                    received.push_back(std::move(enveloped));
+                }
+            }
+
+            batch.clear();
+            for (size_t i = 30; i < datagrams.size(); i++) {
+                batch.push_back(OutgoingDatagram(server_address, datagrams[i]));
+            }
+            client.send_batch(batch);
+            for (size_t i = 30; i < datagrams.size(); i++) {
+                std::optional<Enveloped> enveloped = server.receive(1000);
+                TEST_ASSERT("should not time out", enveloped.has_value());
+                received.push_back(*enveloped);
+            }
+
+            TEST_ASSERT(
+                "found " + std::to_string(received.size()) + " messages",
+                received.size() == seqns.size()
+            );
+            for (size_t i = 0; i < seqns.size(); i++) {
+                TEST_ASSERT(
+                    "found seqn "
+                        + std::to_string(received[i].message.header.seqn)
+                        + " at " + std::to_string(i),
+                    received[i].message.header.seqn == seqns[i]
+                );
+            }
+            TEST_ASSERT(
+                "should time out with nothing left",
+                server.receive_batch(4, 0).empty()
+            );
+
+            SocketStats stats = server.stats();
+            TEST_ASSERT(
+                "found " + std::to_string(stats.received_datagrams)
+                    + " datagrams",
+                stats.received_datagrams == seqns.size()
+            );
+            if (gro && client.gso_enabled()) {
+                TEST_ASSERT(
+                    "found " + std::to_string(stats.received_messages)
+                        + " messages",
+                    stats.received_messages < stats.received_datagrams
+                );
+            }
+        })
+
+        .test("receive kernel timestamps on every receive path", [] {
+            Address server_address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            Socket client(500, WIRE_BINARY);
+            Socket server(server_address, 500, WIRE_BINARY);
+            TEST_ASSERT(
+                "timestamps should be turned on",
+                server.set_timestamps(true)
+            );
+
+            Enveloped enveloped;
+            enveloped.remote = server_address;
+            enveloped.message.body = make_pooled<MessagePingReq>();
+
+            int64_t before = realtime_nanos();
+            std::vector<Enveloped> received;
+            enveloped.message.header.fill_req();
+            client.send(enveloped);
+            std::optional<Enveloped> single = server.receive(1000);
+            TEST_ASSERT("should receive", single.has_value());
+            received.push_back(*single);
+
+            enveloped.message.header.fill_req();
+            client.send(enveloped);
+            std::optional<Enveloped> lazy = server.receive_lazy(1000);
+            TEST_ASSERT("should receive lazily", lazy.has_value());
+            received.push_back(*lazy);
+
+            server.set_gro(true);
+            std::vector<std::string> datagrams(10);
+            std::vector<OutgoingDatagram> batch;
+            for (std::string& datagram : datagrams) {
+                enveloped.message.header.fill_req();
+                client.encode(enveloped.message, datagram);
+                batch.push_back(OutgoingDatagram(server_address, datagram));
+            }
+            client.send_batch(batch);
+            while (received.size() < 2 + batch.size()) {
+                std::vector<Enveloped> burst = server.receive_batch(4, 1000);
+                TEST_ASSERT("should not time out", !burst.empty());
+                for (Enveloped& enveloped : burst) {
+                    received.push_back(std::move(enveloped));
+                }
+            }
+            int64_t after = realtime_nanos();
+
+            for (size_t i = 0; i < received.size(); i++) {
+                std::optional<int64_t> received_at =
+                    received[i].received_at_nanos;
+                TEST_ASSERT(
+                    "should have a timestamp at " + std::to_string(i),
+                    received_at.has_value()
+                );
+                TEST_ASSERT(
+                    "found timestamp " + std::to_string(*received_at)
+                        + " out of " + std::to_string(before)
+                        + ".." + std::to_string(after),
+                    *received_at >= before && *received_at <= after
+                );
+                TEST_ASSERT(
+                    "delay should not be negative",
+                    *received[i].queueing_delay_nanos() >= 0
+                );
+            }
+        })
+
+        .test("receive no timestamps unless turned on", [] {
+            Address server_address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            Socket client(500, WIRE_BINARY);
+            Socket server(server_address, 500, WIRE_BINARY);
+
+            Enveloped enveloped;
+            enveloped.remote = server_address;
+            enveloped.message.header.fill_req();
+            enveloped.message.body = make_pooled<MessagePingReq>();
+            client.send(enveloped);
+            client.send(enveloped);
+
+            std::optional<Enveloped> single = server.receive(1000);
+            TEST_ASSERT("should receive", single.has_value());
+            TEST_ASSERT(
+                "should have no timestamp",
+                !single->received_at_nanos.has_value()
+                    && !single->queueing_delay_nanos().has_value()
+            );
+            std::vector<Enveloped> batch = server.receive_batch(4, 1000);
+            TEST_ASSERT("should receive a batch", batch.size() == 1);
+            TEST_ASSERT(
+                "should have no timestamp in batch",
+                !batch[0].received_at_nanos.has_value()
+            );
+        })
+
+        .test("receive buffers are recycled once messages drop", [] {
+            Address server_address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            Socket client(500, WIRE_BINARY);
+            Socket server(server_address, 500, WIRE_BINARY);
+
+            Enveloped enveloped;
+            enveloped.remote = server_address;
+            enveloped.message.body = make_pooled<MessagePingReq>();
+            auto send = [&] (size_t count) {
+                for (size_t i = 0; i < count; i++) {
+                    enveloped.message.header.fill_req();
+                    client.send(enveloped);
+                }
+            };
+            auto round = [&] (size_t count) {
+                send(count);
+                std::vector<Enveloped> kept;
+                for (size_t i = 0; i < count; i++) {
+                    std::optional<Enveloped> lazy = server.receive_lazy(1000);
+                    TEST_ASSERT("should receive lazily", lazy.has_value());
+                    kept.push_back(*lazy);
+                }
+                send(count);
+                for (size_t i = 0; i < count; i++) {
+                    std::optional<Enveloped> decoded = server.receive(1000);
+                    TEST_ASSERT("should receive", decoded.has_value());
+                }
+                send(count);
+                size_t received = 0;
+                while (received < count) {
+                    std::vector<Enveloped> batch =
+                        server.receive_batch(count, 1000);
+                    TEST_ASSERT("should receive a batch", !batch.empty());
+                    received += batch.size();
+                }
+            };
+
+            round(8);
+            uint64_t warm = server.stats().recv_buffer_allocations;
+            TEST_ASSERT("should have allocated", warm > 0);
+            for (size_t i = 0; i < 10; i++) {
+                round(8);
+            }
+            uint64_t allocations = server.stats().recv_buffer_allocations;
+            TEST_ASSERT(
+                "found " + std::to_string(allocations)
+                    + " allocations after " + std::to_string(warm),
+                allocations == warm
+            );
+        })
+
+        .test("count datagrams the kernel drops on overflow", [] {
+            Address server_address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            Socket client(500, WIRE_BINARY);
+            Socket server(server_address, 500, WIRE_BINARY);
+            server.set_buffer_sizes(1);
+            TEST_ASSERT(
+                "drop monitoring should be turned on",
+                server.set_drop_monitoring(true)
+            );
+
+            Enveloped enveloped;
+            enveloped.remote = server_address;
+            enveloped.message.body = make_pooled<MessagePingReq>();
+            for (size_t i = 0; i < 200; i++) {
+                enveloped.message.header.fill_req();
+                client.send(enveloped);
+            }
+
+            std::optional<Enveloped> received = server.receive(1000);
+            TEST_ASSERT("should receive", received.has_value());
+            while (received.has_value()) {
+                received = server.receive(0);
+            }
+            enveloped.message.header.fill_req();
+            client.send(enveloped);
+            received = server.receive(1000);
+            TEST_ASSERT("should receive after draining", received.has_value());
+            SocketStats stats = server.stats();
+            TEST_ASSERT(
+                "found " + std::to_string(stats.kernel_drops) + " drops",
+                stats.kernel_drops > 0 && stats.kernel_drops < 200
+            );
+        })
+
+        .test("buffer sizes are read back after resizing", [] {
+            Socket socket(500, WIRE_BINARY);
+            SocketBufferSizes small = socket.set_buffer_sizes(4096);
+            SocketBufferSizes large = socket.set_buffer_sizes(128 * 1024);
+            TEST_ASSERT(
+                "found " + std::to_string(small.recv) + " bytes",
+                small.recv >= 4096 && small.send >= 4096
+            );
+            TEST_ASSERT(
+                "found " + std::to_string(large.recv) + " bytes",
+                large.recv > small.recv && large.send > small.send
+            );
+            SocketBufferSizes read = socket.buffer_sizes();
+            TEST_ASSERT(
+                "should read the same sizes back",
+                read.recv == large.recv && read.send == large.send
+            );
+        })
+
+        .test("shards bound with reuse port share the datagrams", [] {
+            Address server_address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            std::vector<Socket> shards;
+            for (size_t i = 0; i < 2; i++) {
+                shards.push_back(
+                    Socket(server_address, 500, WIRE_BINARY, true)
+                );
+            }
+
+            constexpr size_t client_count = 8;
+            std::vector<Socket> clients;
+            for (size_t i = 0; i < client_count; i++) {
+                clients.push_back(Socket(500, WIRE_BINARY));
+                Enveloped enveloped;
+                enveloped.remote = server_address;
+                enveloped.message.header.fill_req();
+                enveloped.message.body = make_pooled<MessagePingReq>();
+                clients.back().send(enveloped);
+            }
+
+            std::set<Address> remotes;
+            size_t received = 0;
+            for (Socket& shard : shards) {
+                for (Enveloped& enveloped : shard.receive_batch(16, 100)) {
+                    remotes.insert(enveloped.remote);
+                    received++;
+                }
+            }
+            TEST_ASSERT(
+                "found " + std::to_string(received) + " datagrams",
+                received == client_count
+            );
+            TEST_ASSERT(
+                "found " + std::to_string(remotes.size()) + " remotes",
+                remotes.size() == client_count
+            );
+        })
+
+        .test("io_uring sockets exchange single and batched datagrams", [] {
+            Address server_address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            Socket server(
+                server_address,
+                500,
+                WIRE_BINARY,
+                false,
+                SOCKET_IO_URING
+            );
+            Socket client(500, WIRE_BINARY, SOCKET_IO_URING);
+
+            TEST_ASSERT(
+                "nothing should be received yet",
+                server.receive_batch(8, 10).empty()
+            );
+
+            std::vector<uint64_t> seqns;
+            for (size_t i = 0; i < 3; i++) {
+                Enveloped enveloped;
+                enveloped.remote = server_address;
+                enveloped.message.header.fill_req();
+                enveloped.message.body = make_pooled<MessagePingReq>();
+                seqns.push_back(enveloped.message.header.seqn);
+                client.send(enveloped);
+            }
+
+            std::vector<Enveloped> received;
+            while (received.size() < seqns.size()) {
+                std::vector<Enveloped> batch = server.receive_batch(8, 1000);
+                TEST_ASSERT("server should receive", !batch.empty());
+                for (Enveloped& enveloped : batch) {
+                    received.push_back(std::move(enveloped));
+                }
+            }
+            for (size_t i = 0; i < seqns.size(); i++) {
+                TEST_ASSERT(
+                    "found seqn "
+                        + std::to_string(received[i].message.header.seqn),
+                    received[i].message.header.seqn == seqns[i]
+                );
+            }
+
+            std::vector<std::string> datagrams(seqns.size());
+            std::vector<OutgoingDatagram> responses;
+            for (size_t i = 0; i < seqns.size(); i++) {
+                Message message;
+                message.header.fill_resp(received[i].message.header.seqn);
+                message.body = make_pooled<MessagePingResp>();
+                server.encode(message, datagrams[i]);
+                responses.push_back(
+                    OutgoingDatagram(received[i].remote, datagrams[i])
+                );
+            }
+            server.send_batch(responses);
+
+            for (size_t i = 0; i < seqns.size(); i++) {
+                std::optional<Enveloped> response = client.receive(1000);
+                TEST_ASSERT("client should receive", response.has_value());
+                TEST_ASSERT(
+                    "found seqn "
+                        + std::to_string(response->message.header.seqn),
+                    response->message.header.seqn == seqns[i]
+                );
+            }
+        })
+
+        .test("io_uring sockets count what they exchange", [] {
+            Address server_address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            Socket server(
+                server_address,
+                500,
+                WIRE_BINARY,
+                false,
+                SOCKET_IO_URING
+            );
+            Socket client(500, WIRE_BINARY, SOCKET_IO_URING);
+
+            Enveloped enveloped;
+            enveloped.remote = server_address;
+            enveloped.message.body = make_pooled<MessagePingReq>();
+            for (size_t i = 0; i < 3; i++) {
+                enveloped.message.header.fill_req();
+                client.send(enveloped);
+            }
+
+            std::vector<Enveloped> received;
+            while (received.size() < 3) {
+                std::vector<Enveloped> batch = server.receive_batch(8, 1000);
+                TEST_ASSERT("server should receive", !batch.empty());
+                for (Enveloped& enveloped : batch) {
+                    received.push_back(std::move(enveloped));
+                }
+            }
+
+            std::vector<std::string> datagrams(received.size());
+            std::vector<OutgoingDatagram> responses;
+            for (size_t i = 0; i < received.size(); i++) {
+                Message message;
+                message.header.fill_resp(received[i].message.header.seqn);
+                message.body = make_pooled<MessagePingResp>();
+                server.encode(message, datagrams[i]);
+                responses.push_back(
+                    OutgoingDatagram(received[i].remote, datagrams[i])
+                );
+            }
+            server.send_batch(responses);
+            for (size_t i = 0; i < responses.size(); i++) {
+                TEST_ASSERT(
+                    "client should receive",
+                    client.receive(1000).has_value()
+                );
+            }
+
+            SocketStats client_stats = client.stats();
+            TEST_ASSERT(
+                "found client sent "
+                    + std::to_string(client_stats.sent_datagrams)
+                    + " datagrams in "
+                    + std::to_string(client_stats.send_syscalls)
+                    + " syscalls",
+                client_stats.sent_datagrams == 3
+                    && client_stats.sent_messages == 3
+                    && client_stats.send_syscalls >= 3
+            );
+            TEST_ASSERT(
+                "found client received "
+                    + std::to_string(client_stats.received_datagrams)
+                    + " datagrams",
+                client_stats.received_datagrams == 3
+                    && client_stats.recv_syscalls > 0
+            );
+
+            SocketStats server_stats = server.stats();
+            TEST_ASSERT(
+                "found server received "
+                    + std::to_string(server_stats.received_datagrams)
+                    + " datagrams in "
+                    + std::to_string(server_stats.recv_syscalls)
+                    + " syscalls",
+                server_stats.received_datagrams == 3
+                    && server_stats.received_messages == 3
+                    && server_stats.recv_syscalls > 0
+            );
+            TEST_ASSERT(
+                "found server sent "
+                    + std::to_string(server_stats.sent_datagrams)
+                    + " datagrams in "
+                    + std::to_string(server_stats.send_syscalls)
+                    + " syscalls",
+                server_stats.sent_datagrams == 3
+                    && server_stats.send_syscalls > 0
+                    && server_stats.send_syscalls < 3
+            );
+        })
+
+        .test("io_uring socket receives more datagrams than buffers", [] {
+            Address server_address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            Socket server(
+                server_address,
+                500,
+                WIRE_BINARY,
+                false,
+                SOCKET_IO_URING
+            );
+            Socket client(500, WIRE_BINARY);
+
+            size_t sent = URING_RECV_BUFFERS + URING_RECV_BUFFERS / 4;
+            Enveloped enveloped;
+            enveloped.remote = server_address;
+            enveloped.message.body = make_pooled<MessagePingReq>();
+            for (size_t i = 0; i < sent; i++) {
+                enveloped.message.header.fill_req();
+                client.send(enveloped);
+            }
+
+            size_t received = 0;
+            for (;;) {
+                std::vector<Enveloped> batch = server.receive_batch(64, 100);
+                if (batch.empty()) {
+                    break;
+                }
+                received += batch.size();
+            }
+            TEST_ASSERT(
+                "found " + std::to_string(received) + " datagrams",
+                received == sent
+            );
+        })
+
+        .test("send the same encoded datagram twice", [] {
+            Socket client(500, WIRE_COMPACT);
+            Socket server(
+                Address(make_ipv4({ 127, 0, 0, 1 }), 8082),
+                500,
+                WIRE_COMPACT
+            );
+            Message message;
+            message.header.fill_req();
+            message.body = make_pooled<MessageFollowReq>(Username("@bruno"));
+
+            std::string datagram;
+            client.encode(message, datagram);
+            TEST_ASSERT(
+                "found datagram size " + std::to_string(datagram.size()),
+                datagram.size() == client.serialized_size(message)
+            );
+
+            Address server_address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            client.send_encoded(server_address, datagram);
+            client.send_encoded(server_address, datagram);
+
+            for (size_t i = 0; i < 2; i++) {
+                Enveloped received = server.receive();
+                TEST_ASSERT(
+                    "found seqn: "
+                        + std::to_string(received.message.header.seqn),
+                    received.message.header.seqn == message.header.seqn
+                );
+                TEST_ASSERT(
+                    "found username: "
+                        + received.message.body
+                            ->cast<MessageFollowReq>().username.content(),
+                    received.message.body->cast<MessageFollowReq>().username
+                        == Username("@bruno")
+                );
+            }
+        })
+
+        .test("send and receive with binary wire format", [] {
+            Socket client(500, WIRE_BINARY);
+            Socket server(
+                Address(make_ipv4({ 127, 0, 0, 1 }), 8082),
+                500,
+                WIRE_BINARY
+            );
+            Enveloped enveloped;
+            enveloped.remote = Address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            enveloped.message.header.fill_req();
+            enveloped.message.body = std::shared_ptr<MessageBody>(
+                new MessageDeliverReq(
+                    Username("@bruno"),
+                    NotifMessage("hello; world\\"),
+                    1234
+                )
+            );
+            client.send(enveloped);
+
+            Enveloped received = server.receive();
+
+            TEST_ASSERT(
+                "found message tag: "
+                    + received.message.body->tag().to_string(),
+                received.message.body->tag() == MessageTag(MSG_REQ, MSG_DELIVER)
+            );
+            TEST_ASSERT(
+                "found seqn: "
+                    + std::to_string(received.message.header.seqn),
+                received.message.header.seqn
+                    == enveloped.message.header.seqn
+            );
+
+            MessageDeliverReq const& casted_body =
+                received.message.body->cast<MessageDeliverReq>();
+
+            TEST_ASSERT(
+                "found sender: " + casted_body.sender.content(),
+                casted_body.sender == Username("@bruno")
+            );
+            TEST_ASSERT(
+                "found notification: " + casted_body.notif_message.content(),
+                casted_body.notif_message.content() == "hello; world\\"
+            );
+            TEST_ASSERT(
+                "found sent_at: " + std::to_string(casted_body.sent_at),
+                casted_body.sent_at == 1234
+            );
+        })
+
+        .test("receive lazily and decode the body later", [] {
+            for (
+                WireFormat wire_format
+                : { WIRE_PLAINTEXT, WIRE_BINARY, WIRE_COMPACT }
+            ) {
+                Socket client(500, wire_format);
+                Socket server(
+                    Address(make_ipv4({ 127, 0, 0, 1 }), 8082),
+                    500,
+                    wire_format
+                );
+                Enveloped enveloped;
+                enveloped.remote = Address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+                enveloped.message.header.fill_req();
+                enveloped.message.body = make_pooled<MessageDeliverReq>(
+                    Username("@bruno"),
+                    NotifMessage("hello; world\\"),
+                    -1234
+                );
+                client.send(enveloped);
+
+                Enveloped received = server.receive_lazy();
+
+                TEST_ASSERT(
+                    "found message tag: "
+                        + received.message.body->tag().to_string(),
+                    received.message.body->tag()
+                        == MessageTag(MSG_REQ, MSG_DELIVER)
+                );
+                TEST_ASSERT(
+                    "body should still be raw",
+                    typeid(*received.message.body) == typeid(MessageRawBody)
+                );
+                TEST_ASSERT(
+                    "found seqn: "
+                        + std::to_string(received.message.header.seqn),
+                    received.message.header.seqn
+                        == enveloped.message.header.seqn
+                );
+
+                std::string reencoded;
+                BinaryBufferSerializer serializer(reencoded);
+                serializer << received.message;
+
+                received.message.decode_body();
+
+                MessageDeliverReq const& casted_body =
+                    received.message.body->cast<MessageDeliverReq>();
+                TEST_ASSERT(
+                    "found sender: " + casted_body.sender.content(),
+                    casted_body.sender == Username("@bruno")
+                );
+                TEST_ASSERT(
+                    "found notification: "
+                        + casted_body.notif_message.content(),
+                    casted_body.notif_message.content() == "hello; world\\"
+                );
+                TEST_ASSERT(
+                    "found sent_at: " + std::to_string(casted_body.sent_at),
+                    casted_body.sent_at == -1234
+                );
+
+                std::string expected;
+                BinaryBufferSerializer expected_serializer(expected);
+                expected_serializer << received.message;
+                TEST_ASSERT(
+                    "raw body should encode as the decoded one",
+                    reencoded == expected
+                );
+            }
+        })
 
-            MessageClientConnReq const& casted_req_body =
-                received_req.message.body->cast<MessageClientConnReq>();
-
-            TEST_ASSERT(
-                "message username should be \"bruno\", found: "
-                    + casted_req_body.username.content(),
-                casted_req_body.username == Username("@bruno")
-            );
+        .test("malformed raw body fails only when decoded", [] {
+            std::string buf;
+            BinaryBufferSerializer serializer(buf);
+            Message message;
+            message.header.fill_req();
+            message.body = make_pooled<MessageFollowReq>(Username("@bruno"));
+            serializer << message;
+            buf.resize(buf.size() - 2);
 
-            Enveloped response;
-            response.remote = received_req.remote;
-            response.message.header.fill_resp(received_req.message.header.seqn);
-            response.message.body = std::shared_ptr<MessageClientConnResp>(
-                new MessageClientConnResp
+            BinarySpanDeserializer deserializer(buf.data(), buf.size());
+            Message received;
+            MessageTag tag = received.decode_header(deserializer);
+            size_t offset = deserializer.position() - buf.data();
+            received.body = make_pooled<MessageRawBody>(
+                tag,
+                WIRE_BINARY,
+                std::move(buf),
+                offset
             );
-            server.send(response);
-
-            Enveloped received_resp = client.receive();
 
             TEST_ASSERT(
-                "found " + received_resp.message.body->tag().to_string(),
-                received_resp.message.body->tag()
-                    == MessageTag(MSG_RESP, MSG_CLIENT_CONN)
+                "found message tag: " + received.body->tag().to_string(),
+                received.body->tag() == MessageTag(MSG_REQ, MSG_FOLLOW)
             );
 
-            MessageClientConnResp const& casted_resp_body =
-                received_resp.message.body->cast<MessageClientConnResp>();
+            bool throwed = false;
+            try {
+                received.decode_body();
+            } catch (DeserializationError const& exception) {
+                throwed = true;
+            }
+            TEST_ASSERT("decoding the body should throw", throwed);
+        })
+
+        .test("pre-encoded body encodes as the original body", [] {
+            MessageDeliverReq body(
+                Username("@bruno"),
+                NotifMessage("hello; world\\"),
+                -1234
+            );
+            for (
+                WireFormat body_format
+                : { WIRE_PLAINTEXT, WIRE_BINARY, WIRE_COMPACT }
+            ) {
+                for (
+                    WireFormat wire_format
+                    : { WIRE_PLAINTEXT, WIRE_BINARY, WIRE_COMPACT }
+                ) {
+                    Socket socket(500, wire_format);
+                    Message message;
+                    message.header.fill_req();
+                    message.header.election_counter = 7;
+                    message.body = make_pooled<MessageDeliverReq>(body);
+
+                    std::string expected;
+                    socket.encode(message, expected);
+
+                    message.body = MessageRawBody::from_body(body_format, body);
+                    std::string found;
+                    socket.encode(message, found);
+
+                    std::string case_name = "body format "
+                        + std::to_string(body_format)
+                        + ", wire format "
+                        + std::to_string(wire_format);
+                    TEST_ASSERT(case_name, found == expected);
+                    TEST_ASSERT(
+                        case_name + ", size",
+                        socket.serialized_size(message) == expected.size()
+                    );
+                }
+            }
         })
 ;
 }
@@ -771,9 +2763,482 @@ static TestSuite channel_test_suite()
     ;
 }
 
+static TestSuite reactor_test_suite()
+{
+    return TestSuite()
+        .test("reactor with nothing readable times out", [] {
+            Reactor reactor;
+            int fds[2];
+            TEST_ASSERT("pipe should be created", pipe(fds) == 0);
+            reactor.watch(fds[0]);
+
+            ReactorEvent event = reactor.wait(10);
+
+            close(fds[0]);
+            close(fds[1]);
+            TEST_ASSERT(
+                std::string("found event ") + std::to_string(event),
+                event == REACTOR_TIMED_OUT
+            );
+        })
+
+        .test("reactor reports a readable pipe", [] {
+            Reactor reactor;
+            int fds[2];
+            TEST_ASSERT("pipe should be created", pipe(fds) == 0);
+            reactor.watch(fds[0]);
+            TEST_ASSERT("pipe should be written", write(fds[1], "x", 1) == 1);
+
+            ReactorEvent readable = reactor.wait(1000);
+            char byte;
+            TEST_ASSERT("pipe should be read", read(fds[0], &byte, 1) == 1);
+            ReactorEvent drained = reactor.wait(0);
+            reactor.unwatch(fds[0]);
+            TEST_ASSERT("pipe should be written", write(fds[1], "x", 1) == 1);
+            ReactorEvent unwatched = reactor.wait(0);
+
+            close(fds[0]);
+            close(fds[1]);
+            TEST_ASSERT(
+                std::string("found event ") + std::to_string(readable),
+                readable == REACTOR_READABLE
+            );
+            TEST_ASSERT(
+                std::string("found event ") + std::to_string(drained),
+                drained == REACTOR_TIMED_OUT
+            );
+            TEST_ASSERT(
+                std::string("found event ") + std::to_string(unwatched),
+                unwatched == REACTOR_TIMED_OUT
+            );
+        })
+
+        .test("reactor wake-up interrupts a waiting thread", [] {
+            Reactor reactor;
+            int fds[2];
+            TEST_ASSERT("pipe should be created", pipe(fds) == 0);
+            reactor.watch(fds[0]);
+
+            std::atomic<ReactorEvent> event = REACTOR_TIMED_OUT;
+            std::thread waiter([&reactor, &event] {
+                event.store(reactor.wait(-1));
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            reactor.wake();
+            waiter.join();
+
+            TEST_ASSERT("pipe should be written", write(fds[1], "x", 1) == 1);
+            ReactorEvent later = reactor.wait(-1);
+            bool woken = reactor.wait_woken(-1);
+
+            close(fds[0]);
+            close(fds[1]);
+            TEST_ASSERT(
+                std::string("found event ") + std::to_string(event.load()),
+                event.load() == REACTOR_WOKEN
+            );
+            TEST_ASSERT(
+                std::string("found later event ") + std::to_string(later),
+                later == REACTOR_WOKEN
+            );
+            TEST_ASSERT("reactor should stay woken", woken);
+        })
+
+        .test("reactor wait for wake-up ignores readable descriptors", [] {
+            Reactor reactor;
+            int fds[2];
+            TEST_ASSERT("pipe should be created", pipe(fds) == 0);
+            reactor.watch(fds[0]);
+            TEST_ASSERT("pipe should be written", write(fds[1], "x", 1) == 1);
+
+            bool woken = reactor.wait_woken(10);
+
+            close(fds[0]);
+            close(fds[1]);
+            TEST_ASSERT("reactor should not be woken", !woken);
+        })
+
+        .test("reactor treats regular files as always readable", [] {
+            Reactor reactor;
+            int fd = open("/dev/null", O_RDONLY);
+            TEST_ASSERT("/dev/null should be opened", fd >= 0);
+            reactor.watch(fd);
+
+            ReactorEvent readable = reactor.wait(-1);
+            reactor.unwatch(fd);
+            ReactorEvent unwatched = reactor.wait(0);
+
+            close(fd);
+            TEST_ASSERT(
+                std::string("found event ") + std::to_string(readable),
+                readable == REACTOR_READABLE
+            );
+            TEST_ASSERT(
+                std::string("found event ") + std::to_string(unwatched),
+                unwatched == REACTOR_TIMED_OUT
+            );
+        })
+    ;
+}
+
+static TestSuite loopback_test_suite()
+{
+    return TestSuite()
+        .test("loopback transports exchange datagrams", [] {
+            std::shared_ptr<LoopbackNetwork> network(new LoopbackNetwork);
+            Address server_address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            LoopbackTransport server(network, server_address, 500);
+            LoopbackTransport client(network, 500);
+
+            Enveloped enveloped;
+            enveloped.remote = server_address;
+            enveloped.message.header.fill_req();
+            enveloped.message.body = make_pooled<MessageClientConnReq>(
+                Username("@bruno")
+            );
+            client.send(enveloped);
+            enveloped.remote = Address(make_ipv4({ 127, 0, 0, 1 }), 8083);
+            client.send(enveloped);
+
+            std::vector<Enveloped> batch = server.receive_batch(4, 1000);
+            TEST_ASSERT("should receive one", batch.size() == 1);
+            TEST_ASSERT(
+                "found " + batch[0].remote.to_string(),
+                batch[0].remote == client.address()
+            );
+            batch[0].message.decode_body();
+            TEST_ASSERT(
+                "found " + batch[0].message.body->tag().to_string(),
+                batch[0].message.body->cast<MessageClientConnReq>().username
+                    == Username("@bruno")
+            );
+            TEST_ASSERT(
+                "should time out",
+                server.receive_batch(4, 10).empty()
+            );
+
+            LoopbackStats stats = network->stats();
+            TEST_ASSERT(
+                "found " + std::to_string(stats.unreachable) + " unreachable",
+                stats.sent == 2 && stats.unreachable == 1
+            );
+
+            bool in_use = false;
+            try {
+                LoopbackTransport other(network, server_address, 500);
+            } catch (LoopbackAddressInUse const& exc) {
+                in_use = true;
+            }
+            TEST_ASSERT("address should be in use", in_use);
+        })
+
+        .test("loopback network loses and duplicates", [] {
+            std::shared_ptr<LoopbackNetwork> lossy(new LoopbackNetwork(
+                LoopbackConditions().with_loss(1.0)
+            ));
+            LoopbackTransport lossy_server(lossy, 500);
+            LoopbackTransport lossy_client(lossy, 500);
+            Enveloped enveloped;
+            enveloped.remote = lossy_server.address();
+            enveloped.message.header.fill_req();
+            enveloped.message.body = make_pooled<MessagePingReq>();
+            lossy_client.send(enveloped);
+            TEST_ASSERT(
+                "should lose everything",
+                lossy_server.receive_batch(4, 10).empty()
+                    && lossy->stats().lost == 1
+            );
+
+            std::shared_ptr<LoopbackNetwork> doubling(new LoopbackNetwork(
+                LoopbackConditions().with_duplication(1.0)
+            ));
+            LoopbackTransport server(doubling, 500);
+            LoopbackTransport client(doubling, 500);
+            enveloped.remote = server.address();
+            client.send(enveloped);
+            std::vector<Enveloped> batch = server.receive_batch(4, 1000);
+            TEST_ASSERT(
+                "found " + std::to_string(batch.size()) + " copies",
+                batch.size() == 2
+                    && batch[0].message.header.seqn
+                        == batch[1].message.header.seqn
+            );
+        })
+
+        .test("loopback link meets the same fate beside other links", [] {
+            auto received_over_link = [] (bool beside_other_link) {
+                std::shared_ptr<LoopbackNetwork> network(new LoopbackNetwork(
+                    LoopbackConditions()
+                        .with_loss(0.3)
+                        .with_duplication(0.2)
+                        .with_seed(11)
+                ));
+                Address server_address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+                Address first_address(make_ipv4({ 127, 0, 0, 1 }), 8083);
+                Address second_address(make_ipv4({ 127, 0, 0, 1 }), 8084);
+                LoopbackTransport server(network, server_address, 500);
+                LoopbackTransport first(network, first_address, 500);
+                LoopbackTransport second(network, second_address, 500);
+
+                Enveloped enveloped;
+                enveloped.remote = server_address;
+                enveloped.message.body = make_pooled<MessagePingReq>();
+                for (uint64_t i = 0; i < 64; i++) {
+                    enveloped.message.header.seqn = i;
+                    if (beside_other_link) {
+                        second.send(enveloped);
+                    }
+                    first.send(enveloped);
+                    if (beside_other_link && i % 2 == 0) {
+                        second.send(enveloped);
+                    }
+                }
+
+                std::vector<uint64_t> received;
+                for (;;) {
+                    std::vector<Enveloped> batch =
+                        server.receive_batch(256, 0);
+                    if (batch.empty()) {
+                        break;
+                    }
+                    for (Enveloped const& enveloped : batch) {
+                        if (enveloped.remote == first_address) {
+                            received.push_back(enveloped.message.header.seqn);
+                        }
+                    }
+                }
+                return received;
+            };
+
+            std::vector<uint64_t> alone = received_over_link(false);
+            std::vector<uint64_t> beside = received_over_link(true);
+            std::set<uint64_t> distinct(alone.begin(), alone.end());
+            TEST_ASSERT(
+                "found " + std::to_string(distinct.size()) + " distinct and "
+                    + std::to_string(alone.size()) + " in total",
+                distinct.size() < 64 && alone.size() > distinct.size()
+            );
+            TEST_ASSERT("should meet the same fate", alone == beside);
+        })
+
+        .test("loopback network delays and reorders", [] {
+            std::shared_ptr<LoopbackNetwork> network(new LoopbackNetwork(
+                LoopbackConditions()
+                    .with_delay_nanos(20 * 1000 * 1000)
+                    .with_reordering(0.5)
+                    .with_reorder_delay_nanos(5 * 1000 * 1000)
+                    .with_seed(7)
+            ));
+            LoopbackTransport server(network, 500);
+            LoopbackTransport client(network, 500);
+
+            Enveloped enveloped;
+            enveloped.remote = server.address();
+            enveloped.message.body = make_pooled<MessagePingReq>();
+            std::vector<uint64_t> sent;
+            auto then = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < 32; i++) {
+                enveloped.message.header.fill_req();
+                sent.push_back(enveloped.message.header.seqn);
+                client.send(enveloped);
+            }
+            TEST_ASSERT(
+                "should not be due yet",
+                server.receive_batch(32, 0).empty()
+            );
+
+            std::vector<uint64_t> received;
+            while (received.size() < sent.size()) {
+                std::vector<Enveloped> batch = server.receive_batch(32, 1000);
+                TEST_ASSERT("should not time out", !batch.empty());
+                for (Enveloped const& enveloped : batch) {
+                    received.push_back(enveloped.message.header.seqn);
+                }
+            }
+            auto elapsed = std::chrono::steady_clock::now() - then;
+            TEST_ASSERT(
+                "should be delayed",
+                elapsed >= std::chrono::milliseconds(20)
+            );
+            uint64_t reordered = network->stats().reordered;
+            TEST_ASSERT(
+                "found " + std::to_string(reordered) + " reordered",
+                reordered > 0 && reordered < sent.size()
+            );
+            TEST_ASSERT("should be reordered", received != sent);
+            std::sort(received.begin(), received.end());
+            TEST_ASSERT("should receive every datagram", received == sent);
+        })
+
+        .test("reliable sockets over an impaired loopback network", [] {
+            std::shared_ptr<LoopbackNetwork> network(new LoopbackNetwork(
+                LoopbackConditions()
+                    .with_loss(0.2)
+                    .with_duplication(0.1)
+                    .with_reordering(0.1)
+                    .with_reorder_delay_nanos(200 * 1000)
+                    .with_seed(42)
+            ));
+            Address server_address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            ReliableSocket server(std::unique_ptr<Transport>(
+                new LoopbackTransport(network, server_address, 500)
+            ));
+
+            constexpr size_t client_count = 16;
+            std::vector<std::unique_ptr<ReliableSocket>> clients;
+            for (size_t i = 0; i < client_count; i++) {
+                clients.push_back(std::unique_ptr<ReliableSocket>(
+                    new ReliableSocket(std::unique_ptr<Transport>(
+                        new LoopbackTransport(network, 500)
+                    ))
+                ));
+            }
+
+            std::thread responder([&server] {
+                for (size_t i = 0; i < client_count * 2; i++) {
+                    ReliableSocket::ReceivedReq received =
+                        server.receive_req();
+                    std::move(received).send_resp(
+                        make_pooled<MessageClientConnResp>()
+                    );
+                }
+            });
+
+            for (auto& client : clients) {
+                for (size_t i = 0; i < 2; i++) {
+                    Enveloped conn_req;
+                    conn_req.remote = server_address;
+                    conn_req.message.body = make_pooled<MessageClientConnReq>(
+                        Username("@bruno")
+                    );
+                    Enveloped resp = client->send_req(conn_req).receive_resp();
+                    TEST_ASSERT(
+                        "found " + resp.message.body->tag().to_string(),
+                        resp.message.body->tag()
+                            == MessageTag(MSG_RESP, MSG_CLIENT_CONN)
+                    );
+                }
+            }
+            responder.join();
+
+            LoopbackStats stats = network->stats();
+            TEST_ASSERT(
+                "found " + std::to_string(stats.lost) + " lost",
+                stats.lost > 0
+            );
+        })
+    ;
+}
+
 static TestSuite reliable_socket_test_suite()
 {
     return TestSuite()
+        .test("received requests keep the kernel timestamp", [] () {
+            Socket client_udp(500);
+            ReliableSocket client(std::move(client_udp));
+
+            Socket server_udp(Address(make_ipv4({ 127, 0, 0, 1 }), 8082), 500);
+            server_udp.set_timestamps(true);
+            ReliableSocket server(std::move(server_udp));
+
+            Enveloped conn_req;
+            conn_req.remote = Address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            conn_req.message.body = std::shared_ptr<MessageBody>(
+                new MessageClientConnReq(Username("@bruno"))
+            );
+            int64_t before = realtime_nanos();
+            ReliableSocket::SentReq sent_conn_req = client.send_req(conn_req);
+
+            ReliableSocket::ReceivedReq recvd_conn_req = server.receive_req();
+            int64_t after = realtime_nanos();
+            std::optional<int64_t> received_at =
+                recvd_conn_req.req_enveloped().received_at_nanos;
+            TEST_ASSERT("should have a timestamp", received_at.has_value());
+            TEST_ASSERT(
+                "found timestamp " + std::to_string(*received_at)
+                    + " out of " + std::to_string(before)
+                    + ".." + std::to_string(after),
+                *received_at >= before && *received_at <= after
+            );
+
+            std::move(recvd_conn_req).send_resp(std::shared_ptr<MessageBody>(
+                new MessageClientConnResp
+            ));
+            Enveloped recvd_conn_resp = std::move(sent_conn_req).receive_resp();
+            TEST_ASSERT(
+                "response should have no timestamp",
+                !recvd_conn_resp.received_at_nanos.has_value()
+            );
+        })
+
+        .test("configured socket buffers are granted and reported", [] () {
+            Socket udp(500);
+            ReliableSocket socket(
+                std::move(udp),
+                ReliableSocket::Config().with_socket_buffer_packets(64)
+            );
+            SocketBufferSizes sizes = socket.config().socket_buffer_sizes;
+            TEST_ASSERT(
+                "found " + std::to_string(sizes.recv) + " bytes",
+                sizes.recv > 0 && sizes.send > 0
+            );
+            std::ostringstream report;
+            socket.config().report(report);
+            TEST_ASSERT(
+                "found " + report.str(),
+                report.str().find("socket buffers: target of 64 packets")
+                    != std::string::npos
+            );
+        })
+
+        .test("busy polling sockets exchange and disconnect", [] () {
+            ReliableSocket::Config config = ReliableSocket::Config()
+                .with_busy_poll_nanos(1000 * 1000);
+            Socket client_udp(500);
+            ReliableSocket client(std::move(client_udp), config);
+
+            Socket server_udp(Address(make_ipv4({ 127, 0, 0, 1 }), 8082), 500);
+            ReliableSocket server(std::move(server_udp), config);
+
+            Enveloped conn_req;
+            conn_req.remote = Address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            conn_req.message.body = make_pooled<MessageClientConnReq>(
+                Username("@bruno")
+            );
+            ReliableSocket::SentReq sent_conn_req = client.send_req(conn_req);
+            std::move(server.receive_req()).send_resp(
+                make_pooled<MessageClientConnResp>()
+            );
+            std::move(sent_conn_req).receive_resp();
+
+            for (size_t i = 0; i < 20; i++) {
+                Enveloped ping;
+                ping.remote = conn_req.remote;
+                ping.message.body = make_pooled<MessagePingReq>();
+                Enveloped pong = client.send_req(ping).receive_resp();
+                TEST_ASSERT(
+                    "found " + pong.message.body->tag().to_string(),
+                    pong.message.body->tag() == MessageTag(MSG_RESP, MSG_PING)
+                );
+            }
+
+            std::ostringstream report;
+            server.config().report(report);
+            TEST_ASSERT(
+                "found " + report.str(),
+                report.str().find("busy polling: up to") != std::string::npos
+            );
+
+            auto then = std::chrono::steady_clock::now();
+            server.disconnect_timeout(1000 * 1000, 10);
+            client.disconnect_timeout(1000 * 1000, 10);
+            auto elapsed = std::chrono::steady_clock::now() - then;
+            TEST_ASSERT(
+                "disconnecting should not wait for the spinning to end",
+                elapsed < std::chrono::seconds(1)
+            );
+        })
+
         .test("one client, one server, single-threaded", [] () {
             Socket client_udp(500);
             ReliableSocket client(std::move(client_udp));
@@ -1000,6 +3465,101 @@ static TestSuite reliable_socket_test_suite()
                 thread_count == disconnected
             );
         })
+
+        .test("one client, many servers, batched requests", [] {
+            Socket client_udp(500);
+            ReliableSocket client(std::move(client_udp));
+
+            std::vector<std::unique_ptr<ReliableSocket>> servers;
+            std::vector<Enveloped> conn_reqs;
+            for (uint16_t port = 8082; port < 8085; port++) {
+                Address address(make_ipv4({ 127, 0, 0, 1 }), port);
+                servers.push_back(std::unique_ptr<ReliableSocket>(
+                    new ReliableSocket(Socket(address, 500))
+                ));
+                Enveloped conn_req;
+                conn_req.remote = address;
+                conn_req.message.body = make_pooled<MessageClientConnReq>(
+                    Username("@bruno")
+                );
+                conn_reqs.push_back(conn_req);
+            }
+
+            std::vector<ReliableSocket::SentReq> sent_conn_reqs =
+                client.send_req_batch(conn_reqs);
+            TEST_ASSERT(
+                "found " + std::to_string(sent_conn_reqs.size()) + " requests",
+                sent_conn_reqs.size() == servers.size()
+            );
+
+            for (auto& server : servers) {
+                ReliableSocket::ReceivedReq recvd_conn_req =
+                    server->receive_req();
+                TEST_ASSERT(
+                    "found " + recvd_conn_req.req_enveloped()
+                        .message.body->tag().to_string(),
+                    recvd_conn_req.req_enveloped().message.body->tag()
+                        == MessageTag(MSG_REQ, MSG_CLIENT_CONN)
+                );
+                std::move(recvd_conn_req).send_resp(
+                    make_pooled<MessageClientConnResp>()
+                );
+            }
+
+            for (size_t i = 0; i < sent_conn_reqs.size(); i++) {
+                Address remote = sent_conn_reqs[i].req_enveloped().remote;
+                Enveloped recvd_conn_resp =
+                    std::move(sent_conn_reqs[i]).receive_resp();
+                TEST_ASSERT(
+                    "found " + recvd_conn_resp.message.body->tag().to_string(),
+                    recvd_conn_resp.message.body->tag()
+                        == MessageTag(MSG_RESP, MSG_CLIENT_CONN)
+                );
+                TEST_ASSERT(
+                    "found response from " + recvd_conn_resp.remote.to_string(),
+                    recvd_conn_resp.remote == remote
+                );
+            }
+        })
+
+        .test("batched requests before one too large are still sent", [] {
+            std::shared_ptr<LoopbackNetwork> network(new LoopbackNetwork());
+            Address address(make_ipv4({ 127, 0, 0, 1 }), 8082);
+            ReliableSocket server(std::unique_ptr<Transport>(
+                new LoopbackTransport(network, address, 500)
+            ));
+            ReliableSocket client(std::unique_ptr<Transport>(
+                new LoopbackTransport(network, 100)
+            ));
+
+            std::vector<Enveloped> reqs(2);
+            reqs[0].remote = address;
+            reqs[0].message.body = make_pooled<MessageClientConnReq>(
+                Username("@bruno")
+            );
+            reqs[1].remote = address;
+            reqs[1].message.body = make_pooled<MessageDeliverReq>(
+                Username("@bruno"),
+                NotifMessage(std::string(NotifMessage::MAX_LEN, 'a')),
+                0
+            );
+
+            bool throwed = false;
+            try {
+                client.send_req_batch(reqs);
+            } catch (MessageTooLarge const& exception) {
+                throwed = true;
+            }
+            TEST_ASSERT("should throw MessageTooLarge", throwed);
+
+            ReliableSocket::ReceivedReq recvd_conn_req = server.receive_req();
+            TEST_ASSERT(
+                "found " + recvd_conn_req.req_enveloped()
+                    .message.body->tag().to_string(),
+                recvd_conn_req.req_enveloped().message.body->tag()
+                    == MessageTag(MSG_REQ, MSG_CLIENT_CONN)
+            );
+        })
     ;
 }
 
@@ -1704,3 +4264,10 @@ static TestSuite seqn_set_test_suite()
         })
     ;
 }
+
+static int64_t realtime_nanos()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
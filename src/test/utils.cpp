@@ -1,5 +1,34 @@
+#include <cstdlib>
+#include <new>
 #include "utils.h"
 
+static thread_local uint64_t thread_allocations = 0;
+
+void *operator new(size_t size)
+{
+    thread_allocations++;
+    void *ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == NULL) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t size) noexcept
+{
+    free(ptr);
+}
+
+uint64_t thread_allocation_count()
+{
+    return thread_allocations;
+}
+
 TestFailure::TestFailure(
     std::string const& message,
     std::string const& filename,
@@ -1,6 +1,7 @@
 #ifndef TEST_UTILS_H_
 #define TEST_UTILS_H_ 1
 
+#include <cstdint>
 #include <iostream>
 #include <string>
 #include <sstream>
@@ -66,6 +67,12 @@ void test_assert_impl(
     int line_number
 );
 
+/**
+ * Number of heap allocations made so far by the calling thread. The tester
+ * replaces the global operator new to count them.
+ */
+uint64_t thread_allocation_count();
+
 template <typename F>
 TestCase::TestCase(std::string const& name, F test) :
     name_(name),